@@ -34,64 +34,9 @@ typedef struct
     uint64 nextFileStart;
     int64 nextEnumPos;
     MojoArchiveEntry *archiveEntries;
+    MojoArchiveIndex *index;  // built on first openEntry().
 } PCKinfo;
 
-static boolean MojoInput_pck_ready(MojoInput *io)
-{
-    return true;  // !!! FIXME?
-} // MojoInput_pck_ready
-
-static int64 MojoInput_pck_read(MojoInput *io, void *buf, uint32 bufsize)
-{
-    MojoArchive *ar = (MojoArchive *) io->opaque;
-    const MojoArchiveEntry *entry = &ar->prevEnum;
-    int64 pos = io->tell(io);
-    if ((pos + bufsize) > entry->filesize)
-        bufsize = (uint32) (entry->filesize - pos);
-    return ar->io->read(ar->io, buf, bufsize);
-} // MojoInput_pck_read
-
-static boolean MojoInput_pck_seek(MojoInput *io, uint64 pos)
-{
-    MojoArchive *ar = (MojoArchive *) io->opaque;
-    const PCKinfo *info = (PCKinfo *) ar->opaque;
-    const MojoArchiveEntry *entry = &ar->prevEnum;
-    boolean retval = false;
-    if (pos < ((uint64) entry->filesize))
-    {
-        const uint64 newpos = (info->nextFileStart - entry->filesize) + pos;
-        retval = ar->io->seek(ar->io, newpos);
-    } // if
-    return retval;
-} // MojoInput_pck_seek
-
-static int64 MojoInput_pck_tell(MojoInput *io)
-{
-    MojoArchive *ar = (MojoArchive *) io->opaque;
-    const PCKinfo *info = (PCKinfo *) ar->opaque;
-    const MojoArchiveEntry *entry = &ar->prevEnum;
-    return ar->io->tell(ar->io) - (info->nextFileStart - entry->filesize);
-} // MojoInput_pck_tell
-
-static int64 MojoInput_pck_length(MojoInput *io)
-{
-    MojoArchive *ar = (MojoArchive *) io->opaque;
-    const MojoArchiveEntry *entry = &ar->prevEnum;
-    return entry->filesize;
-} // MojoInput_pck_length
-
-static MojoInput *MojoInput_pck_duplicate(MojoInput *io)
-{
-    MojoInput *retval = NULL;
-    fatal(_("BUG: Can't duplicate pck inputs"));  // !!! FIXME: why not?
-    return retval;
-} // MojoInput_pck_duplicate
-
-static void MojoInput_pck_close(MojoInput *io)
-{
-    free(io);
-} // MojoInput_pck_close
-
 // MojoArchive implementation...
 
 static boolean MojoArchive_pck_enumerate(MojoArchive *ar)
@@ -104,10 +49,15 @@ static boolean MojoArchive_pck_enumerate(MojoArchive *ar)
     PCKentry fileEntry;
     uint64 i, realFileCount = 0;
     char directory[256] = {'\0'};
-    MojoInput *io = ar->io;
+    MojoInput *io = NULL;
 
     MojoArchive_resetEntry(&ar->prevEnum);
 
+    // The directory is a run of 64-byte records; read it in big chunks.
+    io = MojoInput_newBuffered(ar->io, 0);
+    if (io == NULL)
+        io = ar->io;
+
     archiveEntries = (MojoArchiveEntry *) xmalloc(len);
 
     for (i = 0; i < fileCount; i++)
@@ -117,9 +67,9 @@ static boolean MojoArchive_pck_enumerate(MojoArchive *ar)
 
         br = io->read(io, fileEntry.filename, sizeof (fileEntry.filename));
         if (br != sizeof (fileEntry.filename))
-            return false;
+            break;
         else if (!MojoInput_readui32(io, &fileEntry.filesize))
-            return false;
+            break;
 
         dotdot = (strcmp(fileEntry.filename, "..") == 0);
 
@@ -174,6 +124,17 @@ static boolean MojoArchive_pck_enumerate(MojoArchive *ar)
         } // else
     } // for
 
+    if (io != ar->io)
+        io->close(io);
+
+    if (i < fileCount)  // i/o error.
+    {
+        for (i = 0; i < realFileCount; i++)
+            free(archiveEntries[i].filename);
+        free(archiveEntries);
+        return false;
+    } // if
+
     info->fileCount = realFileCount;
     info->archiveEntries = archiveEntries;
     info->nextEnumPos = 0;
@@ -205,24 +166,85 @@ static const MojoArchiveEntry *MojoArchive_pck_enumNext(MojoArchive *ar)
 
 static MojoInput *MojoArchive_pck_openCurrentEntry(MojoArchive *ar)
 {
-    MojoInput *io = NULL;
-    io = (MojoInput *) xmalloc(sizeof (MojoInput));
-    io->ready = MojoInput_pck_ready;
-    io->read = MojoInput_pck_read;
-    io->seek = MojoInput_pck_seek;
-    io->tell = MojoInput_pck_tell;
-    io->length = MojoInput_pck_length;
-    io->duplicate = MojoInput_pck_duplicate;
-    io->close = MojoInput_pck_close;
-    io->opaque = ar;
-    return io;
+    const PCKinfo *info = (PCKinfo *) ar->opaque;
+    const MojoArchiveEntry *entry = &ar->prevEnum;
+    const uint64 start = info->nextFileStart - entry->filesize;
+    return MojoInput_newFromRange(ar->io, start, entry->filesize);
 } // MojoArchive_pck_openCurrentEntry
 
 
+static MojoInput *MojoArchive_pck_openCurrentEntryDetached(MojoArchive *ar)
+{
+    const PCKinfo *info = (PCKinfo *) ar->opaque;
+    const MojoArchiveEntry *entry = &ar->prevEnum;
+    const uint64 start = info->nextFileStart - entry->filesize;
+    MojoInput *io = NULL;
+    MojoInput *retval = NULL;
+
+    if (entry->type != MOJOARCHIVE_ENTRY_FILE)
+        return NULL;
+    else if (entry->filesize == 0)  // subsets can't be empty.
+        return MojoInput_newFromMemory((const uint8 *) "", 0, 1);
+
+    // Give the entry its own copy of the archive's input, so it has its own
+    //  file position.
+    io = ar->io->duplicate(ar->io);
+    if (io != NULL)
+    {
+        retval = MojoInput_newFromSubset(io, start, info->nextFileStart);
+        if (retval == NULL)
+            io->close(io);
+    } // if
+
+    return retval;
+} // MojoArchive_pck_openCurrentEntryDetached
+
+
+static MojoInput *MojoArchive_pck_openEntry(MojoArchive *ar, const char *fname)
+{
+    PCKinfo *info = (PCKinfo *) ar->opaque;
+    uint64 start = 0;
+    uint64 len = 0;
+
+    if (info->index == NULL)
+    {
+        // The whole directory is in memory after the first enumerate(), and
+        //  file data is stored back to back in the same order.
+        uint64 i;
+        if ((info->archiveEntries == NULL) && (!ar->enumerate(ar)))
+            return NULL;
+
+        info->index = MojoArchiveIndex_create();
+        start = info->dataStart;
+        for (i = 0; i < info->fileCount; i++)
+        {
+            const MojoArchiveEntry *entry = &info->archiveEntries[i];
+            if (entry->type != MOJOARCHIVE_ENTRY_FILE)
+                continue;
+            MojoArchiveIndex_add(info->index, entry->filename, start,
+                                 (uint64) entry->filesize);
+            start += entry->filesize;
+        } // for
+    } // if
+
+    if (!MojoArchiveIndex_find(info->index, fname, &start, &len))
+        return NULL;
+
+    return MojoInput_newFromRange(ar->io, start, len);
+} // MojoArchive_pck_openEntry
+
+
+static boolean MojoArchive_pck_indexed(MojoArchive *ar)
+{
+    return true;  // the directory is all at the front, and small.
+} // MojoArchive_pck_indexed
+
+
 static void MojoArchive_pck_close(MojoArchive *ar)
 {
     int i;
     PCKinfo *info = (PCKinfo *) ar->opaque;
+    MojoArchiveIndex_destroy(info->index);
     ar->io->close(ar->io);
 
     for (i = 0; i < info->fileCount; i++)
@@ -260,6 +282,9 @@ MojoArchive *MojoArchive_createPCK(MojoInput *io)
     ar->enumerate = MojoArchive_pck_enumerate;
     ar->enumNext = MojoArchive_pck_enumNext;
     ar->openCurrentEntry = MojoArchive_pck_openCurrentEntry;
+    ar->openCurrentEntryDetached = MojoArchive_pck_openCurrentEntryDetached;
+    ar->openEntry = MojoArchive_pck_openEntry;
+    ar->indexed = MojoArchive_pck_indexed;
     ar->close = MojoArchive_pck_close;
     ar->io = io;
 
@@ -24,64 +24,9 @@ typedef struct
 typedef struct
 {
     uint64 nextFileStart;
+    MojoArchiveIndex *index;  // built on first openEntry().
 } PKGinfo;
 
-static boolean MojoInput_pkg_ready(MojoInput *io)
-{
-    return true;
-} // MojoInput_pkg_ready
-
-static int64 MojoInput_pkg_read(MojoInput *io, void *buf, uint32 bufsize)
-{
-    MojoArchive *ar = (MojoArchive *) io->opaque;
-    const MojoArchiveEntry *entry = &ar->prevEnum;
-    int64 pos = io->tell(io);
-    if ((pos + bufsize) > entry->filesize)
-        bufsize = (uint32) (entry->filesize - pos);
-    return ar->io->read(ar->io, buf, bufsize);
-} // MojoInput_pkg_read
-
-static boolean MojoInput_pkg_seek(MojoInput *io, uint64 pos)
-{
-    MojoArchive *ar = (MojoArchive *) io->opaque;
-    const PKGinfo *info = (PKGinfo *) ar->opaque;
-    const MojoArchiveEntry *entry = &ar->prevEnum;
-    boolean retval = false;
-    if (pos < ((uint64) entry->filesize))
-    {
-        const uint64 newpos = (info->nextFileStart - entry->filesize) + pos;
-        retval = ar->io->seek(ar->io, newpos);
-    } // if
-    return retval;
-} // MojoInput_pkg_seek
-
-static int64 MojoInput_pkg_tell(MojoInput *io)
-{
-    MojoArchive *ar = (MojoArchive *) io->opaque;
-    const PKGinfo *info = (PKGinfo *) ar->opaque;
-    const MojoArchiveEntry *entry = &ar->prevEnum;
-    return ar->io->tell(ar->io) - (info->nextFileStart - entry->filesize);
-} // MojoInput_pkg_tell
-
-static int64 MojoInput_pkg_length(MojoInput *io)
-{
-    MojoArchive *ar = (MojoArchive *) io->opaque;
-    const MojoArchiveEntry *entry = &ar->prevEnum;
-    return entry->filesize;
-} // MojoInput_pkg_length
-
-static MojoInput *MojoInput_pkg_duplicate(MojoInput *io)
-{
-    MojoInput *retval = NULL;
-    fatal(_("BUG: Can't duplicate pkg inputs"));  // !!! FIXME: why not?
-    return retval;
-} // MojoInput_pkg_duplicate
-
-static void MojoInput_pkg_close(MojoInput *io)
-{
-    free(io);
-} // MojoInput_pkg_close
-
 // MojoArchive implementation...
 
 static boolean MojoArchive_pkg_enumerate(MojoArchive *ar)
@@ -170,23 +115,78 @@ static const MojoArchiveEntry *MojoArchive_pkg_enumNext(MojoArchive *ar)
 
 static MojoInput *MojoArchive_pkg_openCurrentEntry(MojoArchive *ar)
 {
-    MojoInput *io = NULL;
-    io = (MojoInput *) xmalloc(sizeof (MojoInput));
-    io->ready = MojoInput_pkg_ready;
-    io->read = MojoInput_pkg_read;
-    io->seek = MojoInput_pkg_seek;
-    io->tell = MojoInput_pkg_tell;
-    io->length = MojoInput_pkg_length;
-    io->duplicate = MojoInput_pkg_duplicate;
-    io->close = MojoInput_pkg_close;
-    io->opaque = ar;
-    return io;
+    const PKGinfo *info = (PKGinfo *) ar->opaque;
+    const MojoArchiveEntry *entry = &ar->prevEnum;
+    const uint64 start = info->nextFileStart - entry->filesize;
+    return MojoInput_newFromRange(ar->io, start, entry->filesize);
 } // MojoArchive_pkg_openCurrentEntry
 
 
+static MojoInput *MojoArchive_pkg_openCurrentEntryDetached(MojoArchive *ar)
+{
+    const PKGinfo *info = (PKGinfo *) ar->opaque;
+    const MojoArchiveEntry *entry = &ar->prevEnum;
+    const uint64 start = info->nextFileStart - entry->filesize;
+    MojoInput *io = NULL;
+    MojoInput *retval = NULL;
+
+    if (entry->type != MOJOARCHIVE_ENTRY_FILE)
+        return NULL;
+    else if (entry->filesize == 0)  // subsets can't be empty.
+        return MojoInput_newFromMemory((const uint8 *) "", 0, 1);
+
+    // Give the entry its own copy of the archive's input, so it has its own
+    //  file position.
+    io = ar->io->duplicate(ar->io);
+    if (io != NULL)
+    {
+        retval = MojoInput_newFromSubset(io, start, info->nextFileStart);
+        if (retval == NULL)
+            io->close(io);
+    } // if
+
+    return retval;
+} // MojoArchive_pkg_openCurrentEntryDetached
+
+
+static uint64 MojoArchive_pkg_entryStart(MojoArchive *ar)
+{
+    const PKGinfo *info = (PKGinfo *) ar->opaque;
+    return info->nextFileStart - ar->prevEnum.filesize;
+} // MojoArchive_pkg_entryStart
+
+
+static MojoInput *MojoArchive_pkg_openEntry(MojoArchive *ar, const char *fname)
+{
+    PKGinfo *info = (PKGinfo *) ar->opaque;
+    uint64 start = 0;
+    uint64 len = 0;
+
+    if (info->index == NULL)
+    {
+        const uint64 nextFileStart = info->nextFileStart;
+        info->index = MojoArchiveIndex_build(ar, MojoArchive_pkg_entryStart);
+        info->nextFileStart = nextFileStart;
+    } // if
+
+    if (!MojoArchiveIndex_find(info->index, fname, &start, &len))
+        return NULL;
+
+    return MojoInput_newFromRange(ar->io, start, len);
+} // MojoArchive_pkg_openEntry
+
+
+static boolean MojoArchive_pkg_indexed(MojoArchive *ar)
+{
+    // until openEntry() builds the index, it has to read every header.
+    return (((PKGinfo *) ar->opaque)->index != NULL);
+} // MojoArchive_pkg_indexed
+
+
 static void MojoArchive_pkg_close(MojoArchive *ar)
 {
     PKGinfo *info = (PKGinfo *) ar->opaque;
+    MojoArchiveIndex_destroy(info->index);
     ar->io->close(ar->io);
 
     free(info);
@@ -216,6 +216,9 @@ MojoArchive *MojoArchive_createPKG(MojoInput *io)
     ar->enumerate = MojoArchive_pkg_enumerate;
     ar->enumNext = MojoArchive_pkg_enumNext;
     ar->openCurrentEntry = MojoArchive_pkg_openCurrentEntry;
+    ar->openCurrentEntryDetached = MojoArchive_pkg_openCurrentEntryDetached;
+    ar->openEntry = MojoArchive_pkg_openEntry;
+    ar->indexed = MojoArchive_pkg_indexed;
     ar->close = MojoArchive_pkg_close;
     ar->io = io;
 
@@ -15,92 +15,17 @@
 MojoArchive *MojoArchive_createTAR(MojoInput *io) { return NULL; }
 #else
 
-// MojoInput implementation...
-
-// Decompression is handled in the parent MojoInput, so this just needs to
-//  make sure we stay within the bounds of the tarfile entry.
-
-typedef struct TARinput
-{
-    int64 fsize;
-    int64 offset;
-    MojoArchive *ar;
-} TARinput;
-
 typedef struct TARinfo
 {
-    MojoInput *input;
     uint64 curFileStart;
     uint64 nextEnumPos;
+    MojoArchiveIndex *index;  // built on first openEntry().
+    MojoArchiveEntry *toc;  // from MojoArchive_useTOC(), or NULL.
+    uint64 *tocOffsets;  // where each (toc) entry's data starts.
+    uint32 tocCount;
+    uint32 tocIndex;
 } TARinfo;
 
-static boolean MojoInput_tar_ready(MojoInput *io)
-{
-    return true;  // !!! FIXME: ready if there are bytes uncompressed.
-} // MojoInput_tar_ready
-
-static int64 MojoInput_tar_read(MojoInput *io, void *buf, uint32 bufsize)
-{
-    TARinput *input = (TARinput *) io->opaque;
-    int64 pos = io->tell(io);
-    if ((pos + bufsize) > input->fsize)
-        bufsize = (uint32) (input->fsize - pos);
-    return input->ar->io->read(input->ar->io, buf, bufsize);
-} // MojoInput_tar_read
-
-static boolean MojoInput_tar_seek(MojoInput *io, uint64 pos)
-{
-    TARinput *input = (TARinput *) io->opaque;
-    boolean retval = false;
-    if (pos < ((uint64) input->fsize))
-        retval = input->ar->io->seek(input->ar->io, input->offset + pos);
-    return retval;
-} // MojoInput_tar_seek
-
-static int64 MojoInput_tar_tell(MojoInput *io)
-{
-    TARinput *input = (TARinput *) io->opaque;
-    return input->ar->io->tell(input->ar->io) - input->offset;
-} // MojoInput_tar_tell
-
-static int64 MojoInput_tar_length(MojoInput *io)
-{
-    return ((TARinput *) io->opaque)->fsize;
-} // MojoInput_tar_length
-
-static MojoInput *MojoInput_tar_duplicate(MojoInput *io)
-{
-    MojoInput *retval = NULL;
-    fatal(_("BUG: Can't duplicate tar inputs"));  // !!! FIXME: why not?
-#if 0
-    TARinput *input = (TARinput *) io->opaque;
-    MojoInput *origio = (MojoInput *) io->opaque;
-    MojoInput *newio = origio->duplicate(origio);
-
-    if (newio != NULL)
-    {
-        TARinput *newopaque = (TARinput *) xmalloc(sizeof (TARinput));
-        newopaque->origio = newio;
-        newopaque->fsize = input->fsize;
-        newopaque->offset = input->offset;
-        retval = (MojoInput *) xmalloc(sizeof (MojoInput));
-        memcpy(retval, io, sizeof (MojoInput));
-        retval->opaque = newopaque;
-    } // if
-#endif
-    return retval;
-} // MojoInput_tar_duplicate
-
-static void MojoInput_tar_close(MojoInput *io)
-{
-    TARinput *input = (TARinput *) io->opaque;
-    TARinfo *info = (TARinfo *) input->ar->opaque;
-    //input->ar->io->close(input->ar->io);
-    info->input = NULL;
-    free(input);
-    free(io);
-} // MojoInput_tar_close
-
 
 // MojoArchive implementation...
 
@@ -108,9 +33,8 @@ static boolean MojoArchive_tar_enumerate(MojoArchive *ar)
 {
     TARinfo *info = (TARinfo *) ar->opaque;
     MojoArchive_resetEntry(&ar->prevEnum);
-    if (info->input != NULL)
-        fatal("BUG: tar entry still open on new enumeration");
     info->curFileStart = info->nextEnumPos = 0;
+    info->tocIndex = 0;
     return true;
 } // MojoArchive_tar_enumerate
 
@@ -204,8 +128,20 @@ static const MojoArchiveEntry *MojoArchive_tar_enumNext(MojoArchive *ar)
     memset(scratch, '\0', sizeof (scratch));
 
     MojoArchive_resetEntry(&ar->prevEnum);
-    if (info->input != NULL)
-        fatal("BUG: tar entry still open on new enumeration");
+
+    if (info->toc != NULL)  // no need to touch the tarball at all.
+    {
+        const MojoArchiveEntry *entry = NULL;
+        if (info->tocIndex >= info->tocCount)
+            return NULL;
+        entry = &info->toc[info->tocIndex];
+        memcpy(&ar->prevEnum, entry, sizeof (MojoArchiveEntry));
+        ar->prevEnum.filename = xstrdup(entry->filename);
+        if (entry->linkdest != NULL)
+            ar->prevEnum.linkdest = xstrdup(entry->linkdest);
+        info->curFileStart = info->tocOffsets[info->tocIndex++];
+        return &ar->prevEnum;
+    } // if
 
 get_next_block:
 
@@ -265,6 +201,10 @@ get_next_block:
         ar->prevEnum.filename = xstrdup((const char *) scratch);
     }
 
+    fnamelen = strlen(ar->prevEnum.filename);  // might be a GNU long name.
+    if (fnamelen == 0)
+        return NULL;   // corrupt file.  !!! FIXME: fatal() ?
+
     ar->prevEnum.perms = (uint16) octal_convert(&block[TAR_MODE], TAR_MODELEN);
     ar->prevEnum.filesize = octal_convert(&block[TAR_SIZE], TAR_SIZELEN);
     info->curFileStart = info->nextEnumPos + 512;
@@ -307,45 +247,314 @@ get_next_block:
 } // MojoArchive_tar_enumNext
 
 
+// If we're enumerating from a table of contents, make sure it still matches
+//  the tarball before we hand out data from it: the entry's header is right
+//  before its data, and has to agree with the TOC about the size.
+static boolean MojoArchive_tar_checkTOCEntry(MojoArchive *ar, uint64 start,
+                                             int64 filesize)
+{
+    TARinfo *info = (TARinfo *) ar->opaque;
+    uint8 block[512];
+
+    if (info->toc == NULL)
+        return true;  // we read the header ourselves, then.
+
+    if ( (start < sizeof (block)) ||
+         (!ar->io->seek(ar->io, start - sizeof (block))) ||
+         (ar->io->read(ar->io, block, sizeof (block)) != sizeof (block)) ||
+         (octal_convert(&block[TAR_SIZE], TAR_SIZELEN) != filesize) )
+    {
+        logError("tar: table of contents doesn't match the archive");
+        return false;
+    } // if
+
+    return true;
+} // MojoArchive_tar_checkTOCEntry
+
+
 static MojoInput *MojoArchive_tar_openCurrentEntry(MojoArchive *ar)
 {
     TARinfo *info = (TARinfo *) ar->opaque;
-    MojoInput *io = NULL;
-    TARinput *opaque = NULL;
 
     if (info->curFileStart == 0)
         return NULL;
+    else if (!MojoArchive_tar_checkTOCEntry(ar, info->curFileStart,
+                                            ar->prevEnum.filesize))
+        return NULL;
 
-    // Can't open multiple, since we would end up decompressing twice
-    //  to enumerate the next file, so I imposed this limitation for now.
-    if (info->input != NULL)
-        fatal("BUG: tar entry double open");
-
-    // !!! FIXME: replace this with MojoInput_newFromSubset()?
-
-    opaque = (TARinput *) xmalloc(sizeof (TARinput));
-    opaque->ar = ar;
-    opaque->fsize = ar->prevEnum.filesize;
-    opaque->offset = info->curFileStart;
-
-    io = (MojoInput *) xmalloc(sizeof (MojoInput));
-    io->ready = MojoInput_tar_ready;
-    io->read = MojoInput_tar_read;
-    io->seek = MojoInput_tar_seek;
-    io->tell = MojoInput_tar_tell;
-    io->length = MojoInput_tar_length;
-    io->duplicate = MojoInput_tar_duplicate;
-    io->close = MojoInput_tar_close;
-    io->opaque = opaque;
-    info->input = io;
-    return io;
+    // Decompression is handled in the parent MojoInput, so the entry just
+    //  needs to stay within its bounds. It gets its own file position, so
+    //  entries can be open while we keep enumerating, but reading one after
+    //  moving on makes a compressed parent seek backwards, which is slow.
+    return MojoInput_newFromRange(ar->io, info->curFileStart,
+                                  ar->prevEnum.filesize);
 } // MojoArchive_tar_openCurrentEntry
 
 
+static MojoInput *MojoArchive_tar_openCurrentEntryDetached(MojoArchive *ar)
+{
+    TARinfo *info = (TARinfo *) ar->opaque;
+    const MojoArchiveEntry *entry = &ar->prevEnum;
+    const uint64 start = info->curFileStart;
+    MojoInput *io = NULL;
+    MojoInput *retval = NULL;
+
+    // Each copy of a compressed tarball would have to decompress its own way
+    //  to its entry, which costs far more than reading the entries in order
+    //  on this thread does. Plain tarballs just need a new file position.
+    if ((start == 0) || (entry->type != MOJOARCHIVE_ENTRY_FILE))
+        return NULL;
+    else if (!MojoInput_seeksCheaply(ar->io))
+        return NULL;
+    else if (!MojoArchive_tar_checkTOCEntry(ar, start, entry->filesize))
+        return NULL;
+    else if (entry->filesize == 0)  // subsets can't be empty.
+        return MojoInput_newFromMemory((const uint8 *) "", 0, 1);
+
+    io = ar->io->duplicate(ar->io);
+    if (io != NULL)
+    {
+        retval = MojoInput_newFromSubset(io, start, start + entry->filesize);
+        if (retval == NULL)
+            io->close(io);
+    } // if
+
+    return retval;
+} // MojoArchive_tar_openCurrentEntryDetached
+
+
+static uint64 MojoArchive_tar_entryStart(MojoArchive *ar)
+{
+    return ((TARinfo *) ar->opaque)->curFileStart;
+} // MojoArchive_tar_entryStart
+
+
+static MojoInput *MojoArchive_tar_openEntry(MojoArchive *ar, const char *fname)
+{
+    TARinfo *info = (TARinfo *) ar->opaque;
+    uint64 start = 0;
+    uint64 len = 0;
+
+    if (info->index == NULL)
+    {
+        // Tarballs have no directory, so read every header once up front.
+        const uint64 curFileStart = info->curFileStart;
+        const uint64 nextEnumPos = info->nextEnumPos;
+        const uint32 tocIndex = info->tocIndex;
+        info->index = MojoArchiveIndex_build(ar, MojoArchive_tar_entryStart);
+        info->curFileStart = curFileStart;
+        info->nextEnumPos = nextEnumPos;
+        info->tocIndex = tocIndex;
+    } // if
+
+    if (!MojoArchiveIndex_find(info->index, fname, &start, &len))
+        return NULL;
+    else if (!MojoArchive_tar_checkTOCEntry(ar, start, (int64) len))
+        return NULL;
+
+    return MojoInput_newFromRange(ar->io, start, len);
+} // MojoArchive_tar_openEntry
+
+
+static boolean MojoArchive_tar_indexed(MojoArchive *ar)
+{
+    // Without a TOC, the first openEntry() reads (and, if we're compressed,
+    //  decompresses) the whole tarball to build an index, and a forward-only
+    //  parent can't come back from that. A TOC never gets used on one.
+    TARinfo *info = (TARinfo *) ar->opaque;
+    return ((info->index != NULL) || (info->toc != NULL));
+} // MojoArchive_tar_indexed
+
+
+static void freeTOC(MojoArchiveEntry *toc, uint64 *offsets, uint32 count)
+{
+    uint32 i;
+    for (i = 0; i < count; i++)
+        MojoArchive_resetEntry(&toc[i]);
+    free(toc);
+    free(offsets);
+} // freeTOC
+
+
+static char *readTOCString(MojoInput *toc)
+{
+    uint16 len = 0;
+    char *retval = NULL;
+    if (!MojoInput_readui16(toc, &len))
+        return NULL;
+    retval = (char *) xmalloc(len + 1);
+    if ((len > 0) && (toc->read(toc, retval, len) != len))
+    {
+        free(retval);
+        return NULL;
+    } // if
+    return retval;
+} // readTOCString
+
+
+// How much of the archive file, as stored, a TOC's CRC-32 covers.
+#define TOC_CRCLEN (64 * 1024)
+
+// Does (raw), the archive file as stored, look like the one the TOC was made
+//  from? Same size, and the same first TOC_CRCLEN bytes: a tarball that was
+//  rebuilt with different contents almost never keeps both.
+static boolean tocMatches(MojoInput *raw, uint64 tocraw, uint32 toccrc)
+{
+    const int64 rawsize = raw->length(raw);
+    boolean retval = true;
+
+    if (rawsize < 0)
+        return true;  // no way to tell; the entry headers get checked, too.
+    else if (tocraw != (uint64) rawsize)
+        return false;
+
+    #if SUPPORT_CRC32
+    {
+        uint8 buf[4096];
+        uint64 pos = 0;
+        uint32 crc = 0;
+        MojoCrc32 ctx;
+
+        MojoCrc32_init(&ctx);
+        if (!raw->seek(raw, 0))
+            retval = false;
+        while ((retval) && (pos < TOC_CRCLEN) && (pos < tocraw))
+        {
+            uint32 len = sizeof (buf);
+            int64 br;
+            if (len > TOC_CRCLEN - pos)
+                len = (uint32) (TOC_CRCLEN - pos);
+            br = raw->read(raw, buf, len);
+            if (br <= 0)
+                retval = false;
+            else
+            {
+                MojoCrc32_append(&ctx, buf, (uint32) br);
+                pos += br;
+            } // else
+        } // while
+        MojoCrc32_finish(&ctx, &crc);
+        if ((!raw->seek(raw, 0)) || (crc != toccrc))
+            retval = false;
+    }
+    #endif
+
+    return retval;
+} // tocMatches
+
+
+// Table of contents format (all integers littleendian):
+//  "MOJOTOC2", uint64 size of the (compressed) archive file it describes,
+//  uint32 CRC-32 of its first TOC_CRCLEN bytes (or all of it, if smaller),
+//  uint32 entry count, then for each entry: uint8 MojoArchiveEntryType,
+//  uint16 perms, uint64 filesize, uint64 offset of the entry's data in the
+//  uncompressed tarball, uint16-length-prefixed filename and link target.
+//  misc/make_tar_toc.pl writes these.
+static boolean readTOC(MojoArchive *ar, MojoInput *toc, MojoInput *raw)
+{
+    TARinfo *info = (TARinfo *) ar->opaque;
+    const int64 toclen = toc->length(toc);
+    MojoArchiveEntry *entries = NULL;
+    uint64 *offsets = NULL;
+    uint64 tocraw = 0;
+    uint32 toccrc = 0;
+    uint32 count = 0;
+    uint32 i = 0;
+    uint8 magic[8];
+
+    if (toc->read(toc, magic, sizeof (magic)) != sizeof (magic))
+        return false;
+    else if (memcmp(magic, "MOJOTOC2", sizeof (magic)) != 0)
+        return false;
+    else if (!MojoInput_readui64(toc, &tocraw))
+        return false;
+    else if (!MojoInput_readui32(toc, &toccrc))
+        return false;
+    else if (!MojoInput_readui32(toc, &count))
+        return false;
+    else if ((raw != NULL) && (!tocMatches(raw, tocraw, toccrc)))
+    {
+        logDebug("tar: table of contents is out of date, ignoring it.");
+        return false;
+    } // else if
+
+    // each entry is at least 23 bytes, so don't let a bogus count make us
+    //  allocate gigabytes.
+    if ((toclen >= 0) && (((uint64) count) * 23 > (uint64) toclen))
+        return false;
+
+    entries = (MojoArchiveEntry *) xmalloc(sizeof (MojoArchiveEntry) * count);
+    offsets = (uint64 *) xmalloc(sizeof (uint64) * count);
+    for (i = 0; i < count; i++)
+    {
+        MojoArchiveEntry *entry = &entries[i];
+        uint64 filesize = 0;
+        uint8 type = 0;
+
+        if (toc->read(toc, &type, 1) != 1)
+            break;
+        else if (type > MOJOARCHIVE_ENTRY_SYMLINK)
+            break;
+        else if (!MojoInput_readui16(toc, &entry->perms))
+            break;
+        else if (!MojoInput_readui64(toc, &filesize))
+            break;
+        else if (!MojoInput_readui64(toc, &offsets[i]))
+            break;
+        else if ((entry->filename = readTOCString(toc)) == NULL)
+            break;
+        else if ((entry->linkdest = readTOCString(toc)) == NULL)
+            break;
+        else if ((entry->filename[0] == '\0') || (offsets[i] < 512))
+            break;
+
+        entry->type = (MojoArchiveEntryType) type;
+        entry->filesize = (int64) filesize;
+        if (entry->linkdest[0] == '\0')
+        {
+            free(entry->linkdest);
+            entry->linkdest = NULL;
+        } // if
+    } // for
+
+    if (i < count)
+    {
+        freeTOC(entries, offsets, count);
+        return false;
+    } // if
+
+    freeTOC(info->toc, info->tocOffsets, info->tocCount);
+    MojoArchive_resetEntry(&ar->prevEnum);
+    info->toc = entries;
+    info->tocOffsets = offsets;
+    info->tocCount = count;
+    info->tocIndex = 0;
+    info->curFileStart = 0;
+    logDebug("tar: using a table of contents with %0 entries.",
+             numstr((int) count));
+    return true;
+} // readTOC
+
+static boolean MojoArchive_tar_useTOC(MojoArchive *ar, MojoInput *toc,
+                                      MojoInput *raw)
+{
+    // A TOC is nothing but tiny fields, and it's usually compressed too.
+    MojoInput *buffered = MojoInput_newBuffered(toc, 0);
+    boolean retval;
+    if (buffered == NULL)
+        return readTOC(ar, toc, raw);
+    retval = readTOC(ar, buffered, raw);
+    buffered->close(buffered);
+    return retval;
+} // MojoArchive_tar_useTOC
+
+
 static void MojoArchive_tar_close(MojoArchive *ar)
 {
     TARinfo *info = (TARinfo *) ar->opaque;
     MojoArchive_resetEntry(&ar->prevEnum);
+    MojoArchiveIndex_destroy(info->index);
+    freeTOC(info->toc, info->tocOffsets, info->tocCount);
     ar->io->close(ar->io);
     free(info);
     free(ar);
@@ -371,6 +580,10 @@ MojoArchive *MojoArchive_createTAR(MojoInput *io)
     ar->enumerate = MojoArchive_tar_enumerate;
     ar->enumNext = MojoArchive_tar_enumNext;
     ar->openCurrentEntry = MojoArchive_tar_openCurrentEntry;
+    ar->openCurrentEntryDetached = MojoArchive_tar_openCurrentEntryDetached;
+    ar->openEntry = MojoArchive_tar_openEntry;
+    ar->indexed = MojoArchive_tar_indexed;
+    ar->useTOC = MojoArchive_tar_useTOC;
     ar->close = MojoArchive_tar_close;
     ar->io = io;
     return ar;
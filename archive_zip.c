@@ -189,7 +189,9 @@ typedef void (*PHYSFS_EnumFilesCallback)(void *, const char *, const char *);
  *  PHYSFS_read().
  *
  * Uncompressed entries in a zipfile do not allocate this buffer; they just
- *  read data directly into the buffer passed to PHYSFS_read().
+ *  read data directly into the buffer passed to PHYSFS_read(). In MojoSetup,
+ *  compressed entries don't allocate it either if the archive can lend us
+ *  its data through MojoInput_borrow() (it's memory-mapped, etc).
  *
  * Depending on your speed and memory requirements, you should tweak this
  *  value.
@@ -264,6 +266,9 @@ typedef struct
 {
     #if __MOJOSETUP__
     ZIPinfo *archive; /* archive this belongs to, for duplication. */
+    PHYSFS_uint32 crc;  /* running CRC-32 of data up to crc_position. */
+    PHYSFS_uint32 crc_position;
+    int corrupted;  /* CRC didn't match; all reads fail from now on. */
     #endif
     ZIPentry *entry;                      /* Info on file.              */
     void *handle;                         /* physical file handle.      */
@@ -387,6 +392,52 @@ static int readui16(void *in, PHYSFS_uint16 *val)
 #endif
 
 
+#if __MOJOSETUP__
+/*
+ * Run data through a CRC-32 as it goes by, if we've seen everything before
+ *  it, and check that against the central directory when we hit the end.
+ *  Reading from the start again starts over; skipping ahead means we can't
+ *  check this time. Call this before moving uncompressed_position past
+ *  (buf). Returns zero if the entry is corrupted.
+ */
+static int zip_check_crc(ZIPfileinfo *finfo, const void *buf, PHYSFS_uint32 len)
+{
+    const ZIPentry *entry = finfo->entry;
+    PHYSFS_uint32 crc;
+
+    if (finfo->uncompressed_position == 0)
+    {
+        #if SUPPORT_CRC32
+        MojoCrc32_init(&finfo->crc);
+        #else
+        finfo->crc = crc32(0, Z_NULL, 0);
+        #endif
+        finfo->crc_position = 0;
+    } /* if */
+
+    else if (finfo->crc_position != finfo->uncompressed_position)
+        return(1);
+
+    #if SUPPORT_CRC32
+    MojoCrc32_append(&finfo->crc, (const uint8 *) buf, len);
+    #else
+    finfo->crc = crc32(finfo->crc, (const Bytef *) buf, len);
+    #endif
+    finfo->crc_position += len;
+
+    if (finfo->crc_position != entry->uncompressed_size)
+        return(1);
+
+    crc = finfo->crc;
+    #if SUPPORT_CRC32
+    MojoCrc32_finish(&crc, &crc);
+    #endif
+    finfo->corrupted = (crc != entry->crc);
+    return(!finfo->corrupted);
+} /* zip_check_crc */
+#endif
+
+
 static PHYSFS_sint64 ZIP_read(fvoid *opaque, void *buf,
                               PHYSFS_uint32 objSize, PHYSFS_uint32 objCount)
 {
@@ -398,6 +449,9 @@ static PHYSFS_sint64 ZIP_read(fvoid *opaque, void *buf,
                           finfo->uncompressed_position;
 
     BAIL_IF_MACRO(maxread == 0, NULL, 0);    /* quick rejection. */
+    #if __MOJOSETUP__
+    BAIL_IF_MACRO(finfo->corrupted, ERR_CORRUPTED, -1);
+    #endif
 
     if (avail < maxread)
     {
@@ -429,17 +483,40 @@ static PHYSFS_sint64 ZIP_read(fvoid *opaque, void *buf,
                 br = entry->compressed_size - finfo->compressed_position;
                 if (br > 0)
                 {
-                    if (br > ZIP_READBUFSIZE)
-                        br = ZIP_READBUFSIZE;
+                    const PHYSFS_uint8 *ptr = NULL;
 
-                    br = __PHYSFS_platformRead(finfo->handle,
-                                               finfo->buffer,
-                                               1, (PHYSFS_uint32) br);
-                    if (br <= 0)
+                    #if __MOJOSETUP__
+                    /* inflate straight out of the archive's memory if we can. */
+                    br = MojoInput_borrow((MojoInput *) finfo->handle,
+                                          (PHYSFS_uint32) br, &ptr);
+                    if (br == 0)
                         break;
+                    else if (br < 0)
+                    #endif
+                    {
+                        if (finfo->buffer == NULL)
+                        {
+                            finfo->buffer = (PHYSFS_uint8 *)
+                                        allocator.Malloc(ZIP_READBUFSIZE);
+                            BAIL_IF_MACRO(finfo->buffer == NULL,
+                                          ERR_OUT_OF_MEMORY, -1);
+                        } /* if */
+
+                        br = entry->compressed_size -
+                             finfo->compressed_position;
+                        if (br > ZIP_READBUFSIZE)
+                            br = ZIP_READBUFSIZE;
+
+                        br = __PHYSFS_platformRead(finfo->handle,
+                                                   finfo->buffer,
+                                                   1, (PHYSFS_uint32) br);
+                        if (br <= 0)
+                            break;
+                        ptr = finfo->buffer;
+                    } /* if */
 
                     finfo->compressed_position += (PHYSFS_uint32) br;
-                    finfo->stream.next_in = finfo->buffer;
+                    finfo->stream.next_in = ptr;
                     finfo->stream.avail_in = (PHYSFS_uint32) br;
                 } /* if */
             } /* if */
@@ -455,7 +532,13 @@ static PHYSFS_sint64 ZIP_read(fvoid *opaque, void *buf,
     } /* else */
 
     if (retval > 0)
+    {
+        #if __MOJOSETUP__
+        const PHYSFS_uint32 len = (PHYSFS_uint32) (retval * objSize);
+        BAIL_IF_MACRO(!zip_check_crc(finfo, buf, len), ERR_CORRUPTED, -1);
+        #endif
         finfo->uncompressed_position += (PHYSFS_uint32) (retval * objSize);
+    } /* if */
 
     return(retval);
 } /* ZIP_read */
@@ -1273,21 +1356,40 @@ static int zip_load_entries(void *in, ZIPinfo *info,
     const PHYSFS_uint64 max = info->entryCount;
     const int zip64 = info->zip64;
     PHYSFS_uint64 i;
+#if __MOJOSETUP__
+    MojoInput *buffered = NULL;
+#endif
 
     BAIL_IF_MACRO(!__PHYSFS_platformSeek(in, central_ofs), NULL, 0);
 
     info->entries = (ZIPentry *) allocator.Malloc(sizeof (ZIPentry) * max);
     BAIL_IF_MACRO(info->entries == NULL, ERR_OUT_OF_MEMORY, 0);
 
+#if __MOJOSETUP__
+    /* The central directory is a long run of tiny reads; batch them up. */
+    buffered = MojoInput_newBuffered((MojoInput *) in, 0);
+    if (buffered != NULL)
+        in = buffered;
+#endif
+
     for (i = 0; i < max; i++)
     {
         if (!zip_load_entry(in, zip64, &info->entries[i], data_ofs))
         {
             zip_free_entries(info->entries, i);
+#if __MOJOSETUP__
+            if (buffered != NULL)
+                buffered->close(buffered);
+#endif
             return(0);
         } /* if */
     } /* for */
 
+#if __MOJOSETUP__
+    if (buffered != NULL)
+        buffered->close(buffered);
+#endif
+
     __PHYSFS_sort(info->entries, (size_t) max, zip_entry_cmp, zip_entry_swap);
     return(1);
 } /* zip_load_entries */
@@ -1888,12 +1990,7 @@ static fvoid *ZIP_openRead(dvoid *opaque, const char *fnm, int *fileExists)
             return(NULL);
         } /* if */
 
-        finfo->buffer = (PHYSFS_uint8 *) allocator.Malloc(ZIP_READBUFSIZE);
-        if (finfo->buffer == NULL)
-        {
-            ZIP_fileClose(finfo);
-            BAIL_MACRO(ERR_OUT_OF_MEMORY, NULL);
-        } /* if */
+        /* (finfo->buffer is allocated on the first read that needs it.) */
     } /* if */
 
     #if __MOJOSETUP__
@@ -1989,6 +2086,43 @@ static int64 MojoInput_zip_read(MojoInput *io, void *buf, uint32 bufsize)
     return ZIP_read(io->opaque, buf, 1, bufsize);
 } // MojoInput_zip_read
 
+static int64 MojoInput_zip_borrow(MojoInput *io, uint32 len, const uint8 **ptr)
+{
+    ZIPfileinfo *finfo = (ZIPfileinfo *) io->opaque;
+    const uint64 avail = finfo->entry->uncompressed_size -
+                         finfo->uncompressed_position;
+    int64 retval;
+
+    // only stored entries are sitting in the archive as-is.
+    if (finfo->entry->compression_method != COMPMETH_NONE)
+        return -1;
+
+    if (((uint64) len) > avail)
+        len = (uint32) avail;
+
+    if (finfo->corrupted)
+        return -1;  // let read() report it.
+
+    retval = MojoInput_borrow((MojoInput *) finfo->handle, len, ptr);
+    if (retval > 0)
+    {
+        if (!zip_check_crc(finfo, *ptr, (PHYSFS_uint32) retval))
+            return -1;  // now read() will fail, too.
+        finfo->uncompressed_position += (PHYSFS_uint32) retval;
+    } // if
+    return retval;
+} // MojoInput_zip_borrow
+
+static boolean MojoInput_zip_storedcrc(MojoInput *io, uint32 *crc)
+{
+    // ZIP_read() checks this, as long as it starts from the top.
+    ZIPfileinfo *finfo = (ZIPfileinfo *) io->opaque;
+    if (finfo->uncompressed_position != 0)
+        return false;
+    *crc = finfo->entry->crc;
+    return true;
+} // MojoInput_zip_storedcrc
+
 static boolean MojoInput_zip_seek(MojoInput *io, uint64 pos)
 {
     return ((ZIP_seek(io->opaque, pos)) ? true : false);
@@ -2085,6 +2219,8 @@ static MojoInput *buildZipMojoInput(ZIPinfo *info, const char *fullpath)
     io->length = MojoInput_zip_length;
     io->duplicate = MojoInput_zip_duplicate;
     io->close = MojoInput_zip_close;
+    io->borrow = MojoInput_zip_borrow;
+    io->storedcrc = MojoInput_zip_storedcrc;
     io->opaque = opaque;
     return io;
 } // buildZipMojoInput
@@ -2109,6 +2245,30 @@ static MojoInput *MojoArchive_zip_openCurrentEntry(MojoArchive *ar)
 } // MojoArchive_zip_openCurrentEntry
 
 
+static MojoInput *MojoArchive_zip_openEntry(MojoArchive *ar, const char *fname)
+{
+    // The central directory is already in memory and sorted by name, so
+    //  this is a binary search, not an enumeration.
+    ZIPinfo *info = (ZIPinfo *) ar->opaque;
+    ZIPentry *entry = zip_find_entry(info, fname, NULL);
+
+    if (entry == NULL)
+        return NULL;
+    else if (entry->name[strlen(entry->name) - 1] == '/')
+        return NULL;
+    else if (MojoArchive_zip_entry_is_symlink(info, entry))
+        return NULL;
+
+    return buildZipMojoInput(info, entry->name);
+} // MojoArchive_zip_openEntry
+
+
+static boolean MojoArchive_zip_indexed(MojoArchive *ar)
+{
+    return true;  // the central directory was read when we opened it.
+} // MojoArchive_zip_indexed
+
+
 static void MojoArchive_zip_close(MojoArchive *ar)
 {
     ZIP_dirClose(ar->opaque);
@@ -2129,6 +2289,9 @@ MojoArchive *MojoArchive_createZIP(MojoInput *io)
     ar->enumerate = MojoArchive_zip_enumerate;
     ar->enumNext = MojoArchive_zip_enumNext;
     ar->openCurrentEntry = MojoArchive_zip_openCurrentEntry;
+    ar->openCurrentEntryDetached = MojoArchive_zip_openCurrentEntry;  // (always is.)
+    ar->openEntry = MojoArchive_zip_openEntry;
+    ar->indexed = MojoArchive_zip_indexed;
     ar->close = MojoArchive_zip_close;
     ar->offsetOfStart = ((const ZIPinfo *) opaque)->offset;
     ar->opaque = opaque;
@@ -0,0 +1,1058 @@
+/**
+ * MojoSetup; a portable, flexible installation application.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ *
+ *  This file written by Ryan C. Gordon.
+ */
+
+// Throughput benchmarks, built as mojosetup-bench (see CMakeLists.txt; "make
+//  bench" runs it). Every payload is generated here, so runs are repeatable
+//  from machine to machine without shipping test data. Results go out as
+//  JSON, so they can be diffed between builds to catch regressions, or to
+//  see what a buffer size change actually bought us.
+//
+// Command line:
+//  --output=fname    where to write the JSON (default: stdout).
+//  --benchsize=mb    megabytes of payload for the streaming tests (32).
+//  --benchfiles=n    entries in the synthetic archives (2000).
+//  --benchtime=ms    run each test at least this long (1000).
+//  --benchdir=path   scratch dir for the disk tests (mojosetup-bench.tmp).
+//  --threads=n       worker threads, same as the installer.
+
+#include "fileio.h"
+#include "platform.h"
+
+#if SUPPORT_BZIP2
+#include "bzip2/bzlib.h"
+#endif
+
+// We can only make .xz data with the system's liblzma; ours is decode-only.
+#define BENCH_XZ (SUPPORT_XZ && !MOJOSETUP_INTERNAL_LIBLZMA)
+#if BENCH_XZ
+#include "lzma.h"
+#endif
+
+#define BENCH_READSIZE (128 * 1024)
+
+// A growable chunk of memory: payloads, archives, and the JSON report.
+typedef struct BenchBuf
+{
+    uint8 *data;
+    uint32 len;
+    uint32 alloc;
+} BenchBuf;
+
+static void bench_reserve(BenchBuf *buf, uint32 len)
+{
+    if (buf->len + len > buf->alloc)
+    {
+        buf->alloc = (buf->len + len) * 2;
+        buf->data = (uint8 *) xrealloc(buf->data, buf->alloc);
+    } // if
+} // bench_reserve
+
+static void bench_put(BenchBuf *buf, const void *data, uint32 len)
+{
+    bench_reserve(buf, len);
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+} // bench_put
+
+static void bench_putzeros(BenchBuf *buf, uint32 len)
+{
+    bench_reserve(buf, len);
+    memset(buf->data + buf->len, '\0', len);
+    buf->len += len;
+} // bench_putzeros
+
+static void bench_putstr(BenchBuf *buf, const char *str)
+{
+    bench_put(buf, str, (uint32) strlen(str));
+} // bench_putstr
+
+static void bench_putui16(BenchBuf *buf, uint32 val)
+{
+    const uint8 b[2] = { (uint8) val, (uint8) (val >> 8) };
+    bench_put(buf, b, sizeof (b));
+} // bench_putui16
+
+static void bench_putui32(BenchBuf *buf, uint32 val)
+{
+    const uint8 b[4] = { (uint8) val, (uint8) (val >> 8),
+                         (uint8) (val >> 16), (uint8) (val >> 24) };
+    bench_put(buf, b, sizeof (b));
+} // bench_putui32
+
+
+static uint32 bench_rand(uint32 *state)
+{
+    *state = (*state * 1103515245) + 12345;
+    return *state >> 8;
+} // bench_rand
+
+
+// Our own CRC-32, so the archives and .gz files are valid even when the
+//  build leaves out checksum_crc32.c.
+static uint32 bench_crc32(const uint8 *data, uint32 len)
+{
+    static uint32 table[256];
+    uint32 crc = 0xFFFFFFFF;
+    uint32 i;
+
+    if (table[1] == 0)
+    {
+        for (i = 0; i < 256; i++)
+        {
+            uint32 c = i;
+            int j;
+            for (j = 0; j < 8; j++)
+                c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+            table[i] = c;
+        } // for
+    } // if
+
+    for (i = 0; i < len; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
+} // bench_crc32
+
+
+// Text-ish data from a small vocabulary, with some noise mixed in, so it
+//  compresses about as well as a typical install does (~3:1), instead of
+//  all or nothing.
+static uint8 *make_payload(uint32 len)
+{
+    uint8 *retval = (uint8 *) xmalloc(len);
+    char words[64][12];
+    uint32 state = 0x4D6F6A6F;
+    uint32 pos = 0;
+    int i;
+
+    for (i = 0; i < STATICARRAYLEN(words); i++)
+    {
+        const int wordlen = 2 + (int) (bench_rand(&state) % 9);
+        int j;
+        for (j = 0; j < wordlen; j++)
+            words[i][j] = 'a' + (char) (bench_rand(&state) % 26);
+        words[i][wordlen] = '\0';
+    } // for
+
+    while (pos < len)
+    {
+        const uint32 r = bench_rand(&state);
+        if ((r % 64) == 0)  // a little binary noise.
+        {
+            uint32 n = 32 + (r % 96);
+            while ((n--) && (pos < len))
+                retval[pos++] = (uint8) bench_rand(&state);
+        } // if
+        else
+        {
+            const char *word = words[r % STATICARRAYLEN(words)];
+            while ((*word) && (pos < len))
+                retval[pos++] = (uint8) *(word++);
+            if (pos < len)
+                retval[pos++] = ((r % 11) == 0) ? '\n' : ' ';
+        } // else
+    } // while
+
+    return retval;
+} // make_payload
+
+
+#if SUPPORT_GZIP
+// Just enough of a deflate compressor to make test data for the gzip
+//  decoder: greedy matches from a one-entry hash table, fixed Huffman codes.
+//  It's not zlib, but the decoder does the same kind of work for it.
+
+typedef struct BitWriter
+{
+    BenchBuf *out;
+    uint32 bits;
+    int count;
+} BitWriter;
+
+static const uint16 deflate_lenbase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+    67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8 deflate_lenextra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4,
+    5, 5, 5, 5, 0
+};
+static const uint16 deflate_distbase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513,
+    769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8 deflate_distextra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+    11, 11, 12, 12, 13, 13
+};
+
+// (the output buffer is reserved up front, so no bounds checks here.)
+static void put_bits(BitWriter *bw, uint32 val, int n)
+{
+    bw->bits |= val << bw->count;
+    bw->count += n;
+    while (bw->count >= 8)
+    {
+        bw->out->data[bw->out->len++] = (uint8) bw->bits;
+        bw->bits >>= 8;
+        bw->count -= 8;
+    } // while
+} // put_bits
+
+// Huffman codes go out most significant bit first, unlike everything else.
+static void put_huff(BitWriter *bw, uint32 code, int n)
+{
+    uint32 rev = 0;
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        rev = (rev << 1) | (code & 1);
+        code >>= 1;
+    } // for
+    put_bits(bw, rev, n);
+} // put_huff
+
+static void put_litlen(BitWriter *bw, uint32 sym)
+{
+    if (sym < 144)
+        put_huff(bw, 0x30 + sym, 8);
+    else if (sym < 256)
+        put_huff(bw, 0x190 + (sym - 144), 9);
+    else if (sym < 280)
+        put_huff(bw, sym - 256, 7);
+    else
+        put_huff(bw, 0xC0 + (sym - 280), 8);
+} // put_litlen
+
+static void put_match(BitWriter *bw, uint32 len, uint32 dist)
+{
+    int i = 28;
+    while (len < deflate_lenbase[i])
+        i--;
+    put_litlen(bw, 257 + i);
+    put_bits(bw, len - deflate_lenbase[i], deflate_lenextra[i]);
+
+    i = 29;
+    while (dist < deflate_distbase[i])
+        i--;
+    put_huff(bw, (uint32) i, 5);
+    put_bits(bw, dist - deflate_distbase[i], deflate_distextra[i]);
+} // put_match
+
+#define DEFLATE_HASHBITS 15
+
+static void make_gzip(BenchBuf *out, const uint8 *src, uint32 len)
+{
+    static const uint8 header[10] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF };
+    uint32 *head = (uint32 *) xmalloc(sizeof (uint32) << DEFLATE_HASHBITS);
+    BitWriter bw;
+    uint32 i = 0;
+
+    bench_put(out, header, sizeof (header));
+    bench_reserve(out, len + (len / 8) + 64);  // worst case, all 9-bit codes.
+
+    bw.out = out;
+    bw.bits = 0;
+    bw.count = 0;
+    put_bits(&bw, 1, 1);  // last block.
+    put_bits(&bw, 1, 2);  // fixed Huffman codes.
+
+    while (i < len)
+    {
+        uint32 best = 0;
+        uint32 dist = 0;
+        if (i + 3 <= len)
+        {
+            const uint32 key = (((uint32) src[i]) << 16) |
+                               (((uint32) src[i+1]) << 8) | src[i+2];
+            const uint32 hash = (key * 2654435761u) >> (32 - DEFLATE_HASHBITS);
+            const uint32 cand = head[hash];  // position + 1, 0 for none.
+            head[hash] = i + 1;
+            if ((cand != 0) && (i - (cand - 1) <= 32768))
+            {
+                const uint32 c = cand - 1;
+                const uint32 maxlen = ((len - i) < 258) ? (len - i) : 258;
+                while ((best < maxlen) && (src[c + best] == src[i + best]))
+                    best++;
+                dist = i - c;
+            } // if
+        } // if
+
+        if (best >= 3)
+        {
+            put_match(&bw, best, dist);
+            i += best;
+        } // if
+        else
+        {
+            put_litlen(&bw, src[i]);
+            i++;
+        } // else
+    } // while
+
+    put_litlen(&bw, 256);  // end of block.
+    if (bw.count > 0)
+        put_bits(&bw, 0, 8 - bw.count);
+
+    bench_putui32(out, bench_crc32(src, len));
+    bench_putui32(out, len);
+    free(head);
+} // make_gzip
+#endif
+
+
+#if SUPPORT_BZIP2
+static boolean make_bzip2(BenchBuf *out, const uint8 *src, uint32 len)
+{
+    unsigned int outlen = len + (len / 100) + 600;  // what bzlib.h promises.
+    bench_reserve(out, outlen);
+    if (BZ2_bzBuffToBuffCompress((char *) out->data + out->len, &outlen,
+                                 (char *) src, len, 9, 0, 0) != BZ_OK)
+        return false;
+    out->len += outlen;
+    return true;
+} // make_bzip2
+#endif
+
+
+#if BENCH_XZ
+static boolean make_xz(BenchBuf *out, const uint8 *src, uint32 len)
+{
+    const size_t avail = lzma_stream_buffer_bound(len);
+    size_t outpos = 0;
+    bench_reserve(out, (uint32) avail);
+    if (lzma_easy_buffer_encode(6, LZMA_CHECK_CRC32, NULL, src, len,
+                                out->data + out->len, &outpos,
+                                avail) != LZMA_OK)
+        return false;
+    out->len += (uint32) outpos;
+    return true;
+} // make_xz
+#endif
+
+
+// Archive entries get a little of the payload each, a few hundred bytes to
+//  a few kilobytes, like the pile of small files most installs are.
+static uint32 entry_size(uint32 idx)
+{
+    uint32 state = idx * 2654435761u;
+    return bench_rand(&state) % 4096;
+} // entry_size
+
+static void entry_name(char *buf, size_t buflen, uint32 idx)
+{
+    snprintf(buf, buflen, "dir%03u/file%05u.dat",
+             (unsigned int) (idx / 100), (unsigned int) idx);
+} // entry_name
+
+
+static void tar_octal(uint8 *dst, size_t len, uint64 val)
+{
+    char buf[32];
+    snprintf(buf, sizeof (buf), "%0*llo", (int) (len - 1),
+             (unsigned long long) val);
+    memcpy(dst, buf, len);  // (includes the null terminator.)
+} // tar_octal
+
+static void make_tar(BenchBuf *out, const uint8 *payload, uint32 paylen,
+                     uint32 files)
+{
+    uint32 pos = 0;
+    uint32 i;
+
+    for (i = 0; i < files; i++)
+    {
+        uint8 hdr[512];
+        const uint32 size = entry_size(i);
+        uint32 sum = 0;
+        int j;
+
+        if (pos + size > paylen)
+            pos = 0;
+
+        memset(hdr, '\0', sizeof (hdr));
+        entry_name((char *) hdr, 100, i);
+        tar_octal(hdr + 100, 8, 0644);
+        tar_octal(hdr + 108, 8, 0);
+        tar_octal(hdr + 116, 8, 0);
+        tar_octal(hdr + 124, 12, size);
+        tar_octal(hdr + 136, 12, 0);
+        hdr[156] = '0';  // regular file.
+        memcpy(hdr + 257, "ustar", 6);
+        memcpy(hdr + 263, "00", 2);
+        memset(hdr + 148, ' ', 8);
+        for (j = 0; j < sizeof (hdr); j++)
+            sum += hdr[j];
+        tar_octal(hdr + 148, 7, sum);
+
+        bench_put(out, hdr, sizeof (hdr));
+        bench_put(out, payload + pos, size);
+        bench_putzeros(out, (512 - (size % 512)) % 512);
+        pos += size;
+    } // for
+
+    bench_putzeros(out, 1024);  // end of archive.
+} // make_tar
+
+
+// Stored (uncompressed) entries, so this times the archiver, not inflate.
+static void make_zip(BenchBuf *out, const uint8 *payload, uint32 paylen,
+                     uint32 files)
+{
+    BenchBuf cdir;
+    uint32 cdiroffset;
+    uint32 pos = 0;
+    uint32 i;
+
+    memset(&cdir, '\0', sizeof (cdir));
+
+    for (i = 0; i < files; i++)
+    {
+        const uint32 size = entry_size(i);
+        const uint32 offset = out->len;
+        char name[64];
+        uint32 crc;
+        uint32 namelen;
+
+        if (pos + size > paylen)
+            pos = 0;
+
+        entry_name(name, sizeof (name), i);
+        namelen = (uint32) strlen(name);
+        crc = bench_crc32(payload + pos, size);
+
+        bench_putui32(out, 0x04034B50);  // local file header.
+        bench_putui16(out, 20);  // version needed.
+        bench_putui16(out, 0);  // flags.
+        bench_putui16(out, 0);  // stored.
+        bench_putui16(out, 0);  // mod time.
+        bench_putui16(out, 0x21);  // mod date (1980-01-01).
+        bench_putui32(out, crc);
+        bench_putui32(out, size);
+        bench_putui32(out, size);
+        bench_putui16(out, namelen);
+        bench_putui16(out, 0);  // extra field length.
+        bench_put(out, name, namelen);
+        bench_put(out, payload + pos, size);
+
+        bench_putui32(&cdir, 0x02014B50);  // central directory entry.
+        bench_putui16(&cdir, (3 << 8) | 20);  // made by Unix, zip 2.0.
+        bench_putui16(&cdir, 20);
+        bench_putui16(&cdir, 0);
+        bench_putui16(&cdir, 0);
+        bench_putui16(&cdir, 0);
+        bench_putui16(&cdir, 0x21);
+        bench_putui32(&cdir, crc);
+        bench_putui32(&cdir, size);
+        bench_putui32(&cdir, size);
+        bench_putui16(&cdir, namelen);
+        bench_putui16(&cdir, 0);  // extra field length.
+        bench_putui16(&cdir, 0);  // comment length.
+        bench_putui16(&cdir, 0);  // disk number.
+        bench_putui16(&cdir, 0);  // internal attributes.
+        bench_putui32(&cdir, (0100644) << 16);  // external: Unix perms.
+        bench_putui32(&cdir, offset);
+        bench_put(&cdir, name, namelen);
+
+        pos += size;
+    } // for
+
+    cdiroffset = out->len;
+    bench_put(out, cdir.data, cdir.len);
+    free(cdir.data);
+
+    bench_putui32(out, 0x06054B50);  // end of central directory.
+    bench_putui16(out, 0);  // disk number.
+    bench_putui16(out, 0);  // disk with the central directory.
+    bench_putui16(out, files);
+    bench_putui16(out, files);
+    bench_putui32(out, cdir.len);
+    bench_putui32(out, cdiroffset);
+    bench_putui16(out, 0);  // comment length.
+} // make_zip
+
+
+#if SUPPORT_PCK
+static void make_pck(BenchBuf *out, const uint8 *payload, uint32 paylen,
+                     uint32 files)
+{
+    uint32 pos = 0;
+    uint32 i;
+
+    bench_putui32(out, 0x534C4850);  // "PHLS"
+    bench_putui32(out, files * 64);  // the directory comes first.
+    for (i = 0; i < files; i++)
+    {
+        char name[60];
+        memset(name, '\0', sizeof (name));
+        snprintf(name, sizeof (name), "file%05u.dat", (unsigned int) i);
+        bench_put(out, name, sizeof (name));
+        bench_putui32(out, entry_size(i));
+    } // for
+
+    for (i = 0; i < files; i++)
+    {
+        const uint32 size = entry_size(i);
+        if (pos + size > paylen)
+            pos = 0;
+        bench_put(out, payload + pos, size);
+        pos += size;
+    } // for
+} // make_pck
+#endif
+
+
+static boolean write_file(const char *fname, const uint8 *data, uint32 len)
+{
+    const uint32 flags = MOJOFILE_WRITE|MOJOFILE_CREATE|MOJOFILE_TRUNCATE;
+    void *out = MojoPlatform_open(fname, flags, MojoPlatform_defaultFilePerms());
+    boolean retval = false;
+    if (out != NULL)
+    {
+        retval = (MojoPlatform_write(out, data, len) == len);
+        if (!MojoPlatform_close(out))
+            retval = false;
+    } // if
+    return retval;
+} // write_file
+
+
+// The test harness. Each test returns how much it did (bytes or entries) per
+//  run, or -1 on failure, and we run it until (benchtime) has passed.
+
+typedef int64 (*BenchFn)(void *data);
+
+typedef struct BenchReport
+{
+    BenchBuf json;
+    uint32 benchtime;
+    boolean first;
+    int failures;
+} BenchReport;
+
+static void report_start(BenchReport *report, const char *group,
+                         const char *name)
+{
+    char buf[256];
+    snprintf(buf, sizeof (buf), "%s\n    { \"group\": \"%s\", \"name\": \"%s\"",
+             report->first ? "" : ",", group, name);
+    bench_putstr(&report->json, buf);
+    report->first = false;
+    fprintf(stderr, "%s %s...\n", group, name);
+} // report_start
+
+static void report_skip(BenchReport *report, const char *group,
+                        const char *name, const char *why)
+{
+    report_start(report, group, name);
+    bench_putstr(&report->json, ", \"skipped\": \"");
+    bench_putstr(&report->json, why);
+    bench_putstr(&report->json, "\" }");
+} // report_skip
+
+// (extra) is more JSON to put in the result, like ", \"x\": 1", or NULL.
+static void run_bench(BenchReport *report, const char *group,
+                      const char *name, const char *unit, const char *extra,
+                      BenchFn fn, void *data)
+{
+    const uint32 start = MojoPlatform_ticks();
+    uint32 iterations = 0;
+    uint32 elapsed = 0;
+    int64 amount = 0;
+    char buf[256];
+
+    report_start(report, group, name);
+
+    do
+    {
+        const int64 rc = fn(data);
+        if (rc < 0)
+        {
+            bench_putstr(&report->json, ", \"failed\": true }");
+            report->failures++;
+            return;
+        } // if
+        amount += rc;
+        iterations++;
+        elapsed = MojoPlatform_ticks() - start;
+    } while (elapsed < report->benchtime);
+
+    if (elapsed == 0)
+        elapsed = 1;
+
+    snprintf(buf, sizeof (buf),
+             "%s, \"iterations\": %u, \"ms\": %u, \"%s\": %llu, \"%s_per_sec\": %.2f }",
+             (extra != NULL) ? extra : "", (unsigned int) iterations, (unsigned int) elapsed, unit,
+             (unsigned long long) amount,
+             (strcmp(unit, "bytes") == 0) ? "mb" : unit,
+             ((strcmp(unit, "bytes") == 0) ? (amount / (1024.0 * 1024.0)) :
+                                             (double) amount) /
+                (elapsed / 1000.0));
+    bench_putstr(&report->json, buf);
+} // run_bench
+
+
+typedef struct DecodeBench
+{
+    const uint8 *compressed;
+    uint32 complen;
+    const uint8 *payload;  // to check the first run against.
+    uint32 paylen;
+    boolean verify;
+    uint8 *buf;
+} DecodeBench;
+
+static int64 bench_decode(void *data)
+{
+    DecodeBench *db = (DecodeBench *) data;
+    MojoInput *io = MojoInput_newFromMemory(db->compressed, db->complen, 1);
+    MojoInput *dec = MojoInput_newCompressedStream(io);
+    int64 total = 0;
+    int64 br = 0;
+
+    if (dec == NULL)
+    {
+        io->close(io);
+        return -1;
+    } // if
+
+    while ((br = dec->read(dec, db->buf, BENCH_READSIZE)) > 0)
+    {
+        if (db->verify)
+        {
+            if ( (total + br > db->paylen) ||
+                 (memcmp(db->buf, db->payload + total, (size_t) br) != 0) )
+                br = -1;
+        } // if
+        if (br < 0)
+            break;
+        total += br;
+    } // while
+
+    dec->close(dec);
+
+    if ((br < 0) || ((db->verify) && (total != db->paylen)))
+        return -1;
+    db->verify = false;  // we trust it from here on.
+    return total;
+} // bench_decode
+
+static void bench_decoder(BenchReport *report, const char *name,
+                          const BenchBuf *compressed, const uint8 *payload,
+                          uint32 paylen)
+{
+    DecodeBench db;
+    char extra[64];
+    snprintf(extra, sizeof (extra), ", \"compressed_bytes\": %u",
+             (unsigned int) compressed->len);
+    db.compressed = compressed->data;
+    db.complen = compressed->len;
+    db.payload = payload;
+    db.paylen = paylen;
+    db.verify = true;
+    db.buf = (uint8 *) xmalloc(BENCH_READSIZE);
+    run_bench(report, "decoder", name, "bytes", extra, bench_decode, &db);
+    free(db.buf);
+} // bench_decoder
+
+
+typedef struct ArchiveBench
+{
+    const char *dirname;  // non-NULL to enumerate a real directory...
+    const char *fname;  // ...else the name the archive pretends to have...
+    const BenchBuf *archive;  // ...and its data.
+    uint32 files;
+} ArchiveBench;
+
+static int64 bench_enumerate(void *data)
+{
+    ArchiveBench *ab = (ArchiveBench *) data;
+    MojoArchive *ar = NULL;
+    int64 count = 0;
+
+    if (ab->dirname != NULL)
+        ar = MojoArchive_newFromDirectory(ab->dirname);
+    else
+    {
+        const BenchBuf *buf = ab->archive;
+        MojoInput *io = MojoInput_newFromMemory(buf->data, buf->len, 1);
+        ar = MojoArchive_newFromInput(io, ab->fname);
+    } // else
+
+    if (ar == NULL)
+        return -1;
+
+    if (ar->enumerate(ar))
+    {
+        while (ar->enumNext(ar) != NULL)
+            count++;
+    } // if
+
+    ar->close(ar);
+    return (count >= ab->files) ? count : -1;  // dirs count, too.
+} // bench_enumerate
+
+static void bench_archive(BenchReport *report, const char *name,
+                          const char *fname, const BenchBuf *archive,
+                          uint32 files)
+{
+    ArchiveBench ab;
+    ab.dirname = NULL;
+    ab.fname = fname;
+    ab.archive = archive;
+    ab.files = files;
+    run_bench(report, "archive", name, "entries", NULL, bench_enumerate, &ab);
+} // bench_archive
+
+
+typedef struct ChecksumBench
+{
+    uint32 flag;
+    const uint8 *payload;
+    uint32 paylen;
+} ChecksumBench;
+
+static int64 bench_checksum(void *data)
+{
+    ChecksumBench *cb = (ChecksumBench *) data;
+    MojoChecksumContext ctx;
+    MojoChecksums sums;
+    uint32 pos = 0;
+
+    // same size pieces as a real install feeds it.
+    MojoChecksum_init(&ctx, cb->flag);
+    while (pos < cb->paylen)
+    {
+        uint32 len = cb->paylen - pos;
+        if (len > BENCH_READSIZE)
+            len = BENCH_READSIZE;
+        MojoChecksum_append(&ctx, cb->payload + pos, len);
+        pos += len;
+    } // while
+    MojoChecksum_finish(&ctx, &sums);
+    return cb->paylen;
+} // bench_checksum
+
+
+typedef struct WriteBench
+{
+    const char *fname;  // NULL for a null sink.
+    boolean checksums;
+    const uint8 *payload;
+    uint32 paylen;
+} WriteBench;
+
+static int64 bench_write(void *data)
+{
+    WriteBench *wb = (WriteBench *) data;
+    MojoInput *in = MojoInput_newFromMemory(wb->payload, wb->paylen, 1);
+    const uint16 perms = MojoPlatform_defaultFilePerms();
+    MojoChecksums sums;
+    // Don't let it lend us the payload: with nothing to copy and nowhere
+    //  to write it, the null sink would just be timing a loop. Decompressed
+    //  archive entries come through read() anyhow.
+    in->borrow = NULL;
+    if (!MojoInput_toPhysicalFile(in, wb->fname, perms,
+                                  wb->checksums ? &sums : NULL, -1,
+                                  NULL, NULL))
+        return -1;
+    return wb->paylen;
+} // bench_write
+
+
+static uint32 bench_setting(const char *arg, uint32 deflt)
+{
+    const char *str = cmdlinestr(arg, NULL, NULL);
+    return (str == NULL) ? deflt : (uint32) strtoul(str, NULL, 10);
+} // bench_setting
+
+
+int MojoSetup_benchmark(int argc, char **argv)
+{
+    static const struct { const char *name; uint32 flag; } checksums[] =
+    {
+        { "crc32", MOJOCHECKSUM_CRC32 },
+        { "md5", MOJOCHECKSUM_MD5 },
+        { "sha1", MOJOCHECKSUM_SHA1 },
+        { "xxh128", MOJOCHECKSUM_XXH128 },
+        { "blake3", MOJOCHECKSUM_BLAKE3 },
+    };
+
+    const uint32 paylen = bench_setting("benchsize", 32) * 1024 * 1024;
+    const uint32 files = bench_setting("benchfiles", 2000);
+    const char *outfname = cmdlinestr("output", NULL, "-");
+    const char *benchdir = cmdlinestr("benchdir", NULL, "mojosetup-bench.tmp");
+    char *treedir = NULL;
+    char *writefname = NULL;
+    uint8 *payload = NULL;
+    BenchBuf tar;
+    BenchReport report;
+    char buf[256];
+    void *out = NULL;
+    uint32 i;
+
+    MojoLog_initLogging();
+
+    memset(&tar, '\0', sizeof (tar));
+    memset(&report, '\0', sizeof (report));
+    report.benchtime = bench_setting("benchtime", 1000);
+    report.first = true;
+
+    if ((paylen == 0) || (files == 0))
+    {
+        fprintf(stderr, "Nothing to do.\n");
+        return 1;
+    } // if
+
+    fprintf(stderr, "Generating %u megabytes of payload...\n",
+            (unsigned int) (paylen / (1024 * 1024)));
+    payload = make_payload(paylen);
+    make_tar(&tar, payload, paylen, files);
+
+    snprintf(buf, sizeof (buf),
+             "{\n  \"buildver\": \"%s\",\n  \"threads\": %u,\n"
+             "  \"cpus\": %u,\n  \"payload_bytes\": %u,\n"
+             "  \"archive_entries\": %u,\n  \"results\": [",
+             GBuildVer, (unsigned int) MojoWorker_count(),
+             (unsigned int) MojoPlatform_cpuCount(),
+             (unsigned int) paylen, (unsigned int) files);
+    bench_putstr(&report.json, buf);
+
+    // Decoders. Each gets the payload on its own, and a .tar of the
+    //  archive entries for the archive tests below.
+    {
+        BenchBuf gz, bz2, xz;
+        memset(&gz, '\0', sizeof (gz));
+        memset(&bz2, '\0', sizeof (bz2));
+        memset(&xz, '\0', sizeof (xz));
+
+        #if SUPPORT_GZIP
+        make_gzip(&gz, payload, paylen);
+        bench_decoder(&report, "gzip", &gz, payload, paylen);
+
+        // `cat a.gz b.gz` is a valid .gz file, too.
+        gz.len = 0;
+        make_gzip(&gz, payload, paylen / 2);
+        make_gzip(&gz, payload + (paylen / 2), paylen - (paylen / 2));
+        bench_decoder(&report, "gzip-multimember", &gz, payload, paylen);
+
+        gz.len = 0;
+        make_gzip(&gz, tar.data, tar.len);
+        #else
+        report_skip(&report, "decoder", "gzip", "not built in");
+        #endif
+
+        #if SUPPORT_BZIP2
+        if (!make_bzip2(&bz2, payload, paylen))
+            report_skip(&report, "decoder", "bzip2", "compressor failed");
+        else
+        {
+            bench_decoder(&report, "bzip2", &bz2, payload, paylen);
+
+            // pbzip2 and lbzip2 write several streams back to back.
+            bz2.len = 0;
+            if ( (!make_bzip2(&bz2, payload, paylen / 2)) ||
+                 (!make_bzip2(&bz2, payload + (paylen / 2),
+                              paylen - (paylen / 2))) )
+                report_skip(&report, "decoder", "bzip2-multistream", "compressor failed");
+            else
+                bench_decoder(&report, "bzip2-multistream", &bz2, payload, paylen);
+
+            bz2.len = 0;
+            if (!make_bzip2(&bz2, tar.data, tar.len))
+                bz2.len = 0;
+        } // else
+        #else
+        report_skip(&report, "decoder", "bzip2", "not built in");
+        #endif
+
+        #if BENCH_XZ
+        if (!make_xz(&xz, payload, paylen))
+            report_skip(&report, "decoder", "xz", "compressor failed");
+        else
+        {
+            bench_decoder(&report, "xz", &xz, payload, paylen);
+            xz.len = 0;
+            if (!make_xz(&xz, tar.data, tar.len))
+                xz.len = 0;
+        } // else
+        #elif SUPPORT_XZ
+        report_skip(&report, "decoder", "xz", "no compressor with the internal liblzma");
+        #else
+        report_skip(&report, "decoder", "xz", "not built in");
+        #endif
+
+        // Archivers...
+        #if SUPPORT_ZIP
+        {
+            BenchBuf zip;
+            memset(&zip, '\0', sizeof (zip));
+            make_zip(&zip, payload, paylen, files);
+            bench_archive(&report, "zip", "bench.zip", &zip, files);
+            free(zip.data);
+        }
+        #else
+        report_skip(&report, "archive", "zip", "not built in");
+        #endif
+
+        #if SUPPORT_TAR
+        bench_archive(&report, "tar", "bench.tar", &tar, files);
+        if (gz.len > 0)
+            bench_archive(&report, "tar.gz", "bench.tar.gz", &gz, files);
+        if (bz2.len > 0)
+            bench_archive(&report, "tar.bz2", "bench.tar.bz2", &bz2, files);
+        if (xz.len > 0)
+            bench_archive(&report, "tar.xz", "bench.tar.xz", &xz, files);
+        #else
+        report_skip(&report, "archive", "tar", "not built in");
+        #endif
+
+        free(gz.data);
+        free(bz2.data);
+        free(xz.data);
+    }
+
+    #if SUPPORT_PCK
+    {
+        BenchBuf pck;
+        memset(&pck, '\0', sizeof (pck));
+        make_pck(&pck, payload, paylen, files);
+        bench_archive(&report, "pck", "bench.pck", &pck, files);
+        free(pck.data);
+    }
+    #else
+    report_skip(&report, "archive", "pck", "not built in");
+    #endif
+
+    // UZ2 is one compressed file, not a directory of them; PKG is a whole
+    //  OS X package. Neither has an enumeration rate worth tracking.
+
+    // Checksum kernels, by themselves.
+    for (i = 0; i < STATICARRAYLEN(checksums); i++)
+    {
+        MojoChecksumContext ctx;
+        MojoChecksums sums;
+        ChecksumBench cb;
+        MojoChecksum_init(&ctx, checksums[i].flag);
+        MojoChecksum_finish(&ctx, &sums);
+        if (sums.flags == 0)
+        {
+            report_skip(&report, "checksum", checksums[i].name, "not built in");
+            continue;
+        } // if
+        cb.flag = checksums[i].flag;
+        cb.payload = payload;
+        cb.paylen = paylen;
+        run_bench(&report, "checksum", checksums[i].name, "bytes", NULL,
+                  bench_checksum, &cb);
+    } // for
+
+    if ((!MojoPlatform_mkdir(benchdir, MojoPlatform_defaultDirPerms())) &&
+        (!MojoPlatform_isdir(benchdir)))
+    {
+        report_skip(&report, "archive", "directory", "couldn't create benchdir");
+        report_skip(&report, "write", "file", "couldn't create benchdir");
+    } // if
+    else
+    {
+        ArchiveBench ab;
+        WriteBench wb;
+        boolean treeok = true;
+
+        treedir = format("%0/tree", benchdir);
+        writefname = format("%0/write.bin", benchdir);
+
+        // A real directory tree, to see what readdir() and stat() cost us.
+        treeok = MojoPlatform_mkdir(treedir, MojoPlatform_defaultDirPerms());
+        for (i = 0; (treeok) && (i < files); i++)
+        {
+            char name[64];
+            char *path;
+            snprintf(name, sizeof (name), "file%05u.dat", (unsigned int) i);
+            path = format("%0/%1", treedir, name);
+            treeok = write_file(path, payload, entry_size(i));
+            free(path);
+        } // for
+
+        if (!treeok)
+            report_skip(&report, "archive", "directory", "couldn't write files");
+        else
+        {
+            ab.dirname = treedir;
+            ab.fname = NULL;
+            ab.archive = NULL;
+            ab.files = files;
+            run_bench(&report, "archive", "directory", "entries", NULL,
+                      bench_enumerate, &ab);
+        } // else
+
+        // MojoInput_toPhysicalFile(), with and without the disk, and with
+        //  and without every checksum we have riding along.
+        MojoChecksum_setPolicy(MOJOCHECKSUM_ALL);
+        wb.payload = payload;
+        wb.paylen = paylen;
+        wb.fname = NULL;
+        wb.checksums = false;
+        run_bench(&report, "write", "null", "bytes", NULL, bench_write, &wb);
+        wb.checksums = true;
+        run_bench(&report, "write", "null+checksums", "bytes", NULL, bench_write, &wb);
+        wb.fname = writefname;
+        wb.checksums = false;
+        run_bench(&report, "write", "file", "bytes", NULL, bench_write, &wb);
+        wb.checksums = true;
+        run_bench(&report, "write", "file+checksums", "bytes", NULL, bench_write, &wb);
+
+        // clean up after ourselves.
+        MojoPlatform_unlink(writefname);
+        for (i = 0; i < files; i++)
+        {
+            char name[64];
+            char *path;
+            snprintf(name, sizeof (name), "file%05u.dat", (unsigned int) i);
+            path = format("%0/%1", treedir, name);
+            MojoPlatform_unlink(path);
+            free(path);
+        } // for
+        MojoPlatform_unlink(treedir);
+        MojoPlatform_unlink(benchdir);
+    } // else
+
+    bench_putstr(&report.json, "\n  ]\n}\n");
+
+    if (strcmp(outfname, "-") == 0)
+        out = MojoPlatform_stdout();
+    else
+    {
+        const uint32 flags = MOJOFILE_WRITE|MOJOFILE_CREATE|MOJOFILE_TRUNCATE;
+        out = MojoPlatform_open(outfname, flags, MojoPlatform_defaultFilePerms());
+    } // else
+
+    if (out == NULL)
+    {
+        fprintf(stderr, "Couldn't open '%s' for writing.\n", outfname);
+        report.failures++;
+    } // if
+    else
+    {
+        MojoPlatform_write(out, report.json.data, report.json.len);
+        MojoPlatform_close(out);
+    } // else
+
+    free(report.json.data);
+    free(tar.data);
+    free(payload);
+    free(treedir);
+    free(writefname);
+
+    MojoWorker_shutdown();
+    MojoLog_deinitLogging();
+
+    return (report.failures > 0) ? 1 : 0;
+} // MojoSetup_benchmark
+
+// end of benchmark.c ...
+
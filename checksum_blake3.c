@@ -0,0 +1,283 @@
+/**
+ * MojoSetup; a portable, flexible installation application.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ *
+ *  This file written by Ryan C. Gordon.
+ */
+
+#include "universal.h"
+
+#if SUPPORT_BLAKE3
+
+// BLAKE3, unkeyed, 256-bit output. This follows the structure of the
+//  reference implementation from the BLAKE3 spec (public domain/CC0): input
+//  is split into 1024-byte chunks, each chunk is compressed 64 bytes at a
+//  time, and finished chunks are merged into a binary tree as we go, so we
+//  only ever hold one chaining value per level.
+
+#define BLAKE3_CHUNK_START (1 << 0)
+#define BLAKE3_CHUNK_END (1 << 1)
+#define BLAKE3_PARENT (1 << 2)
+#define BLAKE3_ROOT (1 << 3)
+#define BLAKE3_CHUNK_LEN 1024
+
+static const uint32 blake3_iv[8] =
+{
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+    0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+#define ror32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define G(a, b, c, d, x, y) \
+    s[a] = s[a] + s[b] + (x); s[d] = ror32(s[d] ^ s[a], 16); \
+    s[c] = s[c] + s[d]; s[b] = ror32(s[b] ^ s[c], 12); \
+    s[a] = s[a] + s[b] + (y); s[d] = ror32(s[d] ^ s[a], 8); \
+    s[c] = s[c] + s[d]; s[b] = ror32(s[b] ^ s[c], 7);
+
+// The message words each round uses, already permuted, so we don't have to
+//  shuffle the block between rounds.
+static const uint8 blake3_schedule[7][16] =
+{
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+    { 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+    { 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+    { 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+    { 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+    { 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 },
+};
+
+// Run the compression function, leaving all sixteen output words in (out).
+//  The first eight are the chaining value.
+static void blake3_compress(const uint32 cv[8], const uint8 block[64],
+                            uint64 counter, uint32 blocklen, uint32 flags,
+                            uint32 out[16])
+{
+    uint32 m[16];
+    uint32 s[16];
+    int i;
+
+    for (i = 0; i < 16; i++)
+    {
+        const uint8 *b = block + (i * 4);
+        m[i] = ( (((uint32) b[0]) << 0) | (((uint32) b[1]) << 8) |
+                 (((uint32) b[2]) << 16) | (((uint32) b[3]) << 24) );
+    } // for
+
+    for (i = 0; i < 8; i++)
+        s[i] = cv[i];
+    s[8] = blake3_iv[0];
+    s[9] = blake3_iv[1];
+    s[10] = blake3_iv[2];
+    s[11] = blake3_iv[3];
+    s[12] = (uint32) counter;
+    s[13] = (uint32) (counter >> 32);
+    s[14] = blocklen;
+    s[15] = flags;
+
+    for (i = 0; i < 7; i++)
+    {
+        const uint8 *w = blake3_schedule[i];
+        G(0, 4, 8, 12, m[w[0]], m[w[1]]);
+        G(1, 5, 9, 13, m[w[2]], m[w[3]]);
+        G(2, 6, 10, 14, m[w[4]], m[w[5]]);
+        G(3, 7, 11, 15, m[w[6]], m[w[7]]);
+        G(0, 5, 10, 15, m[w[8]], m[w[9]]);
+        G(1, 6, 11, 12, m[w[10]], m[w[11]]);
+        G(2, 7, 8, 13, m[w[12]], m[w[13]]);
+        G(3, 4, 9, 14, m[w[14]], m[w[15]]);
+    } // for
+
+    for (i = 0; i < 8; i++)
+    {
+        out[i] = s[i] ^ s[i+8];
+        out[i+8] = s[i+8] ^ cv[i];
+    } // for
+} // blake3_compress
+
+#undef G
+#undef ror32
+
+
+static void blake3_parent(const uint32 left[8], const uint32 right[8],
+                          uint32 flags, uint32 out[16])
+{
+    uint8 block[64];
+    int i;
+    for (i = 0; i < 8; i++)
+    {
+        uint8 *l = block + (i * 4);
+        uint8 *r = block + 32 + (i * 4);
+        l[0] = (uint8) left[i]; l[1] = (uint8) (left[i] >> 8);
+        l[2] = (uint8) (left[i] >> 16); l[3] = (uint8) (left[i] >> 24);
+        r[0] = (uint8) right[i]; r[1] = (uint8) (right[i] >> 8);
+        r[2] = (uint8) (right[i] >> 16); r[3] = (uint8) (right[i] >> 24);
+    } // for
+    blake3_compress(blake3_iv, block, 0, 64, BLAKE3_PARENT | flags, out);
+} // blake3_parent
+
+
+static void blake3_compress_block(MojoBlake3 *ctx, const uint8 *block)
+{
+    const uint32 flags = (ctx->blocks == 0) ? BLAKE3_CHUNK_START : 0;
+    uint32 out[16];
+    blake3_compress(ctx->cv, block, ctx->chunk, 64, flags, out);
+    memcpy(ctx->cv, out, sizeof (ctx->cv));
+    ctx->blocks++;
+} // blake3_compress_block
+
+
+// The current chunk is full and there's more input: fold it into the tree.
+//  Every time the chunk count gains a trailing zero bit, a subtree is
+//  complete, and we merge it with its left sibling on the stack.
+static void blake3_finish_chunk(MojoBlake3 *ctx)
+{
+    uint32 cv[16];
+    uint64 total;
+
+    blake3_compress(ctx->cv, ctx->block, ctx->chunk, ctx->blocklen,
+                    BLAKE3_CHUNK_END, cv);
+
+    total = ++ctx->chunk;
+    while ((total & 1) == 0)
+    {
+        blake3_parent(ctx->stack[--ctx->stacklen], cv, 0, cv);
+        total >>= 1;
+    } // while
+    memcpy(ctx->stack[ctx->stacklen++], cv, sizeof (ctx->stack[0]));
+
+    memcpy(ctx->cv, blake3_iv, sizeof (ctx->cv));
+    ctx->blocklen = 0;
+    ctx->blocks = 0;
+} // blake3_finish_chunk
+
+
+void MojoBlake3_init(MojoBlake3 *context)
+{
+    memset(context, '\0', sizeof (MojoBlake3));
+    memcpy(context->cv, blake3_iv, sizeof (context->cv));
+} // MojoBlake3_init
+
+
+// We can't compress a block until we know it's not the last one of its
+//  chunk (the last one gets a flag), so a full block waits in the buffer
+//  until more data shows up.
+void MojoBlake3_append(MojoBlake3 *ctx, const uint8 *data, uint32 len)
+{
+    while (len > 0)
+    {
+        uint32 cpy;
+
+        if (ctx->blocklen == 64)
+        {
+            if (ctx->blocks == (BLAKE3_CHUNK_LEN / 64) - 1)
+                blake3_finish_chunk(ctx);
+            else
+            {
+                blake3_compress_block(ctx, ctx->block);
+                ctx->blocklen = 0;
+            } // else
+        } // if
+
+        // compress straight from the caller's buffer when we can.
+        while ((ctx->blocklen == 0) && (len > 64) &&
+               (ctx->blocks < (BLAKE3_CHUNK_LEN / 64) - 1))
+        {
+            blake3_compress_block(ctx, data);
+            data += 64;
+            len -= 64;
+        } // while
+
+        cpy = 64 - ctx->blocklen;
+        if (cpy > len)
+            cpy = len;
+        memcpy(ctx->block + ctx->blocklen, data, cpy);
+        ctx->blocklen += cpy;
+        data += cpy;
+        len -= cpy;
+    } // while
+} // MojoBlake3_append
+
+
+void MojoBlake3_finish(MojoBlake3 *ctx, uint8 digest[32])
+{
+    uint32 flags = BLAKE3_CHUNK_END | ((ctx->blocks == 0) ? BLAKE3_CHUNK_START : 0);
+    uint32 out[16];
+    int i;
+
+    memset(ctx->block + ctx->blocklen, '\0', 64 - ctx->blocklen);
+
+    if (ctx->stacklen == 0)  // a single chunk is the root.
+        blake3_compress(ctx->cv, ctx->block, ctx->chunk, ctx->blocklen,
+                        flags | BLAKE3_ROOT, out);
+    else
+    {
+        blake3_compress(ctx->cv, ctx->block, ctx->chunk, ctx->blocklen,
+                        flags, out);
+        while (ctx->stacklen > 1)
+            blake3_parent(ctx->stack[--ctx->stacklen], out, 0, out);
+        blake3_parent(ctx->stack[0], out, BLAKE3_ROOT, out);
+    } // else
+
+    for (i = 0; i < 8; i++)
+    {
+        digest[(i*4)+0] = (uint8) (out[i] >> 0);
+        digest[(i*4)+1] = (uint8) (out[i] >> 8);
+        digest[(i*4)+2] = (uint8) (out[i] >> 16);
+        digest[(i*4)+3] = (uint8) (out[i] >> 24);
+    } // for
+
+    memset(ctx, '\0', sizeof (MojoBlake3));
+} // MojoBlake3_finish
+
+#endif  // SUPPORT_BLAKE3
+
+#if TEST_BLAKE3
+int main(int argc, char **argv)
+{
+    int i = 0;
+    for (i = 1; i < argc; i++)
+    {
+        FILE *in = NULL;
+        MojoBlake3 ctx;
+        MojoBlake3_init(&ctx);
+        in = fopen(argv[i], "rb");
+        if (!in)
+            perror("fopen");
+        else
+        {
+            uint8 dig[32];
+            int err = 0;
+            int j;
+            while ( (!err) && (!feof(in)) )
+            {
+                uint8 buf[1024];
+                size_t rc = fread(buf, 1, sizeof (buf), in);
+                if (rc > 0)
+                    MojoBlake3_append(&ctx, buf, rc);
+                err = ferror(in);
+            } // while
+
+            if (err)
+                perror("fread");
+            fclose(in);
+            MojoBlake3_finish(&ctx, dig);
+
+            if (!err)
+            {
+                printf("%s: ", argv[i]);
+                for (j = 0; j < 32; j++)
+                    printf("%02x", (int) dig[j]);
+                printf("\n");
+            } // if
+        } // else
+    } // for
+
+    return 0;
+} // main
+#endif
+
+// end of checksum_blake3.c ...
+
@@ -6,20 +6,28 @@
  *  This file written by Ryan C. Gordon.
  */
 
+// The intrinsics headers pull in malloc(), which universal.h won't allow.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_CRC32_PCLMUL 1
+#include <immintrin.h>
+#endif
+
 #include "universal.h"
 
 #if SUPPORT_CRC32
 
-void MojoCrc32_init(MojoCrc32 *context)
-{
-    *context = (MojoCrc32) 0xFFFFFFFF;
-} // MojoCrc32_init
+// We have three ways to do this: the original bit-at-a-time loop, which
+//  needs no tables and is the reference everything else is tested against;
+//  slicing-by-8, which eats eight bytes per step with 8KB of tables we build
+//  on first use; and on x86 CPUs with PCLMULQDQ, carry-less multiplication
+//  folding 64 bytes per step (Intel's "Fast CRC Computation for Generic
+//  Polynomials Using PCLMULQDQ Instruction" paper). We pick the best one at
+//  runtime, since we can't assume anything about the CPU at build time.
 
+typedef uint32 (*Crc32Kernel)(uint32 crc, const uint8 *buf, uint32 len);
 
-void MojoCrc32_append(MojoCrc32 *_crc, const uint8 *buf, uint32 len)
+static uint32 crc32_bitwise(uint32 crc, const uint8 *buf, uint32 len)
 {
-    uint32 crc = (uint32) *_crc;
-
     uint32 n;
     for (n = 0; n < len; n++)
     {
@@ -34,8 +42,216 @@ void MojoCrc32_append(MojoCrc32 *_crc, const uint8 *buf, uint32 len)
         xorval = ((xorval & 1) ? (0xEDB88320 ^ (xorval >> 1)) : (xorval >> 1));
         crc = xorval ^ (crc >> 8);
     } // for
+    return crc;
+} // crc32_bitwise
+
+
+// crc32_table[0] is the usual byte-at-a-time table; crc32_table[k][x] is
+//  what byte (x) contributes after (k) more zero bytes go through.
+static uint32 crc32_table[8][256];
+
+static void crc32_build_tables(void)
+{
+    uint32 i, k;
+    for (i = 0; i < 256; i++)
+    {
+        const uint8 byte = (uint8) i;
+        crc32_table[0][i] = crc32_bitwise(0, &byte, 1);
+    } // for
+
+    for (k = 1; k < 8; k++)
+    {
+        for (i = 0; i < 256; i++)
+        {
+            const uint32 prev = crc32_table[k-1][i];
+            crc32_table[k][i] = (prev >> 8) ^ crc32_table[0][prev & 0xFF];
+        } // for
+    } // for
+} // crc32_build_tables
+
+static uint32 crc32_slice8(uint32 crc, const uint8 *buf, uint32 len)
+{
+    // Assembled a byte at a time so it works on any byteorder or alignment;
+    //  compilers turn this into a single load where they can.
+    while (len >= 8)
+    {
+        const uint32 lo = crc ^ ( (((uint32) buf[0]) << 0) |
+                                  (((uint32) buf[1]) << 8) |
+                                  (((uint32) buf[2]) << 16) |
+                                  (((uint32) buf[3]) << 24) );
+        const uint32 hi = ( (((uint32) buf[4]) << 0) |
+                            (((uint32) buf[5]) << 8) |
+                            (((uint32) buf[6]) << 16) |
+                            (((uint32) buf[7]) << 24) );
+        crc = crc32_table[7][lo & 0xFF] ^
+              crc32_table[6][(lo >> 8) & 0xFF] ^
+              crc32_table[5][(lo >> 16) & 0xFF] ^
+              crc32_table[4][lo >> 24] ^
+              crc32_table[3][hi & 0xFF] ^
+              crc32_table[2][(hi >> 8) & 0xFF] ^
+              crc32_table[1][(hi >> 16) & 0xFF] ^
+              crc32_table[0][hi >> 24];
+        buf += 8;
+        len -= 8;
+    } // while
+
+    while (len--)
+        crc = crc32_table[0][(crc ^ *(buf++)) & 0xFF] ^ (crc >> 8);
+
+    return crc;
+} // crc32_slice8
+
+
+#if HAVE_CRC32_PCLMUL
+// Folding constants for the reflected CRC-32 polynomial, from Intel's paper:
+//  x^(4*128+32) mod P, x^(4*128-32) mod P, x^(128+32) mod P,
+//  x^(128-32) mod P, x^64 mod P, then P' and mu for the Barrett reduction.
+static const uint64 crc32_k1k2[2] __attribute__((aligned(16))) =
+    { 0x0154442bd4ULL, 0x01c6e41596ULL };
+static const uint64 crc32_k3k4[2] __attribute__((aligned(16))) =
+    { 0x01751997d0ULL, 0x00ccaa009eULL };
+static const uint64 crc32_k5k0[2] __attribute__((aligned(16))) =
+    { 0x0163cd6124ULL, 0x0000000000ULL };
+static const uint64 crc32_poly[2] __attribute__((aligned(16))) =
+    { 0x01db710641ULL, 0x01f7011641ULL };
+
+// (len) must be at least 64 and a multiple of 16.
+__attribute__((target("pclmul,sse4.1")))
+static uint32 crc32_pclmul_blocks(uint32 crc, const uint8 *buf, uint32 len)
+{
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i *) (buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *) (buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *) (buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *) (buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) crc));
+    x0 = _mm_load_si128((const __m128i *) crc32_k1k2);
+    buf += 64;
+    len -= 64;
+
+    // Fold four 128-bit lanes in parallel, 64 bytes per step.
+    while (len >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        y5 = _mm_loadu_si128((const __m128i *) (buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i *) (buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i *) (buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i *) (buf + 0x30));
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+        buf += 64;
+        len -= 64;
+    } // while
+
+    // Fold the four lanes down into one.
+    x0 = _mm_load_si128((const __m128i *) crc32_k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // Any 16-byte blocks left over.
+    while (len >= 16)
+    {
+        x2 = _mm_loadu_si128((const __m128i *) buf);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        buf += 16;
+        len -= 16;
+    } // while
+
+    // 128 bits down to 64.
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i *) crc32_k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction down to 32.
+    x0 = _mm_load_si128((const __m128i *) crc32_poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (uint32) _mm_extract_epi32(x1, 1);
+} // crc32_pclmul_blocks
+
+static uint32 crc32_pclmul(uint32 crc, const uint8 *buf, uint32 len)
+{
+    if (len >= 64)
+    {
+        const uint32 blocks = len & ~((uint32) 15);
+        crc = crc32_pclmul_blocks(crc, buf, blocks);
+        buf += blocks;
+        len -= blocks;
+    } // if
+    return crc32_slice8(crc, buf, len);  // small stuff and leftovers.
+} // crc32_pclmul
+
+static boolean crc32_cpu_has_pclmul(void)
+{
+    __builtin_cpu_init();
+    return ( (__builtin_cpu_supports("pclmul")) &&
+             (__builtin_cpu_supports("sse4.1")) );
+} // crc32_cpu_has_pclmul
+#endif
+
+
+// Chosen on the first append. The tables are finished before this is set.
+// !!! FIXME: not thread safe! Two threads racing through here write the
+// !!! FIXME:  same values, but weakly-ordered CPUs want a memory barrier.
+static Crc32Kernel crc32_kernel = NULL;
 
-    *_crc = (MojoCrc32) crc;
+static Crc32Kernel crc32_choose_kernel(void)
+{
+    if (crc32_kernel == NULL)
+    {
+        Crc32Kernel kernel = crc32_slice8;
+        crc32_build_tables();
+        #if HAVE_CRC32_PCLMUL
+        if (crc32_cpu_has_pclmul())
+            kernel = crc32_pclmul;
+        #endif
+        crc32_kernel = kernel;
+    } // if
+    return crc32_kernel;
+} // crc32_choose_kernel
+
+
+void MojoCrc32_init(MojoCrc32 *context)
+{
+    *context = (MojoCrc32) 0xFFFFFFFF;
+} // MojoCrc32_init
+
+
+void MojoCrc32_append(MojoCrc32 *_crc, const uint8 *buf, uint32 len)
+{
+    Crc32Kernel kernel = crc32_kernel;
+    if (kernel == NULL)
+        kernel = crc32_choose_kernel();
+    *_crc = (MojoCrc32) kernel((uint32) *_crc, buf, len);
 } // MojoCrc32_append
 
 
@@ -48,9 +264,129 @@ void MojoCrc32_finish(MojoCrc32 *context, uint32 *digest)
 #endif  // SUPPORT_CRC32
 
 #if TEST_CRC32
+#include <time.h>
+
+static const char *crc32_kernel_names[] = { "bitwise", "slice8", "pclmul" };
+static const Crc32Kernel crc32_kernels[] =
+{
+    crc32_bitwise,
+    crc32_slice8,
+    #if HAVE_CRC32_PCLMUL
+    crc32_pclmul,
+    #endif
+};
+
+// Every kernel has to match the bitwise reference at every length and
+//  alignment, both in one call and fed in uneven pieces.
+static int crc32_selftest(void)
+{
+    static uint8 data[4096 + 16];
+    int failures = 0;
+    uint32 seed = 0x12345678;
+    uint32 i, k, len, align;
+
+    crc32_choose_kernel();  // builds the tables.
+
+    for (i = 0; i < sizeof (data); i++)
+    {
+        seed = (seed * 1103515245) + 12345;
+        data[i] = (uint8) (seed >> 16);
+    } // for
+
+    for (k = 1; k < STATICARRAYLEN(crc32_kernels); k++)
+    {
+        const Crc32Kernel kernel = crc32_kernels[k];
+        const int prevfailures = failures;
+
+        #if HAVE_CRC32_PCLMUL
+        if ((kernel == crc32_pclmul) && (!crc32_cpu_has_pclmul()))
+        {
+            printf("%s: not supported by this CPU\n", crc32_kernel_names[k]);
+            continue;
+        } // if
+        #endif
+
+        for (align = 0; align < 16; align++)
+        {
+            for (len = 0; len <= 4096; len += (len < 300) ? 1 : 61)
+            {
+                const uint8 *buf = data + align;
+                const uint32 want = crc32_bitwise(0xFFFFFFFF, buf, len);
+                uint32 got = kernel(0xFFFFFFFF, buf, len);
+                uint32 pos = 0;
+                uint32 piece = 1;
+
+                if (got == want)  // now try it in pieces.
+                {
+                    got = 0xFFFFFFFF;
+                    for (pos = 0; pos < len; pos += piece, piece = piece*3+1)
+                    {
+                        const uint32 n = ((len-pos) < piece) ? len-pos : piece;
+                        got = kernel(got, buf + pos, n);
+                    } // for
+                } // if
+
+                if (got != want)
+                {
+                    printf("%s: mismatch, len %u, align %u: %X vs %X\n",
+                           crc32_kernel_names[k], (unsigned int) len,
+                           (unsigned int) align, (unsigned int) got,
+                           (unsigned int) want);
+                    failures++;
+                } // if
+            } // for
+        } // for
+        printf("%s: %s\n", crc32_kernel_names[k],
+               (failures != prevfailures) ? "FAIL" : "ok");
+    } // for
+
+    return (failures != 0);
+} // crc32_selftest
+
+static int crc32_bench(void)
+{
+    static uint8 buf[1024 * 1024];
+    const uint32 len = sizeof (buf);
+    const int reps = 256;
+    uint32 k;
+
+    crc32_choose_kernel();
+    for (k = 0; k < STATICARRAYLEN(crc32_kernels); k++)
+    {
+        const Crc32Kernel kernel = crc32_kernels[k];
+        const int n = (k == 0) ? reps / 16 : reps;  // bitwise is SLOW.
+        uint32 crc = 0xFFFFFFFF;
+        clock_t start, elapsed;
+        int i;
+
+        #if HAVE_CRC32_PCLMUL
+        if ((kernel == crc32_pclmul) && (!crc32_cpu_has_pclmul()))
+            continue;
+        #endif
+
+        start = clock();
+        for (i = 0; i < n; i++)
+            crc = kernel(crc, buf, len);
+        elapsed = clock() - start;
+        if (elapsed == 0)
+            elapsed = 1;
+        printf("%s: %.1f MB/s (%X)\n", crc32_kernel_names[k],
+               ((double) n) / (((double) elapsed) / CLOCKS_PER_SEC),
+               (unsigned int) crc);
+    } // for
+
+    return 0;
+} // crc32_bench
+
 int main(int argc, char **argv)
 {
     int i = 0;
+
+    if ((argc == 2) && (strcmp(argv[1], "--selftest") == 0))
+        return crc32_selftest();
+    else if ((argc == 2) && (strcmp(argv[1], "--bench") == 0))
+        return crc32_bench();
+
     for (i = 1; i < argc; i++)
     {
         FILE *in = NULL;
@@ -6,6 +6,13 @@
  *  This file written by Ryan C. Gordon.
  */
 
+// The intrinsics headers pull in malloc(), which universal.h won't allow.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_SHA1_X86 1
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
 #include "universal.h"
 
 #if SUPPORT_SHA1
@@ -58,9 +65,8 @@ static void MojoSha1_transform(uint32 state[5], const uint8 buffer[64])
         uint8 c[64];
         uint32 l[16];
     } CHAR64LONG16;
-    CHAR64LONG16* block;
-    static uint8 workspace[64];
-    block = (CHAR64LONG16*)workspace;
+    CHAR64LONG16 workspace;  /* on the stack: workers hash in parallel. */
+    CHAR64LONG16* block = &workspace;
     memcpy(block, buffer, 64);
     /* Copy context->state[] to working vars */
     a = state[0];
@@ -98,6 +104,119 @@ static void MojoSha1_transform(uint32 state[5], const uint8 buffer[64])
 }
 
 
+// Everything below works on runs of whole 64-byte blocks. The original
+//  transform above is the reference, and what most CPUs get. x86 CPUs with
+//  the SHA extensions do four rounds per instruction instead; we check for
+//  them at runtime. (Vectorizing just the message schedule with SSSE3 was
+//  tried, and lost to what compilers make of the scalar code.)
+
+typedef void (*Sha1Kernel)(uint32 state[5], const uint8 *data, uint32 blocks);
+
+static void sha1_blocks_scalar(uint32 state[5], const uint8 *data,
+                               uint32 blocks)
+{
+    while (blocks--)
+    {
+        MojoSha1_transform(state, data);
+        data += 64;
+    } // while
+} // sha1_blocks_scalar
+
+
+#if HAVE_SHA1_X86
+
+// Four rounds at a time with the SHA extensions. M[] holds the message
+//  schedule, four words per slot, with slot (j % 4) used by rounds 4j to
+//  4j+3. While those run, we start on the schedule for later slots.
+#define SHA1NI_ROUNDS(j) \
+    e = (j == 0) ? _mm_add_epi32(E, M[0]) : _mm_sha1nexte_epu32(esave, M[j%4]); \
+    esave = abcd; \
+    abcd = _mm_sha1rnds4_epu32(abcd, e, (j) / 5); \
+    if ((j >= 3) && (j <= 18)) M[(j+1)%4] = _mm_sha1msg2_epu32(M[(j+1)%4], M[j%4]); \
+    if ((j >= 2) && (j <= 17)) M[(j+2)%4] = _mm_xor_si128(M[(j+2)%4], M[j%4]); \
+    if ((j >= 1) && (j <= 16)) M[(j+3)%4] = _mm_sha1msg1_epu32(M[(j+3)%4], M[j%4]);
+
+__attribute__((target("sha,ssse3,sse4.1")))
+static void sha1_blocks_shani(uint32 state[5], const uint8 *data,
+                              uint32 blocks)
+{
+    const __m128i bswap = _mm_set_epi8(0,1,2,3, 4,5,6,7,
+                                       8,9,10,11, 12,13,14,15);
+    __m128i abcd = _mm_loadu_si128((const __m128i *) state);
+    __m128i E = _mm_set_epi32((int) state[4], 0, 0, 0);
+    abcd = _mm_shuffle_epi32(abcd, 0x1B);  // we want A in the top lane.
+
+    while (blocks--)
+    {
+        const __m128i abcdsave = abcd;
+        __m128i M[4];
+        __m128i e, esave;
+        int i;
+
+        for (i = 0; i < 4; i++)
+        {
+            const __m128i w = _mm_loadu_si128((const __m128i *) (data+i*16));
+            M[i] = _mm_shuffle_epi8(w, bswap);
+        } // for
+
+        SHA1NI_ROUNDS(0);  SHA1NI_ROUNDS(1);  SHA1NI_ROUNDS(2);
+        SHA1NI_ROUNDS(3);  SHA1NI_ROUNDS(4);  SHA1NI_ROUNDS(5);
+        SHA1NI_ROUNDS(6);  SHA1NI_ROUNDS(7);  SHA1NI_ROUNDS(8);
+        SHA1NI_ROUNDS(9);  SHA1NI_ROUNDS(10); SHA1NI_ROUNDS(11);
+        SHA1NI_ROUNDS(12); SHA1NI_ROUNDS(13); SHA1NI_ROUNDS(14);
+        SHA1NI_ROUNDS(15); SHA1NI_ROUNDS(16); SHA1NI_ROUNDS(17);
+        SHA1NI_ROUNDS(18); SHA1NI_ROUNDS(19);
+
+        E = _mm_sha1nexte_epu32(esave, E);
+        abcd = _mm_add_epi32(abcd, abcdsave);
+        data += 64;
+    } // while
+
+    abcd = _mm_shuffle_epi32(abcd, 0x1B);
+    _mm_storeu_si128((__m128i *) state, abcd);
+    state[4] = (uint32) _mm_extract_epi32(E, 3);
+} // sha1_blocks_shani
+
+#undef SHA1NI_ROUNDS
+
+static Sha1Kernel sha1_x86_kernel(void)
+{
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    boolean ssse3 = false;
+    boolean sse41 = false;
+    boolean sha = false;
+
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    {
+        ssse3 = ((ecx & (1 << 9)) != 0);
+        sse41 = ((ecx & (1 << 19)) != 0);
+    } // if
+
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        sha = ((ebx & (1 << 29)) != 0);
+
+    return ((sha) && (ssse3) && (sse41)) ? sha1_blocks_shani : NULL;
+} // sha1_x86_kernel
+#endif
+
+
+// !!! FIXME: not thread safe! Racing threads pick the same kernel, though.
+static Sha1Kernel sha1_kernel = NULL;
+
+static Sha1Kernel sha1_choose_kernel(void)
+{
+    if (sha1_kernel == NULL)
+    {
+        Sha1Kernel kernel = NULL;
+        #if HAVE_SHA1_X86
+        kernel = sha1_x86_kernel();
+        #endif
+        sha1_kernel = (kernel != NULL) ? kernel : sha1_blocks_scalar;
+    } // if
+    return sha1_kernel;
+} // sha1_choose_kernel
+
+
 /* MojoSha1_init - Initialize new context */
 
 void MojoSha1_init(MojoSha1 *context)
@@ -117,15 +236,20 @@ void MojoSha1_init(MojoSha1 *context)
 void MojoSha1_append(MojoSha1 *context, const uint8 *data, uint32 len)
 {
     uint32 i, j;
+    Sha1Kernel kernel = sha1_kernel;
+    if (kernel == NULL)
+        kernel = sha1_choose_kernel();
 
     j = (context->count[0] >> 3) & 63;
     if ((context->count[0] += len << 3) < (len << 3)) context->count[1]++;
     context->count[1] += (len >> 29);
     if ((j + len) > 63) {
         memcpy(&context->buffer[j], data, (i = 64-j));
-        MojoSha1_transform(context->state, context->buffer);
-        for ( ; i + 63 < len; i += 64) {
-            MojoSha1_transform(context->state, &data[i]);
+        kernel(context->state, context->buffer, 1);
+        if (len - i >= 64) {
+            const uint32 blocks = (len - i) / 64;
+            kernel(context->state, &data[i], blocks);
+            i += blocks * 64;
         }
         j = 0;
     }
@@ -165,9 +289,151 @@ void MojoSha1_finish(MojoSha1 *context, uint8 digest[20])
 #endif  // SUPPORT_SHA1
 
 #if TEST_SHA1
+#include <time.h>
+
+static const char *sha1_kernel_names[] = { "scalar", "sha-ni" };
+static const Sha1Kernel sha1_kernels[] =
+{
+    sha1_blocks_scalar,
+    #if HAVE_SHA1_X86
+    sha1_blocks_shani,
+    #endif
+};
+
+static boolean sha1_kernel_usable(const Sha1Kernel kernel)
+{
+    #if HAVE_SHA1_X86
+    if (kernel == sha1_blocks_shani)
+        return (sha1_x86_kernel() == sha1_blocks_shani);
+    #endif
+    return true;
+} // sha1_kernel_usable
+
+static void sha1_digest_with(Sha1Kernel kernel, const uint8 *buf,
+                             uint32 len, uint32 piece, uint8 digest[20])
+{
+    MojoSha1 ctx;
+    uint32 pos;
+    sha1_kernel = kernel;
+    MojoSha1_init(&ctx);
+    for (pos = 0; pos < len; pos += piece, piece = (piece * 3) + 1)
+        MojoSha1_append(&ctx, buf + pos, ((len-pos) < piece) ? len-pos : piece);
+    MojoSha1_finish(&ctx, digest);
+} // sha1_digest_with
+
+// Every kernel has to produce the same digests as the original transform,
+//  for the FIPS 180-1 vectors and for random data at every alignment.
+static int sha1_selftest(void)
+{
+    static const uint8 fips[2][20] = {
+        { 0xA9,0x99,0x3E,0x36,0x47,0x06,0x81,0x6A,0xBA,0x3E,
+          0x25,0x71,0x78,0x50,0xC2,0x6C,0x9C,0xD0,0xD8,0x9D },
+        { 0x84,0x98,0x3E,0x44,0x1C,0x3B,0xD2,0x6E,0xBA,0xAE,
+          0x4A,0xA1,0xF9,0x51,0x29,0xE5,0xE5,0x46,0x70,0xF1 },
+    };
+    static const char *fipsstr[2] = {
+        "abc", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+    };
+    static uint8 data[4096 + 16];
+    uint32 seed = 0x12345678;
+    int failures = 0;
+    uint32 i, k, len, align;
+
+    for (i = 0; i < sizeof (data); i++)
+    {
+        seed = (seed * 1103515245) + 12345;
+        data[i] = (uint8) (seed >> 16);
+    } // for
+
+    for (k = 0; k < STATICARRAYLEN(sha1_kernels); k++)
+    {
+        const Sha1Kernel kernel = sha1_kernels[k];
+        const int prevfailures = failures;
+        uint8 want[20], got[20];
+
+        if (!sha1_kernel_usable(kernel))
+        {
+            printf("%s: not supported by this CPU\n", sha1_kernel_names[k]);
+            continue;
+        } // if
+
+        for (i = 0; i < 2; i++)
+        {
+            const uint8 *str = (const uint8 *) fipsstr[i];
+            sha1_digest_with(kernel, str, strlen(fipsstr[i]), 1 << 30, got);
+            if (memcmp(got, fips[i], 20) != 0)
+            {
+                printf("%s: wrong digest for \"%s\"\n",
+                       sha1_kernel_names[k], fipsstr[i]);
+                failures++;
+            } // if
+        } // for
+
+        for (align = 0; align < 16; align += 3)
+        {
+            for (len = 0; len <= 4096; len += (len < 300) ? 1 : 61)
+            {
+                const uint8 *buf = data + align;
+                sha1_digest_with(sha1_blocks_scalar, buf, len, len+1, want);
+                sha1_digest_with(kernel, buf, len, 1, got);
+                if (memcmp(got, want, 20) != 0)
+                {
+                    printf("%s: mismatch, len %u, align %u\n",
+                           sha1_kernel_names[k], (unsigned int) len,
+                           (unsigned int) align);
+                    failures++;
+                } // if
+            } // for
+        } // for
+
+        printf("%s: %s\n", sha1_kernel_names[k],
+               (failures != prevfailures) ? "FAIL" : "ok");
+    } // for
+
+    sha1_kernel = NULL;
+    return (failures != 0);
+} // sha1_selftest
+
+static int sha1_bench(void)
+{
+    static uint8 buf[1024 * 1024];
+    const int reps = 128;
+    uint32 k;
+
+    for (k = 0; k < STATICARRAYLEN(sha1_kernels); k++)
+    {
+        const Sha1Kernel kernel = sha1_kernels[k];
+        uint32 state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE,
+                            0x10325476, 0xC3D2E1F0 };
+        clock_t start, elapsed;
+        int i;
+
+        if (!sha1_kernel_usable(kernel))
+            continue;
+
+        start = clock();
+        for (i = 0; i < reps; i++)
+            kernel(state, buf, sizeof (buf) / 64);
+        elapsed = clock() - start;
+        if (elapsed == 0)
+            elapsed = 1;
+        printf("%s: %.1f MB/s (%X)\n", sha1_kernel_names[k],
+               ((double) reps) / (((double) elapsed) / CLOCKS_PER_SEC),
+               (unsigned int) state[0]);
+    } // for
+
+    return 0;
+} // sha1_bench
+
 int main(int argc, char **argv)
 {
     int i = 0;
+
+    if ((argc == 2) && (strcmp(argv[1], "--selftest") == 0))
+        return sha1_selftest();
+    else if ((argc == 2) && (strcmp(argv[1], "--bench") == 0))
+        return sha1_bench();
+
     for (i = 1; i < argc; i++)
     {
         FILE *in = NULL;
@@ -0,0 +1,95 @@
+/**
+ * MojoSetup; a portable, flexible installation application.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ *
+ *  This file written by Ryan C. Gordon.
+ */
+
+// xxhash.h's SIMD code pulls in the intrinsics headers, which use malloc(),
+//  which universal.h won't allow, so the implementation has to come first.
+//  We never ask it to allocate anything: our state lives in the context.
+#if SUPPORT_XXH128
+#define XXH_STATIC_LINKING_ONLY 1
+#define XXH_NAMESPACE MojoSetup_
+#define XXH_IMPLEMENTATION 1
+#define XXH_NO_STDLIB 1
+#include "xxhash.h"
+#endif
+
+#include "universal.h"
+
+#if SUPPORT_XXH128
+
+// XXH3-128: not cryptographic, but it catches corruption, and it runs at
+//  memory speed, so it's a good "fast" checksum for a manifest.
+
+void MojoXxh128_init(MojoXxh128 *context)
+{
+    XXH3_128bits_reset(context);
+} // MojoXxh128_init
+
+
+void MojoXxh128_append(MojoXxh128 *context, const uint8 *data, uint32 len)
+{
+    XXH3_128bits_update(context, data, (size_t) len);
+} // MojoXxh128_append
+
+
+void MojoXxh128_finish(MojoXxh128 *context, uint8 digest[16])
+{
+    // canonical form is bigendian, high half first, like xxhsum prints.
+    XXH128_canonical_t canonical;
+    XXH128_canonicalFromHash(&canonical, XXH3_128bits_digest(context));
+    memcpy(digest, canonical.digest, 16);
+} // MojoXxh128_finish
+
+#endif  // SUPPORT_XXH128
+
+#if TEST_XXH128
+int main(int argc, char **argv)
+{
+    int i = 0;
+    for (i = 1; i < argc; i++)
+    {
+        FILE *in = NULL;
+        MojoXxh128 ctx;
+        MojoXxh128_init(&ctx);
+        in = fopen(argv[i], "rb");
+        if (!in)
+            perror("fopen");
+        else
+        {
+            uint8 dig[16];
+            int err = 0;
+            int j;
+            while ( (!err) && (!feof(in)) )
+            {
+                uint8 buf[1024];
+                size_t rc = fread(buf, 1, sizeof (buf), in);
+                if (rc > 0)
+                    MojoXxh128_append(&ctx, buf, rc);
+                err = ferror(in);
+            } // while
+
+            if (err)
+                perror("fread");
+            fclose(in);
+            MojoXxh128_finish(&ctx, dig);
+
+            if (!err)
+            {
+                printf("%s: ", argv[i]);
+                for (j = 0; j < 16; j++)
+                    printf("%02x", (int) dig[j]);
+                printf("\n");
+            } // if
+        } // else
+    } // for
+
+    return 0;
+} // main
+#endif
+
+// end of checksum_xxh128.c ...
+
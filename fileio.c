@@ -50,12 +50,50 @@ static const MojoArchiveType archives[] =
 
 #define GZIP_READBUFSIZE (128 * 1024)
 
-static MojoInput *make_gzip_input(MojoInput *origio);
+// Seeking in a deflate stream means decoding everything before the target,
+//  so we keep a list of snapshots of the decoder state every so often, and
+//  resume from the closest one instead of the start of the file (this is the
+//  same idea as zlib's examples/zran.c). Each checkpoint costs about the size
+//  of miniz's inflate_state (~43k), so there's a memory cap: when we hit it,
+//  we drop every other checkpoint and double the spacing.
+// Both values can be overridden, in kilobytes, with --gzipcheckpointspacing
+//  and --gzipcheckpointmem (or the MOJOSETUP_GZIPCHECKPOINTSPACING and
+//  MOJOSETUP_GZIPCHECKPOINTMEM environment vars). A spacing of 0 disables it.
+#define GZIP_CHECKPOINT_SPACING (1024 * 1024)
+#define GZIP_CHECKPOINT_MAXMEM (32 * 1024 * 1024)
+
+static MojoInput *make_gzip_input(MojoInput *origio, const void *parent);
+
+typedef struct GZIPcheckpoint
+{
+    uint64 uncompressed_position;
+    int64 compressed_position;  // offset in origio of next unconsumed byte.
+    uint64 member_position;  // where the current member's data started.
+    MojoCrc32 crc;  // of the current member, up to here.
+    z_stream stream;  // private copy of the decoder state at this point.
+} GZIPcheckpoint;
+
+// Duplicates share this, and they might be on different threads, so
+//  everything in here is protected by (mutex).
+typedef struct GZIPindex
+{
+    void *mutex;
+    uint32 refcount;  // shared between an input and its duplicates.
+    uint64 spacing;
+    uint32 maxcheckpoints;
+    uint32 count;
+    GZIPcheckpoint *checkpoints;
+} GZIPindex;
 
 typedef struct GZIPinfo
 {
     MojoInput *origio;
+    int64 deflate_start;  // offset in origio past the gzip header.
     uint64 uncompressed_position;
+    uint64 member_position;  // `cat a.gz b.gz` is valid; this is b's start.
+    MojoCrc32 crc;  // of the current member, for its trailer.
+    boolean eof;  // past the last member.
+    GZIPindex *index;
     uint8 buffer[GZIP_READBUFSIZE];
     z_stream stream;
 } GZIPinfo;
@@ -77,6 +115,298 @@ static void initializeZStream(z_stream *pstr)
     pstr->zfree = mojoZlibFree;
 } // initializeZStream
 
+static uint64 gzipCheckpointSetting(const char *arg, const char *envr,
+                                    uint64 deflt)
+{
+    const char *str = cmdlinestr(arg, envr, NULL);
+    if (str == NULL)
+        return deflt;
+    return ((uint64) strtoul(str, NULL, 10)) * 1024;
+} // gzipCheckpointSetting
+
+static GZIPindex *gzip_index_create(void)
+{
+    GZIPindex *index = NULL;
+    uint64 spacing = gzipCheckpointSetting("gzipcheckpointspacing",
+                                           "MOJOSETUP_GZIPCHECKPOINTSPACING",
+                                           GZIP_CHECKPOINT_SPACING);
+    uint64 maxmem = gzipCheckpointSetting("gzipcheckpointmem",
+                                          "MOJOSETUP_GZIPCHECKPOINTMEM",
+                                          GZIP_CHECKPOINT_MAXMEM);
+    uint64 maxcheckpoints = maxmem / (sizeof (GZIPcheckpoint) + 48 * 1024);
+
+    if ((spacing == 0) || (maxcheckpoints < 2))
+        return NULL;  // checkpointing is disabled.
+    else if (maxcheckpoints > 0xFFFF)
+        maxcheckpoints = 0xFFFF;
+
+    index = (GZIPindex *) xmalloc(sizeof (GZIPindex));
+    index->mutex = MojoPlatform_createMutex();
+    if (index->mutex == NULL)
+    {
+        free(index);
+        return NULL;  // we'll just have to decode from the start.
+    } // if
+    index->refcount = 1;
+    index->spacing = spacing;
+    index->maxcheckpoints = (uint32) maxcheckpoints;
+    index->checkpoints = (GZIPcheckpoint *)
+                            xmalloc(sizeof (GZIPcheckpoint) * maxcheckpoints);
+    return index;
+} // gzip_index_create
+
+static void gzip_index_retain(GZIPindex *index)
+{
+    if (index != NULL)
+    {
+        MojoPlatform_lockMutex(index->mutex);
+        index->refcount++;
+        MojoPlatform_unlockMutex(index->mutex);
+    } // if
+} // gzip_index_retain
+
+static void gzip_index_release(GZIPindex *index)
+{
+    uint32 refcount;
+    uint32 i;
+    if (index == NULL)
+        return;
+
+    MojoPlatform_lockMutex(index->mutex);
+    assert(index->refcount > 0);
+    refcount = --index->refcount;
+    MojoPlatform_unlockMutex(index->mutex);
+    if (refcount > 0)
+        return;
+
+    for (i = 0; i < index->count; i++)
+        inflateEnd(&index->checkpoints[i].stream);
+    MojoPlatform_destroyMutex(index->mutex);
+    free(index->checkpoints);
+    free(index);
+} // gzip_index_release
+
+// Throw away every other checkpoint (keeping the first) to make room.
+static void gzip_index_thin(GZIPindex *index)
+{
+    uint32 i, keep = 0;
+    for (i = 0; i < index->count; i++)
+    {
+        if ((i % 2) == 1)
+            inflateEnd(&index->checkpoints[i].stream);
+        else
+            memcpy(&index->checkpoints[keep++], &index->checkpoints[i],
+                   sizeof (GZIPcheckpoint));
+    } // for
+
+    index->count = keep;
+    index->spacing *= 2;
+} // gzip_index_thin
+
+static void gzip_crc_init(MojoCrc32 *crc)
+{
+    #if SUPPORT_CRC32
+    MojoCrc32_init(crc);
+    #else
+    *crc = 0;  // without CRC-32 support, we only check the trailer's ISIZE.
+    #endif
+} // gzip_crc_init
+
+// You must hold info->index->mutex to call this!
+static void gzip_maybe_checkpoint(GZIPinfo *info)
+{
+    GZIPindex *index = info->index;
+    GZIPcheckpoint *cp = NULL;
+    uint64 next = index->spacing;
+
+    if (index->count > 0)
+        next += index->checkpoints[index->count-1].uncompressed_position;
+
+    if (info->uncompressed_position < next)
+        return;  // not far enough along, or another instance got here first.
+
+    if (index->count == index->maxcheckpoints)
+    {
+        gzip_index_thin(index);
+        gzip_maybe_checkpoint(info);  // spacing changed, check again.
+        return;
+    } // if
+
+    cp = &index->checkpoints[index->count];
+    if (inflateCopy(&cp->stream, &info->stream) != Z_OK)
+        return;
+
+    // The copy points at our read buffer (or borrowed data); restoring
+    //  reloads from origio.
+    cp->stream.next_in = NULL;
+    cp->stream.avail_in = 0;
+    cp->stream.next_out = NULL;
+    cp->stream.avail_out = 0;
+    cp->uncompressed_position = info->uncompressed_position;
+    cp->compressed_position = info->origio->tell(info->origio) -
+                                ((int64) info->stream.avail_in);
+    cp->member_position = info->member_position;
+    cp->crc = info->crc;
+    index->count++;
+} // gzip_maybe_checkpoint
+
+// Get the next (len) bytes of compressed input, whether inflate already
+//  has them buffered or they're still in origio. We use this for the gzip
+//  header and trailer, which we parse ourselves, and it never seeks, so it
+//  works on pipes, too.
+static boolean gzip_take(GZIPinfo *info, uint8 *buf, uint32 len)
+{
+    while (len > 0)
+    {
+        if (info->stream.avail_in > 0)
+        {
+            uint32 cpy = info->stream.avail_in;
+            if (cpy > len)
+                cpy = len;
+            memcpy(buf, info->stream.next_in, cpy);
+            info->stream.next_in += cpy;
+            info->stream.avail_in -= cpy;
+            buf += cpy;
+            len -= cpy;
+        } // if
+        else
+        {
+            const int64 br = info->origio->read(info->origio, buf, len);
+            if (br <= 0)
+                return false;
+            buf += br;
+            len -= (uint32) br;
+        } // else
+    } // while
+
+    return true;
+} // gzip_take
+
+static boolean gzip_skip(GZIPinfo *info, uint32 len)
+{
+    uint8 buf[256];
+    while (len > 0)
+    {
+        const uint32 cpy = (len > sizeof (buf)) ? sizeof (buf) : len;
+        if (!gzip_take(info, buf, cpy))
+            return false;
+        len -= cpy;
+    } // while
+    return true;
+} // gzip_skip
+
+// Read a gzip member header (RFC 1952), so we can inflate the raw deflate
+//  data that follows it. Returns 1 if we got one, 0 if the input is over or
+//  doesn't start with the gzip magic, and -1 if the header is broken.
+static int gzip_read_header(GZIPinfo *info)
+{
+    uint8 hdr[10];
+    uint8 flags;
+
+    if (!gzip_take(info, hdr, 2))
+        return 0;
+    else if ((hdr[0] != 0x1F) || (hdr[1] != 0x8B))
+        return 0;
+    else if (!gzip_take(info, hdr + 2, sizeof (hdr) - 2))
+        return -1;
+    else if (hdr[2] != 0x08)
+        return -1;
+
+    flags = hdr[3];
+    if (flags & 0x04)  // FEXTRA
+    {
+        uint8 xlen[2];
+        if (!gzip_take(info, xlen, sizeof (xlen)))
+            return -1;
+        if (!gzip_skip(info, ((uint32) xlen[1]) << 8 | xlen[0]))
+            return -1;
+    } // if
+
+    if (flags & 0x08)  // FNAME
+    {
+        uint8 ch = 1;
+        while (ch != 0)
+        {
+            if (!gzip_take(info, &ch, 1))
+                return -1;
+        } // while
+    } // if
+
+    if (flags & 0x10)  // FCOMMENT
+    {
+        uint8 ch = 1;
+        while (ch != 0)
+        {
+            if (!gzip_take(info, &ch, 1))
+                return -1;
+        } // while
+    } // if
+
+    if (flags & 0x02)  // FHCRC
+    {
+        if (!gzip_skip(info, 2))
+            return -1;
+    } // if
+
+    return 1;
+} // gzip_read_header
+
+// The member's deflate data ended at (position); check its trailer against
+//  what we decoded, and set up for the next member, if there is one.
+//  Returns 1 if there is, 0 if that was the last one, -1 on error.
+static int gzip_next_member(GZIPinfo *info, uint64 position)
+{
+    const uint32 isize = (uint32) (position - info->member_position);
+    z_stream *str = &info->stream;
+    const unsigned char *next_in;
+    unsigned int avail_in;
+    unsigned char *next_out;
+    unsigned int avail_out;
+    uint8 trailer[8];
+    uint32 val;
+    int rc;
+
+    // miniz reads ahead, so it might have some of the trailer already.
+    //  Its bit buffer holds less than 8 whole bytes, so never more.
+    rc = mz_inflateUnused(str, trailer);
+    assert(rc < 8);
+    if (!gzip_take(info, trailer + rc, sizeof (trailer) - rc))
+        return -1;  // truncated.
+
+    #if SUPPORT_CRC32
+    MojoCrc32_finish(&info->crc, &val);
+    if (val != ( ((uint32) trailer[0]) | (((uint32) trailer[1]) << 8) |
+                 (((uint32) trailer[2]) << 16) | (((uint32) trailer[3]) << 24) ))
+        return -1;
+    #endif
+
+    val = ( ((uint32) trailer[4]) | (((uint32) trailer[5]) << 8) |
+            (((uint32) trailer[6]) << 16) | (((uint32) trailer[7]) << 24) );
+    if (val != isize)
+        return -1;
+
+    rc = gzip_read_header(info);
+    if (rc <= 0)
+        return rc;  // anything that isn't a gzip header is junk we ignore.
+
+    next_in = str->next_in;
+    avail_in = str->avail_in;
+    next_out = str->next_out;
+    avail_out = str->avail_out;
+    inflateEnd(str);
+    initializeZStream(str);
+    if (inflateInit2(str, -MAX_WBITS) != Z_OK)
+        return -1;
+    str->next_in = next_in;
+    str->avail_in = avail_in;
+    str->next_out = next_out;
+    str->avail_out = avail_out;
+
+    info->member_position = position;
+    gzip_crc_init(&info->crc);
+    return 1;
+} // gzip_next_member
+
 static boolean MojoInput_gzip_ready(MojoInput *io)
 {
     return true;  // !!! FIXME: ready if there are bytes uncompressed.
@@ -86,22 +416,82 @@ static boolean MojoInput_gzip_seek(MojoInput *io, uint64 offset)
 {
     // This is all really expensive.
     GZIPinfo *info = (GZIPinfo *) io->opaque;
+    GZIPindex *index = info->index;
+    GZIPcheckpoint *cp = NULL;
+    boolean restored = false;
+
+    // Find the last checkpoint at or before (offset), if there is one.
+    if (index != NULL)
+    {
+        uint32 lo = 0;
+        uint32 hi;
+        MojoPlatform_lockMutex(index->mutex);
+        hi = index->count;
+        while (lo < hi)
+        {
+            const uint32 middle = lo + ((hi - lo) / 2);
+            if (index->checkpoints[middle].uncompressed_position <= offset)
+                lo = middle + 1;
+            else
+                hi = middle;
+        } // while
+
+        if (lo > 0)
+            cp = &index->checkpoints[lo - 1];
+    } // if
 
     /*
      * If seeking backwards, we need to redecode the file
-     *  from the start and throw away the compressed bits until we hit
-     *  the offset we need. If seeking forward, we still need to
-     *  decode, but we don't rewind first.
+     *  from the start (or the closest checkpoint) and throw away the
+     *  compressed bits until we hit the offset we need. If seeking forward,
+     *  we still need to decode, but we don't rewind first, unless there's
+     *  a checkpoint that gets us closer.
      */
-    if (offset < info->uncompressed_position)
+    if ((cp != NULL) && (cp->uncompressed_position > info->uncompressed_position))
+        ;  // jump ahead to the checkpoint.
+    else if (offset < info->uncompressed_position)
+        ;  // rewind to the checkpoint (or the start if cp == NULL).
+    else
+        cp = NULL;  // just decode forward from here.
+
+    if (cp != NULL)
     {
-        if (!info->origio->seek(info->origio, 0))
+        z_stream str;
+        if (inflateCopy(&str, &cp->stream) != Z_OK)
+        {
+            MojoPlatform_unlockMutex(index->mutex);
+            return false;
+        } // if
+        else if (!info->origio->seek(info->origio, cp->compressed_position))
+        {
+            MojoPlatform_unlockMutex(index->mutex);
+            inflateEnd(&str);
+            return false;
+        } // else if
+        inflateEnd(&info->stream);
+        memcpy(&info->stream, &str, sizeof (z_stream));
+        info->uncompressed_position = cp->uncompressed_position;
+        info->member_position = cp->member_position;
+        info->crc = cp->crc;
+        info->eof = false;
+        restored = true;
+    } // if
+
+    if (index != NULL)
+        MojoPlatform_unlockMutex(index->mutex);
+
+    if ((!restored) && (offset < info->uncompressed_position))
+    {
+        if (!info->origio->seek(info->origio, info->deflate_start))
             return false;
         inflateEnd(&info->stream);
         initializeZStream(&info->stream);
-        if (inflateInit2(&info->stream, 31) != Z_OK)
+        if (inflateInit2(&info->stream, -MAX_WBITS) != Z_OK)
             return false;
         info->uncompressed_position = 0;
+        info->member_position = 0;
+        gzip_crc_init(&info->crc);
+        info->eof = false;
     } // if
 
     while (info->uncompressed_position != offset)
@@ -140,6 +530,8 @@ static int64 MojoInput_gzip_read(MojoInput *io, void *buf, uint32 bufsize)
 
     if (bufsize == 0)
         return 0;    // quick rejection.
+    else if (info->eof)
+        return 0;
 
     info->stream.next_out = buf;
     info->stream.avail_out = bufsize;
@@ -147,37 +539,72 @@ static int64 MojoInput_gzip_read(MojoInput *io, void *buf, uint32 bufsize)
     while (retval < ((int64) bufsize))
     {
         const uint32 before = info->stream.total_out;
+        uint32 produced;
         int rc;
 
         if (info->stream.avail_in == 0)
         {
-            int64 br = origio->length(origio) - origio->tell(origio);
-            if (br > 0)
+            const int64 len = origio->length(origio);
+            int64 avail = GZIP_READBUFSIZE;  // if (len) is unknown, just ask.
+            int64 br = 0;
+            if (len >= 0)
+                avail = len - origio->tell(origio);
+            if (avail > 0)
             {
-                if (br > GZIP_READBUFSIZE)
-                    br = GZIP_READBUFSIZE;
+                const uint8 *ptr = NULL;
+
+                // inflate straight out of origio's memory if it'll let us.
+                if (avail > 0x7FFFFFFF)
+                    avail = 0x7FFFFFFF;
+                br = MojoInput_borrow(origio, (uint32) avail, &ptr);
+                if (br < 0)
+                {
+                    if (avail > GZIP_READBUFSIZE)
+                        avail = GZIP_READBUFSIZE;
+                    br = origio->read(origio, info->buffer, (uint32) avail);
+                    ptr = info->buffer;
+                } // if
 
-                br = origio->read(origio, info->buffer, (uint32) br);
                 if (br <= 0)
                     return -1;
 
-                info->stream.next_in = info->buffer;
+                info->stream.next_in = ptr;
                 info->stream.avail_in = (uint32) br;
             } // if
         } // if
 
         rc = inflate(&info->stream, Z_SYNC_FLUSH);
-        retval += (info->stream.total_out - before);
+        produced = info->stream.total_out - before;
+        #if SUPPORT_CRC32
+        MojoCrc32_append(&info->crc, ((const uint8 *) buf) + retval, produced);
+        #endif
+        retval += produced;
 
-        if ((rc == Z_STREAM_END) && (retval == 0))
-            return 0;
-        else if ((rc != Z_OK) && (rc != Z_STREAM_END))
+        if (rc == Z_STREAM_END)
+        {
+            rc = gzip_next_member(info, info->uncompressed_position + retval);
+            if (rc < 0)
+                return -1;
+            else if (rc == 0)
+            {
+                info->eof = true;
+                break;
+            } // else if
+        } // if
+        else if (rc != Z_OK)
             return -1;
     } // while
 
     assert(retval >= 0);
     info->uncompressed_position += (uint32) retval;
 
+    if ((info->index != NULL) && (!info->eof))
+    {
+        MojoPlatform_lockMutex(info->index->mutex);
+        gzip_maybe_checkpoint(info);
+        MojoPlatform_unlockMutex(info->index->mutex);
+    } // if
+
     return retval;
 } // MojoInput_gzip_read
 
@@ -188,9 +615,11 @@ static MojoInput* MojoInput_gzip_duplicate(MojoInput *io)
     MojoInput *newio = info->origio->duplicate(info->origio);
     if (newio != NULL)
     {
-        retval = make_gzip_input(newio);
+        // shares our checkpoints, so this seek doesn't have to decode from
+        //  the start of the stream.
+        retval = make_gzip_input(newio, info);
         if (retval != NULL)
-            retval->seek(retval, io->tell(io));  // slow, slow, slow...
+            retval->seek(retval, io->tell(io));
     } // if
     return retval;
 } // MojoInput_gzip_duplicate
@@ -200,24 +629,45 @@ static void MojoInput_gzip_close(MojoInput *io)
     GZIPinfo *info = (GZIPinfo *) io->opaque;
     if (info->origio != NULL)
         info->origio->close(info->origio);
+    gzip_index_release(info->index);
     inflateEnd(&info->stream);
     free(info);
     free(io);
 } // MojoInput_gzip_close
 
-static MojoInput *make_gzip_input(MojoInput *origio)
+static MojoInput *make_gzip_input(MojoInput *origio, const void *_parent)
 {
+    const GZIPinfo *parent = (const GZIPinfo *) _parent;
     MojoInput *io = NULL;
     GZIPinfo *info = (GZIPinfo *) xmalloc(sizeof (GZIPinfo));
 
+    // miniz only does raw deflate and zlib streams, so we parse the
+    //  gzip wrapper ourselves. The stream has no buffered input yet, so
+    //  this reads straight from (origio).
     initializeZStream(&info->stream);
-    if (inflateInit2(&info->stream, 31) != Z_OK)
+    info->origio = origio;
+    if (gzip_read_header(info) <= 0)
     {
+        origio->seek(origio, 0);
         free(info);
         return NULL;
     } // if
 
-    info->origio = origio;
+    if (inflateInit2(&info->stream, -MAX_WBITS) != Z_OK)
+    {
+        free(info);
+        return NULL;
+    } // if
+
+    info->deflate_start = origio->tell(origio);
+    gzip_crc_init(&info->crc);
+    if (parent == NULL)
+        info->index = gzip_index_create();
+    else
+    {
+        info->index = parent->index;  // (which might be NULL.)
+        gzip_index_retain(info->index);
+    } // else
 
     io = (MojoInput *) xmalloc(sizeof (MojoInput));
     io->ready = MojoInput_gzip_ready;
@@ -240,14 +690,93 @@ static MojoInput *make_gzip_input(MojoInput *origio)
 
 #define BZIP2_READBUFSIZE (128 * 1024)
 
-static MojoInput *make_bzip2_input(MojoInput *origio);
+// bzip2 compresses in independent blocks of up to 900k, each starting with
+//  a 48-bit magic number (which isn't byte-aligned). If we have worker
+//  threads and a seekable input, we search the file for these a chunk at a
+//  time on the worker pool, just far enough ahead of the decoders to know
+//  where the next few blocks end, decode several blocks at once, and hand
+//  the results back in order. The block list doubles as an index for
+//  seeking: once we've decoded past a block, we know where its uncompressed
+//  data starts.
+// The magic can show up by chance inside compressed data; if a block fails
+//  to decode, we give up on all this and fall back to the serial decoder.
+#define BZIP2_BLOCK_MAGIC 0x314159265359ULL
+#define BZIP2_EOS_MAGIC 0x177245385090ULL
+#define BZIP2_BITS48 0xFFFFFFFFFFFFULL
+#define BZIP2_MAGICBYTES 6
+#define BZIP2_SCANSIZE (1024 * 1024)
+#define BZIP2_MAXSCANS 4
+
+static MojoInput *make_bzip2_input(MojoInput *origio, const void *parent);
+
+typedef struct BZIP2block
+{
+    uint64 bitpos;  // offset of the block magic in origio, in bits.
+    uint64 bitlen;  // length of the block, in bits, magic and CRC included.
+    uint64 uncompressed_position;  // only valid if < BZIP2info::knownblocks.
+} BZIP2block;
+
+typedef struct BZIP2magic
+{
+    uint64 bitpos;  // in origio.
+    boolean eos;  // end-of-stream magic, not a block.
+} BZIP2magic;
+
+typedef struct BZIP2scanjob
+{
+    uint64 start;  // offset of data[0] in origio.
+    uint8 *data;  // raw bytes from origio, plus enough to finish a magic.
+    uint32 datalen;
+    uint32 scanlen;  // only report magic that starts in the first scanlen.
+    BZIP2magic *found;
+    uint32 foundcount;
+    MojoJob *job;
+} BZIP2scanjob;
+
+typedef struct BZIP2blockjob
+{
+    uint32 block;
+    uint8 shift;  // bits to skip at the start of (compressed).
+    uint8 *compressed;  // raw bytes from origio covering this block.
+    uint32 compressedlen;
+    uint64 bitlen;
+    uint8 *output;
+    uint32 outputlen;
+    boolean failed;
+    MojoJob *job;
+} BZIP2blockjob;
 
 typedef struct BZIP2info
 {
     MojoInput *origio;
     uint64 uncompressed_position;
+
+    // parallel mode (blocks != NULL)...
+    BZIP2block *blocks;  // (blockcount+1) entries; the last is the EOF.
+    uint32 blockcount;  // blocks found so far.
+    uint32 allocated;  // entries in (blocks).
+    uint32 knownblocks;  // blocks[0..knownblocks-1] have known positions.
+    boolean inblock;  // haven't found where blocks[blockcount-1] ends yet.
+    boolean scandone;  // searched all of origio; (blockcount) is final.
+    uint64 complen;  // length of origio.
+    uint64 scanend;  // bytes of origio handed to scan jobs so far.
+    BZIP2scanjob scans[BZIP2_MAXSCANS];  // ring buffer, in file order.
+    uint32 scanhead;
+    uint32 scancount;
+    uint32 curblock;  // block whose data is in (curbuf).
+    uint8 *curbuf;
+    uint32 curlen;
+    uint32 curpos;
+    BZIP2blockjob *pending;  // ring buffer of jobs for the following blocks.
+    uint32 maxpending;
+    uint32 pendinghead;
+    uint32 pendingcount;
+
+    // serial mode...
     uint8 buffer[BZIP2_READBUFSIZE];
     bz_stream stream;
+    uint32 streams;  // streams finished so far; pbzip2 and friends make lots.
+    boolean streamend;  // bzlib errors if we call it again after the end.
 } BZIP2info;
 
 static void *mojoBzlib2Alloc(void *opaque, int items, int size)
@@ -267,216 +796,495 @@ static void initializeBZ2Stream(bz_stream *pstr)
     pstr->bzfree = mojoBzlib2Free;
 } // initializeBZ2Stream
 
-static boolean MojoInput_bzip2_ready(MojoInput *io)
+// Runs on a worker thread: find every block (and end-of-stream) magic that
+//  starts in one chunk of the file.
+static void bzip2_scan_segment(void *data)
 {
-    return true;  // !!! FIXME: ready if there are bytes uncompressed.
-} // MojoInput_bzip2_ready
+    BZIP2scanjob *job = (BZIP2scanjob *) data;
+    const uint64 scanbits = ((uint64) job->scanlen) * 8;
+    uint32 allocated = 0;
+    uint64 reg = 0;
+    uint32 i;
+
+    MojoTrace_begin("bzip2", "block scan");
+    for (i = 0; i < job->datalen; i++)
+    {
+        const uint64 bitsseen = ((uint64) (i + 1)) * 8;
+        int k;
+        reg = (reg << 8) | job->data[i];
+        if (bitsseen < 48)
+            continue;
+
+        // check every bit alignment, earliest first.
+        for (k = 7; k >= 0; k--)
+        {
+            const uint64 val = (reg >> k) & BZIP2_BITS48;
+            uint64 pos;
+            if ((val != BZIP2_BLOCK_MAGIC) && (val != BZIP2_EOS_MAGIC))
+                continue;
+            else if (bitsseen < (uint64) (48 + k))
+                continue;
+
+            pos = bitsseen - k - 48;
+            if (pos >= scanbits)
+                continue;  // the next chunk will report this one.
+
+            if (job->foundcount >= allocated)
+            {
+                allocated = (allocated == 0) ? 16 : allocated * 2;
+                job->found = (BZIP2magic *) xrealloc(job->found,
+                                            sizeof (BZIP2magic) * allocated);
+            } // if
+            job->found[job->foundcount].bitpos = (job->start * 8) + pos;
+            job->found[job->foundcount].eos = (val == BZIP2_EOS_MAGIC);
+            job->foundcount++;
+        } // for
+    } // for
 
-static boolean MojoInput_bzip2_seek(MojoInput *io, uint64 offset)
-{
-    // This is all really expensive.
-    BZIP2info *info = (BZIP2info *) io->opaque;
+    free(job->data);
+    job->data = NULL;
+    MojoTrace_end("bzip2");
+} // bzip2_scan_segment
 
-    /*
-     * If seeking backwards, we need to redecode the file
-     *  from the start and throw away the compressed bits until we hit
-     *  the offset we need. If seeking forward, we still need to
-     *  decode, but we don't rewind first.
-     */
-    if (offset < info->uncompressed_position)
+// Read the next chunk of origio and hand it to a worker to search.
+static boolean bzip2_submit_scan(BZIP2info *info)
+{
+    const uint32 idx = (info->scanhead + info->scancount) % BZIP2_MAXSCANS;
+    BZIP2scanjob *job = &info->scans[idx];
+    MojoInput *origio = info->origio;
+    uint64 len = info->complen - info->scanend;
+    uint64 datalen;
+
+    assert(info->scancount < BZIP2_MAXSCANS);
+    assert(len > 0);
+    if (len > BZIP2_SCANSIZE)
+        len = BZIP2_SCANSIZE;
+
+    // a magic that starts near the end of this chunk runs into the next.
+    datalen = len + BZIP2_MAGICBYTES;
+    if (datalen > info->complen - info->scanend)
+        datalen = info->complen - info->scanend;
+
+    memset(job, '\0', sizeof (BZIP2scanjob));
+    job->start = info->scanend;
+    job->scanlen = (uint32) len;
+    job->datalen = (uint32) datalen;
+    job->data = (uint8 *) xmalloc(job->datalen);
+
+    if ( (!origio->seek(origio, job->start)) ||
+         (origio->read(origio, job->data, job->datalen) != job->datalen) )
     {
-#if 0
-        /* we do a copy so state is sane if inflateInit2() fails. */
-        bz_stream str;
-        initializeBZ2Stream(&str);
-        if (BZ2_bzDecompressInit(&str, 0, 0) != BZ_OK)
-            return false;
+        free(job->data);
+        return false;
+    } // if
 
-        if (!info->origio->seek(info->origio, 0))
-            return false;  // !!! FIXME: leaking (str)?
+    job->job = MojoWorker_submit(bzip2_scan_segment, job);
+    info->scancount++;
+    info->scanend += len;
+    return true;
+} // bzip2_submit_scan
 
-        BZ2_bzDecompressEnd(&info->stream);
-        memcpy(&info->stream, &str, sizeof (bz_stream));
-#endif
+// Wait for the oldest scan job and add what it found to the block list.
+static void bzip2_finish_scan(BZIP2info *info)
+{
+    BZIP2scanjob *job = &info->scans[info->scanhead];
+    uint32 i;
 
-        if (!info->origio->seek(info->origio, 0))
-            return false;
-        BZ2_bzDecompressEnd(&info->stream);
-        initializeBZ2Stream(&info->stream);
-        if (BZ2_bzDecompressInit(&info->stream, 0, 0) != BZ_OK)
-            return false;
-        info->uncompressed_position = 0;
-    } // if
+    assert(info->scancount > 0);
+    MojoWorker_wait(job->job);
+    info->scanhead = (info->scanhead + 1) % BZIP2_MAXSCANS;
+    info->scancount--;
 
-    while (info->uncompressed_position != offset)
+    for (i = 0; i < job->foundcount; i++)
     {
-        uint8 buf[512];
-        uint32 maxread;
-        int64 br;
+        const BZIP2magic *magic = &job->found[i];
+        if (info->inblock)  // this ends the previous block.
+        {
+            BZIP2block *block = &info->blocks[info->blockcount-1];
+            block->bitlen = magic->bitpos - block->bitpos;
+            info->inblock = false;
+        } // if
 
-        maxread = (uint32) (offset - info->uncompressed_position);
-        if (maxread > sizeof (buf))
-            maxread = sizeof (buf);
+        if (!magic->eos)
+        {
+            // keep room for the EOF entry after the last block.
+            if (info->blockcount+2 > info->allocated)
+            {
+                info->allocated *= 2;
+                info->blocks = (BZIP2block *) xrealloc(info->blocks,
+                                    sizeof (BZIP2block) * info->allocated);
+            } // if
 
-        br = io->read(io, buf, maxread);
-        if (br != maxread)
-            return false;
-    } /* while */
+            // don't touch uncompressed_position; we might know it already.
+            info->blocks[info->blockcount].bitpos = magic->bitpos;
+            info->blocks[info->blockcount].bitlen = 0;
+            info->blockcount++;
+            info->inblock = true;
+        } // if
+    } // for
 
-    return true;
-} // MojoInput_bzip2_seek
+    free(job->found);
+    job->found = NULL;
 
-static int64 MojoInput_bzip2_tell(MojoInput *io)
+    if ((info->scancount == 0) && (info->scanend == info->complen))
+        info->scandone = true;
+} // bzip2_finish_scan
+
+// Make sure we know where (block) starts and ends, searching more of the
+//  file if we have to. Returns 1 if we do, 0 if the file ends before
+//  (block), or -1 if the file doesn't split into blocks after all.
+static int bzip2_find_block(BZIP2info *info, uint32 block)
 {
-    return (((BZIP2info *) io->opaque)->uncompressed_position);
-} // MojoInput_bzip2_tell
+    while ( (block >= info->blockcount) ||
+            ((block == info->blockcount-1) && (info->inblock)) )
+    {
+        if (info->scandone)
+            return ((info->inblock) || (info->blockcount == 0)) ? -1 : 0;
 
-static int64 MojoInput_bzip2_length(MojoInput *io)
+        // keep a few chunks in flight, so the search stays ahead of us.
+        while ( (info->scancount < BZIP2_MAXSCANS) &&
+                (info->scanend < info->complen) )
+        {
+            if (!bzip2_submit_scan(info))
+                return -1;
+        } // while
+
+        bzip2_finish_scan(info);
+    } // while
+
+    return 1;
+} // bzip2_find_block
+
+static void bzip2_put_bits(uint8 *buf, uint64 *bitpos, uint64 val, int bits)
 {
-    return -1;
-} // MojoInput_bzip2_length
+    while (bits-- > 0)
+    {
+        if ((val >> bits) & 1)
+            buf[*bitpos / 8] |= (uint8) (0x80 >> (*bitpos % 8));
+        (*bitpos)++;
+    } // while
+} // bzip2_put_bits
 
-static int64 MojoInput_bzip2_read(MojoInput *io, void *buf, uint32 bufsize)
+// Runs on a worker thread: turn one block into a complete .bz2 stream
+//  (header, the block, end-of-stream marker, stream CRC), and decode it.
+static void bzip2_decode_block(void *data)
 {
-    BZIP2info *info = (BZIP2info *) io->opaque;
-    MojoInput *origio = info->origio;
-    int64 retval = 0;
+    BZIP2blockjob *job = (BZIP2blockjob *) data;
+    const uint8 *in = job->compressed;
+    const uint8 shift = job->shift;
+    const uint64 bytes = (job->bitlen + 7) / 8;
+    const uint64 streambits = 32 + job->bitlen + 48 + 32;
+    uint8 *stream = (uint8 *) xmalloc((size_t) ((streambits + 7) / 8) + 1);
+    uint32 alloclen = 1024 * 1024;
+    uint64 bitpos = 32 + job->bitlen;
+    uint32 crc = 0;
+    bz_stream bz;
+    uint64 i;
+    int rc;
+
+    MojoTrace_begin("bzip2", "decode block");
+
+    // "BZh9" works for any block size.
+    stream[0] = 'B'; stream[1] = 'Z'; stream[2] = 'h'; stream[3] = '9';
+    for (i = 0; i < bytes; i++)
+    {
+        uint8 val = in[i] << shift;
+        if ((shift != 0) && ((i + 1) < job->compressedlen))
+            val |= in[i + 1] >> (8 - shift);
+        stream[4 + i] = val;
+    } // for
 
-    if (bufsize == 0)
-        return 0;    // quick rejection.
+    // clear whatever trailing bits came along from the next block.
+    if (job->bitlen % 8)
+        stream[4 + bytes - 1] &= (uint8) (0xFF << (8 - (job->bitlen % 8)));
 
-    info->stream.next_out = buf;
-    info->stream.avail_out = bufsize;
+    // a single-block stream's CRC is just the block's CRC, which follows
+    //  the block magic.
+    for (i = 0; i < 4; i++)
+        crc = (crc << 8) | stream[4 + 6 + i];
 
-    while (retval < ((int64) bufsize))
+    bzip2_put_bits(stream, &bitpos, BZIP2_EOS_MAGIC, 48);
+    bzip2_put_bits(stream, &bitpos, crc, 32);
+
+    free(job->compressed);
+    job->compressed = NULL;
+
+    job->output = (uint8 *) xmalloc(alloclen);
+    job->outputlen = 0;
+    initializeBZ2Stream(&bz);
+    if (BZ2_bzDecompressInit(&bz, 0, 0) != BZ_OK)
     {
-        const uint32 before = info->stream.total_out_lo32;
-        int rc;
+        job->failed = true;
+        free(stream);
+        MojoTrace_end("bzip2");
+        return;
+    } // if
 
-        if (info->stream.avail_in == 0)
+    bz.next_in = (char *) stream;
+    bz.avail_in = (unsigned int) ((bitpos + 7) / 8);
+    do
+    {
+        const uint32 before = job->outputlen;
+        if (job->outputlen == alloclen)
         {
-            int64 br = origio->length(origio) - origio->tell(origio);
-            if (br > 0)
-            {
-                if (br > BZIP2_READBUFSIZE)
-                    br = BZIP2_READBUFSIZE;
+            alloclen *= 2;
+            job->output = (uint8 *) xrealloc(job->output, alloclen);
+        } // if
+        bz.next_out = (char *) (job->output + job->outputlen);
+        bz.avail_out = alloclen - job->outputlen;
+        rc = BZ2_bzDecompress(&bz);
+        job->outputlen = alloclen - bz.avail_out;
+
+        // a truncated block, or magic that wasn't really a block, can leave
+        //  bzlib wanting input we don't have. That's not going to change.
+        if ((rc == BZ_OK) && (bz.avail_in == 0) && (job->outputlen == before))
+            rc = BZ_UNEXPECTED_EOF;
+    } while (rc == BZ_OK);
+
+    job->failed = (rc != BZ_STREAM_END);
+    BZ2_bzDecompressEnd(&bz);
+    free(stream);
+    MojoTrace_end("bzip2");
+} // bzip2_decode_block
+
+// Read the compressed bits for (block) and hand them to a worker.
+static boolean bzip2_submit_block(BZIP2info *info, uint32 block)
+{
+    const uint32 idx = (info->pendinghead + info->pendingcount) %
+                            info->maxpending;
+    BZIP2blockjob *job = &info->pending[idx];
+    const BZIP2block *b = &info->blocks[block];
+    const uint64 firstbyte = b->bitpos / 8;
+    const uint64 lastbyte = (b->bitpos + b->bitlen + 7) / 8;
+    MojoInput *origio = info->origio;
 
-                br = origio->read(origio, info->buffer, (uint32) br);
-                if (br <= 0)
-                    return -1;
+    assert(info->pendingcount < info->maxpending);
+    memset(job, '\0', sizeof (BZIP2blockjob));
+    job->block = block;
+    job->shift = (uint8) (b->bitpos % 8);
+    job->bitlen = b->bitlen;
+    job->compressedlen = (uint32) (lastbyte - firstbyte);
+    job->compressed = (uint8 *) xmalloc(job->compressedlen);
+
+    if ( (!origio->seek(origio, firstbyte)) ||
+         (origio->read(origio, job->compressed, job->compressedlen) !=
+            job->compressedlen) )
+    {
+        free(job->compressed);
+        return false;
+    } // if
 
-                info->stream.next_in = (char *) info->buffer;
-                info->stream.avail_in = (uint32) br;
-            } // if
-        } // if
+    job->job = MojoWorker_submit(bzip2_decode_block, job);
+    info->pendingcount++;
+    return true;
+} // bzip2_submit_block
 
-        rc = BZ2_bzDecompress(&info->stream);
-        retval += (info->stream.total_out_lo32 - before);
-        if (rc != BZ_OK)
-            return -1;
+// Keep enough blocks in flight to keep all the workers busy.
+static void bzip2_fill_pipeline(BZIP2info *info)
+{
+    while (info->pendingcount < info->maxpending)
+    {
+        const uint32 block = info->curblock + 1 + info->pendingcount;
+        if (bzip2_find_block(info, block) <= 0)
+            break;  // EOF, or bzip2_advance() will notice the failure.
+        else if (!bzip2_submit_block(info, block))
+            break;  // we'll try again (and fail properly) in bzip2_advance().
     } // while
+} // bzip2_fill_pipeline
 
-    assert(retval >= 0);
-    info->uncompressed_position += (uint32) retval;
+static void bzip2_flush_pipeline(BZIP2info *info)
+{
+    while (info->pendingcount > 0)
+    {
+        BZIP2blockjob *job = &info->pending[info->pendinghead];
+        MojoWorker_wait(job->job);
+        free(job->output);
+        info->pendinghead = (info->pendinghead + 1) % info->maxpending;
+        info->pendingcount--;
+    } // while
 
-    return retval;
-} // MojoInput_bzip2_read
+    free(info->curbuf);
+    info->curbuf = NULL;
+    info->curlen = info->curpos = 0;
+} // bzip2_flush_pipeline
 
-static MojoInput* MojoInput_bzip2_duplicate(MojoInput *io)
+// Move on to the next block. Returns 1 on success, 0 at EOF, -1 on error.
+static int bzip2_advance(BZIP2info *info)
 {
-    BZIP2info *info = (BZIP2info *) io->opaque;
-    MojoInput *retval = NULL;
-    MojoInput *newio = info->origio->duplicate(info->origio);
-    if (newio != NULL)
+    BZIP2blockjob *job = NULL;
+    const boolean sequential = (info->curbuf != NULL);
+    const uint32 next = sequential ? info->curblock + 1 : info->curblock;
+    int found;
+
+    // we just finished a block, so now we know where the next one (or the
+    //  EOF) starts.
+    if ((sequential) && (next == info->knownblocks))
     {
-        retval = make_bzip2_input(newio);
-        if (retval != NULL)
-            retval->seek(retval, io->tell(io));  // slow, slow, slow...
+        assert(info->curblock < info->knownblocks);
+        info->blocks[next].uncompressed_position =
+            info->blocks[info->curblock].uncompressed_position +
+            info->curlen;
+        info->knownblocks++;
     } // if
-    return retval;
-} // MojoInput_bzip2_duplicate
 
-static void MojoInput_bzip2_close(MojoInput *io)
-{
-    BZIP2info *info = (BZIP2info *) io->opaque;
-    if (info->origio != NULL)
-        info->origio->close(info->origio);
-    BZ2_bzDecompressEnd(&info->stream);
-    free(info);
-    free(io);
-} // MojoInput_bzip2_close
+    found = bzip2_find_block(info, next);
+    if (found <= 0)
+        return found;
 
-static MojoInput *make_bzip2_input(MojoInput *origio)
-{
-    MojoInput *io = NULL;
-    BZIP2info *info = (BZIP2info *) xmalloc(sizeof (BZIP2info));
+    if (sequential)
+    {
+        free(info->curbuf);
+        info->curbuf = NULL;
+        info->curblock = next;
+    } // if
 
-    initializeBZ2Stream(&info->stream);
-    if (BZ2_bzDecompressInit(&info->stream, 0, 0) != BZ_OK)
+    if (info->pendingcount == 0)
     {
-        free(info);
-        return NULL;
+        if (!bzip2_submit_block(info, next))
+            return -1;
     } // if
 
-    info->origio = origio;
+    job = &info->pending[info->pendinghead];
+    assert(job->block == next);
+    MojoWorker_wait(job->job);
+    info->pendinghead = (info->pendinghead + 1) % info->maxpending;
+    info->pendingcount--;
 
-    io = (MojoInput *) xmalloc(sizeof (MojoInput));
-    io->ready = MojoInput_bzip2_ready;
-    io->read = MojoInput_bzip2_read;
-    io->seek = MojoInput_bzip2_seek;
-    io->tell = MojoInput_bzip2_tell;
-    io->length = MojoInput_bzip2_length;
-    io->duplicate = MojoInput_bzip2_duplicate;
-    io->close = MojoInput_bzip2_close;
-    io->opaque = info;
-    return io;
-} // make_bzip2_input
+    if (job->failed)
+    {
+        free(job->output);
+        return -1;
+    } // if
 
-#endif  // SUPPORT_BZIP2
+    info->curbuf = job->output;
+    info->curlen = job->outputlen;
+    info->curpos = 0;
 
+    // Don't start decoding ahead right after a seek; it might just be a
+    //  quick read before seeking somewhere else again.
+    if (sequential)
+        bzip2_fill_pipeline(info);
 
-#if SUPPORT_XZ
+    return 1;
+} // bzip2_advance
 
-#include "lzma.h"
+static void bzip2_free_blocks(BZIP2info *info)
+{
+    if (info->blocks != NULL)
+    {
+        while (info->scancount > 0)
+        {
+            BZIP2scanjob *job = &info->scans[info->scanhead];
+            MojoWorker_wait(job->job);
+            free(job->found);
+            info->scanhead = (info->scanhead + 1) % BZIP2_MAXSCANS;
+            info->scancount--;
+        } // while
+        bzip2_flush_pipeline(info);
+        free(info->pending);
+        free(info->blocks);
+        info->pending = NULL;
+        info->blocks = NULL;
+    } // if
+} // bzip2_free_blocks
 
-#define XZ_READBUFSIZE (128 * 1024)
+static boolean bzip2_reset_serial(BZIP2info *info)
+{
+    if (!info->origio->seek(info->origio, 0))
+        return false;
+    BZ2_bzDecompressEnd(&info->stream);
+    initializeBZ2Stream(&info->stream);
+    if (BZ2_bzDecompressInit(&info->stream, 0, 0) != BZ_OK)
+        return false;
+    info->uncompressed_position = 0;
+    info->streams = 0;
+    info->streamend = false;
+    return true;
+} // bzip2_reset_serial
 
-static MojoInput *make_xz_input(MojoInput *origio);
+static boolean MojoInput_bzip2_seek(MojoInput *io, uint64 offset);
 
-typedef struct XZinfo
+// Something didn't decode in parallel mode; start over the slow way.
+static boolean bzip2_fallback_to_serial(MojoInput *io)
 {
-    MojoInput *origio;
-    uint64 uncompressed_position;
-    uint8 buffer[XZ_READBUFSIZE];
-    lzma_stream stream;
-} XZinfo;
+    BZIP2info *info = (BZIP2info *) io->opaque;
+    const uint64 pos = info->uncompressed_position;
+    bzip2_free_blocks(info);
+    return (bzip2_reset_serial(info) && MojoInput_bzip2_seek(io, pos));
+} // bzip2_fallback_to_serial
 
-static void *mojoLzmaAlloc(void *opaque, size_t items, size_t size)
+static boolean MojoInput_bzip2_ready(MojoInput *io)
 {
-    return xmalloc(items * size);
-} // mojoLzmaAlloc
+    return true;  // !!! FIXME: ready if there are bytes uncompressed.
+} // MojoInput_bzip2_ready
 
-static void mojoLzmaFree(void *opaque, void *address)
+static boolean bzip2_parallel_seek(MojoInput *io, uint64 offset)
 {
-    free(address);
-} // mojoZlibFree
+    BZIP2info *info = (BZIP2info *) io->opaque;
+    uint32 lo = 0;
+    uint32 hi = info->knownblocks;
+    uint32 block;
+    int found;
 
-static void initializeXZStream(lzma_stream *pstr)
-{
-    static lzma_allocator lzmaAlloc = { mojoLzmaAlloc, mojoLzmaFree };
-    memset(pstr, '\0', sizeof (lzma_stream));
-    pstr->allocator = &lzmaAlloc;
-} // initializeXZStream
+    // Find the last block we know starts at or before (offset).
+    while (lo < hi)
+    {
+        const uint32 middle = lo + ((hi - lo) / 2);
+        if (info->blocks[middle].uncompressed_position <= offset)
+            lo = middle + 1;
+        else
+            hi = middle;
+    } // while
+    block = (lo > 0) ? lo - 1 : 0;
+    found = bzip2_find_block(info, block);
+    if (found < 0)
+        return bzip2_fallback_to_serial(io) && MojoInput_bzip2_seek(io, offset);
+    else if (found == 0)  // seeking to EOF.
+        block = info->blockcount - 1;
+
+    // Restart the pipeline, unless we're already decoding up to there.
+    if ( (info->curbuf == NULL) || (block < info->curblock) ||
+         (block > info->curblock + info->pendingcount) )
+    {
+        bzip2_flush_pipeline(info);
+        info->curblock = block;
+    } // if
 
-static boolean MojoInput_xz_ready(MojoInput *io)
-{
-    return true;  // !!! FIXME: ready if there are bytes uncompressed.
-} // MojoInput_xz_ready
+    if (info->curbuf == NULL)
+    {
+        const int rc = bzip2_advance(info);
+        if (rc < 0)
+            return bzip2_fallback_to_serial(io) &&
+                   MojoInput_bzip2_seek(io, offset);
+        else if (rc == 0)
+            return false;
+    } // if
 
-static boolean MojoInput_xz_seek(MojoInput *io, uint64 offset)
+    // Decode forward until we're in the right block.
+    while (offset > info->blocks[info->curblock].uncompressed_position +
+                    info->curlen)
+    {
+        const int rc = bzip2_advance(info);
+        if (rc < 0)
+            return bzip2_fallback_to_serial(io) &&
+                   MojoInput_bzip2_seek(io, offset);
+        else if (rc == 0)
+            return false;
+    } // while
+
+    info->curpos = (uint32) (offset -
+                        info->blocks[info->curblock].uncompressed_position);
+    info->uncompressed_position = offset;
+    return true;
+} // bzip2_parallel_seek
+
+static boolean MojoInput_bzip2_seek(MojoInput *io, uint64 offset)
 {
     // This is all really expensive.
-    XZinfo *info = (XZinfo *) io->opaque;
+    BZIP2info *info = (BZIP2info *) io->opaque;
+
+    if (info->blocks != NULL)
+        return bzip2_parallel_seek(io, offset);
 
     /*
      * If seeking backwards, we need to redecode the file
@@ -486,14 +1294,8 @@ static boolean MojoInput_xz_seek(MojoInput *io, uint64 offset)
      */
     if (offset < info->uncompressed_position)
     {
-        lzma_stream *strm = &info->stream;
-        if (!info->origio->seek(info->origio, 0))
-            return false;
-        lzma_end(strm);
-        initializeXZStream(strm);
-	    if (lzma_stream_decoder(strm, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+        if (!bzip2_reset_serial(info))
             return false;
-        info->uncompressed_position = 0;
     } // if
 
     while (info->uncompressed_position != offset)
@@ -512,103 +1314,201 @@ static boolean MojoInput_xz_seek(MojoInput *io, uint64 offset)
     } /* while */
 
     return true;
-} // MojoInput_xz_seek
+} // MojoInput_bzip2_seek
 
-static int64 MojoInput_xz_tell(MojoInput *io)
+static int64 MojoInput_bzip2_tell(MojoInput *io)
 {
-    return (((XZinfo *) io->opaque)->uncompressed_position);
-} // MojoInput_xz_tell
+    return (((BZIP2info *) io->opaque)->uncompressed_position);
+} // MojoInput_bzip2_tell
 
-static int64 MojoInput_xz_length(MojoInput *io)
+static int64 MojoInput_bzip2_length(MojoInput *io)
 {
     return -1;
-} // MojoInput_xz_length
+} // MojoInput_bzip2_length
 
-static int64 MojoInput_xz_read(MojoInput *io, void *buf, uint32 bufsize)
+static int64 bzip2_parallel_read(MojoInput *io, void *_buf, uint32 bufsize)
+{
+    BZIP2info *info = (BZIP2info *) io->opaque;
+    uint8 *buf = (uint8 *) _buf;
+    int64 retval = 0;
+
+    while (retval < ((int64) bufsize))
+    {
+        uint32 cpy = bufsize - ((uint32) retval);
+        if ((info->curbuf == NULL) || (info->curpos == info->curlen))
+        {
+            const int rc = bzip2_advance(info);
+            if (rc == 0)
+                break;  // EOF.
+            else if (rc < 0)
+            {
+                info->uncompressed_position += retval;
+                if (!bzip2_fallback_to_serial(io))
+                    return -1;
+                else
+                {
+                    const int64 br = io->read(io, buf + retval,
+                                              bufsize - ((uint32) retval));
+                    return (br < 0) ? -1 : retval + br;
+                } // else
+            } // else if
+            continue;
+        } // if
+
+        if (cpy > info->curlen - info->curpos)
+            cpy = info->curlen - info->curpos;
+        memcpy(buf + retval, info->curbuf + info->curpos, cpy);
+        info->curpos += cpy;
+        retval += cpy;
+    } // while
+
+    info->uncompressed_position += retval;
+    return retval;
+} // bzip2_parallel_read
+
+// Refill the serial decoder's input buffer. Returns bytes read, 0 at the
+//  end of (origio), -1 on error.
+static int64 bzip2_fill_serial(BZIP2info *info)
 {
-    XZinfo *info = (XZinfo *) io->opaque;
     MojoInput *origio = info->origio;
+    const int64 len = origio->length(origio);
+    int64 br = BZIP2_READBUFSIZE;  // if (len) is unknown, just ask.
+    if (len >= 0)
+        br = len - origio->tell(origio);
+    if (br > 0)
+    {
+        if (br > BZIP2_READBUFSIZE)
+            br = BZIP2_READBUFSIZE;
+        br = origio->read(origio, info->buffer, (uint32) br);
+        if (br > 0)
+        {
+            info->stream.next_in = (char *) info->buffer;
+            info->stream.avail_in = (uint32) br;
+        } // if
+    } // if
+
+    return (br < 0) ? -1 : br;
+} // bzip2_fill_serial
+
+// Start decoding the next of several concatenated streams, keeping
+//  whatever input and output space we were in the middle of.
+static boolean bzip2_next_stream(BZIP2info *info)
+{
+    bz_stream *bz = &info->stream;
+    char *next_in = bz->next_in;
+    const unsigned int avail_in = bz->avail_in;
+    char *next_out = bz->next_out;
+    const unsigned int avail_out = bz->avail_out;
+
+    BZ2_bzDecompressEnd(bz);
+    initializeBZ2Stream(bz);
+    if (BZ2_bzDecompressInit(bz, 0, 0) != BZ_OK)
+        return false;
+    bz->next_in = next_in;
+    bz->avail_in = avail_in;
+    bz->next_out = next_out;
+    bz->avail_out = avail_out;
+    return true;
+} // bzip2_next_stream
+
+static int64 MojoInput_bzip2_read(MojoInput *io, void *buf, uint32 bufsize)
+{
+    BZIP2info *info = (BZIP2info *) io->opaque;
     int64 retval = 0;
 
     if (bufsize == 0)
         return 0;    // quick rejection.
+    else if (info->blocks != NULL)
+        return bzip2_parallel_read(io, buf, bufsize);
+    else if (info->streamend)
+        return 0;
 
     info->stream.next_out = buf;
     info->stream.avail_out = bufsize;
 
     while (retval < ((int64) bufsize))
     {
-        const uint32 before = info->stream.total_out;
-        lzma_ret rc;
+        const uint32 before = info->stream.total_out_lo32;
+        int rc;
 
-        if (info->stream.avail_in == 0)
+        if ((info->stream.avail_in == 0) && (bzip2_fill_serial(info) < 0))
+            return -1;
+
+        rc = BZ2_bzDecompress(&info->stream);
+        retval += (info->stream.total_out_lo32 - before);
+        if (rc == BZ_STREAM_END)
         {
-            int64 br = origio->length(origio) - origio->tell(origio);
-            if (br > 0)
+            // Concatenated streams decode to the concatenated data, like
+            //  the bzip2 command line does, so keep going if there's more.
+            int64 more = info->stream.avail_in;
+            info->streams++;
+            if (more == 0)
+                more = bzip2_fill_serial(info);
+            if (more < 0)
+                return -1;
+            else if (more == 0)
             {
-                if (br > XZ_READBUFSIZE)
-                    br = XZ_READBUFSIZE;
-
-                br = origio->read(origio, info->buffer, (uint32) br);
-                if (br <= 0)
-                    return -1;
-
-                info->stream.next_in = info->buffer;
-                info->stream.avail_in = (uint32) br;
-            } // if
+                info->streamend = true;
+                break;
+            } // else if
+            else if (!bzip2_next_stream(info))
+                return -1;
         } // if
-
-        rc = lzma_code(&info->stream, LZMA_RUN);
-        retval += (info->stream.total_out - before);
-
-        if (rc != LZMA_OK)
+        else if ((rc == BZ_DATA_ERROR_MAGIC) && (info->streams > 0))
+        {
+            // Junk after a complete stream; bzip2 ignores it, so will we.
+            info->streamend = true;
+            break;
+        } // else if
+        else if (rc != BZ_OK)
             return -1;
+        else if ((info->stream.avail_in == 0) &&
+                 (info->stream.total_out_lo32 == before) &&
+                 (bzip2_fill_serial(info) <= 0))
+        {
+            return -1;  // out of input before the end of the stream.
+        } // else if
     } // while
 
     assert(retval >= 0);
     info->uncompressed_position += (uint32) retval;
 
     return retval;
-} // MojoInput_xz_read
+} // MojoInput_bzip2_read
 
-static MojoInput* MojoInput_xz_duplicate(MojoInput *io)
+static MojoInput* MojoInput_bzip2_duplicate(MojoInput *io)
 {
-    XZinfo *info = (XZinfo *) io->opaque;
+    BZIP2info *info = (BZIP2info *) io->opaque;
     MojoInput *retval = NULL;
     MojoInput *newio = info->origio->duplicate(info->origio);
     if (newio != NULL)
     {
-        retval = make_xz_input(newio);
+        retval = make_bzip2_input(newio, info);  // reuses our block list.
         if (retval != NULL)
             retval->seek(retval, io->tell(io));  // slow, slow, slow...
     } // if
     return retval;
-} // MojoInput_xz_duplicate
+} // MojoInput_bzip2_duplicate
 
-static void MojoInput_xz_close(MojoInput *io)
+static void MojoInput_bzip2_close(MojoInput *io)
 {
-    XZinfo *info = (XZinfo *) io->opaque;
+    BZIP2info *info = (BZIP2info *) io->opaque;
+    bzip2_free_blocks(info);
     if (info->origio != NULL)
         info->origio->close(info->origio);
-    lzma_end(&info->stream);
+    BZ2_bzDecompressEnd(&info->stream);
     free(info);
     free(io);
-} // MojoInput_xz_close
+} // MojoInput_bzip2_close
 
-static MojoInput *make_xz_input(MojoInput *origio)
+static MojoInput *make_bzip2_input(MojoInput *origio, const void *_parent)
 {
+    const BZIP2info *parent = (const BZIP2info *) _parent;
     MojoInput *io = NULL;
-    XZinfo *info = (XZinfo *) xmalloc(sizeof (XZinfo));
-    lzma_stream *strm = &info->stream;
+    BZIP2info *info = (BZIP2info *) xmalloc(sizeof (BZIP2info));
 
-    // UINT64_MAX is the memory usage limit (so basically, no artificial
-    //  limit here). Internally, this holds its entire dictionary in
-    //  RAM (8 megabytes by default), plus a few other structures, so we
-    //  shouldn't eat tons of memory in the normal case. Note that the
-    //  dictionary can max out at _four gigabytes_, but obviously no one does
-    //  that.
-    initializeXZStream(strm);
-	if (lzma_stream_decoder(strm, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+    initializeBZ2Stream(&info->stream);
+    if (BZ2_bzDecompressInit(&info->stream, 0, 0) != BZ_OK)
     {
         free(info);
         return NULL;
@@ -616,572 +1516,3092 @@ static MojoInput *make_xz_input(MojoInput *origio)
 
     info->origio = origio;
 
+    if ((parent != NULL) && (parent->blocks != NULL))
+    {
+        // Take what the parent has found so far, and search on from where
+        //  it had got to; its scan jobs in flight are its own business.
+        info->allocated = parent->allocated;
+        info->blocks = (BZIP2block *)
+                        xmalloc(sizeof (BZIP2block) * info->allocated);
+        memcpy(info->blocks, parent->blocks,
+               sizeof (BZIP2block) * (parent->blockcount + 1));
+        info->blockcount = parent->blockcount;
+        info->knownblocks = parent->knownblocks;
+        info->inblock = parent->inblock;
+        info->scandone = parent->scandone;
+        info->complen = parent->complen;
+        info->scanend = parent->scanend;
+        if (parent->scancount > 0)
+            info->scanend = parent->scans[parent->scanhead].start;
+    } // if
+
+    // Only bother with parallel decoding if there's something to split up.
+    else if ((parent == NULL) && (MojoWorker_count() > 1) &&
+             (origio->length(origio) > 0))
+    {
+        info->complen = (uint64) origio->length(origio);
+        info->allocated = 64;
+        info->blocks = (BZIP2block *)
+                        xmalloc(sizeof (BZIP2block) * info->allocated);
+        info->blocks[0].uncompressed_position = 0;
+        info->knownblocks = 1;
+    } // else if
+
+    if (info->blocks != NULL)
+    {
+        info->maxpending = MojoWorker_count() * 2;
+        info->pending = (BZIP2blockjob *)
+                        xmalloc(sizeof (BZIP2blockjob) * info->maxpending);
+    } // if
+
     io = (MojoInput *) xmalloc(sizeof (MojoInput));
-    io->ready = MojoInput_xz_ready;
-    io->read = MojoInput_xz_read;
-    io->seek = MojoInput_xz_seek;
-    io->tell = MojoInput_xz_tell;
-    io->length = MojoInput_xz_length;
-    io->duplicate = MojoInput_xz_duplicate;
-    io->close = MojoInput_xz_close;
+    io->ready = MojoInput_bzip2_ready;
+    io->read = MojoInput_bzip2_read;
+    io->seek = MojoInput_bzip2_seek;
+    io->tell = MojoInput_bzip2_tell;
+    io->length = MojoInput_bzip2_length;
+    io->duplicate = MojoInput_bzip2_duplicate;
+    io->close = MojoInput_bzip2_close;
     io->opaque = info;
     return io;
-} // make_xz_input
+} // make_bzip2_input
 
-#endif  // SUPPORT_XZ
+#endif  // SUPPORT_BZIP2
 
 
-MojoInput *MojoInput_newCompressedStream(MojoInput *origio)
-{
-#if SUPPORT_GZIP || SUPPORT_BZIP2 || SUPPORT_XZ
-    // Look at the first piece of the file to decide if it is compressed
-    //  by a general compression algorithm, and if so, wrap the MojoInput
-    //  in a decompressor.
-    uint8 magic[6];
-    const int64 br = origio->read(origio, magic, sizeof (magic));
-    if ((origio->seek(origio, 0)) && (br == sizeof (magic)))
-    {
-        #if SUPPORT_GZIP
-        {
-            static const uint8 gzip_sig[] = { 0x1F, 0x8B, 0x08 };
-            if (memcmp(magic, gzip_sig, sizeof (gzip_sig)) == 0)
-                return make_gzip_input(origio);
-        }
-        #endif
+#if SUPPORT_XZ
 
-        #if SUPPORT_BZIP2
-        {
-            static const uint8 bzip2_sig[] = { 0x42, 0x5A };
-            if (memcmp(magic, bzip2_sig, sizeof (bzip2_sig)) == 0)
-                return make_bzip2_input(origio);
-        }
-        #endif
+#include "lzma.h"
 
-        #if SUPPORT_XZ
-        {
-            static const uint8 xz_sig[] = { 0xFD, '7', 'z', 'X', 'Z', 0x00 };
-            if (memcmp(magic, xz_sig, sizeof (xz_sig)) == 0)
-                return make_xz_input(origio);
-        }
-        #endif
-    } // if
-#endif
+#define XZ_READBUFSIZE (128 * 1024)
 
-    return NULL;
-} // MojoInput_newCompressedStream
+// .xz files end with an index of every block in the file. If the input is
+//  seekable and has more than one block (like files from "xz -T"), we read
+//  that index up front, and decode blocks independently: seeks and
+//  duplicates go straight to the right block, and with worker threads, we
+//  decode several blocks ahead of the reader at once. Blocks can be big
+//  (xz -T uses 3x the dictionary size), so we also cap how much decoded
+//  data can be in flight.
+#define XZ_MAXINFLIGHT (256 * 1024 * 1024)
 
+static MojoInput *make_xz_input(MojoInput *origio, const void *parent);
 
-MojoArchive *MojoArchive_newFromInput(MojoInput *_io, const char *origfname)
+typedef struct XZblock
+{
+    uint64 compressed_offset;  // in origio, block header included.
+    uint64 total_size;  // header, data, padding and check.
+    uint64 uncompressed_offset;
+    uint64 uncompressed_size;
+    lzma_check check;
+} XZblock;
+
+typedef struct XZblockjob
+{
+    const XZblock *block;
+    uint8 *compressed;
+    uint8 *output;
+    boolean failed;
+    MojoJob *job;
+} XZblockjob;
+
+typedef struct XZinfo
+{
+    MojoInput *origio;
+    uint64 uncompressed_position;
+
+    // block mode (blocks != NULL)...
+    XZblock *blocks;
+    uint32 blockcount;
+    uint32 curblock;  // block whose data is in (curbuf).
+    uint8 *curbuf;
+    uint32 curpos;
+    boolean readahead;  // decode ahead on worker threads?
+    XZblockjob *pending;  // ring buffer of jobs for the following blocks.
+    uint32 maxpending;
+    uint32 pendinghead;
+    uint32 pendingcount;
+    uint64 inflight;  // uncompressed bytes of the pending jobs.
+
+    // stream mode...
+    uint8 buffer[XZ_READBUFSIZE];
+    lzma_stream stream;
+} XZinfo;
+
+static void *mojoLzmaAlloc(void *opaque, size_t items, size_t size)
+{
+    return xmalloc(items * size);
+} // mojoLzmaAlloc
+
+static void mojoLzmaFree(void *opaque, void *address)
+{
+    free(address);
+} // mojoZlibFree
+
+static lzma_allocator lzmaAlloc = { mojoLzmaAlloc, mojoLzmaFree, NULL };
+
+static void initializeXZStream(lzma_stream *pstr)
+{
+    memset(pstr, '\0', sizeof (lzma_stream));
+    pstr->allocator = &lzmaAlloc;
+} // initializeXZStream
+
+static boolean xz_read_at(MojoInput *origio, uint64 pos, void *buf, uint32 len)
+{
+    return ( (origio->seek(origio, pos)) &&
+             (origio->read(origio, buf, len) == len) );
+} // xz_read_at
+
+// Walk backwards from the end of the file, reading the index from each
+//  stream's footer (there can be several streams, with padding between).
+static lzma_index *xz_decode_index(MojoInput *origio)
+{
+    lzma_index *combined = NULL;
+    int64 pos = origio->length(origio);
+    uint8 footer[LZMA_STREAM_HEADER_SIZE];
+    uint8 header[LZMA_STREAM_HEADER_SIZE];
+
+    if ((pos <= 0) || ((pos % 4) != 0))
+        return NULL;
+
+    while (pos > 0)
+    {
+        lzma_stream_flags footerflags;
+        lzma_stream_flags headerflags;
+        lzma_index *index = NULL;
+        uint64_t memlimit = UINT64_MAX;
+        uint64 padding = 0;
+        uint8 *indexbuf = NULL;
+        size_t inpos = 0;
+        int64 indexpos;
+        lzma_ret rc;
+
+        // Skip stream padding (groups of four zero bytes).
+        while (true)
+        {
+            if ((pos < (2 * LZMA_STREAM_HEADER_SIZE)) ||
+                (!xz_read_at(origio, pos - 4, footer, 4)))
+                goto xz_index_failed;
+            else if (memcmp(footer, "\0\0\0\0", 4) != 0)
+                break;
+            pos -= 4;
+            padding += 4;
+        } // while
+
+        if (!xz_read_at(origio, pos - LZMA_STREAM_HEADER_SIZE,
+                        footer, sizeof (footer)))
+            goto xz_index_failed;
+        else if (lzma_stream_footer_decode(&footerflags, footer) != LZMA_OK)
+            goto xz_index_failed;
+
+        indexpos = pos - LZMA_STREAM_HEADER_SIZE - footerflags.backward_size;
+        if (indexpos < LZMA_STREAM_HEADER_SIZE)
+            goto xz_index_failed;
+
+        indexbuf = (uint8 *) xmalloc((size_t) footerflags.backward_size);
+        if (!xz_read_at(origio, indexpos, indexbuf,
+                        (uint32) footerflags.backward_size))
+        {
+            free(indexbuf);
+            goto xz_index_failed;
+        } // if
+
+        rc = lzma_index_buffer_decode(&index, &memlimit, &lzmaAlloc, indexbuf,
+                                      &inpos, footerflags.backward_size);
+        free(indexbuf);
+        if (rc != LZMA_OK)
+            goto xz_index_failed;
+
+        // Now we know how big this stream is, so check its header, too.
+        pos -= lzma_index_stream_size(index);
+        if ( (pos < 0) ||
+             (!xz_read_at(origio, pos, header, sizeof (header))) ||
+             (lzma_stream_header_decode(&headerflags, header) != LZMA_OK) ||
+             (lzma_stream_flags_compare(&headerflags, &footerflags) != LZMA_OK) ||
+             (lzma_index_stream_flags(index, &footerflags) != LZMA_OK) ||
+             (lzma_index_stream_padding(index, padding) != LZMA_OK) )
+        {
+            lzma_index_end(index, &lzmaAlloc);
+            goto xz_index_failed;
+        } // if
+
+        if (combined != NULL)
+        {
+            if (lzma_index_cat(index, combined, &lzmaAlloc) != LZMA_OK)
+            {
+                lzma_index_end(index, &lzmaAlloc);
+                goto xz_index_failed;
+            } // if
+        } // if
+        combined = index;
+    } // while
+
+    return combined;
+
+xz_index_failed:
+    if (combined != NULL)
+        lzma_index_end(combined, &lzmaAlloc);
+    return NULL;
+} // xz_decode_index
+
+static boolean xz_read_blocks(XZinfo *info)
+{
+    lzma_index *index = xz_decode_index(info->origio);
+    lzma_index_iter iter;
+    uint32 i = 0;
+
+    if (index == NULL)
+        return false;
+
+    // Only worth it if there's more than one block (and there aren't so
+    //  many that we can't count them).
+    if ((lzma_index_block_count(index) < 2) ||
+        (lzma_index_block_count(index) > 0xFFFFFF))
+    {
+        lzma_index_end(index, &lzmaAlloc);
+        return false;
+    } // if
+
+    info->blockcount = (uint32) lzma_index_block_count(index);
+    info->blocks = (XZblock *) xmalloc(sizeof (XZblock) * info->blockcount);
+    lzma_index_iter_init(&iter, index);
+    while (!lzma_index_iter_next(&iter, LZMA_INDEX_ITER_BLOCK))
+    {
+        XZblock *block = &info->blocks[i++];
+        block->compressed_offset = iter.block.compressed_file_offset;
+        block->total_size = iter.block.total_size;
+        block->uncompressed_offset = iter.block.uncompressed_file_offset;
+        block->uncompressed_size = iter.block.uncompressed_size;
+        block->check = iter.stream.flags->check;
+
+        // we keep whole blocks in memory and hand them out 32 bits at a time.
+        if ((block->uncompressed_size > 0x7FFFFFFF) ||
+            (block->total_size > 0x7FFFFFFF))
+            break;
+    } // while
+
+    lzma_index_end(index, &lzmaAlloc);
+
+    if (i != info->blockcount)
+    {
+        free(info->blocks);
+        info->blocks = NULL;
+        info->blockcount = 0;
+        return false;
+    } // if
+
+    return true;
+} // xz_read_blocks
+
+// Runs on a worker thread: decode one complete block.
+static void xz_decode_block(void *data)
 {
+    XZblockjob *job = (XZblockjob *) data;
+    const XZblock *b = job->block;
+    lzma_filter filters[LZMA_FILTERS_MAX + 1];
+    lzma_block block;
+    size_t inpos = 0;
+    size_t outpos = 0;
     int i;
-    MojoArchive *retval = NULL;
-    const char *ext = NULL;
-    MojoInput *io = MojoInput_newCompressedStream(_io);
-    if (io == NULL)
-        io = _io;
 
-    if (origfname != NULL)
+    job->output = (uint8 *) xmalloc((size_t) b->uncompressed_size + 1);
+    job->failed = true;
+
+    memset(&block, '\0', sizeof (block));
+    block.version = 0;
+    block.check = b->check;
+    block.filters = filters;
+    block.header_size = lzma_block_header_size_decode(job->compressed[0]);
+
+    MojoTrace_begin("xz", "decode block");
+    memset(filters, '\0', sizeof (filters));
+    if (block.header_size > b->total_size)
+        ;  // corrupt header; fail, but still free (compressed) below.
+    else if (lzma_block_header_decode(&block, &lzmaAlloc,
+                                      job->compressed) == LZMA_OK)
     {
-        ext = strrchr(origfname, '/');
-        if (ext == NULL)
-            ext = strchr(origfname, '.');
+        inpos = block.header_size;  // the decoder starts after the header.
+        if (lzma_block_buffer_decode(&block, &lzmaAlloc, job->compressed,
+                                     &inpos, (size_t) b->total_size,
+                                     job->output, &outpos,
+                                     (size_t) b->uncompressed_size) == LZMA_OK)
+        {
+            job->failed = (outpos != b->uncompressed_size);
+        } // if
+
+        for (i = 0; filters[i].id != LZMA_VLI_UNKNOWN; i++)
+            free(filters[i].options);
+    } // if
+
+    free(job->compressed);
+    job->compressed = NULL;
+    MojoTrace_end("xz");
+} // xz_decode_block
+
+static boolean xz_submit_block(XZinfo *info, uint32 block)
+{
+    const uint32 idx = (info->pendinghead + info->pendingcount) %
+                            info->maxpending;
+    XZblockjob *job = &info->pending[idx];
+    const XZblock *b = &info->blocks[block];
+
+    assert(info->pendingcount < info->maxpending);
+    memset(job, '\0', sizeof (XZblockjob));
+    job->block = b;
+    job->compressed = (uint8 *) xmalloc((size_t) b->total_size);
+    if (!xz_read_at(info->origio, b->compressed_offset, job->compressed,
+                    (uint32) b->total_size))
+    {
+        free(job->compressed);
+        return false;
+    } // if
+
+    job->job = MojoWorker_submit(xz_decode_block, job);
+    info->pendingcount++;
+    info->inflight += b->uncompressed_size;
+    return true;
+} // xz_submit_block
+
+static void xz_fill_pipeline(XZinfo *info)
+{
+    while (info->pendingcount < info->maxpending)
+    {
+        const uint32 block = info->curblock + 1 + info->pendingcount;
+        if (block >= info->blockcount)
+            break;
+        else if ((info->pendingcount > 0) &&
+                 (info->inflight + info->blocks[block].uncompressed_size >
+                    XZ_MAXINFLIGHT))
+            break;
+        else if (!xz_submit_block(info, block))
+            break;  // we'll try again (and fail properly) in xz_advance().
+    } // while
+} // xz_fill_pipeline
+
+static void xz_flush_pipeline(XZinfo *info)
+{
+    while (info->pendingcount > 0)
+    {
+        XZblockjob *job = &info->pending[info->pendinghead];
+        MojoWorker_wait(job->job);
+        free(job->output);
+        info->pendinghead = (info->pendinghead + 1) % info->maxpending;
+        info->pendingcount--;
+    } // while
+
+    info->inflight = 0;
+    free(info->curbuf);
+    info->curbuf = NULL;
+    info->curpos = 0;
+} // xz_flush_pipeline
+
+// Move on to the next block. Returns 1 on success, 0 at EOF, -1 on error.
+static int xz_advance(XZinfo *info)
+{
+    XZblockjob *job = NULL;
+    const boolean sequential = (info->curbuf != NULL);
+    const uint32 next = sequential ? info->curblock + 1 : info->curblock;
+    if (next >= info->blockcount)
+        return 0;
+
+    free(info->curbuf);
+    info->curbuf = NULL;
+    info->curblock = next;
+
+    if (info->pendingcount == 0)
+    {
+        if (!xz_submit_block(info, next))
+            return -1;
+    } // if
+
+    job = &info->pending[info->pendinghead];
+    assert(job->block == &info->blocks[next]);
+    MojoWorker_wait(job->job);
+    info->pendinghead = (info->pendinghead + 1) % info->maxpending;
+    info->pendingcount--;
+    info->inflight -= job->block->uncompressed_size;
+
+    if (job->failed)
+    {
+        free(job->output);
+        return -1;
+    } // if
+
+    info->curbuf = job->output;
+    info->curpos = 0;
+
+    // Don't start decoding ahead right after a seek; it might just be a
+    //  quick read before seeking somewhere else again.
+    if ((sequential) && (info->readahead))
+        xz_fill_pipeline(info);
+
+    return 1;
+} // xz_advance
+
+static boolean MojoInput_xz_ready(MojoInput *io)
+{
+    return true;  // !!! FIXME: ready if there are bytes uncompressed.
+} // MojoInput_xz_ready
+
+static boolean xz_block_seek(XZinfo *info, uint64 offset)
+{
+    const XZblock *last = &info->blocks[info->blockcount - 1];
+    uint32 lo = 0;
+    uint32 hi = info->blockcount;
+    uint32 block;
+
+    if (offset > last->uncompressed_offset + last->uncompressed_size)
+        return false;
+
+    while (lo < hi)
+    {
+        const uint32 middle = lo + ((hi - lo) / 2);
+        if (info->blocks[middle].uncompressed_offset <= offset)
+            lo = middle + 1;
         else
-            ext = strchr(ext+1, '.');
+            hi = middle;
+    } // while
+    block = (lo > 0) ? lo - 1 : 0;
+
+    // skip empty blocks, unless we're seeking to EOF.
+    while ( (block < info->blockcount - 1) &&
+            (offset == info->blocks[block].uncompressed_offset +
+                       info->blocks[block].uncompressed_size) )
+        block++;
+
+    if ((info->curbuf == NULL) || (block != info->curblock))
+    {
+        // Keep the pipeline if the block we want is already on its way.
+        if ( (info->curbuf == NULL) || (block < info->curblock) ||
+             (block > info->curblock + info->pendingcount) )
+        {
+            xz_flush_pipeline(info);
+            info->curblock = block;
+        } // if
+
+        do
+        {
+            if (xz_advance(info) != 1)
+                return false;
+        } while (info->curblock != block);
     } // if
 
-    while (ext != NULL)
+    info->curpos = (uint32) (offset - info->blocks[block].uncompressed_offset);
+    info->uncompressed_position = offset;
+    return true;
+} // xz_block_seek
+
+static boolean MojoInput_xz_seek(MojoInput *io, uint64 offset)
+{
+    // This is all really expensive.
+    XZinfo *info = (XZinfo *) io->opaque;
+
+    if (info->blocks != NULL)
+        return xz_block_seek(info, offset);
+
+    /*
+     * If seeking backwards, we need to redecode the file
+     *  from the start and throw away the compressed bits until we hit
+     *  the offset we need. If seeking forward, we still need to
+     *  decode, but we don't rewind first.
+     */
+    if (offset < info->uncompressed_position)
     {
-        // Try for an exact match by filename extension.
-        ext++;  // skip that '.'
-        for (i = 0; i < STATICARRAYLEN(archives); i++)
+        lzma_stream *strm = &info->stream;
+        if (!info->origio->seek(info->origio, 0))
+            return false;
+        lzma_end(strm);
+        initializeXZStream(strm);
+	    if (lzma_stream_decoder(strm, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+            return false;
+        info->uncompressed_position = 0;
+    } // if
+
+    while (info->uncompressed_position != offset)
+    {
+        uint8 buf[512];
+        uint32 maxread;
+        int64 br;
+
+        maxread = (uint32) (offset - info->uncompressed_position);
+        if (maxread > sizeof (buf))
+            maxread = sizeof (buf);
+
+        br = io->read(io, buf, maxread);
+        if (br != maxread)
+            return false;
+    } /* while */
+
+    return true;
+} // MojoInput_xz_seek
+
+static int64 MojoInput_xz_tell(MojoInput *io)
+{
+    return (((XZinfo *) io->opaque)->uncompressed_position);
+} // MojoInput_xz_tell
+
+static int64 MojoInput_xz_length(MojoInput *io)
+{
+    XZinfo *info = (XZinfo *) io->opaque;
+    if (info->blocks != NULL)  // the index tells us this for free.
+    {
+        const XZblock *last = &info->blocks[info->blockcount - 1];
+        return (int64) (last->uncompressed_offset + last->uncompressed_size);
+    } // if
+    return -1;
+} // MojoInput_xz_length
+
+static int64 xz_block_read(XZinfo *info, void *_buf, uint32 bufsize)
+{
+    uint8 *buf = (uint8 *) _buf;
+    int64 retval = 0;
+
+    while (retval < ((int64) bufsize))
+    {
+        uint32 avail;
+        uint32 cpy = bufsize - ((uint32) retval);
+
+        if (info->curbuf != NULL)
+            avail = ((uint32) info->blocks[info->curblock].uncompressed_size) -
+                    info->curpos;
+        else
+            avail = 0;
+
+        if (avail == 0)
         {
-            const MojoArchiveType *arc = &archives[i];
-            if (strcasecmp(ext, arc->ext) == 0)
-                return arc->create(io);
-        } // for
-        ext = strchr(ext, '.');
+            const int rc = xz_advance(info);
+            if (rc == 0)
+                break;  // EOF.
+            else if (rc < 0)
+                return -1;
+            continue;
+        } // if
+
+        if (cpy > avail)
+            cpy = avail;
+        memcpy(buf + retval, info->curbuf + info->curpos, cpy);
+        info->curpos += cpy;
+        retval += cpy;
     } // while
 
-    // Try any that could be determined without the file extension...
-    for (i = 0; i < STATICARRAYLEN(archives); i++)
+    info->uncompressed_position += retval;
+    return retval;
+} // xz_block_read
+
+static int64 MojoInput_xz_read(MojoInput *io, void *buf, uint32 bufsize)
+{
+    XZinfo *info = (XZinfo *) io->opaque;
+    MojoInput *origio = info->origio;
+    int64 retval = 0;
+
+    if (bufsize == 0)
+        return 0;    // quick rejection.
+    else if (info->blocks != NULL)
+        return xz_block_read(info, buf, bufsize);
+
+    info->stream.next_out = buf;
+    info->stream.avail_out = bufsize;
+
+    while (retval < ((int64) bufsize))
     {
-        const MojoArchiveType *arc = &archives[i];
-        if ((arc->hasMagic) && ((retval = arc->create(io)) != NULL))
-            return retval;
-    } // for
+        const uint32 before = info->stream.total_out;
+        lzma_action action = LZMA_RUN;
+        lzma_ret rc;
 
-    io->close(io);
-    return NULL;  // nothing can handle this data.
-} // MojoArchive_newFromInput
+        if (info->stream.avail_in == 0)
+        {
+            const int64 len = origio->length(origio);
+            int64 br = XZ_READBUFSIZE;  // if (len) is unknown, just ask.
+            if (len >= 0)
+                br = len - origio->tell(origio);
+            if (br > 0)
+            {
+                if (br > XZ_READBUFSIZE)
+                    br = XZ_READBUFSIZE;
+
+                br = origio->read(origio, info->buffer, (uint32) br);
+                if ((br < 0) || ((br == 0) && (len >= 0)))
+                    return -1;
+            } // if
 
+            if (br > 0)
+            {
+                info->stream.next_in = info->buffer;
+                info->stream.avail_in = (uint32) br;
+            } // if
+            else
+            {
+                action = LZMA_FINISH;  // LZMA_CONCATENATED needs this at EOF.
+            } // else
+        } // if
+
+        rc = lzma_code(&info->stream, action);
+        retval += (info->stream.total_out - before);
+
+        if (rc == LZMA_STREAM_END)
+            break;
+        else if (rc != LZMA_OK)
+            return -1;
+    } // while
+
+    assert(retval >= 0);
+    info->uncompressed_position += (uint32) retval;
+
+    return retval;
+} // MojoInput_xz_read
+
+static MojoInput* MojoInput_xz_duplicate(MojoInput *io)
+{
+    XZinfo *info = (XZinfo *) io->opaque;
+    MojoInput *retval = NULL;
+    MojoInput *newio = info->origio->duplicate(info->origio);
+    if (newio != NULL)
+    {
+        retval = make_xz_input(newio, info);  // reuses our block list.
+        if (retval != NULL)
+            retval->seek(retval, io->tell(io));  // slow, unless we have blocks.
+    } // if
+    return retval;
+} // MojoInput_xz_duplicate
+
+static void MojoInput_xz_close(MojoInput *io)
+{
+    XZinfo *info = (XZinfo *) io->opaque;
+    if (info->blocks != NULL)
+    {
+        xz_flush_pipeline(info);
+        free(info->pending);
+        free(info->blocks);
+    } // if
+    if (info->origio != NULL)
+        info->origio->close(info->origio);
+    lzma_end(&info->stream);
+    free(info);
+    free(io);
+} // MojoInput_xz_close
+
+static MojoInput *make_xz_input(MojoInput *origio, const void *_parent)
+{
+    const XZinfo *parent = (const XZinfo *) _parent;
+    MojoInput *io = NULL;
+    XZinfo *info = (XZinfo *) xmalloc(sizeof (XZinfo));
+    lzma_stream *strm = &info->stream;
+
+    // UINT64_MAX is the memory usage limit (so basically, no artificial
+    //  limit here). Internally, this holds its entire dictionary in
+    //  RAM (8 megabytes by default), plus a few other structures, so we
+    //  shouldn't eat tons of memory in the normal case. Note that the
+    //  dictionary can max out at _four gigabytes_, but obviously no one does
+    //  that.
+    initializeXZStream(strm);
+	if (lzma_stream_decoder(strm, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+    {
+        free(info);
+        return NULL;
+    } // if
+
+    info->origio = origio;
+
+    if (parent != NULL)
+    {
+        if (parent->blocks != NULL)
+        {
+            const size_t len = sizeof (XZblock) * parent->blockcount;
+            info->blocks = (XZblock *) xmalloc(len);
+            memcpy(info->blocks, parent->blocks, len);
+            info->blockcount = parent->blockcount;
+        } // if
+    } // if
+
+    else if (origio->length(origio) > 0)
+    {
+        xz_read_blocks(info);
+        if (!origio->seek(origio, 0))
+        {
+            free(info->blocks);
+            lzma_end(strm);
+            free(info);
+            return NULL;
+        } // if
+    } // else if
+
+    if (info->blocks != NULL)
+    {
+        info->readahead = (MojoWorker_count() > 1);
+        info->maxpending = info->readahead ? MojoWorker_count() * 2 : 1;
+        info->pending = (XZblockjob *)
+                        xmalloc(sizeof (XZblockjob) * info->maxpending);
+    } // if
+
+    io = (MojoInput *) xmalloc(sizeof (MojoInput));
+    io->ready = MojoInput_xz_ready;
+    io->read = MojoInput_xz_read;
+    io->seek = MojoInput_xz_seek;
+    io->tell = MojoInput_xz_tell;
+    io->length = MojoInput_xz_length;
+    io->duplicate = MojoInput_xz_duplicate;
+    io->close = MojoInput_xz_close;
+    io->opaque = info;
+    return io;
+} // make_xz_input
+
+#endif  // SUPPORT_XZ
+
+
+static void MojoInput_mmap_sequential(MojoInput *io);
+
+MojoInput *MojoInput_newCompressedStream(MojoInput *origio)
+{
+    MojoInput *retval = NULL;
+#if SUPPORT_GZIP || SUPPORT_BZIP2 || SUPPORT_XZ
+    // Look at the first piece of the file to decide if it is compressed
+    //  by a general compression algorithm, and if so, wrap the MojoInput
+    //  in a decompressor.
+    uint8 magic[6];
+    const int64 br = origio->read(origio, magic, sizeof (magic));
+    if ((origio->seek(origio, 0)) && (br == sizeof (magic)))
+    {
+        #if SUPPORT_GZIP
+        {
+            static const uint8 gzip_sig[] = { 0x1F, 0x8B, 0x08 };
+            if (memcmp(magic, gzip_sig, sizeof (gzip_sig)) == 0)
+                retval = make_gzip_input(origio, NULL);
+        }
+        #endif
+
+        #if SUPPORT_BZIP2
+        {
+            static const uint8 bzip2_sig[] = { 0x42, 0x5A };
+            if (memcmp(magic, bzip2_sig, sizeof (bzip2_sig)) == 0)
+                retval = make_bzip2_input(origio, NULL);
+        }
+        #endif
+
+        #if SUPPORT_XZ
+        {
+            static const uint8 xz_sig[] = { 0xFD, '7', 'z', 'X', 'Z', 0x00 };
+            if (memcmp(magic, xz_sig, sizeof (xz_sig)) == 0)
+                retval = make_xz_input(origio, NULL);
+        }
+        #endif
+    } // if
+
+    // decompressors work through their input front to back.
+    if (retval != NULL)
+        MojoInput_mmap_sequential(origio);
+#endif
+
+    return retval;
+} // MojoInput_newCompressedStream
+
+
+MojoArchive *MojoArchive_newFromInput(MojoInput *_io, const char *origfname)
+{
+    int i;
+    MojoArchive *retval = NULL;
+    const char *ext = NULL;
+    MojoInput *io = MojoInput_newCompressedStream(_io);
+    if (io == NULL)
+        io = _io;
+
+    // A stream we can only read once (see MojoInput_newForwardOnly()) gets
+    //  its decompressed side read the same way, so archivers can still sniff
+    //  it without the decompressor having to rewind its input.
+    else if (_io->length(_io) < 0)
+        io = MojoInput_newForwardOnly(io);
+
+    if (origfname != NULL)
+    {
+        ext = strrchr(origfname, '/');
+        if (ext == NULL)
+            ext = strchr(origfname, '.');
+        else
+            ext = strchr(ext+1, '.');
+    } // if
+
+    while (ext != NULL)
+    {
+        // Try for an exact match by filename extension.
+        ext++;  // skip that '.'
+        for (i = 0; i < STATICARRAYLEN(archives); i++)
+        {
+            const MojoArchiveType *arc = &archives[i];
+            if (strcasecmp(ext, arc->ext) == 0)
+                return arc->create(io);
+        } // for
+        ext = strchr(ext, '.');
+    } // while
+
+    // Try any that could be determined without the file extension...
+    for (i = 0; i < STATICARRAYLEN(archives); i++)
+    {
+        const MojoArchiveType *arc = &archives[i];
+        if ((arc->hasMagic) && ((retval = arc->create(io)) != NULL))
+            return retval;
+    } // for
+
+    io->close(io);
+    return NULL;  // nothing can handle this data.
+} // MojoArchive_newFromInput
+
+
+boolean MojoArchive_useTOC(MojoArchive *ar, MojoInput *toc, MojoInput *raw)
+{
+    boolean retval = false;
+    if (toc != NULL)
+    {
+        if (ar->useTOC != NULL)
+            retval = ar->useTOC(ar, toc, raw);
+        toc->close(toc);
+    } // if
+    return retval;
+} // MojoArchive_useTOC
+
+
+boolean MojoArchive_indexed(MojoArchive *ar)
+{
+    return ((ar->indexed != NULL) && (ar->indexed(ar)));
+} // MojoArchive_indexed
+
+
+void MojoArchive_resetEntry(MojoArchiveEntry *info)
+{
+    free(info->filename);
+    free(info->linkdest);
+    memset(info, '\0', sizeof (MojoArchiveEntry));
+} // MojoArchive_resetEntry
+
+
+// Hashing for a big file we're writing. Each digest we compute gets its own
+//  context (a "lane"), and each chunk of the file is handed to one worker job
+//  per lane, so the digests run side by side, and alongside the next read()
+//  and write(), instead of one after another on the thread doing the i/o.
+//  A lane's jobs must run in order, so we wait for its last one before
+//  submitting the next. Chunks are refcounted by the lanes still hashing
+//  them and reused when that drops to zero. Only the thread that owns the
+//  pipe touches the refcounts (they drop when it waits on a job), so they
+//  don't have to be atomic.
+#define HASHPIPE_CHUNKS 2  // one being hashed, one being filled.
+
+typedef struct HashChunk
+{
+    uint8 *buf;  // allocated the first time we read into this chunk.
+    const uint8 *ptr;  // (buf), or memory borrowed from the input.
+    uint32 len;
+    uint32 refcount;  // lanes that haven't finished hashing this.
+} HashChunk;
+
+typedef struct HashLane
+{
+    MojoChecksumContext ctx;  // only one flag set.
+    HashChunk *chunk;
+    MojoJob *job;  // NULL if nothing is pending.
+} HashLane;
+
+typedef struct HashPipe
+{
+    uint32 bufsize;
+    uint32 lanecount;
+    HashLane lanes[5];  // one per MojoChecksumFlags bit.
+    HashChunk chunks[HASHPIPE_CHUNKS];
+} HashPipe;
+
+static void hashLaneJob(void *data)
+{
+    HashLane *lane = (HashLane *) data;
+    MojoChecksum_append(&lane->ctx, lane->chunk->ptr, lane->chunk->len);
+} // hashLaneJob
+
+
+static void hashpipe_waitlane(HashLane *lane)
+{
+    if (lane->job != NULL)
+    {
+        MojoWorker_wait(lane->job);
+        lane->job = NULL;
+        lane->chunk->refcount--;
+        lane->chunk = NULL;
+    } // if
+} // hashpipe_waitlane
+
+
+// Takes over computing (ctx)'s digests; it keeps anything it was handed
+//  with MojoChecksum_useCrc32(). Returns NULL, leaving (ctx) alone, if
+//  hashing inline is just as good: no worker threads, or nothing to hash.
+static HashPipe *hashpipe_create(MojoChecksumContext *ctx, uint32 bufsize)
+{
+    const uint32 flags = ctx->flags;
+    HashPipe *pipe = NULL;
+    uint32 bit;
+
+    if (MojoWorker_count() <= 1)
+        return NULL;
+
+    pipe = (HashPipe *) xmallocAligned(sizeof (HashPipe), MOJOCHECKSUM_ALIGN);
+    pipe->bufsize = bufsize;
+    for (bit = 1; (bit & MOJOCHECKSUM_ALL) != 0; bit <<= 1)
+    {
+        HashLane *lane = &pipe->lanes[pipe->lanecount];
+        if ((flags & bit) == 0)
+            continue;
+        assert(pipe->lanecount < STATICARRAYLEN(pipe->lanes));
+        MojoChecksum_init(&lane->ctx, bit);
+        if (lane->ctx.flags != 0)  // zero if it isn't compiled in.
+            pipe->lanecount++;
+    } // for
+
+    if (pipe->lanecount == 0)
+    {
+        xfreeAligned(pipe);
+        return NULL;
+    } // if
+
+    ctx->flags = 0;
+    return pipe;
+} // hashpipe_create
+
+
+static HashChunk *hashpipe_freechunk(HashPipe *pipe)
+{
+    uint32 i;
+    while (true)
+    {
+        for (i = 0; i < HASHPIPE_CHUNKS; i++)
+        {
+            if (pipe->chunks[i].refcount == 0)
+                return &pipe->chunks[i];
+        } // for
+
+        // everything's still being hashed; wait for the lanes to catch up.
+        for (i = 0; i < pipe->lanecount; i++)
+            hashpipe_waitlane(&pipe->lanes[i]);
+    } // while
+} // hashpipe_freechunk
+
+
+// A buffer to read the next chunk into, instead of scratchbuf_128k, which
+//  a worker might still be hashing.
+static uint8 *hashpipe_buffer(HashPipe *pipe)
+{
+    HashChunk *chunk = hashpipe_freechunk(pipe);
+    if (chunk->buf == NULL)
+        chunk->buf = (uint8 *) xmalloc(pipe->bufsize);
+    return chunk->buf;
+} // hashpipe_buffer
+
+
+// (ptr) is either from hashpipe_buffer(), or borrowed from an input that
+//  stays open until hashpipe_finish().
+static void hashpipe_append(HashPipe *pipe, const uint8 *ptr, uint32 len)
+{
+    HashChunk *chunk = NULL;
+    uint32 i;
+
+    for (i = 0; i < HASHPIPE_CHUNKS; i++)
+    {
+        if (pipe->chunks[i].buf == ptr)
+            chunk = &pipe->chunks[i];
+    } // for
+
+    if (chunk == NULL)  // borrowed memory; just needs a chunk to track it.
+        chunk = hashpipe_freechunk(pipe);
+
+    assert(chunk->refcount == 0);
+    chunk->ptr = ptr;
+    chunk->len = len;
+    chunk->refcount = pipe->lanecount;
+
+    for (i = 0; i < pipe->lanecount; i++)
+    {
+        HashLane *lane = &pipe->lanes[i];
+        hashpipe_waitlane(lane);
+        lane->chunk = chunk;
+        lane->job = MojoWorker_submit(hashLaneJob, lane);
+    } // for
+} // hashpipe_append
+
+
+// Waits for all the hashing to finish and frees (pipe). If (sums) isn't
+//  NULL, the digests are added to it.
+static void hashpipe_finish(HashPipe *pipe, MojoChecksums *sums)
+{
+    uint32 i;
+
+    for (i = 0; i < pipe->lanecount; i++)
+        hashpipe_waitlane(&pipe->lanes[i]);
+
+    if (sums != NULL)
+    {
+        for (i = 0; i < pipe->lanecount; i++)
+        {
+            MojoChecksums lanesums;
+            MojoChecksum_finish(&pipe->lanes[i].ctx, &lanesums);
+            sums->flags |= lanesums.flags;
+            if (lanesums.flags & MOJOCHECKSUM_CRC32)
+                sums->crc32 = lanesums.crc32;
+            if (lanesums.flags & MOJOCHECKSUM_MD5)
+                memcpy(sums->md5, lanesums.md5, sizeof (sums->md5));
+            if (lanesums.flags & MOJOCHECKSUM_SHA1)
+                memcpy(sums->sha1, lanesums.sha1, sizeof (sums->sha1));
+            if (lanesums.flags & MOJOCHECKSUM_XXH128)
+                memcpy(sums->xxh128, lanesums.xxh128, sizeof (sums->xxh128));
+            if (lanesums.flags & MOJOCHECKSUM_BLAKE3)
+                memcpy(sums->blake3, lanesums.blake3, sizeof (sums->blake3));
+        } // for
+    } // if
+
+    for (i = 0; i < HASHPIPE_CHUNKS; i++)
+        free(pipe->chunks[i].buf);
+    xfreeAligned(pipe);
+} // hashpipe_finish
+
+
+// Where the time goes writing each file, for the trace: reading (which is
+//  decompressing, for archives), hashing, and writing. With hashing on the
+//  worker threads, "hash" is just the time spent waiting for them.
+static const char *extractTraceArgs[] = { "decode_us", "hash_us", "write_us" };
+#define EXTRACT_TRACE_DECODE 0
+#define EXTRACT_TRACE_HASH 1
+#define EXTRACT_TRACE_WRITE 2
+
+typedef struct ExtractTrace
+{
+    uint64 mark;
+    int64 us[STATICARRAYLEN(extractTraceArgs)];
+} ExtractTrace;
+
+static void extractTraceBegin(ExtractTrace *trace, const char *fname)
+{
+    memset(trace, '\0', sizeof (ExtractTrace));
+    if (MojoTrace_enabled)
+    {
+        MojoTrace_begin("extract", fname);
+        trace->mark = MojoPlatform_microTicks();
+    } // if
+} // extractTraceBegin
+
+// Charge the time since the last mark to (phase), or to nothing if < 0.
+static void extractTraceMark(ExtractTrace *trace, int phase)
+{
+    if (MojoTrace_enabled)
+    {
+        const uint64 now = MojoPlatform_microTicks();
+        if (phase >= 0)
+            trace->us[phase] += (int64) (now - trace->mark);
+        trace->mark = now;
+    } // if
+} // extractTraceMark
+
+static void extractTraceEnd(ExtractTrace *trace)
+{
+    MojoTrace_endWithArgs("extract", STATICARRAYLEN(extractTraceArgs),
+                          extractTraceArgs, trace->us);
+} // extractTraceEnd
+
+
+// !!! FIXME: I'd rather not use a callback here, but I can't see a cleaner
+// !!! FIXME:  way right now...
+boolean MojoInput_toPhysicalFile(MojoInput *in, const char *fname, uint16 perms,
+                                 MojoChecksums *checksums, int64 maxbytes,
+                                 MojoInput_FileCopyCallback cb, void *data)
+{
+    boolean retval = false;
+    uint32 start = MojoPlatform_ticks();
+    void *out = NULL;
+    boolean iofailure = false;
+    int64 flen = 0;
+    int64 bw = 0;
+    MojoChecksumContext sumctx;
+    HashPipe *hashpipe = NULL;
+    ExtractTrace trace;
+    const boolean discard = (fname == NULL);  // read it, but write nothing.
+
+    if (in == NULL)
+        return false;
+
+    extractTraceBegin(&trace, discard ? "(discarded)" : fname);
+
+    if (checksums != NULL)
+    {
+        uint32 crc = 0;
+        memset(checksums, '\0', sizeof (MojoChecksums));
+        MojoChecksum_init(&sumctx, MojoChecksum_policy());
+        // if we'll read it all, read() checks the stored CRC for us.
+        if ((maxbytes < 0) && (MojoInput_storedCrc32(in, &crc)))
+            MojoChecksum_useCrc32(&sumctx, crc);
+    } // if
+
+    // Wait for a ready(), so length() can be meaningful on network streams.
+    while ((!in->ready(in)) && (!iofailure))
+    {
+        MojoPlatform_sleep(100);
+        if (cb != NULL)
+        {
+            if (!cb(MojoPlatform_ticks() - start, 0, 0, -1, data))
+                iofailure = true;
+        } // if
+    } // while
+
+    flen = in->length(in);
+    if ((maxbytes >= 0) && (flen > maxbytes))
+        flen = maxbytes;
+
+    if (!discard)
+        MojoPlatform_unlink(fname);
+    if ((!iofailure) && (!discard))
+    {
+        const uint32 flags = MOJOFILE_WRITE|MOJOFILE_CREATE|MOJOFILE_TRUNCATE;
+        const uint16 mode = MojoPlatform_defaultFilePerms();
+        out = MojoPlatform_open(fname, flags, mode);
+    } // if
+
+    if ((out != NULL) || ((discard) && (!iofailure)))
+    {
+        // Anything bigger than one read gets hashed on the worker threads.
+        const boolean big = ((flen < 0) || (flen > sizeof (scratchbuf_128k)));
+        if ((checksums != NULL) && (big))
+            hashpipe = hashpipe_create(&sumctx, sizeof (scratchbuf_128k));
+
+        while (!iofailure)
+        {
+            int64 br = 0;
+            int64 maxread = sizeof (scratchbuf_128k);
+
+            // see if we need to clamp to eof or maxbytes...
+            if (flen >= 0)
+            {
+                const int64 avail = flen - bw;
+                if (avail < maxread)
+                {
+                    maxread = avail;
+                    if (maxread == 0)
+                        break;  // nothing left to do, break out.
+                } // if
+            } // if
+
+            // If there's a callback, then poll. Otherwise, just block on
+            //  the reads from the MojoInput.
+            if ((cb != NULL) && (!in->ready(in)))
+                MojoPlatform_sleep(100);
+            else
+            {
+                // Write directly from the input's memory if it can lend it
+                //  to us, otherwise copy through the scratch buffer.
+                const uint8 *ptr = NULL;
+                extractTraceMark(&trace, -1);
+                br = MojoInput_borrow(in, (uint32) maxread, &ptr);
+                if (br < 0)
+                {
+                    uint8 *buf = scratchbuf_128k;
+                    if (hashpipe != NULL)
+                        buf = hashpipe_buffer(hashpipe);  // may wait on hashing.
+                    extractTraceMark(&trace, EXTRACT_TRACE_HASH);
+                    br = in->read(in, buf, (uint32) maxread);
+                    ptr = buf;
+                } // if
+                extractTraceMark(&trace, EXTRACT_TRACE_DECODE);
+
+                if (br == 0)  // we're done!
+                    break;
+                else if (br < 0)
+                    iofailure = true;
+                else
+                {
+                    if ((!discard) && (MojoPlatform_write(out, ptr, (uint32) br) != br))
+                        iofailure = true;
+                    else
+                    {
+                        extractTraceMark(&trace, EXTRACT_TRACE_WRITE);
+                        if (hashpipe != NULL)
+                            hashpipe_append(hashpipe, ptr, (uint32) br);
+                        else if (checksums != NULL)
+                            MojoChecksum_append(&sumctx, ptr, (uint32) br);
+                        extractTraceMark(&trace, EXTRACT_TRACE_HASH);
+                        bw += br;
+                    } // else
+                } // else
+            } // else
+
+            if (cb != NULL)
+            {
+                if (!cb(MojoPlatform_ticks() - start, br, bw, flen, data))
+                    iofailure = true;
+            } // if
+        } // while
+
+        if ((!discard) && (!MojoPlatform_close(out)))
+            iofailure = true;
+        else if (bw != flen)
+            iofailure = true;
+
+        if (iofailure)
+        {
+            if (!discard)
+                MojoPlatform_unlink(fname);
+        } // if
+        else
+        {
+            if (!discard)
+                MojoPlatform_chmod(fname, perms);
+            if (checksums != NULL)
+                MojoChecksum_finish(&sumctx, checksums);
+            retval = true;
+        } // else
+
+        if (hashpipe != NULL)  // joins the hashing jobs, even on failure.
+        {
+            extractTraceMark(&trace, -1);
+            hashpipe_finish(hashpipe, retval ? checksums : NULL);
+            extractTraceMark(&trace, EXTRACT_TRACE_HASH);
+        } // if
+    } // if
+
+    in->close(in);
+    extractTraceEnd(&trace);
+    return retval;
+} // MojoInput_toPhysicalFile
+
+
+// One file being written by MojoInput_toPhysicalFiles(). Only the job touches
+//  this until MojoWorker_wait() returns, except for the volatile fields, which
+//  the main thread peeks at for progress reports.
+typedef struct ExtractJob
+{
+    MojoExtractItem *item;
+    MojoJob *job;
+    int64 total;
+    volatile int64 bw;
+    volatile boolean done;
+    volatile boolean *cancel;
+} ExtractJob;
+
+#define EXTRACT_BUFSIZE (64 * 1024)
+#define EXTRACT_POLL_SIZE (1024 * 1024)  // report progress on bigger files.
+
+static void extractJob(void *data)
+{
+    ExtractJob *ej = (ExtractJob *) data;
+    MojoExtractItem *item = ej->item;
+    MojoInput *in = item->in;
+    const uint32 flags = MOJOFILE_WRITE|MOJOFILE_CREATE|MOJOFILE_TRUNCATE;
+    MojoChecksumContext sumctx;
+    uint8 *buf = NULL;
+    boolean iofailure = false;
+    int64 bw = 0;
+    void *out = NULL;
+    uint32 crc = 0;
+    ExtractTrace trace;
+
+    // Jobs can't use scratchbuf_128k, logging, etc: see universal.h.
+    extractTraceBegin(&trace, item->fname);
+    MojoChecksum_init(&sumctx, MojoChecksum_policy());
+    if (MojoInput_storedCrc32(in, &crc))
+        MojoChecksum_useCrc32(&sumctx, crc);  // read() checks it for us.
+    if (*ej->cancel)
+        iofailure = true;  // don't touch the disk at all.
+    else
+    {
+        MojoPlatform_unlink(item->fname);
+        out = MojoPlatform_open(item->fname, flags,
+                                MojoPlatform_defaultFilePerms());
+        if (out == NULL)
+            iofailure = true;
+    } // else
+
+    while ((!iofailure) && (!*ej->cancel))
+    {
+        const uint8 *ptr = NULL;
+        int64 br;
+
+        extractTraceMark(&trace, -1);
+        br = MojoInput_borrow(in, EXTRACT_BUFSIZE, &ptr);
+        if (br < 0)
+        {
+            if (buf == NULL)
+                buf = (uint8 *) xmalloc(EXTRACT_BUFSIZE);
+            br = in->read(in, buf, EXTRACT_BUFSIZE);
+            ptr = buf;
+        } // if
+        extractTraceMark(&trace, EXTRACT_TRACE_DECODE);
+
+        if (br == 0)  // we're done!
+            break;
+        else if (br < 0)
+            iofailure = true;
+        else if (MojoPlatform_write(out, ptr, (uint32) br) != br)
+            iofailure = true;
+        else
+        {
+            extractTraceMark(&trace, EXTRACT_TRACE_WRITE);
+            MojoChecksum_append(&sumctx, ptr, (uint32) br);
+            extractTraceMark(&trace, EXTRACT_TRACE_HASH);
+            bw += br;
+            ej->bw = bw;
+        } // else
+    } // while
+
+    free(buf);
+
+    if (out != NULL)
+    {
+        if (!MojoPlatform_close(out))
+            iofailure = true;
+        else if ((*ej->cancel) || ((ej->total >= 0) && (bw != ej->total)))
+            iofailure = true;
+
+        if (iofailure)
+            MojoPlatform_unlink(item->fname);
+        else
+        {
+            MojoPlatform_chmod(item->fname, item->perms);
+            MojoChecksum_finish(&sumctx, &item->checksums);
+        } // else
+    } // if
+
+    item->ok = !iofailure;
+    extractTraceEnd(&trace);
+    ej->done = true;
+} // extractJob
+
+
+boolean MojoInput_toPhysicalFiles(MojoExtractItem *items, uint32 count,
+                                  MojoInput_FilesCopyCallback cb, void *data)
+{
+    // Keep a few files queued per thread, but don't open everything at once.
+    const uint32 maxinflight = MojoWorker_count() * 2;
+    const uint32 start = MojoPlatform_ticks();
+    ExtractJob *jobs = NULL;
+    volatile boolean cancel = false;
+    uint32 submitted = 0;
+    uint32 i;
+
+    if (count == 0)
+        return true;
+
+    jobs = (ExtractJob *) xmalloc(sizeof (ExtractJob) * count);
+    for (i = 0; i < count; i++)
+    {
+        MojoInput *in = items[i].in;
+        memset(&items[i].checksums, '\0', sizeof (MojoChecksums));
+        items[i].ok = false;
+        jobs[i].item = &items[i];
+        jobs[i].cancel = &cancel;
+        jobs[i].total = in->length(in);  // ask now, on this thread.
+    } // for
+
+    for (i = 0; i < count; i++)
+    {
+        ExtractJob *ej = &jobs[i];
+        const boolean poll = ((ej->total < 0) ||
+                              (ej->total >= EXTRACT_POLL_SIZE));
+        int64 reported = 0;
+
+        while ((!cancel) && (submitted < count) &&
+               (submitted < i + maxinflight))
+        {
+            ExtractJob *next = &jobs[submitted++];
+            next->job = MojoWorker_submit(extractJob, next);
+        } // while
+
+        if (i >= submitted)  // cancelled before we got to this one.
+        {
+            ej->item->in->close(ej->item->in);
+            ej->item->in = NULL;
+            continue;
+        } // if
+
+        // Poll so the GUI keeps moving while big files are written. Small
+        //  files just block; MojoWorker_wait() helps out with queued jobs.
+        while (poll)
+        {
+            const boolean done = ej->done;
+            const int64 bw = ej->bw;
+            if ((cb != NULL) && (!cancel) && ((bw != reported) || (done)))
+            {
+                const uint32 ticks = MojoPlatform_ticks() - start;
+                if (!cb(i, ticks, bw - reported, bw, ej->total, data))
+                    cancel = true;  // let the jobs notice and bail out.
+                reported = bw;
+            } // if
+
+            if (done)
+                break;
+            MojoPlatform_sleep(50);
+        } // while
+
+        MojoWorker_wait(ej->job);
+
+        if ((!poll) && (cb != NULL) && (!cancel))
+        {
+            const uint32 ticks = MojoPlatform_ticks() - start;
+            const int64 bw = ej->bw;
+            if (!cb(i, ticks, bw, bw, ej->total, data))
+                cancel = true;
+        } // if
+
+        ej->item->in->close(ej->item->in);  // refcounts aren't thread safe.
+        ej->item->in = NULL;
+    } // for
+
+    free(jobs);
+    return !cancel;
+} // MojoInput_toPhysicalFiles
+
+
+// One file being hashed by MojoInput_checksumFiles().
+typedef struct ChecksumJob
+{
+    MojoChecksumItem *item;
+    MojoJob *job;
+    uint64 diskorder;
+    int64 bytes;
+    volatile boolean *cancel;
+} ChecksumJob;
+
+#define CHECKSUM_BUFSIZE (128 * 1024)
+
+static void checksumJob(void *data)
+{
+    ChecksumJob *cj = (ChecksumJob *) data;
+    MojoChecksumItem *item = cj->item;
+    MojoChecksumContext sumctx;
+    MojoInput *in = NULL;
+    uint8 *buf = NULL;
+    int64 br = -1;
+
+    if (*cj->cancel)
+        return;
+
+    // Jobs can't use scratchbuf_128k, logging, etc: see universal.h.
+    in = MojoInput_newFromFile(item->fname);
+    if (in == NULL)
+        return;
+
+    MojoTrace_begin("checksum", item->fname);
+    MojoChecksum_init(&sumctx, item->flags);
+    while (!*cj->cancel)
+    {
+        const uint8 *ptr = NULL;
+        br = MojoInput_borrow(in, CHECKSUM_BUFSIZE, &ptr);
+        if (br < 0)
+        {
+            if (buf == NULL)
+                buf = (uint8 *) xmalloc(CHECKSUM_BUFSIZE);
+            br = in->read(in, buf, CHECKSUM_BUFSIZE);
+            ptr = buf;
+        } // if
+
+        if (br <= 0)
+            break;
+        MojoChecksum_append(&sumctx, ptr, (uint32) br);
+        cj->bytes += br;
+    } // while
+
+    free(buf);
+    in->close(in);
+
+    if (br == 0)  // made it to EOF?
+    {
+        MojoChecksum_finish(&sumctx, &item->checksums);
+        item->ok = true;
+    } // if
+    MojoTrace_end("checksum");
+} // checksumJob
+
+
+static int cmpChecksumJobs(const void *_a, const void *_b)
+{
+    const ChecksumJob *a = *((const ChecksumJob * const *) _a);
+    const ChecksumJob *b = *((const ChecksumJob * const *) _b);
+    if (a->diskorder != b->diskorder)
+        return (a->diskorder < b->diskorder) ? -1 : 1;
+    return (a->item < b->item) ? -1 : ((a->item > b->item) ? 1 : 0);
+} // cmpChecksumJobs
+
+
+boolean MojoInput_checksumFiles(MojoChecksumItem *items, uint32 count,
+                                MojoInput_ChecksumFilesCallback cb, void *data)
+{
+    // Keep a few files queued per thread, like MojoInput_toPhysicalFiles().
+    const uint32 maxinflight = MojoWorker_count() * 2;
+    const uint32 start = MojoPlatform_ticks();
+    ChecksumJob *jobs = NULL;
+    ChecksumJob **order = NULL;
+    volatile boolean cancel = false;
+    uint32 submitted = 0;
+    uint32 i;
+
+    if (count == 0)
+        return true;
+
+    jobs = (ChecksumJob *) xmalloc(sizeof (ChecksumJob) * count);
+    order = (ChecksumJob **) xmalloc(sizeof (ChecksumJob *) * count);
+    for (i = 0; i < count; i++)
+    {
+        memset(&items[i].checksums, '\0', sizeof (MojoChecksums));
+        items[i].ok = false;
+        jobs[i].item = &items[i];
+        jobs[i].cancel = &cancel;
+        jobs[i].diskorder = MojoPlatform_diskOrder(items[i].fname);
+        order[i] = &jobs[i];
+    } // for
+
+    qsort(order, count, sizeof (ChecksumJob *), cmpChecksumJobs);
+
+    for (i = 0; i < count; i++)
+    {
+        ChecksumJob *cj = order[i];
+
+        while ((!cancel) && (submitted < count) &&
+               (submitted < i + maxinflight))
+        {
+            ChecksumJob *next = order[submitted++];
+            next->job = MojoWorker_submit(checksumJob, next);
+        } // while
+
+        if (i >= submitted)  // cancelled before we got to this one.
+            continue;
+
+        MojoWorker_wait(cj->job);
+
+        if ((cb != NULL) && (!cancel))
+        {
+            const uint32 ticks = MojoPlatform_ticks() - start;
+            const uint32 item = (uint32) (cj->item - items);
+            if (!cb(item, ticks, cj->bytes, data))
+                cancel = true;  // let the jobs notice and bail out.
+        } // if
+    } // for
+
+    free(order);
+    free(jobs);
+    return !cancel;
+} // MojoInput_checksumFiles
+
+
+MojoInput *MojoInput_newFromArchivePath(MojoArchive *ar, const char *fname)
+{
+    MojoInput *retval = NULL;
+
+    if (ar->openEntry != NULL)
+        return ar->openEntry(ar, fname);
+
+    else if (ar->enumerate(ar))
+    {
+        const MojoArchiveEntry *entinfo;
+        while ((entinfo = ar->enumNext(ar)) != NULL)
+        {
+            if (strcmp(entinfo->filename, fname) == 0)
+            {
+                if (entinfo->type == MOJOARCHIVE_ENTRY_FILE)
+                    retval = ar->openCurrentEntry(ar);
+                break;
+            } // if
+        } // while
+    } // if
+
+    return retval;
+} // MojoInput_newFromArchivePath
+
+
+// Hashed filename lookups for archivers that don't have a directory to
+//  search in memory.
+
+typedef struct MojoArchiveIndexItem
+{
+    char *fname;
+    uint32 hash;
+    uint64 start;
+    uint64 len;
+    struct MojoArchiveIndexItem *next;
+} MojoArchiveIndexItem;
+
+struct MojoArchiveIndex
+{
+    MojoArchiveIndexItem **buckets;
+    uint32 bucketcount;  // always a power of two.
+    uint32 count;
+};
+
+static uint32 hashArchiveIndexName(const char *fname)
+{
+    uint32 hash = 2166136261u;  // FNV-1a
+    while (*fname)
+    {
+        hash ^= (uint8) *(fname++);
+        hash *= 16777619u;
+    } // while
+    return hash;
+} // hashArchiveIndexName
+
+MojoArchiveIndex *MojoArchiveIndex_create(void)
+{
+    MojoArchiveIndex *idx = (MojoArchiveIndex *) xmalloc(sizeof (*idx));
+    idx->bucketcount = 64;
+    idx->buckets = (MojoArchiveIndexItem **)
+                    xmalloc(sizeof (MojoArchiveIndexItem *) * idx->bucketcount);
+    return idx;
+} // MojoArchiveIndex_create
+
+static void growArchiveIndex(MojoArchiveIndex *idx)
+{
+    const uint32 newcount = idx->bucketcount * 2;
+    MojoArchiveIndexItem **newbuckets = (MojoArchiveIndexItem **)
+                    xmalloc(sizeof (MojoArchiveIndexItem *) * newcount);
+    uint32 i;
+
+    for (i = 0; i < idx->bucketcount; i++)
+    {
+        MojoArchiveIndexItem *item = idx->buckets[i];
+        while (item != NULL)
+        {
+            MojoArchiveIndexItem *next = item->next;
+            const uint32 bucket = item->hash & (newcount - 1);
+            item->next = newbuckets[bucket];
+            newbuckets[bucket] = item;
+            item = next;
+        } // while
+    } // for
+
+    free(idx->buckets);
+    idx->buckets = newbuckets;
+    idx->bucketcount = newcount;
+} // growArchiveIndex
+
+static MojoArchiveIndexItem *findArchiveIndexItem(const MojoArchiveIndex *idx,
+                                                  const char *fname,
+                                                  const uint32 hash)
+{
+    MojoArchiveIndexItem *item = idx->buckets[hash & (idx->bucketcount - 1)];
+    while (item != NULL)
+    {
+        if ((item->hash == hash) && (strcmp(item->fname, fname) == 0))
+            return item;
+        item = item->next;
+    } // while
+    return NULL;
+} // findArchiveIndexItem
+
+void MojoArchiveIndex_add(MojoArchiveIndex *idx, const char *fname,
+                          uint64 start, uint64 len)
+{
+    const uint32 hash = hashArchiveIndexName(fname);
+    MojoArchiveIndexItem *item = NULL;
+    uint32 bucket;
+
+    if (findArchiveIndexItem(idx, fname, hash) != NULL)
+        return;  // first one wins, like enumerating would find it.
+
+    if (idx->count >= idx->bucketcount)
+        growArchiveIndex(idx);
+
+    bucket = hash & (idx->bucketcount - 1);
+    item = (MojoArchiveIndexItem *) xmalloc(sizeof (MojoArchiveIndexItem));
+    item->fname = xstrdup(fname);
+    item->hash = hash;
+    item->start = start;
+    item->len = len;
+    item->next = idx->buckets[bucket];
+    idx->buckets[bucket] = item;
+    idx->count++;
+} // MojoArchiveIndex_add
+
+boolean MojoArchiveIndex_find(const MojoArchiveIndex *idx, const char *fname,
+                              uint64 *start, uint64 *len)
+{
+    const uint32 hash = hashArchiveIndexName(fname);
+    const MojoArchiveIndexItem *item = findArchiveIndexItem(idx, fname, hash);
+    if (item == NULL)
+        return false;
+    *start = item->start;
+    *len = item->len;
+    return true;
+} // MojoArchiveIndex_find
+
+void MojoArchiveIndex_destroy(MojoArchiveIndex *idx)
+{
+    uint32 i;
+
+    if (idx == NULL)
+        return;
+
+    for (i = 0; i < idx->bucketcount; i++)
+    {
+        MojoArchiveIndexItem *item = idx->buckets[i];
+        while (item != NULL)
+        {
+            MojoArchiveIndexItem *next = item->next;
+            free(item->fname);
+            free(item);
+            item = next;
+        } // while
+    } // for
+
+    free(idx->buckets);
+    free(idx);
+} // MojoArchiveIndex_destroy
+
+MojoArchiveIndex *MojoArchiveIndex_build(MojoArchive *ar,
+                                         uint64 (*entrystart)(MojoArchive *ar))
+{
+    MojoArchiveIndex *idx = MojoArchiveIndex_create();
+    const MojoArchiveEntry *entinfo = NULL;
+    MojoArchiveEntry saved;
+
+    // Hide the caller's current entry from enumerate(), so it survives.
+    memcpy(&saved, &ar->prevEnum, sizeof (MojoArchiveEntry));
+    memset(&ar->prevEnum, '\0', sizeof (MojoArchiveEntry));
+
+    if (ar->enumerate(ar))
+    {
+        while ((entinfo = ar->enumNext(ar)) != NULL)
+        {
+            if (entinfo->type == MOJOARCHIVE_ENTRY_FILE)
+            {
+                MojoArchiveIndex_add(idx, entinfo->filename, entrystart(ar),
+                                     (uint64) entinfo->filesize);
+            } // if
+        } // while
+    } // if
+
+    MojoArchive_resetEntry(&ar->prevEnum);
+    memcpy(&ar->prevEnum, &saved, sizeof (MojoArchiveEntry));
+    return idx;
+} // MojoArchiveIndex_build
+
+
+
+// MojoInputs from files on the OS filesystem.
+
+typedef struct
+{
+    void *handle;
+    char *path;
+} MojoInputFileInstance;
+
+static boolean MojoInput_file_ready(MojoInput *io)
+{
+    // !!! FIXME: select()? Does that help with network filesystems?
+    return true;
+} // MojoInput_file_ready
+
+static int64 MojoInput_file_read(MojoInput *io, void *buf, uint32 bufsize)
+{
+    MojoInputFileInstance *inst = (MojoInputFileInstance *) io->opaque;
+    return MojoPlatform_read(inst->handle, buf, bufsize);
+} // MojoInput_file_read
+
+static boolean MojoInput_file_seek(MojoInput *io, uint64 pos)
+{
+    MojoInputFileInstance *inst = (MojoInputFileInstance *) io->opaque;
+    return (MojoPlatform_seek(inst->handle, pos, MOJOSEEK_SET) == pos);
+} // MojoInput_file_seek
+
+static int64 MojoInput_file_tell(MojoInput *io)
+{
+    MojoInputFileInstance *inst = (MojoInputFileInstance *) io->opaque;
+    return MojoPlatform_tell(inst->handle);
+} // MojoInput_file_tell
+
+static int64 MojoInput_file_length(MojoInput *io)
+{
+    MojoInputFileInstance *inst = (MojoInputFileInstance *) io->opaque;
+    return MojoPlatform_flen(inst->handle);
+} // MojoInput_file_length
+
+static MojoInput *MojoInput_file_duplicate(MojoInput *io)
+{
+    MojoInputFileInstance *inst = (MojoInputFileInstance *) io->opaque;
+    return MojoInput_newFromFile(inst->path);
+} // MojoInput_file_duplicate
+
+static void MojoInput_file_close(MojoInput *io)
+{
+    MojoInputFileInstance *inst = (MojoInputFileInstance *) io->opaque;
+    MojoPlatform_close(inst->handle);
+    free(inst->path);
+    free(inst);
+    free(io);
+} // MojoInput_file_close
+
+
+
+// MojoInputs from files on the OS filesystem that we mapped into memory.
+//  These hand out pointers into the mapping through borrow(), so layers
+//  above us can skip copying through their own buffers.
+// This is off unless you ask for it with --mmap: if the disc gets scratched,
+//  the USB stick gets yanked, or the network share goes away, a mapped file
+//  takes us down with SIGBUS, where read() would just fail and let us say so.
+// Jobs on worker threads read these, but only the main thread duplicates or
+//  closes them (see MojoInput_toPhysicalFiles()), so the refcount isn't
+//  atomic.
+
+typedef struct
+{
+    const uint8 *data;  // the mapping, shared between duplicates.
+    uint32 *refcount;  // number of MojoInputs sharing (data).
+    uint64 len;
+    uint64 pos;
+} MojoInputMmapInstance;
+
+static boolean MojoInput_mmap_ready(MojoInput *io)
+{
+    return true;  // always ready!
+} // MojoInput_mmap_ready
+
+static int64 MojoInput_mmap_borrow(MojoInput *io, uint32 len,
+                                   const uint8 **ptr)
+{
+    MojoInputMmapInstance *inst = (MojoInputMmapInstance *) io->opaque;
+    const uint64 avail = inst->len - inst->pos;
+    if (((uint64) len) > avail)
+        len = (uint32) avail;
+    *ptr = inst->data + inst->pos;
+    inst->pos += len;
+    return len;
+} // MojoInput_mmap_borrow
+
+static int64 MojoInput_mmap_read(MojoInput *io, void *buf, uint32 bufsize)
+{
+    const uint8 *ptr = NULL;
+    const int64 br = MojoInput_mmap_borrow(io, bufsize, &ptr);
+    memcpy(buf, ptr, (size_t) br);
+    return br;
+} // MojoInput_mmap_read
+
+static boolean MojoInput_mmap_seek(MojoInput *io, uint64 pos)
+{
+    MojoInputMmapInstance *inst = (MojoInputMmapInstance *) io->opaque;
+    if (pos > inst->len)
+        return false;
+    inst->pos = pos;
+    return true;
+} // MojoInput_mmap_seek
+
+static int64 MojoInput_mmap_tell(MojoInput *io)
+{
+    MojoInputMmapInstance *inst = (MojoInputMmapInstance *) io->opaque;
+    return (int64) inst->pos;
+} // MojoInput_mmap_tell
+
+static int64 MojoInput_mmap_length(MojoInput *io)
+{
+    MojoInputMmapInstance *inst = (MojoInputMmapInstance *) io->opaque;
+    return (int64) inst->len;
+} // MojoInput_mmap_length
+
+static MojoInput *MojoInput_mmap_duplicate(MojoInput *io)
+{
+    MojoInputMmapInstance *srcinst = (MojoInputMmapInstance *) io->opaque;
+    MojoInputMmapInstance *inst = NULL;
+    MojoInput *retval = NULL;
+
+    // duplicates share the mapping; we unmap when all referencers close.
+    (*srcinst->refcount)++;  // main thread only; see above.
+
+    inst = (MojoInputMmapInstance *) xmalloc(sizeof (MojoInputMmapInstance));
+    memcpy(inst, srcinst, sizeof (MojoInputMmapInstance));
+    inst->pos = 0;
+
+    retval = (MojoInput *) xmalloc(sizeof (MojoInput));
+    memcpy(retval, io, sizeof (MojoInput));
+    retval->opaque = inst;
+
+    return retval;
+} // MojoInput_mmap_duplicate
+
+static void MojoInput_mmap_close(MojoInput *io)
+{
+    MojoInputMmapInstance *inst = (MojoInputMmapInstance *) io->opaque;
+
+    assert(*inst->refcount > 0);
+    if (--(*inst->refcount) == 0)  // main thread only; see above.
+    {
+        MojoPlatform_munmap((void *) inst->data, inst->len);
+        free(inst->refcount);
+    } // if
+
+    free(inst);
+    free(io);
+} // MojoInput_mmap_close
+
+static void MojoInput_mmap_sequential(MojoInput *io)
+{
+    if (io->read == MojoInput_mmap_read)  // otherwise, not a mapping.
+    {
+        MojoInputMmapInstance *inst = (MojoInputMmapInstance *) io->opaque;
+        MojoPlatform_mmapSequential((void *) inst->data, inst->len);
+    } // if
+} // MojoInput_mmap_sequential
+
+static MojoInput *MojoInput_newFromMmap(void *f)
+{
+    MojoInput *io = NULL;
+    MojoInputMmapInstance *inst = NULL;
+    const int64 len = MojoPlatform_flen(f);
+    void *data = NULL;
+
+    if (!cmdline("mmap"))
+        return NULL;
+    else if (len <= 0)
+        return NULL;
+    else if ((data = MojoPlatform_mmap(f, (uint64) len)) == NULL)
+        return NULL;
+
+    inst = (MojoInputMmapInstance *) xmalloc(sizeof (MojoInputMmapInstance));
+    inst->data = (const uint8 *) data;
+    inst->refcount = (uint32 *) xmalloc(sizeof (uint32));
+    *inst->refcount = 1;
+    inst->len = (uint64) len;
+    inst->pos = 0;
+
+    io = (MojoInput *) xmalloc(sizeof (MojoInput));
+    io->ready = MojoInput_mmap_ready;
+    io->read = MojoInput_mmap_read;
+    io->seek = MojoInput_mmap_seek;
+    io->tell = MojoInput_mmap_tell;
+    io->length = MojoInput_mmap_length;
+    io->duplicate = MojoInput_mmap_duplicate;
+    io->close = MojoInput_mmap_close;
+    io->borrow = MojoInput_mmap_borrow;
+    io->opaque = inst;
+    return io;
+} // MojoInput_newFromMmap
+
+MojoInput *MojoInput_newFromFile(const char *path)
+{
+    MojoInput *io = NULL;
+    void *f = NULL;
+
+    f = MojoPlatform_open(path, MOJOFILE_READ, 0);
+    if (f != NULL)
+        io = MojoInput_newFromMmap(f);
+
+    // the mapping outlives the handle, so we don't need it anymore.
+    if (io != NULL)
+        MojoPlatform_close(f);
+
+    else if (f != NULL)  // couldn't map it; read it the usual way.
+    {
+        MojoInputFileInstance *inst;
+        inst = (MojoInputFileInstance *) xmalloc(sizeof (MojoInputFileInstance));
+        inst->path = xstrdup(path);
+        inst->handle = f;
+
+        io = (MojoInput *) xmalloc(sizeof (MojoInput));
+        io->ready = MojoInput_file_ready;
+        io->read = MojoInput_file_read;
+        io->seek = MojoInput_file_seek;
+        io->tell = MojoInput_file_tell;
+        io->length = MojoInput_file_length;
+        io->duplicate = MojoInput_file_duplicate;
+        io->close = MojoInput_file_close;
+        io->opaque = inst;
+    } // else if
+
+    return io;
+} // MojoInput_newFromFile
+
+
+
+// MojoInputs from blocks of memory.
+
+typedef struct
+{
+    void *ptr;  // original pointer from xmalloc()
+    uint32 *refcount;  // address in xmalloc()'d block for reference count.
+    const uint8 *data; // base of actual "file" data in xmalloc()'d block.
+    uint32 len;  // size, in bytes, of "file" data.
+    uint32 pos;  // current read position.
+} MojoInputMemInstance;
+
+static boolean MojoInput_memory_ready(MojoInput *io)
+{
+    return true;  // always ready!
+} // MojoInput_memory_ready
+
+static int64 MojoInput_memory_read(MojoInput *io, void *buf, uint32 bufsize)
+{
+    MojoInputMemInstance *inst = (MojoInputMemInstance *) io->opaque;
+    const uint32 avail = inst->len - inst->pos;
+    if (bufsize > avail)
+        bufsize = avail;
+    memcpy(buf, inst->data + inst->pos, bufsize);
+    inst->pos += bufsize;
+    return bufsize;
+} // MojoInput_memory_read
+
+static int64 MojoInput_memory_borrow(MojoInput *io, uint32 len,
+                                     const uint8 **ptr)
+{
+    MojoInputMemInstance *inst = (MojoInputMemInstance *) io->opaque;
+    const uint32 avail = inst->len - inst->pos;
+    if (len > avail)
+        len = avail;
+    *ptr = inst->data + inst->pos;
+    inst->pos += len;
+    return len;
+} // MojoInput_memory_borrow
+
+static boolean MojoInput_memory_seek(MojoInput *io, uint64 pos)
+{
+    MojoInputMemInstance *inst = (MojoInputMemInstance *) io->opaque;
+    if (pos > (uint64) inst->len)
+        return false;
+    inst->pos = (uint32) pos;
+    return true;
+} // MojoInput_memory_seek
+
+static int64 MojoInput_memory_tell(MojoInput *io)
+{
+    MojoInputMemInstance *inst = (MojoInputMemInstance *) io->opaque;
+    return (int64) inst->pos;
+} // MojoInput_memory_tell
+
+static int64 MojoInput_memory_length(MojoInput *io)
+{
+    MojoInputMemInstance *inst = (MojoInputMemInstance *) io->opaque;
+    return (int64) inst->len;
+} // MojoInput_memory_length
+
+static MojoInput *MojoInput_memory_duplicate(MojoInput *io)
+{
+    MojoInputMemInstance *srcinst = (MojoInputMemInstance *) io->opaque;
+    MojoInput *retval = NULL;
+    MojoInputMemInstance *inst = NULL;
+
+    if (srcinst->refcount != NULL)
+    {
+        // we don't copy the data for each duplicate; we just bump a reference
+        //  counter. We free the data when all referencers are closed.
+        (*srcinst->refcount)++;  // !!! FIXME: not thread safe!
+    } // if
+
+    inst = (MojoInputMemInstance*) xmalloc(sizeof (MojoInputMemInstance));
+    memcpy(inst, srcinst, sizeof (MojoInputMemInstance));
+    inst->pos = 0;
+
+    retval = (MojoInput *) xmalloc(sizeof (MojoInput));
+    memcpy(retval, io, sizeof (MojoInput));
+    retval->opaque = inst;
+
+    return retval;
+} // MojoInput_memory_duplicate
+
+static void MojoInput_memory_close(MojoInput *io)
+{
+    MojoInputMemInstance *inst = (MojoInputMemInstance *) io->opaque;
+
+    if (inst->refcount != NULL)  // memory we have to free?
+    {
+        assert(*inst->refcount > 0);
+        if (--(*inst->refcount) == 0)  // !!! FIXME: not thread safe!
+            free(inst->ptr);
+    } // if
+
+    free(inst);
+    free(io);
+} // MojoInput_memory_close
+
+MojoInput *MojoInput_newFromMemory(const uint8 *ptr, uint32 len, int constant)
+{
+    MojoInput *io = (MojoInput *) xmalloc(sizeof (MojoInput));
+    MojoInputMemInstance *inst = (MojoInputMemInstance*)
+                                    xmalloc(sizeof (MojoInputMemInstance));
+
+    if (constant)
+        inst->data = ptr;
+    else
+    {
+        inst->ptr = xmalloc(len + sizeof (uint32));
+        inst->refcount = (uint32 *) inst->ptr;
+        inst->data = ((const uint8 *) inst->ptr) + sizeof (uint32);
+        *inst->refcount = 1;
+        memcpy((void *) inst->data, ptr, len);
+    } // else
+
+    inst->len = len;
+
+    io->ready = MojoInput_memory_ready;
+    io->read = MojoInput_memory_read;
+    io->seek = MojoInput_memory_seek;
+    io->tell = MojoInput_memory_tell;
+    io->length = MojoInput_memory_length;
+    io->duplicate = MojoInput_memory_duplicate;
+    io->close = MojoInput_memory_close;
+    io->borrow = MojoInput_memory_borrow;
+    io->opaque = inst;
+
+    return io;
+} // MojoInput_newFromMemory
+
+
+// Put a limit on the range of an existing MojoInput.
+
+typedef struct
+{
+    MojoInput *io;  // original io we're a subset of.
+    uint64 pos;
+    uint64 start;
+    uint64 end;
+} MojoInputSubsetInstance;
+
+static boolean MojoInput_subset_ready(MojoInput *io)
+{
+    MojoInputSubsetInstance *inst = (MojoInputSubsetInstance *) io->opaque;
+    return inst->io->ready(inst->io);
+} // MojoInput_subset_ready
+
+static int64 MojoInput_subset_read(MojoInput *io, void *buf, uint32 bufsize)
+{
+    MojoInputSubsetInstance *inst = (MojoInputSubsetInstance *) io->opaque;
+    const uint64 avail = (inst->end - inst->start) - inst->pos;
+    int64 rc;
+
+    assert(inst->pos <= (inst->end - inst->start));
+    if (((uint64) bufsize) > avail)
+        bufsize = (uint32) avail;
+    rc = inst->io->read(inst->io, buf, bufsize);
+    if (rc > 0)
+        inst->pos += rc;
+    return rc;
+} // MojoInput_subset_read
+
+static int64 MojoInput_subset_borrow(MojoInput *io, uint32 len,
+                                     const uint8 **ptr)
+{
+    MojoInputSubsetInstance *inst = (MojoInputSubsetInstance *) io->opaque;
+    const uint64 avail = (inst->end - inst->start) - inst->pos;
+    int64 rc;
+
+    if (((uint64) len) > avail)
+        len = (uint32) avail;
+    rc = MojoInput_borrow(inst->io, len, ptr);
+    if (rc > 0)
+        inst->pos += rc;
+    return rc;
+} // MojoInput_subset_borrow
+
+static boolean MojoInput_subset_seek(MojoInput *io, uint64 pos)
+{
+    MojoInputSubsetInstance *inst = (MojoInputSubsetInstance *) io->opaque;
+    if (pos > (inst->end - inst->start))
+        return false;
+    else if (!inst->io->seek(inst->io, pos + inst->start))
+        return false;
+    inst->pos = pos;
+    return true;
+} // MojoInput_subset_seek
+
+static int64 MojoInput_subset_tell(MojoInput *io)
+{
+    MojoInputSubsetInstance *inst = (MojoInputSubsetInstance *) io->opaque;
+    return (int64) inst->pos;
+} // MojoInput_subset_tell
+
+static int64 MojoInput_subset_length(MojoInput *io)
+{
+    MojoInputSubsetInstance *inst = (MojoInputSubsetInstance *) io->opaque;
+    return (int64) (inst->end - inst->start);
+} // MojoInput_subset_length
+
+static MojoInput *MojoInput_subset_duplicate(MojoInput *io)
+{
+    MojoInputSubsetInstance *srcinst = (MojoInputSubsetInstance *) io->opaque;
+    MojoInput *dupio = srcinst->io->duplicate(srcinst->io);
+    MojoInput *retval = NULL;
+    MojoInputSubsetInstance *inst = NULL;
+
+    if (dupio == NULL)
+        return NULL;
+
+    if (!dupio->seek(dupio, srcinst->start))
+    {
+        dupio->close(dupio);
+        return NULL;
+    } // if
+
+    inst = (MojoInputSubsetInstance*) xmalloc(sizeof (MojoInputSubsetInstance));
+    memcpy(inst, srcinst, sizeof (MojoInputSubsetInstance));
+    inst->io = dupio;
+    inst->pos = 0;
+
+    retval = (MojoInput *) xmalloc(sizeof (MojoInput));
+    memcpy(retval, io, sizeof (MojoInput));
+    retval->opaque = inst;
+
+    return retval;
+} // MojoInput_subset_duplicate
+
+static void MojoInput_subset_close(MojoInput *io)
+{
+    MojoInputSubsetInstance *inst = (MojoInputSubsetInstance *) io->opaque;
+    inst->io->close(inst->io);
+    free(inst);
+    free(io);
+} // MojoInput_subset_close
+
+MojoInput *MojoInput_newFromSubset(MojoInput *_io, const uint64 start,
+                                   const uint64 end)
+{
+    MojoInput *io;
+    MojoInputSubsetInstance *inst;
+
+    assert(end > start);
+    if (!_io->seek(_io, start))
+        return NULL;
+
+    io = (MojoInput *) xmalloc(sizeof (MojoInput));
+    inst = (MojoInputSubsetInstance*)xmalloc(sizeof (MojoInputSubsetInstance));
+
+    inst->io = _io;
+    inst->pos = 0;
+    inst->start = start;
+    inst->end = end;
+
+    io->ready = MojoInput_subset_ready;
+    io->read = MojoInput_subset_read;
+    io->seek = MojoInput_subset_seek;
+    io->tell = MojoInput_subset_tell;
+    io->length = MojoInput_subset_length;
+    io->duplicate = MojoInput_subset_duplicate;
+    io->close = MojoInput_subset_close;
+    io->borrow = MojoInput_subset_borrow;
+    io->opaque = inst;
+
+    return io;
+} // MojoInput_newFromSubset
+
+
+// A window into another MojoInput, with its own file position. We don't own
+//  the parent; every read seeks it back to where this window's cursor is, so
+//  several of these can share one parent and be read in any order.
+
+typedef struct
+{
+    MojoInput *parent;
+    uint64 pos;
+    uint64 start;
+    uint64 len;
+} MojoInputRangeInstance;
+
+// Put the parent where our cursor is. Sequential reads through one window
+//  leave it there already, so we don't pay for a seek (which might mean
+//  re-decompressing from a checkpoint on compressed parents) in that case.
+static boolean MojoInput_range_sync(MojoInputRangeInstance *inst)
+{
+    MojoInput *parent = inst->parent;
+    const uint64 want = inst->start + inst->pos;
+    if (parent->tell(parent) == ((int64) want))
+        return true;
+    return parent->seek(parent, want);
+} // MojoInput_range_sync
+
+static boolean MojoInput_range_ready(MojoInput *io)
+{
+    MojoInputRangeInstance *inst = (MojoInputRangeInstance *) io->opaque;
+    return inst->parent->ready(inst->parent);
+} // MojoInput_range_ready
+
+static int64 MojoInput_range_read(MojoInput *io, void *buf, uint32 bufsize)
+{
+    MojoInputRangeInstance *inst = (MojoInputRangeInstance *) io->opaque;
+    const uint64 avail = inst->len - inst->pos;
+    int64 rc;
+
+    if (((uint64) bufsize) > avail)
+        bufsize = (uint32) avail;
+    if (bufsize == 0)
+        return 0;
+    else if (!MojoInput_range_sync(inst))
+        return -1;
+
+    rc = inst->parent->read(inst->parent, buf, bufsize);
+    if (rc > 0)
+        inst->pos += rc;
+    return rc;
+} // MojoInput_range_read
+
+static int64 MojoInput_range_borrow(MojoInput *io, uint32 len,
+                                    const uint8 **ptr)
+{
+    MojoInputRangeInstance *inst = (MojoInputRangeInstance *) io->opaque;
+    const uint64 avail = inst->len - inst->pos;
+    int64 rc;
+
+    if (((uint64) len) > avail)
+        len = (uint32) avail;
+    if (len == 0)
+        return 0;
+    else if (!MojoInput_range_sync(inst))
+        return -1;
+
+    rc = MojoInput_borrow(inst->parent, len, ptr);
+    if (rc > 0)
+        inst->pos += rc;
+    return rc;
+} // MojoInput_range_borrow
 
-void MojoArchive_resetEntry(MojoArchiveEntry *info)
+static boolean MojoInput_range_seek(MojoInput *io, uint64 pos)
 {
-    free(info->filename);
-    free(info->linkdest);
-    memset(info, '\0', sizeof (MojoArchiveEntry));
-} // MojoArchive_resetEntry
-
+    MojoInputRangeInstance *inst = (MojoInputRangeInstance *) io->opaque;
+    if (pos > inst->len)
+        return false;
+    inst->pos = pos;  // parent catches up on the next read.
+    return true;
+} // MojoInput_range_seek
 
-// !!! FIXME: I'd rather not use a callback here, but I can't see a cleaner
-// !!! FIXME:  way right now...
-boolean MojoInput_toPhysicalFile(MojoInput *in, const char *fname, uint16 perms,
-                                 MojoChecksums *checksums, int64 maxbytes,
-                                 MojoInput_FileCopyCallback cb, void *data)
+static int64 MojoInput_range_tell(MojoInput *io)
 {
-    boolean retval = false;
-    uint32 start = MojoPlatform_ticks();
-    void *out = NULL;
-    boolean iofailure = false;
-    int64 flen = 0;
-    int64 bw = 0;
-    MojoChecksumContext sumctx;
+    MojoInputRangeInstance *inst = (MojoInputRangeInstance *) io->opaque;
+    return (int64) inst->pos;
+} // MojoInput_range_tell
 
-    if (in == NULL)
-        return false;
+static int64 MojoInput_range_length(MojoInput *io)
+{
+    MojoInputRangeInstance *inst = (MojoInputRangeInstance *) io->opaque;
+    return (int64) inst->len;
+} // MojoInput_range_length
 
-    if (checksums != NULL)
-    {
-        memset(checksums, '\0', sizeof (MojoChecksums));
-        MojoChecksum_init(&sumctx);
-    } // if
+static MojoInput *MojoInput_range_duplicate(MojoInput *io)
+{
+    MojoInputRangeInstance *srcinst = (MojoInputRangeInstance *) io->opaque;
+    return MojoInput_newFromRange(srcinst->parent, srcinst->start,
+                                  srcinst->len);
+} // MojoInput_range_duplicate
 
-    // Wait for a ready(), so length() can be meaningful on network streams.
-    while ((!in->ready(in)) && (!iofailure))
-    {
-        MojoPlatform_sleep(100);
-        if (cb != NULL)
-        {
-            if (!cb(MojoPlatform_ticks() - start, 0, 0, -1, data))
-                iofailure = true;
-        } // if
-    } // while
+static void MojoInput_range_close(MojoInput *io)
+{
+    free(io->opaque);
+    free(io);
+} // MojoInput_range_close
 
-    flen = in->length(in);
-    if ((maxbytes >= 0) && (flen > maxbytes))
-        flen = maxbytes;
+MojoInput *MojoInput_newFromRange(MojoInput *parent, const uint64 start,
+                                  const uint64 len)
+{
+    MojoInput *io = (MojoInput *) xmalloc(sizeof (MojoInput));
+    MojoInputRangeInstance *inst;
 
-    MojoPlatform_unlink(fname);
-    if (!iofailure)
-    {
-        const uint32 flags = MOJOFILE_WRITE|MOJOFILE_CREATE|MOJOFILE_TRUNCATE;
-        const uint16 mode = MojoPlatform_defaultFilePerms();
-        out = MojoPlatform_open(fname, flags, mode);
-    } // if
+    inst = (MojoInputRangeInstance *) xmalloc(sizeof (MojoInputRangeInstance));
+    inst->parent = parent;
+    inst->pos = 0;
+    inst->start = start;
+    inst->len = len;
 
-    if (out != NULL)
-    {
-        while (!iofailure)
-        {
-            int64 br = 0;
-            int64 maxread = sizeof (scratchbuf_128k);
+    io->ready = MojoInput_range_ready;
+    io->read = MojoInput_range_read;
+    io->seek = MojoInput_range_seek;
+    io->tell = MojoInput_range_tell;
+    io->length = MojoInput_range_length;
+    io->duplicate = MojoInput_range_duplicate;
+    io->close = MojoInput_range_close;
+    io->borrow = MojoInput_range_borrow;
+    io->opaque = inst;
 
-            // see if we need to clamp to eof or maxbytes...
-            if (flen >= 0)
-            {
-                const int64 avail = flen - bw;
-                if (avail < maxread)
-                {
-                    maxread = avail;
-                    if (maxread == 0)
-                        break;  // nothing left to do, break out.
-                } // if
-            } // if
+    return io;
+} // MojoInput_newFromRange
 
-            // If there's a callback, then poll. Otherwise, just block on
-            //  the reads from the MojoInput.
-            if ((cb != NULL) && (!in->ready(in)))
-                MojoPlatform_sleep(100);
-            else
-            {
-                br = in->read(in, scratchbuf_128k, (uint32) maxread);
-                if (br == 0)  // we're done!
-                    break;
-                else if (br < 0)
-                    iofailure = true;
-                else
-                {
-                    if (MojoPlatform_write(out, scratchbuf_128k, (uint32) br) != br)
-                        iofailure = true;
-                    else
-                    {
-                        if (checksums != NULL)
-                            MojoChecksum_append(&sumctx, scratchbuf_128k, (uint32) br);
-                        bw += br;
-                    } // else
-                } // else
-            } // else
 
-            if (cb != NULL)
-            {
-                if (!cb(MojoPlatform_ticks() - start, br, bw, flen, data))
-                    iofailure = true;
-            } // if
-        } // while
+// Read something that can't seek (a pipe, a download) strictly front to back.
 
-        if (MojoPlatform_close(out) != 0)
-            iofailure = true;
-        else if (bw != flen)
-            iofailure = true;
+#define FORWARDONLY_HEADSIZE (64 * 1024)
+#define FORWARDONLY_DRAINSIZE (16 * 1024)
 
-        if (iofailure)
-            MojoPlatform_unlink(fname);
-        else
+typedef struct
+{
+    MojoInput *io;
+    uint8 *head;  // the first bytes of (io), so format sniffing can rewind.
+    uint32 headlen;  // bytes in (head); we can rewind while iopos <= this.
+    uint8 *drain;  // scratch space for skipping forward.
+    uint64 pos;  // our position.
+    uint64 iopos;  // how much we've read from (io).
+} MojoInputForwardOnlyInstance;
+
+// Read the next bytes from (io), keeping a copy if they belong in (head).
+static int64 forwardonly_pull(MojoInputForwardOnlyInstance *inst,
+                              uint8 *buf, uint32 bufsize)
+{
+    const int64 br = inst->io->read(inst->io, buf, bufsize);
+    if (br > 0)
+    {
+        if (inst->iopos < FORWARDONLY_HEADSIZE)
         {
-            MojoPlatform_chmod(fname, perms);
-            if (checksums != NULL)
-                MojoChecksum_finish(&sumctx, checksums);
-            retval = true;
-        } // else
+            uint64 cpy = FORWARDONLY_HEADSIZE - inst->iopos;
+            if (cpy > (uint64) br)
+                cpy = (uint64) br;
+            memcpy(inst->head + inst->headlen, buf, (size_t) cpy);
+            inst->headlen += (uint32) cpy;
+        } // if
+        inst->iopos += br;
     } // if
+    return br;
+} // forwardonly_pull
 
-    in->close(in);
-    return retval;
-} // MojoInput_toPhysicalFile
-
+static boolean MojoInput_forwardonly_ready(MojoInput *io)
+{
+    MojoInputForwardOnlyInstance *inst;
+    inst = (MojoInputForwardOnlyInstance *) io->opaque;
+    return ((inst->pos < inst->headlen) || (inst->io->ready(inst->io)));
+} // MojoInput_forwardonly_ready
 
-MojoInput *MojoInput_newFromArchivePath(MojoArchive *ar, const char *fname)
+static int64 MojoInput_forwardonly_read(MojoInput *io, void *_buf,
+                                        uint32 bufsize)
 {
-    MojoInput *retval = NULL;
-    if (ar->enumerate(ar))
+    MojoInputForwardOnlyInstance *inst;
+    uint8 *buf = (uint8 *) _buf;
+    int64 retval = 0;
+    int64 br = 0;
+
+    inst = (MojoInputForwardOnlyInstance *) io->opaque;
+    if (inst->pos < inst->headlen)  // rewound into the head?
     {
-        const MojoArchiveEntry *entinfo;
-        while ((entinfo = ar->enumNext(ar)) != NULL)
-        {
-            if (strcmp(entinfo->filename, fname) == 0)
-            {
-                if (entinfo->type == MOJOARCHIVE_ENTRY_FILE)
-                    retval = ar->openCurrentEntry(ar);
-                break;
-            } // if
-        } // while
+        retval = inst->headlen - inst->pos;
+        if (retval > bufsize)
+            retval = bufsize;
+        memcpy(buf, inst->head + inst->pos, (size_t) retval);
+        inst->pos += retval;
+        if (retval == bufsize)
+            return retval;
     } // if
 
-    return retval;
-} // MojoInput_newFromArchivePath
-
+    if (inst->pos != inst->iopos)
+        return (retval > 0) ? retval : -1;  // those bytes are gone.
 
+    br = forwardonly_pull(inst, buf + retval, bufsize - ((uint32) retval));
+    if (br > 0)
+    {
+        inst->pos += br;
+        retval += br;
+    } // if
+    else if (retval == 0)
+        retval = br;  // EOF or error.
 
-// MojoInputs from files on the OS filesystem.
+    return retval;
+} // MojoInput_forwardonly_read
 
-typedef struct
+static boolean MojoInput_forwardonly_seek(MojoInput *io, uint64 pos)
 {
-    void *handle;
-    char *path;
-} MojoInputFileInstance;
+    MojoInputForwardOnlyInstance *inst;
+    inst = (MojoInputForwardOnlyInstance *) io->opaque;
 
-static boolean MojoInput_file_ready(MojoInput *io)
-{
-    // !!! FIXME: select()? Does that help with network filesystems?
-    return true;
-} // MojoInput_file_ready
+    if ((pos < inst->iopos) && (inst->iopos > inst->headlen))
+        return false;  // we threw some of those bytes away already.
 
-static int64 MojoInput_file_read(MojoInput *io, void *buf, uint32 bufsize)
-{
-    MojoInputFileInstance *inst = (MojoInputFileInstance *) io->opaque;
-    return MojoPlatform_read(inst->handle, buf, bufsize);
-} // MojoInput_file_read
+    while (inst->iopos < pos)  // read ahead to get there.
+    {
+        uint64 len = pos - inst->iopos;
+        int64 br;
+        if (len > FORWARDONLY_DRAINSIZE)
+            len = FORWARDONLY_DRAINSIZE;
+        if (inst->drain == NULL)
+            inst->drain = (uint8 *) xmalloc(FORWARDONLY_DRAINSIZE);
+        br = forwardonly_pull(inst, inst->drain, (uint32) len);
+        if (br <= 0)
+            return false;
+    } // while
 
-static boolean MojoInput_file_seek(MojoInput *io, uint64 pos)
-{
-    MojoInputFileInstance *inst = (MojoInputFileInstance *) io->opaque;
-    return (MojoPlatform_seek(inst->handle, pos, MOJOSEEK_SET) == pos);
-} // MojoInput_file_seek
+    inst->pos = pos;
+    return true;
+} // MojoInput_forwardonly_seek
 
-static int64 MojoInput_file_tell(MojoInput *io)
+static int64 MojoInput_forwardonly_tell(MojoInput *io)
 {
-    MojoInputFileInstance *inst = (MojoInputFileInstance *) io->opaque;
-    return MojoPlatform_tell(inst->handle);
-} // MojoInput_file_tell
+    MojoInputForwardOnlyInstance *inst;
+    inst = (MojoInputForwardOnlyInstance *) io->opaque;
+    return (int64) inst->pos;
+} // MojoInput_forwardonly_tell
 
-static int64 MojoInput_file_length(MojoInput *io)
+static int64 MojoInput_forwardonly_length(MojoInput *io)
 {
-    MojoInputFileInstance *inst = (MojoInputFileInstance *) io->opaque;
-    return MojoPlatform_flen(inst->handle);
-} // MojoInput_file_length
+    // Even if (io) knows, don't say: things that see a length tend to go
+    //  look at the end of the file (the xz index, bzip2 block scans), and
+    //  we'd have to read everything to get there and couldn't come back.
+    return -1;
+} // MojoInput_forwardonly_length
 
-static MojoInput *MojoInput_file_duplicate(MojoInput *io)
+static MojoInput *MojoInput_forwardonly_duplicate(MojoInput *io)
 {
-    MojoInputFileInstance *inst = (MojoInputFileInstance *) io->opaque;
-    return MojoInput_newFromFile(inst->path);
-} // MojoInput_file_duplicate
+    return NULL;  // there's only one copy of a stream.
+} // MojoInput_forwardonly_duplicate
 
-static void MojoInput_file_close(MojoInput *io)
+static void MojoInput_forwardonly_close(MojoInput *io)
 {
-    MojoInputFileInstance *inst = (MojoInputFileInstance *) io->opaque;
-    MojoPlatform_close(inst->handle);
-    free(inst->path);
+    MojoInputForwardOnlyInstance *inst;
+    inst = (MojoInputForwardOnlyInstance *) io->opaque;
+    inst->io->close(inst->io);
+    free(inst->drain);
+    free(inst->head);
     free(inst);
     free(io);
-} // MojoInput_file_close
+} // MojoInput_forwardonly_close
 
-MojoInput *MojoInput_newFromFile(const char *path)
+MojoInput *MojoInput_newForwardOnly(MojoInput *_io)
 {
     MojoInput *io = NULL;
-    void *f = NULL;
+    MojoInputForwardOnlyInstance *inst = NULL;
 
-    f = MojoPlatform_open(path, MOJOFILE_READ, 0);
-    if (f != NULL)
-    {
-        MojoInputFileInstance *inst;
-        inst = (MojoInputFileInstance *) xmalloc(sizeof (MojoInputFileInstance));
-        inst->path = xstrdup(path);
-        inst->handle = f;
+    if (_io == NULL)
+        return NULL;
 
-        io = (MojoInput *) xmalloc(sizeof (MojoInput));
-        io->ready = MojoInput_file_ready;
-        io->read = MojoInput_file_read;
-        io->seek = MojoInput_file_seek;
-        io->tell = MojoInput_file_tell;
-        io->length = MojoInput_file_length;
-        io->duplicate = MojoInput_file_duplicate;
-        io->close = MojoInput_file_close;
-        io->opaque = inst;
-    } // if
+    inst = (MojoInputForwardOnlyInstance *)
+                xmalloc(sizeof (MojoInputForwardOnlyInstance));
+    inst->io = _io;
+    inst->head = (uint8 *) xmalloc(FORWARDONLY_HEADSIZE);
+
+    io = (MojoInput *) xmalloc(sizeof (MojoInput));
+    io->ready = MojoInput_forwardonly_ready;
+    io->read = MojoInput_forwardonly_read;
+    io->seek = MojoInput_forwardonly_seek;
+    io->tell = MojoInput_forwardonly_tell;
+    io->length = MojoInput_forwardonly_length;
+    io->duplicate = MojoInput_forwardonly_duplicate;
+    io->close = MojoInput_forwardonly_close;
+    io->opaque = inst;
 
     return io;
-} // MojoInput_newFromFile
+} // MojoInput_newForwardOnly
 
 
+// Soak up lots of tiny reads (archive headers, directories, TOCs) with one
+//  big read() from another MojoInput. We don't own the parent.
 
-// MojoInputs from blocks of memory.
+#define BUFFERED_DEFAULTSIZE (32 * 1024)
 
 typedef struct
 {
-    void *ptr;  // original pointer from xmalloc()
-    uint32 *refcount;  // address in xmalloc()'d block for reference count.
-    const uint8 *data; // base of actual "file" data in xmalloc()'d block.
-    uint32 len;  // size, in bytes, of "file" data.
-    uint32 pos;  // current read position.
-} MojoInputMemInstance;
+    MojoInput *parent;
+    uint8 *buffer;  // our own storage, if the parent can't lend us its own.
+    const uint8 *window;  // current bytes: (buffer), or borrowed from parent.
+    uint32 bufsize;
+    uint32 windowlen;  // valid bytes in (window).
+    uint32 windowpos;  // our position in (window).
+    uint64 windowstart;  // parent's offset of window[0]; parent is at the end.
+    boolean noborrow;  // parent said it can't lend; don't keep asking.
+} MojoInputBufferedInstance;
+
+// Move the window to the parent's next bytes. Returns bytes available.
+static int64 buffered_refill(MojoInputBufferedInstance *inst)
+{
+    MojoInput *parent = inst->parent;
+    int64 br = -1;
 
-static boolean MojoInput_memory_ready(MojoInput *io)
+    inst->windowstart += inst->windowlen;
+    inst->windowpos = inst->windowlen = 0;
+
+    if (!inst->noborrow)
+    {
+        br = MojoInput_borrow(parent, inst->bufsize, &inst->window);
+        inst->noborrow = (br < 0);
+    } // if
+
+    if (br < 0)
+    {
+        if (inst->buffer == NULL)
+            inst->buffer = (uint8 *) xmalloc(inst->bufsize);
+        inst->window = inst->buffer;
+        br = parent->read(parent, inst->buffer, inst->bufsize);
+    } // if
+
+    if (br > 0)
+        inst->windowlen = (uint32) br;
+    return br;
+} // buffered_refill
+
+static boolean MojoInput_buffered_ready(MojoInput *io)
 {
-    return true;  // always ready!
-} // MojoInput_memory_ready
+    MojoInputBufferedInstance *inst = (MojoInputBufferedInstance *) io->opaque;
+    return ( (inst->windowpos < inst->windowlen) ||
+             (inst->parent->ready(inst->parent)) );
+} // MojoInput_buffered_ready
 
-static int64 MojoInput_memory_read(MojoInput *io, void *buf, uint32 bufsize)
+static int64 MojoInput_buffered_read(MojoInput *io, void *_buf, uint32 bufsize)
 {
-    MojoInputMemInstance *inst = (MojoInputMemInstance *) io->opaque;
-    const uint32 avail = inst->len - inst->pos;
-    if (bufsize > avail)
-        bufsize = avail;
-    memcpy(buf, inst->data + inst->pos, bufsize);
-    inst->pos += bufsize;
-    return bufsize;
-} // MojoInput_memory_read
+    MojoInputBufferedInstance *inst = (MojoInputBufferedInstance *) io->opaque;
+    uint8 *buf = (uint8 *) _buf;
+    int64 retval = 0;
+
+    while (bufsize > 0)
+    {
+        uint32 avail = inst->windowlen - inst->windowpos;
+        if (avail == 0)
+        {
+            int64 br;
+            if (bufsize >= inst->bufsize)  // big read? Skip the copy.
+            {
+                MojoInput *parent = inst->parent;
+                inst->windowstart += inst->windowlen;
+                inst->windowpos = inst->windowlen = 0;
+                br = parent->read(parent, buf, bufsize);
+                if (br > 0)
+                {
+                    inst->windowstart += br;
+                    retval += br;
+                } // if
+                else if (retval == 0)
+                    retval = br;
+                break;
+            } // if
+
+            br = buffered_refill(inst);
+            if (br <= 0)
+            {
+                if (retval == 0)
+                    retval = br;  // EOF or error.
+                break;
+            } // if
+            avail = (uint32) br;
+        } // if
+
+        if (avail > bufsize)
+            avail = bufsize;
+        memcpy(buf, inst->window + inst->windowpos, avail);
+        inst->windowpos += avail;
+        buf += avail;
+        bufsize -= avail;
+        retval += avail;
+    } // while
 
-static boolean MojoInput_memory_seek(MojoInput *io, uint64 pos)
-{
-    MojoInputMemInstance *inst = (MojoInputMemInstance *) io->opaque;
-    if (pos > (uint64) inst->len)
-        return false;
-    inst->pos = (uint32) pos;
-    return true;
-} // MojoInput_memory_seek
+    return retval;
+} // MojoInput_buffered_read
 
-static int64 MojoInput_memory_tell(MojoInput *io)
+static int64 MojoInput_buffered_borrow(MojoInput *io, uint32 len,
+                                       const uint8 **ptr)
 {
-    MojoInputMemInstance *inst = (MojoInputMemInstance *) io->opaque;
-    return (int64) inst->pos;
-} // MojoInput_memory_tell
+    MojoInputBufferedInstance *inst = (MojoInputBufferedInstance *) io->opaque;
+    uint32 avail = inst->windowlen - inst->windowpos;
 
-static int64 MojoInput_memory_length(MojoInput *io)
-{
-    MojoInputMemInstance *inst = (MojoInputMemInstance *) io->opaque;
-    return (int64) inst->len;
-} // MojoInput_memory_length
+    // We can only lend out the parent's memory. Our own buffer gets
+    //  overwritten by the next refill, and borrow() promises the pointer
+    //  stays good until we're closed.
+    if (inst->noborrow)
+        return -1;
 
-static MojoInput *MojoInput_memory_duplicate(MojoInput *io)
+    if (avail == 0)
+    {
+        const int64 br = buffered_refill(inst);
+        if (inst->noborrow)
+            return -1;  // it's in (buffer) now; read() will hand it over.
+        else if (br <= 0)
+            return (br < 0) ? -1 : 0;
+        avail = (uint32) br;
+    } // if
+
+    if (avail > len)
+        avail = len;
+    *ptr = inst->window + inst->windowpos;
+    inst->windowpos += avail;
+    return (int64) avail;
+} // MojoInput_buffered_borrow
+
+static boolean MojoInput_buffered_seek(MojoInput *io, uint64 pos)
 {
-    MojoInputMemInstance *srcinst = (MojoInputMemInstance *) io->opaque;
-    MojoInput *retval = NULL;
-    MojoInputMemInstance *inst = NULL;
+    MojoInputBufferedInstance *inst = (MojoInputBufferedInstance *) io->opaque;
+    MojoInput *parent = inst->parent;
 
-    if (srcinst->refcount != NULL)
+    if ((pos >= inst->windowstart) &&
+        (pos <= inst->windowstart + inst->windowlen))
     {
-        // we don't copy the data for each duplicate; we just bump a reference
-        //  counter. We free the data when all referencers are closed.
-        (*srcinst->refcount)++;  // !!! FIXME: not thread safe!
+        inst->windowpos = (uint32) (pos - inst->windowstart);
+        return true;  // already have it.
     } // if
 
-    inst = (MojoInputMemInstance*) xmalloc(sizeof (MojoInputMemInstance));
-    memcpy(inst, srcinst, sizeof (MojoInputMemInstance));
-    inst->pos = 0;
+    if (!parent->seek(parent, pos))
+        return false;
 
-    retval = (MojoInput *) xmalloc(sizeof (MojoInput));
-    memcpy(retval, io, sizeof (MojoInput));
-    retval->opaque = inst;
+    inst->windowstart = pos;
+    inst->windowpos = inst->windowlen = 0;
+    return true;
+} // MojoInput_buffered_seek
 
-    return retval;
-} // MojoInput_memory_duplicate
+static int64 MojoInput_buffered_tell(MojoInput *io)
+{
+    MojoInputBufferedInstance *inst = (MojoInputBufferedInstance *) io->opaque;
+    return (int64) (inst->windowstart + inst->windowpos);
+} // MojoInput_buffered_tell
 
-static void MojoInput_memory_close(MojoInput *io)
+static int64 MojoInput_buffered_length(MojoInput *io)
 {
-    MojoInputMemInstance *inst = (MojoInputMemInstance *) io->opaque;
+    MojoInputBufferedInstance *inst = (MojoInputBufferedInstance *) io->opaque;
+    return inst->parent->length(inst->parent);
+} // MojoInput_buffered_length
 
-    if (inst->refcount != NULL)  // memory we have to free?
-    {
-        assert(*inst->refcount > 0);
-        if (--(*inst->refcount) == 0)  // !!! FIXME: not thread safe!
-            free(inst->ptr);
-    } // if
+static MojoInput *MojoInput_buffered_duplicate(MojoInput *io)
+{
+    return NULL;  // we'd be fighting over the parent's file pointer.
+} // MojoInput_buffered_duplicate
+
+static void MojoInput_buffered_close(MojoInput *io)
+{
+    MojoInputBufferedInstance *inst = (MojoInputBufferedInstance *) io->opaque;
+    MojoInput *parent = inst->parent;
 
+    // Leave the parent where the caller thinks it is, not where we read to.
+    if (inst->windowpos != inst->windowlen)
+        parent->seek(parent, inst->windowstart + inst->windowpos);
+
+    free(inst->buffer);
     free(inst);
     free(io);
-} // MojoInput_memory_close
+} // MojoInput_buffered_close
 
-MojoInput *MojoInput_newFromMemory(const uint8 *ptr, uint32 len, int constant)
+MojoInput *MojoInput_newBuffered(MojoInput *parent, uint32 bufsize)
 {
-    MojoInput *io = (MojoInput *) xmalloc(sizeof (MojoInput));
-    MojoInputMemInstance *inst = (MojoInputMemInstance*)
-                                    xmalloc(sizeof (MojoInputMemInstance));
+    MojoInput *io = NULL;
+    MojoInputBufferedInstance *inst = NULL;
+    const int64 pos = parent->tell(parent);
 
-    if (constant)
-        inst->data = ptr;
-    else
-    {
-        inst->ptr = xmalloc(len + sizeof (uint32));
-        inst->refcount = (uint32 *) inst->ptr;
-        inst->data = ((const uint8 *) inst->ptr) + sizeof (uint32);
-        *inst->refcount = 1;
-        memcpy((void *) inst->data, ptr, len);
-    } // else
+    if (pos < 0)
+        return NULL;
 
-    inst->len = len;
+    inst = (MojoInputBufferedInstance *)
+                xmalloc(sizeof (MojoInputBufferedInstance));
+    inst->parent = parent;
+    inst->bufsize = (bufsize == 0) ? BUFFERED_DEFAULTSIZE : bufsize;
+    inst->windowstart = (uint64) pos;
 
-    io->ready = MojoInput_memory_ready;
-    io->read = MojoInput_memory_read;
-    io->seek = MojoInput_memory_seek;
-    io->tell = MojoInput_memory_tell;
-    io->length = MojoInput_memory_length;
-    io->duplicate = MojoInput_memory_duplicate;
-    io->close = MojoInput_memory_close;
+    io = (MojoInput *) xmalloc(sizeof (MojoInput));
+    io->ready = MojoInput_buffered_ready;
+    io->read = MojoInput_buffered_read;
+    io->seek = MojoInput_buffered_seek;
+    io->tell = MojoInput_buffered_tell;
+    io->length = MojoInput_buffered_length;
+    io->duplicate = MojoInput_buffered_duplicate;
+    io->close = MojoInput_buffered_close;
+    io->borrow = MojoInput_buffered_borrow;
     io->opaque = inst;
 
     return io;
-} // MojoInput_newFromMemory
+} // MojoInput_newBuffered
 
 
-// Put a limit on the range of an existing MojoInput.
+// Run another MojoInput's read()s ahead of us on a background thread.
+
+#define PREFETCH_DEFAULT_BUFCOUNT 4
+#define PREFETCH_DEFAULT_BUFSIZE (256 * 1024)
 
 typedef struct
 {
-    MojoInput *io;  // original io we're a subset of.
+    uint8 *data;
+    int64 len;  // bytes in (data); 0 means EOF, -1 means i/o error.
+} PrefetchBuffer;
+
+typedef struct
+{
+    MojoInput *io;  // wrapped input. Only the thread touches it while running.
+    void *thread;
+    void *mutex;  // guards (filled) and the stall counters.
+    void *emptysem;  // buffers the thread may fill.
+    void *fullsem;  // buffers the thread has filled.
+    PrefetchBuffer *buffers;
+    uint32 bufcount;
+    uint32 bufsize;
+    uint32 head;  // next buffer the thread fills.
+    uint32 tail;  // buffer we're reading from.
+    uint32 filled;  // buffers filled but not yet started by read().
+    uint32 empty;  // buffers the thread is free to fill.
+    uint32 offset;  // read position in buffers[tail].
+    boolean havebuffer;  // true if we took buffers[tail] from the thread.
+    volatile boolean stop;
+    int64 length;
     uint64 pos;
-    uint64 start;
-    uint64 end;
-} MojoInputSubsetInstance;
+    boolean hascrc;  // (io) has a stored CRC-32; we ask before the thread runs.
+    uint32 crc;
+    uint32 readstalls;  // times read() had to wait on the thread.
+    uint32 threadstalls;  // times the thread had to wait on read().
+} MojoInputPrefetchInstance;
 
-static boolean MojoInput_subset_ready(MojoInput *io)
+static int prefetchThread(void *data)
 {
-    MojoInputSubsetInstance *inst = (MojoInputSubsetInstance *) io->opaque;
-    return inst->io->ready(inst->io);
-} // MojoInput_subset_ready
+    MojoInputPrefetchInstance *inst = (MojoInputPrefetchInstance *) data;
+    MojoInput *io = inst->io;
 
-static int64 MojoInput_subset_read(MojoInput *io, void *buf, uint32 bufsize)
+    while (true)
+    {
+        PrefetchBuffer *buf = &inst->buffers[inst->head];
+
+        MojoPlatform_lockMutex(inst->mutex);
+        if (inst->empty == 0)
+            inst->threadstalls++;  // reader is slower than we are.
+        MojoPlatform_unlockMutex(inst->mutex);
+
+        MojoPlatform_semaphoreWait(inst->emptysem);
+        if (inst->stop)
+            break;
+
+        MojoPlatform_lockMutex(inst->mutex);
+        inst->empty--;
+        MojoPlatform_unlockMutex(inst->mutex);
+
+        buf->len = io->read(io, buf->data, inst->bufsize);
+        inst->head = (inst->head + 1) % inst->bufcount;
+
+        MojoPlatform_lockMutex(inst->mutex);
+        inst->filled++;
+        MojoPlatform_unlockMutex(inst->mutex);
+        MojoPlatform_semaphorePost(inst->fullsem);
+
+        if (buf->len <= 0)
+            break;  // EOF or error. The reader will find out from (buf).
+    } // while
+
+    return 0;
+} // prefetchThread
+
+static void prefetch_stop(MojoInputPrefetchInstance *inst)
 {
-    MojoInputSubsetInstance *inst = (MojoInputSubsetInstance *) io->opaque;
-    const uint32 avail = inst->end - inst->pos;
-    int64 rc;
+    if (inst->thread != NULL)
+    {
+        inst->stop = true;
+        MojoPlatform_semaphorePost(inst->emptysem);  // in case it's waiting.
+        MojoPlatform_waitThread(inst->thread);
+        inst->thread = NULL;
+    } // if
 
-    assert(inst->pos < inst->end);
-    if (bufsize > avail)
-        bufsize = avail;
-    rc = inst->io->read(inst->io, buf, bufsize);
-    if (rc > 0)
-        inst->pos += rc;
-    return rc;
-} // MojoInput_subset_read
+    if (inst->emptysem != NULL)
+        MojoPlatform_destroySemaphore(inst->emptysem);
+    if (inst->fullsem != NULL)
+        MojoPlatform_destroySemaphore(inst->fullsem);
+    inst->emptysem = inst->fullsem = NULL;
+} // prefetch_stop
 
-static boolean MojoInput_subset_seek(MojoInput *io, uint64 pos)
+// Start reading ahead from the wrapped input's current position.
+static boolean prefetch_start(MojoInputPrefetchInstance *inst)
 {
-    MojoInputSubsetInstance *inst = (MojoInputSubsetInstance *) io->opaque;
-    if (pos > (inst->end - inst->start))
+    inst->head = inst->tail = inst->filled = inst->offset = 0;
+    inst->empty = inst->bufcount;
+    inst->havebuffer = false;
+    inst->stop = false;
+    inst->emptysem = MojoPlatform_createSemaphore(inst->bufcount);
+    inst->fullsem = MojoPlatform_createSemaphore(0);
+    if ((inst->emptysem != NULL) && (inst->fullsem != NULL))
+        inst->thread = MojoPlatform_createThread(prefetchThread, inst);
+
+    if (inst->thread == NULL)
+    {
+        prefetch_stop(inst);
         return false;
-    else if (!inst->io->seek(inst->io, pos + inst->start))
+    } // if
+
+    return true;
+} // prefetch_start
+
+static boolean prefetch_restart(MojoInputPrefetchInstance *inst)
+{
+    prefetch_stop(inst);
+    if (!inst->io->seek(inst->io, inst->pos))
+        return false;
+    return prefetch_start(inst);
+} // prefetch_restart
+
+static boolean MojoInput_prefetch_ready(MojoInput *io)
+{
+    return true;  // read() blocks until the thread catches up.
+} // MojoInput_prefetch_ready
+
+static int64 MojoInput_prefetch_read(MojoInput *io, void *_buf, uint32 bufsize)
+{
+    MojoInputPrefetchInstance *inst = (MojoInputPrefetchInstance *) io->opaque;
+    uint8 *buf = (uint8 *) _buf;
+    int64 retval = 0;
+
+    if (inst->thread == NULL)
+        return -1;  // a failed seek() left us without a thread.
+
+    while (bufsize > 0)
+    {
+        PrefetchBuffer *pb = &inst->buffers[inst->tail];
+        uint32 cpy;
+
+        if (!inst->havebuffer)
+        {
+            boolean empty;
+            MojoPlatform_lockMutex(inst->mutex);
+            empty = (inst->filled == 0);
+            if ((empty) && (retval == 0))
+                inst->readstalls++;
+            MojoPlatform_unlockMutex(inst->mutex);
+
+            if ((empty) && (retval > 0))
+                break;  // hand back what we have, don't block for more.
+
+            MojoPlatform_semaphoreWait(inst->fullsem);
+            MojoPlatform_lockMutex(inst->mutex);
+            inst->filled--;
+            MojoPlatform_unlockMutex(inst->mutex);
+            inst->havebuffer = true;
+            inst->offset = 0;
+        } // if
+
+        // EOF and errors stay at the tail, so later reads see them too.
+        if (pb->len <= 0)
+        {
+            if ((pb->len < 0) && (retval == 0))
+                retval = -1;
+            break;
+        } // if
+
+        cpy = (uint32) (pb->len - inst->offset);
+        if (cpy > bufsize)
+            cpy = bufsize;
+        memcpy(buf, pb->data + inst->offset, cpy);
+        inst->offset += cpy;
+        inst->pos += cpy;
+        retval += cpy;
+        buf += cpy;
+        bufsize -= cpy;
+
+        if (inst->offset == pb->len)  // give this buffer back to the thread.
+        {
+            inst->havebuffer = false;
+            inst->tail = (inst->tail + 1) % inst->bufcount;
+            MojoPlatform_lockMutex(inst->mutex);
+            inst->empty++;
+            MojoPlatform_unlockMutex(inst->mutex);
+            MojoPlatform_semaphorePost(inst->emptysem);
+        } // if
+    } // while
+
+    return retval;
+} // MojoInput_prefetch_read
+
+static boolean MojoInput_prefetch_seek(MojoInput *io, uint64 pos)
+{
+    MojoInputPrefetchInstance *inst = (MojoInputPrefetchInstance *) io->opaque;
+    const uint64 oldpos = inst->pos;
+
+    prefetch_stop(inst);
+    if (!inst->io->seek(inst->io, pos))
+    {
+        prefetch_restart(inst);  // try to go back to where we were.
         return false;
+    } // if
+
     inst->pos = pos;
+    if (!prefetch_start(inst))
+    {
+        inst->pos = oldpos;
+        return false;
+    } // if
+
     return true;
-} // MojoInput_subset_seek
+} // MojoInput_prefetch_seek
 
-static int64 MojoInput_subset_tell(MojoInput *io)
+static int64 MojoInput_prefetch_tell(MojoInput *io)
 {
-    MojoInputSubsetInstance *inst = (MojoInputSubsetInstance *) io->opaque;
+    MojoInputPrefetchInstance *inst = (MojoInputPrefetchInstance *) io->opaque;
     return (int64) inst->pos;
-} // MojoInput_subset_tell
+} // MojoInput_prefetch_tell
 
-static int64 MojoInput_subset_length(MojoInput *io)
+static int64 MojoInput_prefetch_length(MojoInput *io)
 {
-    MojoInputSubsetInstance *inst = (MojoInputSubsetInstance *) io->opaque;
-    return (int64) (inst->end - inst->start);
-} // MojoInput_subset_length
+    MojoInputPrefetchInstance *inst = (MojoInputPrefetchInstance *) io->opaque;
+    return inst->length;  // cached, since the thread owns (inst->io).
+} // MojoInput_prefetch_length
 
-static MojoInput *MojoInput_subset_duplicate(MojoInput *io)
+static boolean MojoInput_prefetch_storedcrc(MojoInput *io, uint32 *crc)
 {
-    MojoInputSubsetInstance *srcinst = (MojoInputSubsetInstance *) io->opaque;
-    MojoInput *dupio = io->duplicate(io);
+    MojoInputPrefetchInstance *inst = (MojoInputPrefetchInstance *) io->opaque;
+    // (io)'s read()s check it, and pass the failure on to ours.
+    if ((!inst->hascrc) || (inst->pos != 0))
+        return false;
+    *crc = inst->crc;
+    return true;
+} // MojoInput_prefetch_storedcrc
+
+static MojoInput *MojoInput_prefetch_duplicate(MojoInput *io)
+{
+    MojoInputPrefetchInstance *inst = (MojoInputPrefetchInstance *) io->opaque;
     MojoInput *retval = NULL;
-    MojoInputSubsetInstance *inst = NULL;
+    MojoInput *dupio = NULL;
 
-    if (dupio == NULL)
-        return NULL;
+    // the thread has to be stopped while we touch the wrapped input.
+    prefetch_stop(inst);
+    dupio = inst->io->duplicate(inst->io);
+    prefetch_restart(inst);
 
-    if (!dupio->seek(dupio, 0))
+    if (dupio != NULL)
     {
-        dupio->close(dupio);
-        return NULL;
+        retval = MojoInput_newPrefetched(dupio, inst->bufcount, inst->bufsize);
+        if ((retval != NULL) && (!retval->seek(retval, inst->pos)))
+        {
+            retval->close(retval);
+            retval = NULL;
+        } // if
     } // if
 
-    inst = (MojoInputSubsetInstance*) xmalloc(sizeof (MojoInputSubsetInstance));
-    memcpy(inst, srcinst, sizeof (MojoInputSubsetInstance));
-    inst->io = dupio;
-    inst->pos = 0;
-
-    retval = (MojoInput *) xmalloc(sizeof (MojoInput));
-    memcpy(retval, io, sizeof (MojoInput));
-    retval->opaque = inst;
-
     return retval;
-} // MojoInput_subset_duplicate
+} // MojoInput_prefetch_duplicate
 
-static void MojoInput_subset_close(MojoInput *io)
+static void MojoInput_prefetch_close(MojoInput *io)
 {
-    MojoInputSubsetInstance *inst = (MojoInputSubsetInstance *) io->opaque;
+    MojoInputPrefetchInstance *inst = (MojoInputPrefetchInstance *) io->opaque;
+    uint32 i;
+
+    prefetch_stop(inst);
+    logDebug("prefetch: read() waited %0 times, thread waited %1 times.",
+             numstr((int) inst->readstalls), numstr((int) inst->threadstalls));
+
     inst->io->close(inst->io);
+    MojoPlatform_destroyMutex(inst->mutex);
+    for (i = 0; i < inst->bufcount; i++)
+        free(inst->buffers[i].data);
+    free(inst->buffers);
     free(inst);
     free(io);
-} // MojoInput_subset_close
+} // MojoInput_prefetch_close
 
-MojoInput *MojoInput_newFromSubset(MojoInput *_io, const uint64 start,
-                                   const uint64 end)
+MojoInput *MojoInput_newPrefetched(MojoInput *_io, uint32 bufcount,
+                                   uint32 bufsize)
 {
-    MojoInput *io;
-    MojoInputSubsetInstance *inst;
+    MojoInput *io = NULL;
+    MojoInputPrefetchInstance *inst = NULL;
+    void *mutex = NULL;
+    uint32 i;
 
-    assert(end > start);
-    if (!_io->seek(_io, start))
-        return NULL;
+    if (MojoWorker_count() <= 1)
+        return _io;  // user doesn't want threads, or we can't make them.
+    else if ((mutex = MojoPlatform_createMutex()) == NULL)
+        return _io;
 
-    io = (MojoInput *) xmalloc(sizeof (MojoInput));
-    inst = (MojoInputSubsetInstance*)xmalloc(sizeof (MojoInputSubsetInstance));
+    if (bufcount == 0)
+        bufcount = PREFETCH_DEFAULT_BUFCOUNT;
+    if (bufsize == 0)
+        bufsize = PREFETCH_DEFAULT_BUFSIZE;
 
+    inst = (MojoInputPrefetchInstance *)
+                xmalloc(sizeof (MojoInputPrefetchInstance));
     inst->io = _io;
-    inst->pos = 0;
-    inst->start = start;
-    inst->end = end;
+    inst->mutex = mutex;
+    inst->bufcount = bufcount;
+    inst->bufsize = bufsize;
+    inst->length = _io->length(_io);
+    inst->pos = (uint64) _io->tell(_io);
+    inst->hascrc = MojoInput_storedCrc32(_io, &inst->crc);
+    inst->buffers = (PrefetchBuffer *) xmalloc(sizeof (PrefetchBuffer) * bufcount);
+    for (i = 0; i < bufcount; i++)
+        inst->buffers[i].data = (uint8 *) xmalloc(bufsize);
+
+    if (!prefetch_start(inst))
+    {
+        MojoPlatform_destroyMutex(mutex);
+        for (i = 0; i < bufcount; i++)
+            free(inst->buffers[i].data);
+        free(inst->buffers);
+        free(inst);
+        return _io;
+    } // if
 
-    io->ready = MojoInput_subset_ready;
-    io->read = MojoInput_subset_read;
-    io->seek = MojoInput_subset_seek;
-    io->tell = MojoInput_subset_tell;
-    io->length = MojoInput_subset_length;
-    io->duplicate = MojoInput_subset_duplicate;
-    io->close = MojoInput_subset_close;
+    io = (MojoInput *) xmalloc(sizeof (MojoInput));
+    io->ready = MojoInput_prefetch_ready;
+    io->read = MojoInput_prefetch_read;
+    io->seek = MojoInput_prefetch_seek;
+    io->tell = MojoInput_prefetch_tell;
+    io->length = MojoInput_prefetch_length;
+    io->duplicate = MojoInput_prefetch_duplicate;
+    io->close = MojoInput_prefetch_close;
+    io->storedcrc = MojoInput_prefetch_storedcrc;
     io->opaque = inst;
-
     return io;
-} // MojoInput_newFromSubset
+} // MojoInput_newPrefetched
 
 
 // MojoArchives from directories on the OS filesystem.
@@ -1346,6 +4766,44 @@ static MojoInput *MojoArchive_dir_openCurrentEntry(MojoArchive *ar)
 } // MojoArchive_dir_openCurrentEntry
 
 
+static MojoInput *MojoArchive_dir_openEntry(MojoArchive *ar,
+                                            const char *fname)
+{
+    MojoArchiveDirInstance *inst = (MojoArchiveDirInstance *) ar->opaque;
+    MojoInput *retval = NULL;
+    const char *ptr = fname;
+    char *fullpath = NULL;
+
+    // Enumerating would never find anything outside the base dir, or any
+    //  "." or ".." entries, so don't let a lookup reach them either.
+    while (true)
+    {
+        const char *sep = strchr(ptr, '/');
+        const size_t len = (sep == NULL) ? strlen(ptr) : (size_t) (sep - ptr);
+        if ((len == 0) || ((len == 1) && (ptr[0] == '.')) ||
+            ((len == 2) && (ptr[0] == '.') && (ptr[1] == '.')))
+            return NULL;
+        else if (sep == NULL)
+            break;
+        ptr = sep + 1;
+    } // while
+
+    fullpath = (char *) xmalloc(strlen(inst->base) + strlen(fname) + 2);
+    sprintf(fullpath, "%s/%s", inst->base, fname);
+    if (MojoPlatform_isfile(fullpath))
+        retval = MojoInput_newFromFile(fullpath);
+    free(fullpath);
+
+    return retval;
+} // MojoArchive_dir_openEntry
+
+
+static boolean MojoArchive_dir_indexed(MojoArchive *ar)
+{
+    return true;  // the filesystem does the lookups.
+} // MojoArchive_dir_indexed
+
+
 static void MojoArchive_dir_close(MojoArchive *ar)
 {
     MojoArchiveDirInstance *inst = (MojoArchiveDirInstance *) ar->opaque;
@@ -1378,6 +4836,9 @@ MojoArchive *MojoArchive_newFromDirectory(const char *dirname)
     ar->enumerate = MojoArchive_dir_enumerate;
     ar->enumNext = MojoArchive_dir_enumNext;
     ar->openCurrentEntry = MojoArchive_dir_openCurrentEntry;
+    ar->openCurrentEntryDetached = MojoArchive_dir_openCurrentEntry;  // (always is.)
+    ar->openEntry = MojoArchive_dir_openEntry;
+    ar->indexed = MojoArchive_dir_indexed;
     ar->close = MojoArchive_dir_close;
     ar->offsetOfStart = -1;  // doesn't mean anything here.
     ar->opaque = inst;
@@ -1385,10 +4846,69 @@ MojoArchive *MojoArchive_newFromDirectory(const char *dirname)
 } // MojoArchive_newFromDirectory
 
 
+int64 MojoInput_borrow(MojoInput *io, uint32 len, const uint8 **ptr)
+{
+    *ptr = NULL;
+    if (io->borrow == NULL)
+        return -1;  // caller has to read() this one.
+    return io->borrow(io, len, ptr);
+} // MojoInput_borrow
+
+
+boolean MojoInput_storedCrc32(MojoInput *io, uint32 *crc)
+{
+    if (io->storedcrc == NULL)
+        return false;
+    return io->storedcrc(io, crc);
+} // MojoInput_storedCrc32
+
+
+boolean MojoInput_seeksCheaply(MojoInput *io)
+{
+    // Only things we know; anything else might be decompressing its way
+    //  to the new position.
+    while (io != NULL)
+    {
+        if ( (io->read == MojoInput_file_read) ||
+             (io->read == MojoInput_mmap_read) ||
+             (io->read == MojoInput_memory_read) )
+            return true;
+        else if (io->read == MojoInput_subset_read)
+            io = ((MojoInputSubsetInstance *) io->opaque)->io;
+        else if (io->read == MojoInput_range_read)
+            io = ((MojoInputRangeInstance *) io->opaque)->parent;
+        else
+            return false;
+    } // while
+    return false;
+} // MojoInput_seeksCheaply
+
+
+// Get (len) bytes for a fixed-width read. If (io) can lend them to us (it's
+//  in memory, mmap'd, or a MojoInput_newBuffered()), this is just a pointer
+//  bump instead of a read() with a copy. Returns NULL on i/o error or EOF.
+static const uint8 *readFixed(MojoInput *io, uint8 *buf, const uint32 len)
+{
+    const uint8 *ptr = NULL;
+    int64 br = MojoInput_borrow(io, len, &ptr);
+    if (br == len)
+        return ptr;
+    else if (br < 0)
+        br = 0;  // can't lend; read the whole thing.
+    else
+        memcpy(buf, ptr, (size_t) br);  // got the start of it; read the rest.
+
+    if (io->read(io, buf + br, len - ((uint32) br)) != (len - br))
+        return NULL;
+    return buf;
+} // readFixed
+
+
 boolean MojoInput_readui16(MojoInput *io, uint16 *ui16)
 {
-    uint8 buf[sizeof (uint16)];
-    if (io->read(io, buf, sizeof (buf)) != sizeof (buf))
+    uint8 tmp[sizeof (uint16)];
+    const uint8 *buf = readFixed(io, tmp, sizeof (tmp));
+    if (buf == NULL)
         return false;
 
     *ui16 = ( (((uint16) buf[0]) << 0) |
@@ -1399,8 +4919,9 @@ boolean MojoInput_readui16(MojoInput *io, uint16 *ui16)
 
 boolean MojoInput_readui32(MojoInput *io, uint32 *ui32)
 {
-    uint8 buf[sizeof (uint32)];
-    if (io->read(io, buf, sizeof (buf)) != sizeof (buf))
+    uint8 tmp[sizeof (uint32)];
+    const uint8 *buf = readFixed(io, tmp, sizeof (tmp));
+    if (buf == NULL)
         return false;
 
     *ui32 = ( (((uint32) buf[0]) << 0) |
@@ -1413,8 +4934,9 @@ boolean MojoInput_readui32(MojoInput *io, uint32 *ui32)
 
 boolean MojoInput_readui64(MojoInput *io, uint64 *ui64)
 {
-    uint8 buf[sizeof (uint64)];
-    if (io->read(io, buf, sizeof (buf)) != sizeof (buf))
+    uint8 tmp[sizeof (uint64)];
+    const uint8 *buf = readFixed(io, tmp, sizeof (tmp));
+    if (buf == NULL)
         return false;
 
     *ui64 = ( (((uint64) buf[0]) << 0) |
@@ -40,6 +40,12 @@ struct MojoInput
     MojoInput* (*duplicate)(MojoInput *io);
     void (*close)(MojoInput *io);
 
+    // optional, may be NULL. Use MojoInput_borrow() instead of calling this.
+    int64 (*borrow)(MojoInput *io, uint32 len, const uint8 **ptr);
+
+    // optional, may be NULL. Use MojoInput_storedCrc32() instead.
+    boolean (*storedcrc)(MojoInput *io, uint32 *crc);
+
     // private
     void *opaque;
 };
@@ -57,6 +63,42 @@ MojoInput *MojoInput_newFromFile(const char *fname);
 MojoInput *MojoInput_newFromSubset(MojoInput *io, const uint64 start,
                                    const uint64 end);
 
+// Make (len) bytes of (parent), starting at (start), look like the entire
+//  file. Unlike MojoInput_newFromSubset(), this does NOT take over (parent):
+//  it keeps its own file position and seeks (parent) to it on each read, so
+//  you can have several of these open on one parent at once, and duplicate()
+//  is cheap. (parent) must outlive them, and none of this is thread safe.
+MojoInput *MojoInput_newFromRange(MojoInput *parent, const uint64 start,
+                                  const uint64 len);
+
+// Wrap (io), which can't seek (a pipe, a download), for code that expects
+//  to. Seeking forward reads and throws bytes away; seeking backward only
+//  works until we've read past the first 64KB, which we keep so archivers
+//  and decompressors can sniff formats and rewind. Anything else fails,
+//  instead of quietly starting over. The
+//  length is always reported as unknown (-1). Like MojoInput_newFromSubset(),
+//  this takes over (io). A tarball on one of these is read in one pass.
+MojoInput *MojoInput_newForwardOnly(MojoInput *io);
+
+// Read (parent) through a (bufsize)-byte window (0 picks a default), starting
+//  from its current position, so lots of small reads (headers, directories,
+//  the MojoInput_readui*() functions) cost one real read() per window. Seeks
+//  inside the window are free. This does NOT take over (parent); closing it
+//  puts (parent)'s file pointer back where the caller would expect it to be.
+//  Don't touch (parent) while this is open, and you can't duplicate() it.
+//  Returns NULL if (parent) can't tell() where it is.
+MojoInput *MojoInput_newBuffered(MojoInput *parent, uint32 bufsize);
+
+// Wrap (io) so its read()s run ahead on a background thread, into a queue
+//  of (bufcount) buffers of (bufsize) bytes each (0 for either picks a
+//  default). This lets decompression overlap with whatever you do with the
+//  data, like writing it to disk. Like MojoInput_newFromSubset(), this takes
+//  over control of (io). If threads aren't available (or --threads=1), you
+//  get (io) back as-is. (io) must not be touched by anything else while this
+//  is open, including the archive it came from.
+MojoInput *MojoInput_newPrefetched(MojoInput *io, uint32 bufcount,
+                                   uint32 bufsize);
+
 typedef enum
 {
     MOJOARCHIVE_ENTRY_UNKNOWN = 0,
@@ -87,6 +129,31 @@ struct MojoArchive
     MojoInput* (*openCurrentEntry)(MojoArchive *ar);
     void (*close)(MojoArchive *ar);
 
+    // optional, may be NULL. Like openCurrentEntry(), but the MojoInput
+    //  shares no state with (ar) or other open entries, so it can be read on
+    //  another thread while (ar) keeps enumerating. It must still be closed
+    //  on the main thread, before (ar) is.
+    MojoInput* (*openCurrentEntryDetached)(MojoArchive *ar);
+
+    // optional, may be NULL. Open the file entry named (fname) directly,
+    //  without enumerating and without disturbing an enumeration that's in
+    //  progress. NULL if there's no such entry or it isn't a plain file.
+    //  Use MojoInput_newFromArchivePath(), which falls back to enumerating.
+    MojoInput* (*openEntry)(MojoArchive *ar, const char *fname);
+
+    // optional, may be NULL, which means false. True if openEntry() can find
+    //  an entry without reading through the archive to do it: there's a
+    //  directory in memory, or the headers were already indexed. Use
+    //  MojoArchive_indexed().
+    boolean (*indexed)(MojoArchive *ar);
+
+    // optional, may be NULL. Use (toc), a table of contents shipped next to
+    //  the archive, to enumerate and find entries instead of reading through
+    //  the archive. (raw) is the archive file as stored; the start of it is
+    //  read to catch stale TOCs, then it's rewound. (raw) may be NULL to
+    //  skip that check. Use MojoArchive_useTOC().
+    boolean (*useTOC)(MojoArchive *ar, MojoInput *toc, MojoInput *raw);
+
     // private
     MojoInput *io;
     MojoArchiveEntry prevEnum;
@@ -97,13 +164,39 @@ struct MojoArchive
 MojoArchive *MojoArchive_newFromDirectory(const char *dirname);
 MojoArchive *MojoArchive_newFromInput(MojoInput *io, const char *origfname);
 
-// This will reset enumeration in the archive, don't use it while iterating!
-// Also, this can be very slow depending on the archive in question, so
-//  try to limit your random access filename lookups to known-fast quantities
-//  (like directories on the physical filesystem or a zipfile...tarballs and
-//  zipfiles-in-zipfiles will bog down here, for example).
+// Hand a table of contents sidecar to (ar), if it knows how to use one; see
+//  the useTOC method. This always closes (toc), which may be NULL, but not
+//  (raw). Returns true if (ar) will enumerate from it from now on.
+boolean MojoArchive_useTOC(MojoArchive *ar, MojoInput *toc, MojoInput *raw);
+
+// True if (ar) can open entries by name cheaply; see the indexed method.
+boolean MojoArchive_indexed(MojoArchive *ar);
+
+// Open the file entry (fname) in (ar), or NULL if there isn't one (or it's
+//  a directory, symlink, etc). This uses the archive's openEntry() if it has
+//  one, which doesn't disturb enumeration and is cheap after the first call.
+//  Otherwise this will reset enumeration in the archive, so don't use it while
+//  iterating, and it has to walk the whole archive to find (fname) each time.
 MojoInput *MojoInput_newFromArchivePath(MojoArchive *ar, const char *fname);
 
+// A name -> (offset, size) hash table of an archive's file entries, for
+//  archivers that would otherwise have to enumerate to look up a name.
+//  The first entry added under a given name wins, like enumerating would.
+typedef struct MojoArchiveIndex MojoArchiveIndex;
+MojoArchiveIndex *MojoArchiveIndex_create(void);
+void MojoArchiveIndex_add(MojoArchiveIndex *idx, const char *fname,
+                          uint64 start, uint64 len);
+boolean MojoArchiveIndex_find(const MojoArchiveIndex *idx, const char *fname,
+                              uint64 *start, uint64 *len);
+void MojoArchiveIndex_destroy(MojoArchiveIndex *idx);
+
+// Enumerate (ar) once and index every file entry, asking (entrystart) where
+//  the current entry's data starts in ar->io. This saves and restores
+//  ar->prevEnum, but the archiver has to save and restore the rest of its own
+//  enumeration state around this call.
+MojoArchiveIndex *MojoArchiveIndex_build(MojoArchive *ar,
+                                         uint64 (*entrystart)(MojoArchive *ar));
+
 // Wrap (origio) in a new MojoInput that decompresses a compressed stream
 //  on the fly. Returns NULL on error or if (origio) isn't a supported
 //  compressed format. The returned MojoInput wraps the original input;
@@ -121,12 +214,77 @@ void MojoArchive_deinitBaseArchive(void);
 
 typedef boolean (*MojoInput_FileCopyCallback)(uint32 ticks, int64 justwrote,
                                             int64 bw, int64 total, void *data);
+// A NULL (fname) reads and checksums (in) without writing it anywhere, so
+//  the benchmarks can time everything but the disk.
 boolean MojoInput_toPhysicalFile(MojoInput *in, const char *fname, uint16 perms,
                                  MojoChecksums *checksums, int64 maxbytes,
                                  MojoInput_FileCopyCallback cb, void *data);
 
+// Write several files at once, one per job on the worker threads. Each
+//  (in) should come from openCurrentEntryDetached(), or otherwise be safe to
+//  read on another thread; they are all closed before this returns. (cb) is
+//  called on this thread, with the index of the file it's reporting on, as
+//  each file progresses; files are reported on in order, so (item) never
+//  goes backwards. Returns false if (cb) cancelled the whole thing. Check
+//  each item's (ok) for individual failures.
+typedef struct MojoExtractItem
+{
+    MojoInput *in;
+    const char *fname;
+    uint16 perms;
+    boolean ok;  // output: true if the file was written successfully.
+    MojoChecksums checksums;  // output: only valid if (ok).
+} MojoExtractItem;
+
+typedef boolean (*MojoInput_FilesCopyCallback)(uint32 item, uint32 ticks,
+                                               int64 justwrote, int64 bw,
+                                               int64 total, void *data);
+boolean MojoInput_toPhysicalFiles(MojoExtractItem *items, uint32 count,
+                                  MojoInput_FilesCopyCallback cb, void *data);
+
+// Compute checksums of several files in the physical filesystem at once,
+//  one per job on the worker threads. Files are read in the order they sit
+//  on the disk (see MojoPlatform_diskOrder()), not the order you list them
+//  in, so a big batch doesn't seek all over the place. (cb) is called on this
+//  thread as each file finishes, with its index and how many bytes were read;
+//  it may return false to stop. Returns false if it did. Check each item's
+//  (ok) for files that couldn't be read.
+typedef struct MojoChecksumItem
+{
+    const char *fname;
+    uint32 flags;  // the digests to compute; see MojoChecksumFlags.
+    boolean ok;  // output: true if the whole file was read.
+    MojoChecksums checksums;  // output: only valid if (ok).
+} MojoChecksumItem;
+
+typedef boolean (*MojoInput_ChecksumFilesCallback)(uint32 item, uint32 ticks,
+                                                   int64 bytes, void *data);
+boolean MojoInput_checksumFiles(MojoChecksumItem *items, uint32 count,
+                                MojoInput_ChecksumFilesCallback cb, void *data);
+
 MojoInput *MojoInput_newFromURL(const char *url);
 
+// Get a pointer to up to (len) bytes at the current position of (io) without
+//  copying them, and move the file pointer past them, like read() would.
+//  Returns the number of bytes in (*ptr), 0 at EOF, or -1 if (io) can't lend
+//  out its data (it isn't backed by memory, it's compressed, etc), in which
+//  case the file pointer doesn't move and you should read() instead. The
+//  pointer is read-only, and valid until (io) is closed.
+int64 MojoInput_borrow(MojoInput *io, uint32 len, const uint8 **ptr);
+
+// If (io) came with a CRC-32 of its data (a zip entry has one in the
+//  central directory) and checks it as it goes, put it in (*crc) and return
+//  true. That check only happens if you read (io) from where it is now to
+//  the end, which must be the start of the data: if it fails, the last read()
+//  fails, so a successful read to EOF means the data matched (*crc), and
+//  you don't have to compute it yourself.
+boolean MojoInput_storedCrc32(MojoInput *io, uint32 *crc);
+
+// True if (io) can seek anywhere without reading its way there: it's a file,
+//  or memory, or a window onto one of those. Compressed streams, downloads
+//  and anything we aren't sure about are false.
+boolean MojoInput_seeksCheaply(MojoInput *io);
+
 // Read a littleendian, unsigned 16-bit integer from (io), swapping it to
 //  the correct byteorder for the platform, and moving the file pointer
 //  ahead 2 bytes. Returns true on successful read and fills the swapped
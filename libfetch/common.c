@@ -1042,7 +1042,7 @@ static int64 MojoInput_blocking_read(MojoInput *io, void *buf, uint32 bufsize)
 
 static boolean MojoInput_blocking_seek(MojoInput *io, uint64 pos)
 {
-    return -1;
+    return false;  // streams only go forward.
 } // MojoInput_blocking_seek
 
 static int64 MojoInput_blocking_tell(MojoInput *io)
@@ -160,7 +160,7 @@ static boolean MojoInput_http_ready(MojoInput *v)
 }
 static boolean MojoInput_http_seek(MojoInput *v, uint64 pos)
 {
-    return -1;
+    return false;  // streams only go forward.
 }
 static int64 MojoInput_http_tell(MojoInput *v)
 {
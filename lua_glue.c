@@ -19,9 +19,31 @@
 
 static lua_State *luaState = NULL;
 
+// Garbage collector pacing; see MojoLua_paceGarbage().
+static size_t luaHeapBytes = 0;      // what Lua has allocated right now.
+static size_t luaHeapPeak = 0;       // high point since the stats reset.
+static uint64 luaAllocated = 0;      // total ever allocated, for step sizes.
+static uint64 gcPacedAt = 0;         // (luaAllocated) at the last step.
+static uint64 gcMicroseconds = 0;    // spent in our steps and collections.
+static uint32 gcSteps = 0;
+static uint32 gcCollections = 0;
+static uint32 gcStepKB = 64;         // most work to do in one step.
+static uint32 gcBudget = 2000;       // most microseconds per pacing call.
+static size_t gcHighWater = 0;       // full collect past this; 0 for never.
+static size_t gcHighWaterAt = 0;     // where the next one is.
+
 // Allocator interface for internal Lua use.
 static void *MojoLua_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
 {
+    if (ptr == NULL)
+        osize = 0;  // (osize) is the object type for new allocations.
+
+    luaHeapBytes = (luaHeapBytes - osize) + nsize;
+    if (luaHeapBytes > luaHeapPeak)
+        luaHeapPeak = luaHeapBytes;
+    if (nsize > osize)
+        luaAllocated += nsize - osize;
+
     if (nsize == 0)
     {
         free(ptr);
@@ -171,11 +193,26 @@ static inline int retvalLightUserData(lua_State *L, void *data)
 } // retvalLightUserData
 
 
+#if SUPPORT_XXH128 || SUPPORT_BLAKE3
+static void hexstr(char *buf, const uint8 *dig, const size_t len)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    size_t i;
+    for (i = 0; i < len; i++)
+    {
+        *(buf++) = hex[dig[i] >> 4];
+        *(buf++) = hex[dig[i] & 0xF];
+    } // for
+    *buf = '\0';
+} // hexstr
+#endif
+
 static int retvalChecksums(lua_State *L, const MojoChecksums *sums)
 {
     lua_newtable(L);
 
     #if SUPPORT_CRC32
+    if (sums->flags & MOJOCHECKSUM_CRC32)
     {
         char buf[64];
         snprintf(buf, sizeof (buf), "%X", (unsigned int) sums->crc32);
@@ -184,6 +221,7 @@ static int retvalChecksums(lua_State *L, const MojoChecksums *sums)
     #endif
 
     #if SUPPORT_MD5
+    if (sums->flags & MOJOCHECKSUM_MD5)
     {
         char buf[64];
         const uint8 *dig = sums->md5;
@@ -197,6 +235,7 @@ static int retvalChecksums(lua_State *L, const MojoChecksums *sums)
     #endif
 
     #if SUPPORT_SHA1
+    if (sums->flags & MOJOCHECKSUM_SHA1)
     {
         char buf[64];
         const uint8 *dig = sums->sha1;
@@ -210,6 +249,25 @@ static int retvalChecksums(lua_State *L, const MojoChecksums *sums)
     }
     #endif
 
+    // Unlike the older ones above, these are zero-padded, like xxhsum/b3sum.
+    #if SUPPORT_XXH128
+    if (sums->flags & MOJOCHECKSUM_XXH128)
+    {
+        char buf[64];
+        hexstr(buf, sums->xxh128, sizeof (sums->xxh128));
+        set_string(L, buf, "xxh128");
+    }
+    #endif
+
+    #if SUPPORT_BLAKE3
+    if (sums->flags & MOJOCHECKSUM_BLAKE3)
+    {
+        char buf[80];
+        hexstr(buf, sums->blake3, sizeof (sums->blake3));
+        set_string(L, buf, "blake3");
+    }
+    #endif
+
     return 1;
 } // retvalChecksums
 
@@ -406,40 +464,29 @@ boolean MojoLua_callProcedure(const char *funcname)
 boolean MojoLua_runFileFromDir(const char *dir, const char *name)
 {
     MojoArchive *ar = GBaseArchive;   // in case we want to generalize later.
-    const MojoArchiveEntry *entinfo = NULL;
     boolean retval = false;
     char *clua = format("%0/%1.luac", dir, name);  // compiled filename.
     char *ulua = format("%0/%1.lua", dir, name);   // uncompiled filename.
+    const char *fname = clua;
     int rc = 0;
     MojoInput *io = NULL;
 
-    if (ar->enumerate(ar))
+    io = MojoInput_newFromArchivePath(ar, clua);
+    #if !DISABLE_LUA_PARSER
+    if (io == NULL)
     {
-        while ((io == NULL) && ((entinfo = ar->enumNext(ar)) != NULL))
-        {
-            boolean match = false;
-
-            if (entinfo->type != MOJOARCHIVE_ENTRY_FILE)
-                continue;
-
-            match = (strcmp(entinfo->filename, clua) == 0);
-            #if !DISABLE_LUA_PARSER
-            if (!match)
-                match = (strcmp(entinfo->filename, ulua) == 0);
-            #endif
-
-            if (match)
-                io = ar->openCurrentEntry(ar);
-        } // while
+        fname = ulua;
+        io = MojoInput_newFromArchivePath(ar, ulua);
     } // if
-
-    free(ulua);
-    free(clua);
+    #endif
 
     if (io != NULL)
     {
-        char *realfname = (char *) xmalloc(strlen(entinfo->filename) + 2);
-        sprintf(realfname, "@%s", entinfo->filename);
+        char *realfname = (char *) xmalloc(strlen(fname) + 2);
+        sprintf(realfname, "@%s", fname);
+        MojoTrace_begin("lua", fname);  // a Lua error won't end this, but
+        free(ulua);                     //  then we're on our way out anyhow.
+        free(clua);
         lua_pushcfunction(luaState, luahook_stackwalk);
         rc = lua_load(luaState, MojoLua_reader, io, realfname, NULL);
         free(realfname);
@@ -456,8 +503,15 @@ boolean MojoLua_runFileFromDir(const char *dir, const char *name)
                 retval = true;   // if this didn't panic, we succeeded.
         } // if
         lua_pop(luaState, 1);   // dump stackwalker.
+        MojoTrace_end("lua");
     } // if
 
+    else
+    {
+        free(ulua);
+        free(clua);
+    } // else
+
     return retval;
 } // MojoLua_runFileFromDir
 
@@ -472,28 +526,30 @@ void MojoLua_collectGarbage(void)
 {
     lua_State *L = luaState;
     uint32 ticks = 0;
+    uint64 start = 0;
     int pre = 0;
     int post = 0;
 
-    lua_getglobal(L, MOJOSETUP_NAMESPACE);
-    if (lua_istable(L, -1))  // namespace is sane?
-        set_integer(L, 0, "garbagecounter");
-    lua_pop(L, 1);
-
     pre = (lua_gc(L, LUA_GCCOUNT, 0) * 1024) + lua_gc(L, LUA_GCCOUNTB, 0);
     logDebug("Collecting garbage (currently using %0 bytes).", numstr(pre));
     ticks = MojoPlatform_ticks();
+    start = MojoPlatform_microTicks();
+    MojoTrace_begin("lua", "Garbage collection");
     lua_gc (L, LUA_GCCOLLECT, 0);
+    MojoTrace_end("lua");
+    gcMicroseconds += MojoPlatform_microTicks() - start;
+    gcCollections++;
+    gcPacedAt = luaAllocated;
     profile("Garbage collection", ticks);
     post = (lua_gc(L, LUA_GCCOUNT, 0) * 1024) + lua_gc(L, LUA_GCCOUNTB, 0);
+    MojoTrace_counter("Lua memory", post);
     logDebug("Now using %0 bytes (%1 bytes savings).",
              numstr(post), numstr(pre - post));
 } // MojoLua_collectGarbage
 
 
 // You can trigger the garbage collector with more control in the standard
-//  Lua runtime, but this notes profiling and statistics via logDebug(),
-//  and resets MojoSetup.garbagecounter to zero.
+//  Lua runtime, but this notes profiling and statistics via logDebug().
 static int luahook_collectgarbage(lua_State *L)
 {
     MojoLua_collectGarbage();
@@ -501,6 +557,135 @@ static int luahook_collectgarbage(lua_State *L)
 } // luahook_collectgarbage
 
 
+// Lua's incremental collector already runs a little as we allocate, but
+//  loops that churn through lots of items call this between them, so more
+//  of the collecting happens there, and the collector stays ahead of the
+//  garbage those loops make. We pay off what Lua allocated since the last
+//  call, (gcStepKB) at a time, until we catch up, the collector finishes a
+//  cycle, or we use up (gcBudget) microseconds. Nothing stops the world
+//  unless the heap passes the high watermark anyhow. If most of the heap is
+//  still alive after that, the watermark moves up to twice what's left, so
+//  we don't end up doing a full collection every time.
+void MojoLua_paceGarbage(void)
+{
+    lua_State *L = luaState;
+    const uint64 start = MojoPlatform_microTicks();
+    uint64 debt = (luaAllocated - gcPacedAt) / 1024;
+
+    if ((gcHighWater > 0) && (luaHeapBytes >= gcHighWaterAt))
+    {
+        logDebug("Lua heap is past %0 KB.", numstr((int) (gcHighWaterAt / 1024)));
+        MojoLua_collectGarbage();
+        gcHighWaterAt = luaHeapBytes * 2;
+        if (gcHighWaterAt < gcHighWater)
+            gcHighWaterAt = gcHighWater;
+        return;
+    } // if
+
+    MojoTrace_begin("lua", "Garbage step");
+    while (true)
+    {
+        const uint32 kb = (debt > gcStepKB) ? gcStepKB : (uint32) debt;
+        const boolean finished = (lua_gc(L, LUA_GCSTEP, (int) kb) != 0);
+        gcSteps++;
+        debt -= kb;
+        if ((finished) || (debt == 0))
+            break;
+        else if ((MojoPlatform_microTicks() - start) >= gcBudget)
+            break;
+    } // while
+    MojoTrace_end("lua");
+    MojoTrace_counter("Lua memory", (int64) luaHeapBytes);
+
+    gcPacedAt = luaAllocated - (debt * 1024);
+    gcMicroseconds += MojoPlatform_microTicks() - start;
+} // MojoLua_paceGarbage
+
+
+static int luahook_pacegarbage(lua_State *L)
+{
+    MojoLua_paceGarbage();
+    return 0;
+} // luahook_pacegarbage
+
+
+// MojoSetup.gcstats(reset): how much time (in milliseconds) our collections
+//  and pacing took, how many of each there were, and the biggest and
+//  current size of the Lua heap (in bytes). Lua's own steps, as it
+//  allocates, aren't counted. If (reset), start counting again from here.
+static int luahook_gcstats(lua_State *L)
+{
+    const boolean reset = lua_toboolean(L, 1);
+    lua_createtable(L, 0, 5);
+    set_number(L, ((lua_Number) gcMicroseconds) / 1000.0, "time");
+    set_integer(L, (lua_Integer) gcSteps, "steps");
+    set_integer(L, (lua_Integer) gcCollections, "collections");
+    set_number(L, (lua_Number) luaHeapPeak, "peak");
+    set_number(L, (lua_Number) luaHeapBytes, "heap");
+
+    if (reset)
+    {
+        gcMicroseconds = 0;
+        gcSteps = 0;
+        gcCollections = 0;
+        luaHeapPeak = luaHeapBytes;
+    } // if
+
+    return 1;
+} // luahook_gcstats
+
+
+// The command line can tune the collector: --gcpause and --gcstepmul are
+//  Lua's own settings (see collectgarbage() in the Lua manual), --gcstep
+//  and --gcbudget are the most kilobytes and microseconds for a pacing
+//  call, and --gcheapmax is the watermark in kilobytes.
+static void initGarbagePacing(lua_State *L)
+{
+    const char *str = NULL;
+
+    if ((str = cmdlinestr("gcpause", "MOJOSETUP_GCPAUSE", NULL)) != NULL)
+        lua_gc(L, LUA_GCSETPAUSE, (int) strtoul(str, NULL, 10));
+    if ((str = cmdlinestr("gcstepmul", "MOJOSETUP_GCSTEPMUL", NULL)) != NULL)
+        lua_gc(L, LUA_GCSETSTEPMUL, (int) strtoul(str, NULL, 10));
+    if ((str = cmdlinestr("gcstep", "MOJOSETUP_GCSTEP", NULL)) != NULL)
+        gcStepKB = (uint32) strtoul(str, NULL, 10);
+    if ((str = cmdlinestr("gcbudget", "MOJOSETUP_GCBUDGET", NULL)) != NULL)
+        gcBudget = (uint32) strtoul(str, NULL, 10);
+    if ((str = cmdlinestr("gcheapmax", "MOJOSETUP_GCHEAPMAX", NULL)) != NULL)
+        gcHighWater = ((size_t) strtoul(str, NULL, 10)) * 1024;
+    gcHighWaterAt = gcHighWater;
+
+    if (gcStepKB == 0)
+        gcStepKB = 1;
+} // initGarbagePacing
+
+
+// Lua interfaces to the MojoTrace_*() functions.
+static int luahook_tracebegin(lua_State *L)
+{
+    const char *cat = luaL_checkstring(L, 1);
+    const char *name = luaL_checkstring(L, 2);
+    MojoTrace_begin(cat, name);
+    return 0;
+} // luahook_tracebegin
+
+
+static int luahook_traceend(lua_State *L)
+{
+    MojoTrace_end(luaL_checkstring(L, 1));
+    return 0;
+} // luahook_traceend
+
+
+static int luahook_tracecounter(lua_State *L)
+{
+    const char *name = luaL_checkstring(L, 1);
+    const lua_Number value = luaL_checknumber(L, 2);
+    MojoTrace_counter(name, (int64) value);
+    return 0;
+} // luahook_tracecounter
+
+
 // Since localization is kept in Lua tables, I stuck this in the Lua glue.
 const char *translate(const char *str)
 {
@@ -806,24 +991,40 @@ static int luahook_findmedia(lua_State *L)
 } // luahook_findmedia
 
 
+typedef struct WriteFileData
+{
+    lua_State *L;
+    boolean failed;  // callback raised an error; it's on top of the stack.
+} WriteFileData;
+
+// MojoInput_toPhysicalFile() may have hashing jobs running that need to be
+//  joined, so an error in the callback can't longjmp out of it. Catch it,
+//  cancel the write, and do_writefile() raises it again afterwards.
 static boolean writeCallback(uint32 ticks, int64 justwrote, int64 bw,
                              int64 total, void *data)
 {
     boolean retval = false;
-    lua_State *L = (lua_State *) data;
+    WriteFileData *wfd = (WriteFileData *) data;
+    lua_State *L = wfd->L;
     // Lua callback is on top of stack...
     if (lua_isnil(L, -1))
         retval = true;
     else
     {
-        lua_pushvalue(L, -1);
+        lua_pushcfunction(L, luahook_stackwalk);
+        lua_pushvalue(L, -2);
         lua_pushnumber(L, (lua_Number) ticks);
         lua_pushnumber(L, (lua_Number) justwrote);
         lua_pushnumber(L, (lua_Number) bw);
         lua_pushnumber(L, (lua_Number) total);
-        lua_call(L, 4, 1);
+        if (lua_pcall(L, 4, 1, -6) != 0)
+        {
+            lua_remove(L, -2);  // dump stackwalker, leave the error.
+            wfd->failed = true;
+            return false;
+        } // if
         retval = lua_toboolean(L, -1);
-        lua_pop(L, 1);
+        lua_pop(L, 2);  // result, stackwalker.
     } // if
     return retval;
 } // writeCallback
@@ -837,6 +1038,7 @@ static int do_writefile(lua_State *L, MojoInput *in, uint16 perms)
     boolean rc = false;
     MojoChecksums sums;
     int64 maxbytes = -1;
+    WriteFileData wfd;
 
     if (in != NULL)
     {
@@ -852,8 +1054,12 @@ static int do_writefile(lua_State *L, MojoInput *in, uint16 perms)
         if (!lua_isnil(L, 4))
             maxbytes = luaL_checkinteger(L, 4);
 
+        wfd.L = L;
+        wfd.failed = false;
         rc = MojoInput_toPhysicalFile(in, path, perms, &sums, maxbytes,
-                                      writeCallback, L);
+                                      writeCallback, &wfd);
+        if (wfd.failed)
+            return lua_error(L);  // error on stack has debug info.
     } // if
 
     retval += retvalBoolean(L, rc);
@@ -866,8 +1072,12 @@ static int do_writefile(lua_State *L, MojoInput *in, uint16 perms)
 static int luahook_writefile(lua_State *L)
 {
     MojoArchive *archive = (MojoArchive *) lua_touserdata(L, 1);
+    const boolean prefetch = lua_toboolean(L, 6);
     uint16 perms = archive->prevEnum.perms;
     MojoInput *in = archive->openCurrentEntry(archive);
+    if ((in != NULL) && (prefetch))
+        in = MojoInput_newPrefetched(in, 0, 0);
+    lua_settop(L, 5);  // do_writefile() wants the callback on top.
     return do_writefile(L, in, perms);
 } // luahook_writefile
 
@@ -875,8 +1085,14 @@ static int luahook_writefile(lua_State *L)
 static int luahook_download(lua_State *L)
 {
     const char *src = luaL_checkstring(L, 1);
-    MojoInput *in = MojoInput_newFromURL(src);
-    return do_writefile(L, in, MojoPlatform_defaultFilePerms());
+    MojoInput *in = NULL;
+    int retval = 0;
+
+    MojoTrace_begin("download", src);
+    in = MojoInput_newFromURL(src);
+    retval = do_writefile(L, in, MojoPlatform_defaultFilePerms());
+    MojoTrace_end("download");
+    return retval;
 } // luahook_download
 
 
@@ -912,13 +1128,32 @@ static int luahook_isvalidperms(lua_State *L)
 } // luahook_isvalidperms
 
 
+static int luahook_isvalidchecksums(lua_State *L)
+{
+    uint32 flags = 0;
+    const char *str = luaL_checkstring(L, 1);
+    return retvalBoolean(L, MojoChecksum_parsePolicy(str, &flags));
+} // luahook_isvalidchecksums
+
+
+static int luahook_setchecksums(lua_State *L)
+{
+    uint32 flags = 0;
+    const char *str = luaL_checkstring(L, 1);
+    const boolean valid = MojoChecksum_parsePolicy(str, &flags);
+    if (valid)
+        MojoChecksum_setPolicy(flags);
+    return retvalBoolean(L, valid);
+} // luahook_setchecksums
+
+
 static int do_checksum(lua_State *L, MojoInput *in)
 {
     MojoChecksumContext ctx;
     MojoChecksums sums;
     int64 br = 0;
 
-    MojoChecksum_init(&ctx);
+    MojoChecksum_init(&ctx, MOJOCHECKSUM_ALL);  // they asked for them.
 
     while (1)
     {
@@ -944,6 +1179,125 @@ static int luahook_checksum(lua_State *L)
 } // luahook_checksum
 
 
+typedef struct ChecksumFilesData
+{
+    lua_State *L;
+    int callback;  // stack index of the Lua callback.
+    boolean failed;  // callback raised an error; it's on top of the stack.
+} ChecksumFilesData;
+
+// The callback can't just longjmp out of MojoInput_checksumFiles() while
+//  jobs are still running, so we catch any error here, cancel, and let
+//  luahook_checksumfiles() raise it again once everything's finished.
+static boolean checksumFilesCallback(uint32 item, uint32 ticks, int64 bytes,
+                                     void *data)
+{
+    ChecksumFilesData *cfd = (ChecksumFilesData *) data;
+    lua_State *L = cfd->L;
+    boolean retval = true;
+    if (!lua_isnil(L, cfd->callback))
+    {
+        lua_pushcfunction(L, luahook_stackwalk);
+        lua_pushvalue(L, cfd->callback);
+        lua_pushinteger(L, (lua_Integer) (item + 1));
+        lua_pushnumber(L, (lua_Number) ticks);
+        lua_pushnumber(L, (lua_Number) bytes);
+        if (lua_pcall(L, 3, 1, -5) != 0)
+        {
+            lua_remove(L, -2);  // dump stackwalker, leave the error.
+            cfd->failed = true;
+            return false;
+        } // if
+        retval = lua_toboolean(L, -1);
+        lua_pop(L, 2);  // result, stackwalker.
+    } // if
+    return retval;
+} // checksumFilesCallback
+
+
+// MojoSetup.checksumfiles(items, callback)
+//  (items) is an array of tables with the field "fname", and optionally
+//  "checksums", a string like MojoSetup.setchecksums() takes, to pick which
+//  digests to compute (all of them if nil). The files are hashed on the
+//  worker threads. Returns false if (callback) cancelled, and a table with
+//  either the checksums or false (couldn't read it) for each item, in the
+//  same order.
+static int luahook_checksumfiles(lua_State *L)
+{
+    MojoChecksumItem *items = NULL;
+    ChecksumFilesData cfd;
+    boolean rc = true;
+    uint32 count;
+    uint32 i;
+
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_settop(L, 2);  // callback is optional.
+    count = (uint32) lua_rawlen(L, 1);
+
+    // Check everything first; a Lua error after we allocate would leak.
+    for (i = 0; i < count; i++)
+    {
+        lua_rawgeti(L, 1, (int) (i + 1));
+        luaL_checktype(L, -1, LUA_TTABLE);
+        lua_getfield(L, -1, "fname");
+        luaL_checktype(L, -1, LUA_TSTRING);  // a number wouldn't stay alive.
+        lua_getfield(L, -2, "checksums");
+        if (!lua_isnil(L, -1))
+            luaL_checktype(L, -1, LUA_TSTRING);
+        lua_pop(L, 3);  // checksums, fname, item table.
+    } // for
+
+    if (count > 0)
+        items = (MojoChecksumItem *) xmalloc(sizeof (MojoChecksumItem) * count);
+
+    for (i = 0; i < count; i++)
+    {
+        MojoChecksumItem *item = &items[i];
+        lua_rawgeti(L, 1, (int) (i + 1));
+
+        // (the table in arg 1 keeps this string alive until we return.)
+        lua_getfield(L, -1, "fname");
+        item->fname = lua_tostring(L, -1);
+        lua_pop(L, 1);
+
+        lua_getfield(L, -1, "checksums");
+        if (lua_isnil(L, -1))
+            item->flags = MOJOCHECKSUM_ALL;
+        else
+        {
+            const char *str = lua_tostring(L, -1);
+            if (!MojoChecksum_parsePolicy(str, &item->flags))
+                fatal(_("BUG: '%0' is not a valid checksum list"), str);
+        } // else
+        lua_pop(L, 2);  // checksums, item table.
+    } // for
+
+    cfd.L = L;
+    cfd.callback = 2;
+    cfd.failed = false;
+    rc = MojoInput_checksumFiles(items, count, checksumFilesCallback, &cfd);
+    if (cfd.failed)
+    {
+        free(items);
+        return lua_error(L);  // error on stack has debug info.
+    } // if
+
+    retvalBoolean(L, rc);
+    lua_createtable(L, (int) count, 0);
+    for (i = 0; i < count; i++)
+    {
+        if (items[i].ok)
+            retvalChecksums(L, &items[i].checksums);
+        else
+            lua_pushboolean(L, false);
+        lua_rawseti(L, -2, (int) (i + 1));
+    } // for
+
+    free(items);
+    return 2;
+} // luahook_checksumfiles
+
+
 static int luahook_archive_fromdir(lua_State *L)
 {
     const char *path = luaL_checkstring(L, 1);
@@ -956,12 +1310,55 @@ static int luahook_archive_fromfile(lua_State *L)
     const char *path = luaL_checkstring(L, 1);
     MojoInput *io = MojoInput_newFromFile(path);
     MojoArchive *archive = NULL;
+    boolean seekable = true;
+
+    // Pipes and such can't seek; read those strictly front to back.
+    if ((io != NULL) && (!io->seek(io, 0)))
+    {
+        io = MojoInput_newForwardOnly(io);
+        seekable = false;
+    } // if
+
     if (io != NULL)
         archive = MojoArchive_newFromInput(io, path);
+
+    // Compressed tarballs can ship a "whatever.tar.xz.toc" so we don't have
+    //  to decompress the whole thing just to list it. A pipe can only be
+    //  read the one way, though, so a TOC is no use there.
+    if ((archive != NULL) && (archive->useTOC != NULL) && (seekable))
+    {
+        char *tocpath = format("%0.toc", path);
+        if (MojoPlatform_exists(tocpath, NULL))
+        {
+            MojoInput *raw = MojoInput_newFromFile(path);
+            if (raw != NULL)
+            {
+                MojoArchive_useTOC(archive, MojoInput_newFromFile(tocpath),
+                                   raw);
+                raw->close(raw);
+            } // if
+        } // if
+        free(tocpath);
+    } // if
+
     return retvalLightUserData(L, archive);
 } // luahook_archive_fromfile
 
 
+// Install straight off the network: the archive is read once, front to
+//  back, as it downloads, so this is only useful for tarballs (zipfiles
+//  keep their directory at the end).
+static int luahook_archive_fromurl(lua_State *L)
+{
+    const char *url = luaL_checkstring(L, 1);
+    MojoInput *io = MojoInput_newForwardOnly(MojoInput_newFromURL(url));
+    MojoArchive *archive = NULL;
+    if (io != NULL)
+        archive = MojoArchive_newFromInput(io, url);
+    return retvalLightUserData(L, archive);
+} // luahook_archive_fromurl
+
+
 static int luahook_archive_fromentry(lua_State *L)
 {
     MojoArchive *ar = (MojoArchive *) lua_touserdata(L, 1);
@@ -969,6 +1366,32 @@ static int luahook_archive_fromentry(lua_State *L)
     MojoArchive *archive = NULL;
     if (io != NULL)
         archive = MojoArchive_newFromInput(io, ar->prevEnum.filename);
+
+    // Look for a TOC sidecar next to the entry, but only if (ar) can find it
+    //  cheaply and without disturbing the enumeration our caller is in the
+    //  middle of. Looking up a name in a tarball with no index means reading
+    //  through all of it, which would cost more than the TOC could save us,
+    //  and would use up a forward-only stream.
+    if ((archive != NULL) && (archive->useTOC != NULL) &&
+        (MojoArchive_indexed(ar)))
+    {
+        char *tocpath = format("%0.toc", ar->prevEnum.filename);
+        MojoInput *toc = MojoInput_newFromArchivePath(ar, tocpath);
+        if (toc != NULL)
+        {
+            // our own copy of the raw entry, to check the TOC against.
+            MojoInput *raw = ar->openCurrentEntry(ar);
+            if (raw == NULL)
+                toc->close(toc);
+            else
+            {
+                MojoArchive_useTOC(archive, toc, raw);
+                raw->close(raw);
+            } // else
+        } // if
+        free(tocpath);
+    } // if
+
     return retvalLightUserData(L, archive);
 } // luahook_archive_fromentry
 
@@ -976,39 +1399,362 @@ static int luahook_archive_fromentry(lua_State *L)
 static int luahook_archive_enumerate(lua_State *L)
 {
     MojoArchive *archive = (MojoArchive *) lua_touserdata(L, 1);
-    return retvalBoolean(L, archive->enumerate(archive));
+    boolean rc = false;
+    MojoTrace_begin("archive", "enumerate");
+    rc = archive->enumerate(archive);
+    MojoTrace_end("archive");
+    return retvalBoolean(L, rc);
 } // luahook_archive_enumerate
 
 
+// An enumeration filter, so Lua only sees the entries it wants: it drops
+//  entries outside (prefix) and strips it from the rest, then checks them
+//  against a list of wildcard lists, one per Setup.File, all at once.
+typedef struct ArchiveFilter
+{
+    MojoWildcardSet *set;
+    char *prefix;
+    size_t prefixlen;
+    uint32 *matches;
+    uint32 listcount;
+} ArchiveFilter;
+
+// MojoSetup.archive.newfilter(prefix, lists): (prefix) may be nil, and
+//  (lists) is an array of arrays of wildcard strings.
+static int luahook_archive_newfilter(lua_State *L)
+{
+    const char *prefix = luaL_optstring(L, 1, "");
+    ArchiveFilter *filter = NULL;
+    uint32 i, j;
+
+    luaL_checktype(L, 2, LUA_TTABLE);
+    filter = (ArchiveFilter *) xmalloc(sizeof (ArchiveFilter));
+    filter->set = MojoWildcardSet_create();
+    filter->prefix = xstrdup(prefix);
+    filter->prefixlen = strlen(prefix);
+    filter->listcount = (uint32) lua_rawlen(L, 2);
+    filter->matches = (uint32 *) xmalloc(sizeof (uint32) *
+                                         (filter->listcount + 1));
+
+    for (i = 0; i < filter->listcount; i++)
+    {
+        lua_rawgeti(L, 2, (int) (i + 1));
+        luaL_checktype(L, -1, LUA_TTABLE);
+        for (j = 1; j <= (uint32) lua_rawlen(L, -1); j++)
+        {
+            lua_rawgeti(L, -1, (int) j);
+            MojoWildcardSet_add(filter->set, luaL_checkstring(L, -1), i);
+            lua_pop(L, 1);
+        } // for
+        lua_pop(L, 1);
+    } // for
+
+    return retvalLightUserData(L, filter);
+} // luahook_archive_newfilter
+
+
+static int luahook_archive_freefilter(lua_State *L)
+{
+    ArchiveFilter *filter = (ArchiveFilter *) lua_touserdata(L, 1);
+    if (filter != NULL)
+    {
+        MojoWildcardSet_destroy(filter->set);
+        free(filter->prefix);
+        free(filter->matches);
+        free(filter);
+    } // if
+    return 0;
+} // luahook_archive_freefilter
+
+
+// Step (archive) to its next entry, skipping anything (filter) doesn't want
+//  (if there is a filter). (*fname) gets the name with the filter's prefix
+//  chopped off, and (*matchcount) the number of lists in filter->matches.
+static const MojoArchiveEntry *archive_next_filtered(MojoArchive *archive,
+                                                     ArchiveFilter *filter,
+                                                     const char **fname,
+                                                     uint32 *matchcount)
+{
+    const MojoArchiveEntry *entinfo = NULL;
+
+    *matchcount = 0;
+    while ((entinfo = archive->enumNext(archive)) != NULL)
+    {
+        *fname = entinfo->filename;
+        if (filter == NULL)
+            break;
+        else if (strncmp(*fname, filter->prefix, filter->prefixlen) != 0)
+            continue;
+
+        *fname += filter->prefixlen;
+        if (**fname == '\0')
+            continue;
+
+        *matchcount = MojoWildcardSet_match(filter->set, *fname,
+                                            filter->matches, filter->listcount);
+        if (*matchcount > 0)
+            break;
+    } // while
+
+    return entinfo;
+} // archive_next_filtered
+
+
+static const char *archive_entry_typestr(const MojoArchiveEntry *entinfo)
+{
+    if (entinfo->type == MOJOARCHIVE_ENTRY_FILE)
+        return "file";
+    else if (entinfo->type == MOJOARCHIVE_ENTRY_DIR)
+        return "dir";
+    else if (entinfo->type == MOJOARCHIVE_ENTRY_SYMLINK)
+        return "symlink";
+    return "unknown";
+} // archive_entry_typestr
+
+
+// Set array t[1..count] to the filter's matches (1-based), where t is on the
+//  top of the Lua stack, and clear anything after that from the last time
+//  this table was filled in.
+static void set_match_array(lua_State *L, const ArchiveFilter *filter,
+                            uint32 count)
+{
+    const int oldlen = (int) lua_rawlen(L, -1);
+    int i;
+
+    for (i = 0; i < (int) count; i++)
+    {
+        lua_pushinteger(L, (lua_Integer) (filter->matches[i] + 1));
+        lua_rawseti(L, -2, i + 1);
+    } // for
+
+    for (i = (int) count + 1; i <= oldlen; i++)
+    {
+        lua_pushnil(L);
+        lua_rawseti(L, -2, i);
+    } // for
+} // set_match_array
+
+
+// Fill in the entry table on the top of the Lua stack. It might be one we
+//  filled in for a previous entry, so every field gets set, even to nil.
+static void set_entry_fields(lua_State *L, const MojoArchiveEntry *entinfo,
+                             const char *fname, const ArchiveFilter *filter,
+                             uint32 matchcount)
+{
+    set_string(L, fname, "filename");
+    set_string(L, entinfo->linkdest, "linkdest");
+    set_number(L, (lua_Number) entinfo->filesize, "filesize");
+    set_string(L, archive_entry_typestr(entinfo), "type");
+
+    if (filter != NULL)
+    {
+        set_string(L, entinfo->filename, "fullname");
+        lua_getfield(L, -1, "matches");
+        if (!lua_istable(L, -1))
+        {
+            lua_pop(L, 1);
+            lua_newtable(L);
+            lua_pushvalue(L, -1);
+            lua_setfield(L, -3, "matches");
+        } // if
+        set_match_array(L, filter, matchcount);
+        lua_pop(L, 1);
+    } // if
+} // set_entry_fields
+
+
+// With a filter as the second argument, entries that don't match anything
+//  are skipped here, in C, and the ones that do have the filter's prefix
+//  chopped off, their original name in "fullname", and a "matches" array:
+//  the (1-based) indices of the wildcard lists that matched, in order.
 static int luahook_archive_enumnext(lua_State *L)
 {
     MojoArchive *archive = (MojoArchive *) lua_touserdata(L, 1);
-    const MojoArchiveEntry *entinfo = archive->enumNext(archive);
+    ArchiveFilter *filter = (ArchiveFilter *) lua_touserdata(L, 2);
+    const MojoArchiveEntry *entinfo = NULL;
+    const char *fname = NULL;
+    uint32 matchcount = 0;
+
+    entinfo = archive_next_filtered(archive, filter, &fname, &matchcount);
     if (entinfo == NULL)
         lua_pushnil(L);
     else
     {
-        const char *typestr = NULL;
-        if (entinfo->type == MOJOARCHIVE_ENTRY_FILE)
-            typestr = "file";
-        else if (entinfo->type == MOJOARCHIVE_ENTRY_DIR)
-            typestr = "dir";
-        else if (entinfo->type == MOJOARCHIVE_ENTRY_SYMLINK)
-            typestr = "symlink";
-        else
-            typestr = "unknown";
-
         lua_newtable(L);
-        set_string(L, entinfo->filename, "filename");
-        set_string(L, entinfo->linkdest, "linkdest");
-        set_number(L, (lua_Number) entinfo->filesize, "filesize");
-        set_string(L, typestr, "type");
+        set_entry_fields(L, entinfo, fname, filter, matchcount);
     } // else
 
     return 1;
 } // luahook_archive_enumnext
 
 
+// The iterator that MojoSetup.archive.entries() returns. Its upvalues are
+//  the archive, the filter (or nil), and the one table it hands out for
+//  every entry.
+static int luahook_archive_entries_iterator(lua_State *L)
+{
+    MojoArchive *archive = (MojoArchive *) lua_touserdata(L, lua_upvalueindex(1));
+    ArchiveFilter *filter = (ArchiveFilter *) lua_touserdata(L, lua_upvalueindex(2));
+    const MojoArchiveEntry *entinfo = NULL;
+    const char *fname = NULL;
+    uint32 matchcount = 0;
+
+    entinfo = archive_next_filtered(archive, filter, &fname, &matchcount);
+    if (entinfo == NULL)
+        lua_pushnil(L);
+    else
+    {
+        lua_pushvalue(L, lua_upvalueindex(3));
+        set_entry_fields(L, entinfo, fname, filter, matchcount);
+    } // else
+
+    return 1;
+} // luahook_archive_entries_iterator
+
+
+// for ent in MojoSetup.archive.entries(archive[, filter]) do ... end
+//  This is enumnext() without a new table for every entry: (ent) is the
+//  same table each time through the loop, refilled for the next entry, so
+//  copy out anything you want to keep. The archive is still sitting on
+//  (ent) during the loop body, so fromentry(), writefile(), etc, work like
+//  they do with enumnext().
+static int luahook_archive_entries(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+    lua_settop(L, 2);
+    lua_newtable(L);
+    lua_pushcclosure(L, luahook_archive_entries_iterator, 3);
+    return 1;
+} // luahook_archive_entries
+
+
+// Clear t[start..oldcount] for the array t at (idx) on the Lua stack.
+static void clear_array_tail(lua_State *L, int idx, int start, int oldcount)
+{
+    int i;
+    for (i = start; i <= oldcount; i++)
+    {
+        lua_pushnil(L);
+        lua_rawseti(L, idx, i);
+    } // for
+} // clear_array_tail
+
+
+// Push batch[sym], where (batch) is at (idx) on the Lua stack, making a new
+//  array there if it doesn't have one yet.
+static void push_batch_array(lua_State *L, int idx, const char *sym)
+{
+    lua_getfield(L, idx, sym);
+    if (!lua_istable(L, -1))
+    {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setfield(L, idx, sym);
+    } // if
+} // push_batch_array
+
+
+// MojoSetup.archive.enumbatch(archive, n[, filter[, batch]]): reads up to
+//  (n) entries and returns them as a struct of arrays instead of a table per
+//  entry: batch.count is the number read (zero at the end of the archive),
+//  and batch.filename[i], batch.type[i], batch.filesize[i] and
+//  batch.linkdest[i] describe entry (i). With a filter, batch.fullname[i]
+//  is there too, and entry (i) matched the lists at
+//  batch.matches[batch.firstmatch[i]] through
+//  batch.matches[batch.firstmatch[i] + batch.matchcount[i] - 1].
+//  Pass the last batch back in to have it refilled, instead of building
+//  new arrays every time.
+// Since this reads ahead, only the last entry in a batch is the archive's
+//  current entry, so this is for looking through an archive, not for
+//  installing from it: use entries() for that.
+static int luahook_archive_enumbatch(lua_State *L)
+{
+    MojoArchive *archive = (MojoArchive *) lua_touserdata(L, 1);
+    const int max = (int) luaL_checkinteger(L, 2);
+    ArchiveFilter *filter = (ArchiveFilter *) lua_touserdata(L, 3);
+    const int lastarray = (filter != NULL) ? 11 : 8;
+    const MojoArchiveEntry *entinfo = NULL;
+    const char *fname = NULL;
+    uint32 matchcount = 0;
+    int oldcount = 0;
+    int oldmatches = 0;
+    int nextmatch = 1;
+    int count = 0;
+    int i;
+
+    if (!lua_istable(L, 4))
+    {
+        lua_settop(L, 3);
+        lua_newtable(L);
+    } // if
+    lua_settop(L, 4);
+
+    lua_getfield(L, 4, "count");
+    oldcount = (int) lua_tointeger(L, -1);
+    lua_pop(L, 1);
+
+    // the arrays go on the stack at 5 through 12, in this order.
+    push_batch_array(L, 4, "filename");
+    push_batch_array(L, 4, "type");
+    push_batch_array(L, 4, "filesize");
+    push_batch_array(L, 4, "linkdest");
+    if (filter != NULL)
+    {
+        push_batch_array(L, 4, "fullname");
+        push_batch_array(L, 4, "firstmatch");
+        push_batch_array(L, 4, "matchcount");
+        push_batch_array(L, 4, "matches");
+        oldmatches = (int) lua_rawlen(L, 12);
+    } // if
+
+    while (count < max)
+    {
+        entinfo = archive_next_filtered(archive, filter, &fname, &matchcount);
+        if (entinfo == NULL)
+            break;
+
+        count++;
+        lua_pushstring(L, fname);
+        lua_rawseti(L, 5, count);
+        lua_pushstring(L, archive_entry_typestr(entinfo));
+        lua_rawseti(L, 6, count);
+        lua_pushnumber(L, (lua_Number) entinfo->filesize);
+        lua_rawseti(L, 7, count);
+        if (entinfo->linkdest == NULL)
+            lua_pushnil(L);
+        else
+            lua_pushstring(L, entinfo->linkdest);
+        lua_rawseti(L, 8, count);
+
+        if (filter != NULL)
+        {
+            lua_pushstring(L, entinfo->filename);
+            lua_rawseti(L, 9, count);
+            lua_pushinteger(L, (lua_Integer) nextmatch);
+            lua_rawseti(L, 10, count);
+            lua_pushinteger(L, (lua_Integer) matchcount);
+            lua_rawseti(L, 11, count);
+            for (i = 0; i < (int) matchcount; i++)
+            {
+                lua_pushinteger(L, (lua_Integer) (filter->matches[i] + 1));
+                lua_rawseti(L, 12, nextmatch++);
+            } // for
+        } // if
+    } // while
+
+    // drop whatever's left over from the last time this batch was filled.
+    for (i = 5; i <= lastarray; i++)
+        clear_array_tail(L, i, count + 1, oldcount);
+    if (filter != NULL)
+        clear_array_tail(L, 12, nextmatch, oldmatches);
+
+    lua_settop(L, 4);
+    set_integer(L, (lua_Integer) count, "count");
+    return 1;
+} // luahook_archive_enumbatch
+
+
 static int luahook_archive_close(lua_State *L)
 {
     MojoArchive *archive = (MojoArchive *) lua_touserdata(L, 1);
@@ -1024,6 +1770,659 @@ static int luahook_archive_offsetofstart(lua_State *L)
 } // luahook_archive_offsetofstart
 
 
+// MojoSetup.installentries() does the per-file work of installing from an
+//  archive here, instead of in a dozen little Lua functions per entry. It
+//  has to do what install_archive_entity() and manifest_add() in
+//  mojosetup_mainline.lua do, so keep them in step.
+
+#define INSTALL_BATCH_SIZE 256
+
+// One Setup.File, as installentries() sees it. The strings belong to the
+//  rules table, which stays on the Lua stack while we run.
+typedef struct InstallRule
+{
+    const char *destination;  // may be NULL.
+    const char *permstr;      // may be NULL, for the entry's own permissions.
+    uint16 perms;
+    const char *desc;         // the option's description, and manifest key.
+    int index;                // position in MojoSetup.files.included.
+    boolean hooked;           // has a filter, so Lua picks the destination.
+    boolean prefetch;
+    boolean single_match;
+    boolean finished;
+} InstallRule;
+
+typedef struct InstallState
+{
+    lua_State *L;
+    MojoArchive *archive;
+    ArchiveFilter *filter;
+    InstallRule *rules;
+    uint32 rulecount;
+    int writtenidx;   // stack index of the (written) table.
+    int hooksidx;     // stack index of the hooks table.
+    int manidx;       // stack index of MojoSetup.manifest.
+    int sourcesidx;   // stack index of MojoSetup.sources.
+    int entidx;       // stack index of the entry table we give to hooks.
+    const char *srcpath;
+    const char *destroot;
+    size_t destrootlen;
+    char *lastparent;  // the last parent directory we know exists.
+    lua_Number written;
+    lua_Number totalwrite;
+    boolean keepgoing;
+    MojoExtractItem items[INSTALL_BATCH_SIZE];
+    const char *itemdesc[INSTALL_BATCH_SIZE];
+    uint32 itemcount;
+} InstallState;
+
+
+// Same as calc_percent() in mojosetup_mainline.lua.
+static int installPercent(lua_Number current, lua_Number total)
+{
+    int64 retval = 0;
+    if (total == 0)
+        return 0;
+    else if (total < 0)
+        return -1;
+
+    retval = (int64) ((current / total) * 100);
+    if (retval > 100)
+        retval = 100;
+    else if (retval < 0)
+        retval = 0;
+    return (int) retval;
+} // installPercent
+
+
+static boolean installProgress(InstallState *st, const char *dest,
+                               const char *desc, int64 justwrote,
+                               int64 bw, int64 total)
+{
+    const char *fname = strrchr(dest, '/');
+    char *item = NULL;
+    int percent = -1;
+
+    fname = (fname == NULL) ? dest : fname + 1;
+    if (total >= 0)
+    {
+        st->written += (lua_Number) justwrote;
+        percent = installPercent(st->written, st->totalwrite);
+        item = format(_("%0: %1%%"), fname,
+                      numstr(installPercent((lua_Number) bw,
+                                            (lua_Number) total)));
+    } // if
+
+    st->keepgoing = GGui->progress(_("Installing"), desc, percent,
+                                   (item != NULL) ? item : fname, true);
+    free(item);
+    return st->keepgoing;
+} // installProgress
+
+
+static boolean installFilesCallback(uint32 item, uint32 ticks,
+                                    int64 justwrote, int64 bw, int64 total,
+                                    void *data)
+{
+    InstallState *st = (InstallState *) data;
+    return installProgress(st, st->items[item].fname, st->itemdesc[item],
+                           justwrote, bw, total);
+} // installFilesCallback
+
+
+typedef struct InstallFileData
+{
+    InstallState *st;
+    const char *dest;
+    const char *desc;
+} InstallFileData;
+
+static boolean installFileCallback(uint32 ticks, int64 justwrote, int64 bw,
+                                   int64 total, void *data)
+{
+    InstallFileData *ifd = (InstallFileData *) data;
+    return installProgress(ifd->st, ifd->dest, ifd->desc, justwrote, bw, total);
+} // installFileCallback
+
+
+// Same as manifest_add() in mojosetup_mainline.lua. (sums) and (lndest) may
+//  be NULL.
+static void installManifestAdd(InstallState *st, const char *fname,
+                               const char *key, const char *ftype,
+                               const MojoChecksums *sums, const char *lndest,
+                               boolean warn)
+{
+    lua_State *L = st->L;
+
+    if ((fname == NULL) || (key == NULL))
+        return;
+
+    if (strncmp(fname, st->destroot, st->destrootlen) == 0)
+    {
+        fname += st->destrootlen;  // make it relative.
+        if (*fname != '\0')
+            fname++;
+    } // if
+
+    if (warn)
+    {
+        lua_getfield(L, st->manidx, fname);
+        if (!lua_isnil(L, -1))
+            logWarning("Overwriting file '%0' in manifest!", fname);
+        lua_pop(L, 1);
+    } // if
+
+    lua_createtable(L, 0, 4);
+    set_string(L, key, "key");
+    set_string(L, ftype, "type");
+    if (sums != NULL)
+    {
+        retvalChecksums(L, sums);
+        lua_setfield(L, -2, "checksums");
+    } // if
+    set_string(L, lndest, "linkdest");
+    lua_setfield(L, st->manidx, fname);
+} // installManifestAdd
+
+
+// Frees (st), closing anything still queued for installFlush().
+static void installFree(InstallState *st)
+{
+    uint32 i;
+    for (i = 0; i < st->itemcount; i++)
+    {
+        MojoExtractItem *item = &st->items[i];
+        item->in->close(item->in);
+        free((void *) item->fname);
+    } // for
+    free(st->lastparent);
+    free(st->rules);
+    free(st);
+} // installFree
+
+
+// Stop the install, after a file write failed or the user cancelled one.
+//  fatal() doesn't return, so clean up (st) first.
+static void installFailed(InstallState *st)
+{
+    const boolean cancelled = !st->keepgoing;
+    installFree(st);
+    if (cancelled)
+    {
+        logError("User cancelled install during file write.");
+        fatal(NULL);
+    } // if
+    fatal(_("File creation failed!"));
+} // installFailed
+
+
+// Returns false if the file failed; call installFailed() once you're done
+//  with it.
+static boolean installFileDone(InstallState *st, const char *dest,
+                               const char *key, boolean ok,
+                               const MojoChecksums *sums)
+{
+    if (!ok)
+    {
+        if (st->keepgoing)
+            logError("Failed to create file '%0'", dest);
+        return false;
+    } // if
+
+    // Readd it to the manifest, now with a checksum!
+    installManifestAdd(st, dest, key, "file", sums, NULL, false);
+    logInfo("Created file '%0'", dest);
+    return true;
+} // installFileDone
+
+
+static void installFlush(InstallState *st)
+{
+    const uint32 count = st->itemcount;
+    boolean failed = false;
+    uint32 i;
+
+    if (count == 0)
+        return;
+
+    st->itemcount = 0;
+    MojoInput_toPhysicalFiles(st->items, count, installFilesCallback, st);
+    for (i = 0; i < count; i++)
+    {
+        MojoExtractItem *item = &st->items[i];
+        if (!installFileDone(st, item->fname, st->itemdesc[i], item->ok,
+                             &item->checksums))
+            failed = true;
+        free((void *) item->fname);
+        item->fname = NULL;
+    } // for
+
+    if (failed)
+        installFailed(st);
+
+    MojoLua_paceGarbage();
+} // installFlush
+
+
+static void installDirectory(InstallState *st, const char *path,
+                             uint16 perms, const char *key)
+{
+    if (!MojoPlatform_mkdir(path, perms))
+    {
+        logError("Failed to create dir '%0'", path);
+        fatal(_("Directory creation failed"));
+    } // if
+
+    installManifestAdd(st, path, key, "directory", NULL, NULL, true);
+    logInfo("Created directory '%0'", path);
+} // installDirectory
+
+
+// Same as install_parent_dirs() in mojosetup_mainline.lua, but it remembers
+//  the last directory it made sure of, since archives tend to list a
+//  directory's files together.
+static void installParentDirs(InstallState *st, const char *path,
+                              const char *key)
+{
+    size_t parentlen = strlen(path);
+    char *fullpath = NULL;
+    size_t fullpathlen = 0;
+    const char *ptr = path;
+
+    // Chop any '/' chars from the end of the string, then the last element.
+    while ((parentlen > 0) && (path[parentlen-1] == '/'))
+        parentlen--;
+    while ((parentlen > 0) && (path[parentlen-1] != '/'))
+        parentlen--;
+    if (parentlen > 0)
+        parentlen--;
+
+    if ((st->lastparent != NULL) && (strlen(st->lastparent) == parentlen) &&
+        (strncmp(st->lastparent, path, parentlen) == 0))
+        return;
+
+    fullpath = (char *) xmalloc(parentlen + 2);
+    while (ptr < path + parentlen)
+    {
+        const char *end = strchr(ptr, '/');
+        if (end > ptr)
+        {
+            fullpath[fullpathlen++] = '/';
+            memcpy(fullpath + fullpathlen, ptr, end - ptr);
+            fullpathlen += end - ptr;
+            fullpath[fullpathlen] = '\0';
+            if (!MojoPlatform_exists(fullpath, NULL))
+                installDirectory(st, fullpath,
+                                 MojoPlatform_defaultDirPerms(), key);
+        } // if
+        ptr = end + 1;
+    } // while
+    free(fullpath);
+
+    free(st->lastparent);
+    st->lastparent = (char *) xmalloc(parentlen + 1);
+    memcpy(st->lastparent, path, parentlen);
+} // installParentDirs
+
+
+// Call the hook under its (nargs) arguments on the stack. An error in it
+//  can't just longjmp through us, or (st) and every input queued for
+//  installFlush() would leak, so clean those up and raise it again.
+static void installCallHook(InstallState *st, int nargs, int nresults)
+{
+    lua_State *L = st->L;
+    const int base = lua_gettop(L) - nargs;  // where the hook is.
+    lua_pushcfunction(L, luahook_stackwalk);
+    lua_insert(L, base);
+    if (lua_pcall(L, nargs, nresults, base) != 0)
+    {
+        installFree(st);
+        lua_error(L);  // error on stack has debug info.
+    } // if
+    lua_remove(L, base);  // dump stackwalker.
+} // installCallHook
+
+
+// Push the entry table for the hooks, filling it in if we haven't for this
+//  entry yet.
+static void installPushEntry(InstallState *st, const MojoArchiveEntry *entinfo,
+                            const char *fname, uint32 matchcount,
+                            boolean *filled)
+{
+    lua_State *L = st->L;
+    lua_pushvalue(L, st->entidx);
+    if (!*filled)
+    {
+        set_entry_fields(L, entinfo, fname, st->filter, matchcount);
+        *filled = true;
+    } // if
+} // installPushEntry
+
+
+static void installEntry(InstallState *st, uint32 ruleidx,
+                         const MojoArchiveEntry *entinfo, const char *fname,
+                         uint32 matchcount, boolean *filled)
+{
+    lua_State *L = st->L;
+    MojoArchive *archive = st->archive;
+    const InstallRule *rule = &st->rules[ruleidx];
+    const int top = lua_gettop(L);
+    const char *dest = NULL;
+    const char *permstr = rule->permstr;
+    uint16 perms = rule->perms;
+    int permsidx = 0;  // stack index of the perms for MojoSetup.sources.
+    lua_Integer writtenby = 0;
+
+    // Where does this go?
+    if (rule->hooked)
+    {
+        lua_getfield(L, st->hooksidx, "dest");
+        installPushEntry(st, entinfo, fname, matchcount, filled);
+        lua_pushinteger(L, (lua_Integer) (ruleidx + 1));
+        installCallHook(st, 2, 2);
+        if (lua_isnil(L, -2))  // filtered out.
+        {
+            lua_settop(L, top);
+            return;
+        } // if
+        dest = lua_tostring(L, -2);
+        permstr = lua_tostring(L, -1);
+        permsidx = lua_gettop(L);
+        if (permstr != NULL)
+        {
+            boolean valid = false;
+            perms = MojoPlatform_makePermissions(permstr, &valid);
+            if (!valid)
+                fatal(_("BUG: '%0' is not a valid permission string"), permstr);
+        } // if
+    } // if
+    else
+    {
+        luaL_Buffer b;
+        luaL_buffinit(L, &b);
+        luaL_addlstring(&b, st->destroot, st->destrootlen);
+        luaL_addchar(&b, '/');
+        if (rule->destination != NULL)
+        {
+            luaL_addstring(&b, rule->destination);
+            luaL_addchar(&b, '/');
+        } // if
+        luaL_addstring(&b, fname);
+        luaL_pushresult(&b);
+        dest = lua_tostring(L, -1);
+        if (permstr != NULL)
+        {
+            lua_pushstring(L, permstr);
+            permsidx = lua_gettop(L);
+        } // if
+    } // else
+
+    // A later rule already put something here? Then it wins.
+    lua_getfield(L, st->writtenidx, dest);
+    writtenby = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    if (writtenby > (lua_Integer) rule->index)
+    {
+        lua_settop(L, top);
+        return;
+    } // if
+
+    // write out anything pending for this path before we replace it.
+    if (writtenby != 0)
+        installFlush(st);
+
+    if (MojoPlatform_exists(dest, NULL))
+    {
+        boolean permitted = false;
+
+        // never "permit" existing dirs, so they don't rollback.
+        if (entinfo->type != MOJOARCHIVE_ENTRY_DIR)
+        {
+            lua_getfield(L, st->hooksidx, "permit");
+            installPushEntry(st, entinfo, fname, matchcount, filled);
+            lua_pushinteger(L, (lua_Integer) (ruleidx + 1));
+            lua_pushstring(L, dest);
+            installCallHook(st, 3, 1);
+            permitted = lua_toboolean(L, -1);
+            lua_pop(L, 1);
+        } // if
+
+        if (!permitted)
+        {
+            lua_settop(L, top);
+            return;
+        } // if
+    } // if
+
+    installParentDirs(st, dest, rule->desc);
+
+    if (entinfo->type == MOJOARCHIVE_ENTRY_FILE)
+    {
+        MojoInput *io = NULL;
+
+        if (permstr == NULL)
+            perms = archive->prevEnum.perms;
+
+        // Add to manifest first, so we can delete it during rollback if i/o
+        //  fails.
+        installManifestAdd(st, dest, rule->desc, "file", NULL, NULL, true);
+        GGui->progressitem();
+
+        if (archive->openCurrentEntryDetached != NULL)
+            io = archive->openCurrentEntryDetached(archive);
+
+        if (io != NULL)
+        {
+            MojoExtractItem *item = &st->items[st->itemcount];
+            item->in = io;
+            item->fname = xstrdup(dest);
+            item->perms = perms;
+            st->itemdesc[st->itemcount] = rule->desc;
+            if (++st->itemcount == INSTALL_BATCH_SIZE)
+                installFlush(st);
+        } // if
+        else
+        {
+            InstallFileData ifd;
+            MojoChecksums sums;
+            boolean ok = false;
+
+            io = archive->openCurrentEntry(archive);
+            if ((io != NULL) && (rule->prefetch))
+                io = MojoInput_newPrefetched(io, 0, 0);
+            if (io != NULL)
+            {
+                ifd.st = st;
+                ifd.dest = dest;
+                ifd.desc = rule->desc;
+                ok = MojoInput_toPhysicalFile(io, dest, perms, &sums, -1,
+                                              installFileCallback, &ifd);
+            } // if
+            if (!installFileDone(st, dest, rule->desc, ok, &sums))
+                installFailed(st);
+            MojoLua_paceGarbage();
+        } // else
+
+        if (st->srcpath != NULL)
+        {
+            // Remember where this came from, for "verify --repair".
+            const char *relname = dest;
+            if (strncmp(relname, st->destroot, st->destrootlen) == 0)
+                relname += st->destrootlen + 1;
+            lua_createtable(L, 0, 3);
+            set_string(L, st->srcpath, "archive");
+            set_string(L, entinfo->filename, "path");
+            if (permsidx != 0)
+                lua_pushvalue(L, permsidx);
+            else
+                lua_pushnil(L);
+            lua_setfield(L, -2, "perms");
+            lua_setfield(L, st->sourcesidx, relname);
+        } // if
+    } // if
+
+    else if (entinfo->type == MOJOARCHIVE_ENTRY_DIR)
+    {
+        // Chop any '/' chars from the end of the string...
+        size_t len = strlen(dest);
+        char *path = xstrdup(dest);
+        while ((len > 0) && (path[len-1] == '/'))
+            path[--len] = '\0';
+        if (permstr == NULL)
+            perms = MojoPlatform_defaultDirPerms();
+        installDirectory(st, path, perms, rule->desc);
+        free(path);
+    } // else if
+
+    else if (entinfo->type == MOJOARCHIVE_ENTRY_SYMLINK)
+    {
+        if (!MojoPlatform_symlink(dest, entinfo->linkdest))
+        {
+            logError("Failed to create symlink '%0'", dest);
+            fatal(_("Symlink creation failed!"));
+        } // if
+
+        installManifestAdd(st, dest, rule->desc, "symlink", NULL,
+                           entinfo->linkdest, true);
+        logInfo("Created symlink '%0' -> '%1'", dest, entinfo->linkdest);
+    } // else if
+
+    else  // !!! FIXME: device nodes, etc...
+    {
+        // !!! FIXME: should this be fatal?
+        fatal(_("Unknown file type in archive"));
+    } // else
+
+    lua_pushinteger(L, (lua_Integer) rule->index);
+    lua_setfield(L, st->writtenidx, dest);
+    lua_settop(L, top);
+} // installEntry
+
+
+// MojoSetup.installentries(archive, filter, rules, written, srcpath, hooks)
+//  Installs everything from (archive) that (filter) lets through, for the
+//  rules (from new_archive_rule()) whose wildcard lists matched: creating
+//  directories, writing and checksumming files, and filling in the
+//  manifest. Lua only hears about an entry for a rule with a filter
+//  function, through hooks.dest(ent, ruleindex), which returns the
+//  destination and permissions like archive_entry_dest(), and when
+//  something is already at the destination, through
+//  hooks.permit(ent, ruleindex, dest), which returns true to replace it.
+//  See install_archive_rules() for (written) and (srcpath).
+static int luahook_installentries(lua_State *L)
+{
+    MojoArchive *archive = (MojoArchive *) lua_touserdata(L, 1);
+    ArchiveFilter *filter = (ArchiveFilter *) lua_touserdata(L, 2);
+    const MojoArchiveEntry *entinfo = NULL;
+    const char *fname = NULL;
+    InstallState *st = NULL;
+    uint32 remaining = 0;
+    uint32 matchcount = 0;
+    uint32 i;
+
+    if (filter == NULL)
+        fatal(_("BUG: installentries needs a filter"));
+    luaL_checktype(L, 3, LUA_TTABLE);
+    luaL_checktype(L, 4, LUA_TTABLE);
+    luaL_checktype(L, 6, LUA_TTABLE);
+    lua_settop(L, 6);
+
+    lua_getglobal(L, MOJOSETUP_NAMESPACE);  // stays at 7.
+    lua_getfield(L, 7, "destination");
+    luaL_checkstring(L, -1);  // stays at 8; check it before we allocate.
+
+    st = (InstallState *) xmalloc(sizeof (InstallState));
+    st->L = L;
+    st->archive = archive;
+    st->filter = filter;
+    st->writtenidx = 4;
+    st->srcpath = lua_tostring(L, 5);  // may be NULL.
+    st->hooksidx = 6;
+    st->keepgoing = true;
+    st->destroot = lua_tostring(L, 8);
+    st->destrootlen = strlen(st->destroot);
+    lua_getfield(L, 7, "manifest");
+    st->manidx = lua_gettop(L);
+    lua_getfield(L, 7, "sources");
+    st->sourcesidx = lua_gettop(L);
+    lua_newtable(L);
+    st->entidx = lua_gettop(L);
+    lua_getfield(L, 7, "written");
+    st->written = lua_tonumber(L, -1);
+    lua_getfield(L, 7, "totalwrite");
+    st->totalwrite = lua_tonumber(L, -1);
+    lua_pop(L, 2);
+
+    st->rulecount = (uint32) lua_rawlen(L, 3);
+    st->rules = (InstallRule *) xmalloc(sizeof (InstallRule) *
+                                        (st->rulecount + 1));
+    for (i = 0; i < st->rulecount; i++)
+    {
+        InstallRule *rule = &st->rules[i];
+        lua_rawgeti(L, 3, (int) (i + 1));
+        lua_getfield(L, -1, "index");
+        rule->index = (int) lua_tointeger(L, -1);
+        lua_getfield(L, -2, "single_match");
+        rule->single_match = lua_toboolean(L, -1);
+        lua_getfield(L, -3, "option");
+        lua_getfield(L, -1, "description");
+        rule->desc = lua_tostring(L, -1);
+        lua_getfield(L, -5, "file");
+        lua_getfield(L, -1, "destination");
+        rule->destination = lua_tostring(L, -1);
+        lua_getfield(L, -2, "permissions");
+        rule->permstr = lua_tostring(L, -1);
+        lua_getfield(L, -3, "filter");
+        rule->hooked = !lua_isnil(L, -1);
+        lua_getfield(L, -4, "prefetch");
+        rule->prefetch = lua_toboolean(L, -1);
+        lua_pop(L, 10);
+
+        if (rule->permstr != NULL)
+        {
+            boolean valid = false;
+            rule->perms = MojoPlatform_makePermissions(rule->permstr, &valid);
+            if (!valid)
+                fatal(_("BUG: '%0' is not a valid permission string"), rule->permstr);
+        } // if
+    } // for
+
+    remaining = st->rulecount;  // rules that might still match something.
+    while (remaining > 0)
+    {
+        boolean filled = false;
+        entinfo = archive_next_filtered(archive, filter, &fname, &matchcount);
+        if (entinfo == NULL)
+            break;
+
+        for (i = 0; i < matchcount; i++)
+        {
+            const uint32 ruleidx = filter->matches[i];
+            InstallRule *rule = NULL;
+            if (ruleidx >= st->rulecount)
+                continue;
+            rule = &st->rules[ruleidx];
+            if (rule->finished)
+                continue;
+            installEntry(st, ruleidx, entinfo, fname, matchcount, &filled);
+            if (rule->single_match)
+            {
+                rule->finished = true;
+                remaining--;
+            } // if
+        } // for
+    } // while
+
+    installFlush(st);
+
+    lua_pushnumber(L, st->written);
+    lua_setfield(L, 7, "written");
+
+    installFree(st);
+    return 0;
+} // luahook_installentries
+
+
 static int luahook_platform_unlink(lua_State *L)
 {
     const char *path = luaL_checkstring(L, 1);
@@ -1777,6 +3176,7 @@ boolean MojoLua_initLua(void)
     assert(luaState == NULL);
     luaState = lua_newstate(MojoLua_alloc, NULL);  // calls fatal() on failure.
     lua_atpanic(luaState, luahook_fatal);
+    initGarbagePacing(luaState);
     assert(lua_checkstack(luaState, 20));  // Just in case.
     registerLuaLibs(luaState);
 
@@ -1804,9 +3204,15 @@ boolean MojoLua_initLua(void)
         set_cfunc(luaState, luahook_cmdline, "cmdline");
         set_cfunc(luaState, luahook_cmdlinestr, "cmdlinestr");
         set_cfunc(luaState, luahook_collectgarbage, "collectgarbage");
+        set_cfunc(luaState, luahook_pacegarbage, "incrementgarbagecount");
+        set_cfunc(luaState, luahook_gcstats, "gcstats");
+        set_cfunc(luaState, luahook_tracebegin, "tracebegin");
+        set_cfunc(luaState, luahook_traceend, "traceend");
+        set_cfunc(luaState, luahook_tracecounter, "tracecounter");
         set_cfunc(luaState, luahook_debugger, "debugger");
         set_cfunc(luaState, luahook_findmedia, "findmedia");
         set_cfunc(luaState, luahook_writefile, "writefile");
+        set_cfunc(luaState, luahook_installentries, "installentries");
         set_cfunc(luaState, luahook_copyfile, "copyfile");
         set_cfunc(luaState, luahook_stringtofile, "stringtofile");
         set_cfunc(luaState, luahook_download, "download");
@@ -1815,7 +3221,10 @@ boolean MojoLua_initLua(void)
         set_cfunc(luaState, luahook_truncatenum, "truncatenum");
         set_cfunc(luaState, luahook_date, "date");
         set_cfunc(luaState, luahook_isvalidperms, "isvalidperms");
+        set_cfunc(luaState, luahook_isvalidchecksums, "isvalidchecksums");
+        set_cfunc(luaState, luahook_setchecksums, "setchecksums");
         set_cfunc(luaState, luahook_checksum, "checksum");
+        set_cfunc(luaState, luahook_checksumfiles, "checksumfiles");
         set_cfunc(luaState, luahook_strcmp, "strcmp");
         set_cfunc(luaState, luahook_findproduct, "findproduct");
 
@@ -1890,9 +3299,14 @@ boolean MojoLua_initLua(void)
         lua_newtable(luaState);
             set_cfunc(luaState, luahook_archive_fromdir, "fromdir");
             set_cfunc(luaState, luahook_archive_fromfile, "fromfile");
+            set_cfunc(luaState, luahook_archive_fromurl, "fromurl");
             set_cfunc(luaState, luahook_archive_fromentry, "fromentry");
             set_cfunc(luaState, luahook_archive_enumerate, "enumerate");
             set_cfunc(luaState, luahook_archive_enumnext, "enumnext");
+            set_cfunc(luaState, luahook_archive_entries, "entries");
+            set_cfunc(luaState, luahook_archive_enumbatch, "enumbatch");
+            set_cfunc(luaState, luahook_archive_newfilter, "newfilter");
+            set_cfunc(luaState, luahook_archive_freefilter, "freefilter");
             set_cfunc(luaState, luahook_archive_close, "close");
             set_cfunc(luaState, luahook_archive_offsetofstart, "offsetofstart");
             set_cptr(luaState, GBaseArchive, "base");
@@ -57,6 +57,10 @@ void MojoLua_setStringArray(int argc, const char **argv, const char *sym);
 
 void MojoLua_collectGarbage(void);
 
+// Do a little garbage collection between items in a long loop, instead of
+//  stopping for a full collection every so often. See lua_glue.c.
+void MojoLua_paceGarbage(void);
+
 void MojoLua_debugger(void);
 
 #ifdef __cplusplus
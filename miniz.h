@@ -151,6 +151,8 @@ extern "C" {
 int mz_inflateInit2(mz_streamp pStream, int window_bits);
 int mz_inflate(mz_streamp pStream, int flush);
 int mz_inflateEnd(mz_streamp pStream);
+int mz_inflateCopy(mz_streamp pDest, mz_streamp pSource);
+int mz_inflateUnused(mz_streamp pStream, unsigned char *pBuf);
 
 #ifdef __cplusplus
 }
@@ -656,6 +658,33 @@ int mz_inflateEnd(mz_streamp pStream)
   return MZ_OK;
 }
 
+/* MojoSetup addition: like zlib's inflateCopy(). inflate_state has no internal pointers, so a flat copy is a complete snapshot. */
+int mz_inflateCopy(mz_streamp pDest, mz_streamp pSource)
+{
+  inflate_state *pState;
+  if ((!pDest) || (!pSource) || (!pSource->state) || (!pSource->zalloc) || (!pSource->zfree))
+    return MZ_STREAM_ERROR;
+  pState = (inflate_state*)pSource->zalloc(pSource->opaque, 1, sizeof(inflate_state));
+  if (!pState) return MZ_MEM_ERROR;
+  memcpy(pState, pSource->state, sizeof(inflate_state));
+  memcpy(pDest, pSource, sizeof(mz_stream));
+  pDest->state = (struct mz_internal_state *)pState;
+  return MZ_OK;
+}
+
+/* MojoSetup addition: after MZ_STREAM_END, tinfl may have pulled whole bytes past the end of the deflate data into its bit buffer, where zlib would have left them in next_in. This copies them (fewer than sizeof(tinfl_bit_buf_t)) to pBuf, in order, and returns how many there were. */
+int mz_inflateUnused(mz_streamp pStream, unsigned char *pBuf)
+{
+  const tinfl_decompressor *r;
+  tinfl_bit_buf_t bit_buf; mz_uint32 num_bits; int n = 0;
+  if ((!pStream) || (!pStream->state)) return 0;
+  r = &((const inflate_state*)pStream->state)->m_decomp;
+  num_bits = r->m_num_bits; bit_buf = r->m_bit_buf;
+  bit_buf >>= (num_bits & 7); num_bits -= (num_bits & 7); /* the rest of the last deflate byte. */
+  while (num_bits >= 8) { pBuf[n++] = (unsigned char)(bit_buf & 0xFF); bit_buf >>= 8; num_bits -= 8; }
+  return n;
+}
+
 #endif /* #ifndef TINFL_HEADER_FILE_ONLY */
 
 /* make this a drop-in replacement for zlib... */
@@ -665,6 +694,7 @@ int mz_inflateEnd(mz_streamp pStream)
   #define inflateInit2          mz_inflateInit2
   #define inflate               mz_inflate
   #define inflateEnd            mz_inflateEnd
+  #define inflateCopy           mz_inflateCopy
   #define Z_SYNC_FLUSH          MZ_SYNC_FLUSH
   #define Z_FINISH              MZ_FINISH
   #define Z_OK                  MZ_OK
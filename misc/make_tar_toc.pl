@@ -0,0 +1,145 @@
+#!/usr/bin/perl -w
+
+# Write a table of contents for a tarball, so MojoSetup can list it and jump
+#  to its entries without decompressing the whole thing first. Ship the
+#  output next to the tarball: data.tar.xz gets data.tar.xz.toc. Rebuild it
+#  whenever the tarball changes; MojoSetup ignores a TOC that was made for a
+#  tarball of a different size or with different first 64k, and refuses
+#  entries whose headers disagree.
+#
+# Usage: make_tar_toc.pl data.tar.xz [data.tar.xz.toc]
+#
+# The format is described above readTOC() in archive_tar.c.
+#  The names written here have to match what archive_tar.c would report
+#  when enumerating, so this mirrors MojoArchive_tar_enumNext().
+
+use warnings;
+use strict;
+use Compress::Zlib qw(crc32);
+
+my $arc = shift @ARGV or die("USAGE: $0 <tarball> [output]\n");
+my $out = shift @ARGV;
+$out = "$arc.toc" if not defined $out;
+
+my $rawsize = -s $arc;
+die("$0: can't stat $arc\n") if not defined $rawsize;
+
+# CRC-32 of the first 64k of the file as stored; TOC_CRCLEN in archive_tar.c.
+my $head = '';
+open(RAW, '<', $arc) or die("$0: can't read $arc: $!\n");
+binmode(RAW);
+while (length($head) < 65536) {
+    my $br = read(RAW, $head, 65536 - length($head), length($head));
+    die("$0: read error: $!\n") if not defined $br;
+    last if $br == 0;
+}
+close(RAW);
+my $rawcrc = crc32($head);
+
+my $decompress = 'cat';
+if ($arc =~ /\.(tar\.gz|tgz)\Z/i) {
+    $decompress = 'gzip -dc';
+} elsif ($arc =~ /\.(tar\.bz2|tbz2|tb2)\Z/i) {
+    $decompress = 'bzip2 -dc';
+} elsif ($arc =~ /\.tar\.xz\Z/i) {
+    $decompress = 'xz -dc';
+}
+
+open(IN, '-|', "$decompress \"$arc\"") or die("$0: can't read $arc: $!\n");
+binmode(IN);
+
+sub read_exactly {
+    my $len = shift;
+    my $buf = '';
+    while (length($buf) < $len) {
+        my $br = read(IN, $buf, $len - length($buf), length($buf));
+        die("$0: read error: $!\n") if not defined $br;
+        return undef if $br == 0;
+    }
+    return $buf;
+}
+
+sub cstr {   # up to the first null byte.
+    my $str = shift;
+    $str =~ s/\0.*\Z//s;
+    return $str;
+}
+
+sub octal {
+    my $str = cstr(shift);
+    $str =~ s/\A\s+//;
+    $str =~ s/[^0-7].*\Z//s;
+    return ($str eq '') ? 0 : oct($str);
+}
+
+sub padded {
+    my $size = shift;
+    return ($size % 512) ? ($size + (512 - ($size % 512))) : $size;
+}
+
+my %types = ( '0' => 1, "\0" => 1, '5' => 2, '2' => 3 );  # MojoArchiveEntryType
+my @entries = ();
+my $pos = 0;
+my $longname = undef;
+my $longlink = undef;
+
+while (defined(my $block = read_exactly(512))) {
+    $pos += 512;
+    next if $block eq ("\0" x 512);  # catted tarballs have these mid-stream.
+
+    my $type = substr($block, 156, 1);
+    my $size = octal(substr($block, 124, 12));
+
+    if (($type eq 'L') or ($type eq 'K')) {
+        my $data = read_exactly(padded($size));
+        die("$0: truncated tarball\n") if not defined $data;
+        $pos += padded($size);
+        if ($type eq 'K') {
+            $longlink = cstr(substr($data, 0, $size));
+        } else {
+            $longname = cstr(substr($data, 0, $size));
+        }
+        next;
+    }
+
+    my $ustar = (substr($block, 257, 5) eq 'ustar');
+    my $name = $longname;
+    if (not defined $name) {
+        # prefix goes right in front, no separator, like archive_tar.c does.
+        $name = $ustar ? cstr(substr($block, 345, 155)) : '';
+        $name .= cstr(substr($block, 0, 100));
+    }
+
+    my $mojotype = $types{$type};
+    $mojotype = 0 if not defined $mojotype;
+    if ($name =~ s/\/+\Z//) {
+        $mojotype = 2 if ((not $ustar) and ($mojotype == 1));
+    }
+
+    my $link = '';
+    if ($mojotype == 3) {
+        $link = defined $longlink ? $longlink : cstr(substr($block, 157, 100));
+    }
+
+    push @entries, pack('C v Q< Q< v/a* v/a*', $mojotype,
+                        octal(substr($block, 100, 8)), $size, $pos,
+                        $name, $link);
+
+    $longname = $longlink = undef;
+    if (not defined read_exactly(padded($size))) {
+        die("$0: truncated tarball\n") if $size > 0;
+    }
+    $pos += padded($size);
+}
+
+close(IN) or die("$0: $decompress failed on $arc\n");
+
+open(OUT, '>', $out) or die("$0: can't write $out: $!\n");
+binmode(OUT);
+print OUT pack('a8 Q< V V', 'MOJOTOC2', $rawsize, $rawcrc, scalar(@entries));
+print OUT $_ foreach (@entries);
+close(OUT) or die("$0: can't write $out: $!\n");
+
+print("Wrote $out (" . scalar(@entries) . " entries).\n");
+
+# end of make_tar_toc.pl ...
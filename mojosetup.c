@@ -23,6 +23,12 @@ int MojoSetup_testArchiveCode(int argc, char **argv);
 #define TEST_NETWORK_CODE 0
 int MojoSetup_testNetworkCode(int argc, char **argv);
 
+// The mojosetup-bench target turns this on; see benchmark.c.
+#ifndef BENCHMARK_CODE
+#define BENCHMARK_CODE 0
+#endif
+int MojoSetup_benchmark(int argc, char **argv);
+
 
 uint8 scratchbuf_128k[128 * 1024];
 const MojoSetupEntryPoints GEntryPoints =
@@ -150,6 +156,7 @@ static void MojoSetup_cleanmarker(void)
 static boolean initEverything(void)
 {
     MojoLog_initLogging();
+    MojoTrace_init();
 
     logInfo("MojoSetup starting up...");
 
@@ -192,6 +199,8 @@ static void deinitEverything(void)
     MojoLua_deinitLua();
     MojoGui_deinitGuiPlugin();
     MojoArchive_deinitBaseArchive();
+    MojoWorker_shutdown();
+    MojoTrace_deinit();
     MojoLog_deinitLogging();
     MojoSetup_cleanmarker();
 
@@ -204,17 +213,131 @@ static void deinitEverything(void)
 } // deinitEverything
 
 
-void MojoChecksum_init(MojoChecksumContext *ctx)
+// Digests this build can compute at all.
+static const uint32 checksumsAvailable = 0
+    #if SUPPORT_CRC32
+    | MOJOCHECKSUM_CRC32
+    #endif
+    #if SUPPORT_MD5
+    | MOJOCHECKSUM_MD5
+    #endif
+    #if SUPPORT_SHA1
+    | MOJOCHECKSUM_SHA1
+    #endif
+    #if SUPPORT_XXH128
+    | MOJOCHECKSUM_XXH128
+    #endif
+    #if SUPPORT_BLAKE3
+    | MOJOCHECKSUM_BLAKE3
+    #endif
+    ;
+
+static uint32 checksumPolicy = MOJOCHECKSUM_ALL;
+
+uint32 MojoChecksum_policy(void)
+{
+    return checksumPolicy;
+} // MojoChecksum_policy
+
+
+void MojoChecksum_setPolicy(uint32 flags)
+{
+    checksumPolicy = flags & MOJOCHECKSUM_ALL;
+} // MojoChecksum_setPolicy
+
+
+boolean MojoChecksum_parsePolicy(const char *str, uint32 *flags)
+{
+    static const struct { const char *name; uint32 flags; } names[] =
+    {
+        { "all", MOJOCHECKSUM_ALL },
+        { "none", MOJOCHECKSUM_NONE },
+        { "crc32", MOJOCHECKSUM_CRC32 },
+        { "md5", MOJOCHECKSUM_MD5 },
+        { "sha1", MOJOCHECKSUM_SHA1 },
+        { "xxh128", MOJOCHECKSUM_XXH128 },
+        { "blake3", MOJOCHECKSUM_BLAKE3 },
+    };
+    uint32 retval = MOJOCHECKSUM_NONE;
+    boolean any = false;
+
+    if (str == NULL)
+        return false;
+
+    while (*str)
+    {
+        size_t len = 0;
+        int i;
+
+        if ((*str == ',') || (*str == ' '))
+        {
+            str++;
+            continue;
+        } // if
+
+        while ((str[len] != '\0') && (str[len] != ',') && (str[len] != ' '))
+            len++;
+
+        if ((len == 4) && (strncmp(str, "fast", 4) == 0))
+        {
+            // cheapest one we've got.
+            if (checksumsAvailable & MOJOCHECKSUM_XXH128)
+                retval |= MOJOCHECKSUM_XXH128;
+            else if (checksumsAvailable & MOJOCHECKSUM_CRC32)
+                retval |= MOJOCHECKSUM_CRC32;
+            else if (checksumsAvailable & MOJOCHECKSUM_SHA1)
+                retval |= MOJOCHECKSUM_SHA1;
+            else
+                retval |= MOJOCHECKSUM_MD5;
+        } // if
+        else
+        {
+            for (i = 0; i < STATICARRAYLEN(names); i++)
+            {
+                if ((strlen(names[i].name) == len) &&
+                    (strncmp(str, names[i].name, len) == 0))
+                    break;
+            } // for
+            if (i == STATICARRAYLEN(names))
+                return false;
+            retval |= names[i].flags;
+        } // else
+
+        any = true;
+        str += len;
+    } // while
+
+    if (!any)
+        return false;
+
+    *flags = retval;
+    return true;
+} // MojoChecksum_parsePolicy
+
+
+void MojoChecksum_init(MojoChecksumContext *ctx, uint32 flags)
 {
     memset(ctx, '\0', sizeof (MojoChecksumContext));
+    ctx->flags = flags & checksumsAvailable;
     #if SUPPORT_CRC32
-    MojoCrc32_init(&ctx->crc32);
+    if (ctx->flags & MOJOCHECKSUM_CRC32)
+        MojoCrc32_init(&ctx->crc32);
     #endif
     #if SUPPORT_MD5
-    MojoMd5_init(&ctx->md5);
+    if (ctx->flags & MOJOCHECKSUM_MD5)
+        MojoMd5_init(&ctx->md5);
     #endif
     #if SUPPORT_SHA1
-    MojoSha1_init(&ctx->sha1);
+    if (ctx->flags & MOJOCHECKSUM_SHA1)
+        MojoSha1_init(&ctx->sha1);
+    #endif
+    #if SUPPORT_XXH128
+    if (ctx->flags & MOJOCHECKSUM_XXH128)
+        MojoXxh128_init(&ctx->xxh128);
+    #endif
+    #if SUPPORT_BLAKE3
+    if (ctx->flags & MOJOCHECKSUM_BLAKE3)
+        MojoBlake3_init(&ctx->blake3);
     #endif
 } // MojoChecksum_init
 
@@ -222,13 +345,24 @@ void MojoChecksum_init(MojoChecksumContext *ctx)
 void MojoChecksum_append(MojoChecksumContext *ctx, const uint8 *d, uint32 len)
 {
     #if SUPPORT_CRC32
-    MojoCrc32_append(&ctx->crc32, d, len);
+    if (ctx->flags & MOJOCHECKSUM_CRC32)
+        MojoCrc32_append(&ctx->crc32, d, len);
     #endif
     #if SUPPORT_MD5
-    MojoMd5_append(&ctx->md5, d, len);
+    if (ctx->flags & MOJOCHECKSUM_MD5)
+        MojoMd5_append(&ctx->md5, d, len);
     #endif
     #if SUPPORT_SHA1
-    MojoSha1_append(&ctx->sha1, d, len);
+    if (ctx->flags & MOJOCHECKSUM_SHA1)
+        MojoSha1_append(&ctx->sha1, d, len);
+    #endif
+    #if SUPPORT_XXH128
+    if (ctx->flags & MOJOCHECKSUM_XXH128)
+        MojoXxh128_append(&ctx->xxh128, d, len);
+    #endif
+    #if SUPPORT_BLAKE3
+    if (ctx->flags & MOJOCHECKSUM_BLAKE3)
+        MojoBlake3_append(&ctx->blake3, d, len);
     #endif
 } // MojoChecksum_append
 
@@ -236,18 +370,267 @@ void MojoChecksum_append(MojoChecksumContext *ctx, const uint8 *d, uint32 len)
 void MojoChecksum_finish(MojoChecksumContext *ctx, MojoChecksums *sums)
 {
     memset(sums, '\0', sizeof (MojoChecksums));
+    sums->flags = ctx->flags | ctx->stored;
+    if (ctx->stored & MOJOCHECKSUM_CRC32)
+        sums->crc32 = ctx->storedcrc32;
     #if SUPPORT_CRC32
-    MojoCrc32_finish(&ctx->crc32, &sums->crc32);
+    if (ctx->flags & MOJOCHECKSUM_CRC32)
+        MojoCrc32_finish(&ctx->crc32, &sums->crc32);
     #endif
     #if SUPPORT_MD5
-    MojoMd5_finish(&ctx->md5, sums->md5);
+    if (ctx->flags & MOJOCHECKSUM_MD5)
+        MojoMd5_finish(&ctx->md5, sums->md5);
     #endif
     #if SUPPORT_SHA1
-    MojoSha1_finish(&ctx->sha1, sums->sha1);
+    if (ctx->flags & MOJOCHECKSUM_SHA1)
+        MojoSha1_finish(&ctx->sha1, sums->sha1);
+    #endif
+    #if SUPPORT_XXH128
+    if (ctx->flags & MOJOCHECKSUM_XXH128)
+        MojoXxh128_finish(&ctx->xxh128, sums->xxh128);
+    #endif
+    #if SUPPORT_BLAKE3
+    if (ctx->flags & MOJOCHECKSUM_BLAKE3)
+        MojoBlake3_finish(&ctx->blake3, sums->blake3);
     #endif
 } // MojoChecksum_finish
 
 
+void MojoChecksum_useCrc32(MojoChecksumContext *ctx, uint32 crc)
+{
+    if (ctx->flags & MOJOCHECKSUM_CRC32)
+    {
+        ctx->flags &= ~MOJOCHECKSUM_CRC32;
+        ctx->stored |= MOJOCHECKSUM_CRC32;
+        ctx->storedcrc32 = crc;
+    } // if
+} // MojoChecksum_useCrc32
+
+
+struct MojoJob
+{
+    MojoJobFunc fn;
+    void *data;
+    boolean done;
+    void *sem;
+    MojoJob *next;
+};
+
+static uint32 workerCount = 0;  // zero == not initialized yet.
+static void **workerThreads = NULL;
+static void *workerMutex = NULL;
+static void *workerSem = NULL;  // posted once per submitted job.
+static MojoJob *workerQueue = NULL;
+static MojoJob *workerQueueTail = NULL;
+static boolean workersQuit = false;
+
+// You must hold workerMutex to call this!
+static MojoJob *popWorkerJob(void)
+{
+    MojoJob *job = workerQueue;
+    if (job != NULL)
+    {
+        workerQueue = job->next;
+        if (workerQueue == NULL)
+            workerQueueTail = NULL;
+        job->next = NULL;
+    } // if
+    return job;
+} // popWorkerJob
+
+// MojoWorker_wait() checks (done) under workerMutex, and if it isn't set,
+//  runs a queued job itself or, when there are none left, blocks on the
+//  semaphore. We set (done) and post under that same lock, so a waiter
+//  either sees (done) after we're finished with the job, or waits for a
+//  post that's sure to come. The waiter frees the job as soon as it wakes
+//  up, so the post is the last thing we touch.
+static void runWorkerJob(MojoJob *job)
+{
+    job->fn(job->data);
+    MojoPlatform_lockMutex(workerMutex);
+    job->done = true;
+    MojoPlatform_semaphorePost(job->sem);
+    MojoPlatform_unlockMutex(workerMutex);
+} // runWorkerJob
+
+static int workerThread(void *unused)
+{
+    while (true)
+    {
+        MojoJob *job = NULL;
+        MojoPlatform_semaphoreWait(workerSem);
+        MojoPlatform_lockMutex(workerMutex);
+        job = popWorkerJob();
+        if ((job == NULL) && (workersQuit))
+        {
+            MojoPlatform_unlockMutex(workerMutex);
+            break;
+        } // if
+        MojoPlatform_unlockMutex(workerMutex);
+
+        // (job) can be NULL if a waiting thread ran it first.
+        if (job != NULL)
+            runWorkerJob(job);
+    } // while
+
+    return 0;
+} // workerThread
+
+// !!! FIXME: not thread safe; the first submit must happen before any
+// !!! FIXME:  other thread might submit.
+static void initWorkers(void)
+{
+    const char *str = cmdlinestr("threads", "MOJOSETUP_THREADS", NULL);
+    uint32 count = MojoPlatform_cpuCount();
+    uint32 i;
+
+    if (str != NULL)
+        count = (uint32) strtoul(str, NULL, 10);
+
+    if (count > 64)
+        count = 64;
+    else if (count == 0)
+        count = 1;
+
+    workerCount = 1;  // no threads unless everything below works out.
+    if (count == 1)
+        return;
+
+    workerMutex = MojoPlatform_createMutex();
+    workerSem = MojoPlatform_createSemaphore(0);
+    if ((workerMutex == NULL) || (workerSem == NULL))
+    {
+        logWarning("Couldn't create worker threads; running single-threaded.");
+        if (workerMutex != NULL)
+            MojoPlatform_destroyMutex(workerMutex);
+        if (workerSem != NULL)
+            MojoPlatform_destroySemaphore(workerSem);
+        workerMutex = workerSem = NULL;
+        return;
+    } // if
+
+    workerThreads = (void **) xmalloc(sizeof (void *) * count);
+    for (i = 0; i < count; i++)
+    {
+        workerThreads[i] = MojoPlatform_createThread(workerThread, NULL);
+        if (workerThreads[i] == NULL)
+            break;
+    } // for
+
+    workerCount = i;
+    if (workerCount == 0)
+        workerCount = 1;  // submit() will just run things inline.
+    logDebug("Started %0 worker threads.", numstr((int) i));
+} // initWorkers
+
+
+uint32 MojoWorker_count(void)
+{
+    if (workerCount == 0)
+        initWorkers();
+    return workerCount;
+} // MojoWorker_count
+
+
+MojoJob *MojoWorker_submit(MojoJobFunc fn, void *data)
+{
+    MojoJob *job = (MojoJob *) xmalloc(sizeof (MojoJob));
+    job->fn = fn;
+    job->data = data;
+
+    if (workerCount == 0)
+        initWorkers();
+
+    if (workerThreads == NULL)  // no threads? Just do it now.
+    {
+        fn(data);
+        job->done = true;
+        return job;
+    } // if
+
+    job->sem = MojoPlatform_createSemaphore(0);
+    if (job->sem == NULL)
+    {
+        fn(data);
+        job->done = true;
+        return job;
+    } // if
+
+    MojoPlatform_lockMutex(workerMutex);
+    if (workerQueueTail == NULL)
+        workerQueue = job;
+    else
+        workerQueueTail->next = job;
+    workerQueueTail = job;
+    MojoPlatform_unlockMutex(workerMutex);
+    MojoPlatform_semaphorePost(workerSem);
+
+    return job;
+} // MojoWorker_submit
+
+
+void MojoWorker_wait(MojoJob *job)
+{
+    while (job->sem != NULL)
+    {
+        MojoJob *other = NULL;
+        MojoPlatform_lockMutex(workerMutex);
+        if (job->done)
+        {
+            MojoPlatform_unlockMutex(workerMutex);
+            break;
+        } // if
+
+        // Help out instead of sleeping, so jobs can wait on jobs.
+        other = popWorkerJob();
+        MojoPlatform_unlockMutex(workerMutex);
+
+        if (other != NULL)
+            runWorkerJob(other);
+        else
+        {
+            // (job) is running on another thread right now; it'll post
+            //  its semaphore when it finishes.
+            MojoPlatform_semaphoreWait(job->sem);
+            break;
+        } // else
+    } // while
+
+    if (job->sem != NULL)
+        MojoPlatform_destroySemaphore(job->sem);
+    free(job);
+} // MojoWorker_wait
+
+
+void MojoWorker_shutdown(void)
+{
+    uint32 i;
+
+    if (workerThreads != NULL)
+    {
+        MojoPlatform_lockMutex(workerMutex);
+        workersQuit = true;
+        MojoPlatform_unlockMutex(workerMutex);
+
+        for (i = 0; i < workerCount; i++)
+            MojoPlatform_semaphorePost(workerSem);
+        for (i = 0; i < workerCount; i++)
+            MojoPlatform_waitThread(workerThreads[i]);
+
+        assert(workerQueue == NULL);
+        free(workerThreads);
+        MojoPlatform_destroySemaphore(workerSem);
+        MojoPlatform_destroyMutex(workerMutex);
+    } // if
+
+    workerThreads = NULL;
+    workerSem = NULL;
+    workerMutex = NULL;
+    workersQuit = false;
+    workerCount = 0;
+} // MojoWorker_shutdown
+
+
 boolean cmdline(const char *arg)
 {
     int argc = GArgc;
@@ -355,6 +738,190 @@ boolean wildcardMatch(const char *str, const char *pattern)
 } // wildcardMatch
 
 
+typedef struct WildcardPattern
+{
+    char *pattern;
+    const char *rest;  // after the literal prefix; NULL if no wildcards.
+    const char *suffix;  // literal part after the last wildcard.
+    size_t suffixlen;
+    uint32 tag;
+    int32 next;  // next pattern on the same trie node, or -1.
+} WildcardPattern;
+
+typedef struct WildcardNode
+{
+    char ch;
+    int32 child;  // first child, or -1.
+    int32 sibling;  // next child of our parent, or -1.
+    int32 patterns;  // first pattern whose literal prefix ends here, or -1.
+} WildcardNode;
+
+struct MojoWildcardSet
+{
+    WildcardNode *nodes;  // nodes[0] is the root: the empty prefix.
+    uint32 nodecount;
+    WildcardPattern *patterns;
+    uint32 patterncount;
+    uint8 *hits;  // per tag, while matching.
+    uint32 tagcount;
+};
+
+MojoWildcardSet *MojoWildcardSet_create(void)
+{
+    MojoWildcardSet *set = (MojoWildcardSet *) xmalloc(sizeof (MojoWildcardSet));
+    set->nodes = (WildcardNode *) xmalloc(sizeof (WildcardNode));
+    set->nodes[0].child = set->nodes[0].sibling = set->nodes[0].patterns = -1;
+    set->nodecount = 1;
+    return set;
+} // MojoWildcardSet_create
+
+
+void MojoWildcardSet_add(MojoWildcardSet *set, const char *pattern, uint32 tag)
+{
+    WildcardPattern *pat = NULL;
+    const char *ptr = NULL;
+    int32 node = 0;
+
+    set->patterns = (WildcardPattern *) xrealloc(set->patterns,
+                    sizeof (WildcardPattern) * (set->patterncount + 1));
+    pat = &set->patterns[set->patterncount];
+    pat->pattern = xstrdup(pattern);
+    pat->rest = NULL;
+    pat->suffix = pat->pattern;
+    pat->tag = tag;
+
+    // walk the literal prefix down the trie, growing it as needed.
+    for (ptr = pat->pattern; *ptr; ptr++)
+    {
+        int32 child;
+        if ((*ptr == '*') || (*ptr == '?'))
+        {
+            if (pat->rest == NULL)
+                pat->rest = ptr;
+            pat->suffix = ptr + 1;
+            continue;
+        } // if
+        else if (pat->rest != NULL)
+            continue;  // just looking for the suffix now.
+
+        for (child = set->nodes[node].child; child != -1;
+             child = set->nodes[child].sibling)
+        {
+            if (set->nodes[child].ch == *ptr)
+                break;
+        } // for
+
+        if (child == -1)
+        {
+            WildcardNode *n = NULL;
+            set->nodes = (WildcardNode *) xrealloc(set->nodes,
+                            sizeof (WildcardNode) * (set->nodecount + 1));
+            child = (int32) set->nodecount++;
+            n = &set->nodes[child];
+            n->ch = *ptr;
+            n->child = n->patterns = -1;
+            n->sibling = set->nodes[node].child;
+            set->nodes[node].child = child;
+        } // if
+        node = child;
+    } // for
+
+    pat->suffixlen = strlen(pat->suffix);
+    pat->next = set->nodes[node].patterns;
+    set->nodes[node].patterns = (int32) set->patterncount++;
+
+    if (tag >= set->tagcount)
+    {
+        set->hits = (uint8 *) xrealloc(set->hits, tag + 1);
+        memset(set->hits + set->tagcount, '\0', (tag + 1) - set->tagcount);
+        set->tagcount = tag + 1;
+    } // if
+} // MojoWildcardSet_add
+
+
+uint32 MojoWildcardSet_match(MojoWildcardSet *set, const char *str,
+                             uint32 *tags, uint32 maxtags)
+{
+    const size_t len = strlen(str);
+    boolean matched = false;
+    uint32 retval = 0;
+    size_t depth = 0;
+    int32 node = 0;
+    uint32 i;
+
+    // Every node we pass through is a literal prefix of (str), so only the
+    //  patterns hanging off those nodes can match.
+    while (node != -1)
+    {
+        const char ch = str[depth];
+        int32 p;
+
+        for (p = set->nodes[node].patterns; p != -1; p = set->patterns[p].next)
+        {
+            const WildcardPattern *pat = &set->patterns[p];
+            if (set->hits[pat->tag])
+                continue;  // already have this one.
+            else if (pat->rest == NULL)  // no wildcards: exact match only.
+            {
+                if (ch != '\0')
+                    continue;
+            } // else if
+            else if (pat->suffixlen > (len - depth))
+                continue;
+            else if (memcmp(str + (len - pat->suffixlen), pat->suffix,
+                            pat->suffixlen) != 0)
+                continue;  // anything after the last wildcard ends (str).
+            else if (!wildcardMatch(str + depth, pat->rest))
+                continue;
+
+            set->hits[pat->tag] = 1;
+            matched = true;
+        } // for
+
+        if (ch == '\0')
+            break;
+
+        for (node = set->nodes[node].child; node != -1;
+             node = set->nodes[node].sibling)
+        {
+            if (set->nodes[node].ch == ch)
+                break;
+        } // for
+        depth++;
+    } // while
+
+    if (matched)
+    {
+        for (i = 0; i < set->tagcount; i++)
+        {
+            if (set->hits[i])
+            {
+                set->hits[i] = 0;
+                if (retval < maxtags)
+                    tags[retval] = i;
+                retval++;
+            } // if
+        } // for
+    } // if
+
+    return retval;
+} // MojoWildcardSet_match
+
+
+void MojoWildcardSet_destroy(MojoWildcardSet *set)
+{
+    uint32 i;
+    if (set == NULL)
+        return;
+    for (i = 0; i < set->patterncount; i++)
+        free(set->patterns[i].pattern);
+    free(set->patterns);
+    free(set->nodes);
+    free(set->hits);
+    free(set);
+} // MojoWildcardSet_destroy
+
+
 const char *numstr(int val)
 {
     static int pos = 0;
@@ -561,6 +1128,338 @@ void logDebug(const char *fmt, ...)
 } // logDebug
 
 
+// Tracing. Each thread gets its own ring buffer, so recording an event never
+//  takes a lock after a thread's first one, and a long install just loses
+//  its oldest events instead of eating memory. Events are fixed-size so the
+//  ring never allocates; long names get truncated.
+#define TRACE_RING_EVENTS (16 * 1024)
+#define TRACE_MAX_THREADS 80  // main thread, 64 workers, and some slack.
+#define TRACE_MAX_ARGS 3
+
+typedef struct TraceEvent
+{
+    uint64 ts;  // microseconds, from MojoPlatform_microTicks().
+    char phase;  // 'B', 'E' or 'C', as chrome://tracing spells them.
+    char cat[15];
+    char name[80];
+    uint32 argcount;
+    const char *argnames[TRACE_MAX_ARGS];  // must be string literals.
+    int64 args[TRACE_MAX_ARGS];
+} TraceEvent;
+
+typedef struct TraceThread
+{
+    uint64 threadid;
+    TraceEvent *events;
+    uint64 total;  // events ever recorded; the ring holds the newest ones.
+} TraceThread;
+
+boolean MojoTrace_enabled = false;
+static char *traceFile = NULL;
+static void *traceMutex = NULL;
+static TraceThread traceThreads[TRACE_MAX_THREADS];
+static volatile uint32 traceThreadCount = 0;
+
+// Only the thread itself ever adds its entry, so if it's there, this
+//  thread can see it without locking.
+static TraceThread *getTraceThread(void)
+{
+    const uint64 id = MojoPlatform_threadID();
+    TraceThread *retval = NULL;
+    uint32 i;
+
+    for (i = 0; i < traceThreadCount; i++)
+    {
+        if (traceThreads[i].threadid == id)
+            return &traceThreads[i];
+    } // for
+
+    MojoPlatform_lockMutex(traceMutex);
+    if (traceThreadCount < TRACE_MAX_THREADS)
+    {
+        retval = &traceThreads[traceThreadCount];
+        retval->events = (TraceEvent *)
+                    xmalloc(sizeof (TraceEvent) * TRACE_RING_EVENTS);
+        retval->threadid = id;
+        traceThreadCount++;
+    } // if
+    MojoPlatform_unlockMutex(traceMutex);
+
+    return retval;  // NULL if there are too many threads; we drop those.
+} // getTraceThread
+
+
+// Keeps the end of (src) if it's too long, since that's the interesting
+//  part of a path, without starting in the middle of a UTF-8 sequence.
+static void traceCopyString(char *dst, const char *src, size_t len)
+{
+    const size_t srclen = strlen(src);
+    if (srclen < len)
+        memcpy(dst, src, srclen + 1);
+    else
+    {
+        const char *tail = src + (srclen - (len - 4));
+        while ((((uint8) *tail) & 0xC0) == 0x80)
+            tail++;
+        memcpy(dst, "...", 3);
+        memcpy(dst + 3, tail, strlen(tail) + 1);
+    } // else
+} // traceCopyString
+
+
+static void traceRecord(char phase, const char *cat, const char *name,
+                        uint32 argcount, const char **argnames,
+                        const int64 *args)
+{
+    TraceThread *thread = getTraceThread();
+    TraceEvent *event = NULL;
+    uint32 i;
+
+    if (thread == NULL)
+        return;
+
+    event = &thread->events[thread->total % TRACE_RING_EVENTS];
+    event->ts = MojoPlatform_microTicks();
+    event->phase = phase;
+    traceCopyString(event->cat, (cat != NULL) ? cat : "", sizeof (event->cat));
+    traceCopyString(event->name, (name != NULL) ? name : "",
+                    sizeof (event->name));
+
+    if (argcount > TRACE_MAX_ARGS)
+        argcount = TRACE_MAX_ARGS;
+    event->argcount = argcount;
+    for (i = 0; i < argcount; i++)
+    {
+        event->argnames[i] = argnames[i];
+        event->args[i] = args[i];
+    } // for
+
+    thread->total++;
+} // traceRecord
+
+
+void MojoTrace_begin(const char *cat, const char *name)
+{
+    if (MojoTrace_enabled)
+        traceRecord('B', cat, name, 0, NULL, NULL);
+} // MojoTrace_begin
+
+
+void MojoTrace_end(const char *cat)
+{
+    if (MojoTrace_enabled)
+        traceRecord('E', cat, NULL, 0, NULL, NULL);
+} // MojoTrace_end
+
+
+void MojoTrace_endWithArgs(const char *cat, uint32 argcount,
+                           const char **argnames, const int64 *args)
+{
+    if (MojoTrace_enabled)
+        traceRecord('E', cat, NULL, argcount, argnames, args);
+} // MojoTrace_endWithArgs
+
+
+void MojoTrace_counter(const char *name, int64 value)
+{
+    static const char *argname = "value";
+    if (MojoTrace_enabled)
+        traceRecord('C', "counter", name, 1, &argname, &value);
+} // MojoTrace_counter
+
+
+void MojoTrace_init(void)
+{
+    const char *fname = cmdlinestr("trace", "MOJOSETUP_TRACE", NULL);
+    if ((fname == NULL) || (*fname == '\0') || (MojoTrace_enabled))
+        return;
+
+    traceMutex = MojoPlatform_createMutex();
+    if (traceMutex == NULL)
+    {
+        logWarning("Couldn't start tracing: no mutex.");
+        return;
+    } // if
+
+    traceFile = xstrdup(fname);
+    MojoTrace_enabled = true;
+    getTraceThread();  // so the main thread is always the first one.
+    logInfo("Tracing to '%0'.", traceFile);
+} // MojoTrace_init
+
+
+typedef struct TraceWriter
+{
+    void *io;
+    uint32 len;
+    boolean failed;
+} TraceWriter;
+
+// Buffers output in scratchbuf_128k; the workers are gone by now.
+static void traceFlush(TraceWriter *w)
+{
+    if ((w->len > 0) && (!w->failed))
+    {
+        if (MojoPlatform_write(w->io, scratchbuf_128k, w->len) != w->len)
+            w->failed = true;
+    } // if
+    w->len = 0;
+} // traceFlush
+
+static void traceWrite(TraceWriter *w, const char *str)
+{
+    const size_t len = strlen(str);
+    if (w->len + len > sizeof (scratchbuf_128k))
+        traceFlush(w);
+    if (len > sizeof (scratchbuf_128k))
+        w->failed = true;  // never happens; we only write short pieces.
+    else
+    {
+        memcpy(scratchbuf_128k + w->len, str, len);
+        w->len += (uint32) len;
+    } // else
+} // traceWrite
+
+static void traceWriteJsonString(TraceWriter *w, const char *str)
+{
+    char buf[sizeof (((TraceEvent *) NULL)->name) * 6 + 3];
+    char *ptr = buf;
+
+    *(ptr++) = '"';
+    for (; *str; str++)
+    {
+        const uint8 ch = (uint8) *str;
+        if ((ch == '"') || (ch == '\\'))
+        {
+            *(ptr++) = '\\';
+            *(ptr++) = (char) ch;
+        } // if
+        else if (ch < 0x20)
+        {
+            snprintf(ptr, 7, "\\u%04x", (unsigned int) ch);
+            ptr += 6;
+        } // else if
+        else
+        {
+            *(ptr++) = (char) ch;
+        } // else
+    } // for
+    *(ptr++) = '"';
+    *ptr = '\0';
+    traceWrite(w, buf);
+} // traceWriteJsonString
+
+
+static void traceWriteEvent(TraceWriter *w, uint32 tid, const TraceEvent *ev)
+{
+    char buf[128];
+    uint32 i;
+
+    traceWrite(w, ",\n{\"name\":");
+    traceWriteJsonString(w, ev->name);
+    traceWrite(w, ",\"cat\":");
+    traceWriteJsonString(w, ev->cat);
+    snprintf(buf, sizeof (buf), ",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%llu",
+             ev->phase, (unsigned int) tid, (unsigned long long) ev->ts);
+    traceWrite(w, buf);
+
+    if (ev->argcount > 0)
+    {
+        traceWrite(w, ",\"args\":{");
+        for (i = 0; i < ev->argcount; i++)
+        {
+            if (i > 0)
+                traceWrite(w, ",");
+            traceWriteJsonString(w, ev->argnames[i]);
+            snprintf(buf, sizeof (buf), ":%lld", (long long) ev->args[i]);
+            traceWrite(w, buf);
+        } // for
+        traceWrite(w, "}");
+    } // if
+
+    traceWrite(w, "}");
+} // traceWriteEvent
+
+
+// Call this after MojoWorker_shutdown(), so no one's still recording.
+void MojoTrace_deinit(void)
+{
+    const uint32 flags = MOJOFILE_WRITE|MOJOFILE_CREATE|MOJOFILE_TRUNCATE;
+    uint64 lost = 0;
+    TraceWriter w;
+    uint32 i;
+
+    if (!MojoTrace_enabled)
+        return;
+
+    MojoTrace_enabled = false;
+
+    memset(&w, '\0', sizeof (w));
+    w.io = MojoPlatform_open(traceFile, flags, MojoPlatform_defaultFilePerms());
+    if (w.io == NULL)
+        w.failed = true;
+    else
+    {
+        // Chrome wants a thread_name metadata event to label each row.
+        traceWrite(&w, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        traceWrite(&w, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                       "\"args\":{\"name\":\"MojoSetup\"}}");
+        for (i = 0; i < traceThreadCount; i++)
+        {
+            const TraceThread *thread = &traceThreads[i];
+            uint64 first = 0;
+            uint64 j;
+            char label[32];
+            char buf[160];
+
+            if (i == 0)
+                snprintf(label, sizeof (label), "main");
+            else
+                snprintf(label, sizeof (label), "thread %u", (unsigned int) i);
+            snprintf(buf, sizeof (buf),
+                     ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                     "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                     (unsigned int) (i + 1), label);
+            traceWrite(&w, buf);
+
+            if (thread->total > TRACE_RING_EVENTS)
+            {
+                first = thread->total - TRACE_RING_EVENTS;
+                lost += first;
+            } // if
+
+            for (j = first; j < thread->total; j++)
+            {
+                const TraceEvent *ev = &thread->events[j % TRACE_RING_EVENTS];
+                traceWriteEvent(&w, i + 1, ev);
+            } // for
+        } // for
+        traceWrite(&w, "\n]}\n");
+        traceFlush(&w);
+
+        if (!MojoPlatform_close(w.io))
+            w.failed = true;
+    } // else
+
+    if (w.failed)
+        logError("Couldn't write trace to '%0'.", traceFile);
+    else if (lost > 0)
+    {
+        logWarning("Trace was too long; the oldest %0 events were dropped.",
+                   numstr((int) lost));
+    } // else if
+
+    for (i = 0; i < traceThreadCount; i++)
+        free(traceThreads[i].events);
+    memset(traceThreads, '\0', sizeof (traceThreads));
+    traceThreadCount = 0;
+    MojoPlatform_destroyMutex(traceMutex);
+    traceMutex = NULL;
+    free(traceFile);
+    traceFile = NULL;
+} // MojoTrace_deinit
+
+
 uint32 profile(const char *what, uint32 start_time)
 {
     uint32 retval = MojoPlatform_ticks() - start_time;
@@ -928,6 +1827,26 @@ void *xrealloc(void *ptr, size_t bytes)
 } // xrealloc
 #define realloc(x,y) DO_NOT_CALL_REALLOC__USE_XREALLOC_INSTEAD
 
+// The real block's address goes right in front of the one we hand out.
+void *xmallocAligned(size_t bytes, size_t align)
+{
+    uint8 *block = (uint8 *) xmalloc(bytes + align + sizeof (void *));
+    uint8 *retval = block + sizeof (void *);
+    retval += (align - (((size_t) retval) & (align - 1))) & (align - 1);
+    memcpy(retval - sizeof (void *), &block, sizeof (void *));
+    return retval;
+} // xmallocAligned
+
+void xfreeAligned(void *ptr)
+{
+    if (ptr != NULL)
+    {
+        void *block;
+        memcpy(&block, ((uint8 *) ptr) - sizeof (void *), sizeof (void *));
+        free(block);
+    } // if
+} // xfreeAligned
+
 char *xstrdup(const char *str)
 {
     char *retval = (char *) xmalloc(strlen(str) + 1);
@@ -1049,6 +1968,10 @@ int MojoSetup_main(int argc, char **argv)
     return MojoSetup_testNetworkCode(argc, argv);
     #endif
 
+    #if BENCHMARK_CODE
+    return MojoSetup_benchmark(argc, argv);
+    #endif
+
     if (!initEverything())
         return 1;
 
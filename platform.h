@@ -29,6 +29,11 @@ char *MojoPlatform_homedir(void);
 
 uint32 MojoPlatform_ticks(void);
 
+// Like MojoPlatform_ticks(), from the same starting point, but in
+//  microseconds, for timing things too short to see in milliseconds. It may
+//  be no more precise than MojoPlatform_ticks() on some platforms.
+uint64 MojoPlatform_microTicks(void);
+
 // Make current process kill itself immediately, without any sort of internal
 //  cleanup, like atexit() handlers or static destructors...the OS will have
 //  to sort out the freeing of any resources, and no more code in this
@@ -101,6 +106,13 @@ boolean MojoPlatform_isfile(const char *fname);
 //  Return -1 if file is missing or not a file. Don't follow symlinks.
 int64 MojoPlatform_filesize(const char *fname);
 
+// Returns a number to sort files by, so reading them in that order is kind
+//  to the disk: where the file's data starts on the physical device, if the
+//  filesystem will tell us, otherwise something like its inode number, which
+//  tends to follow allocation order. This is only a hint for ordering; it
+//  returns 0 if we can't tell, or if (fname) doesn't exist.
+uint64 MojoPlatform_diskOrder(const char *fname);
+
 // !!! FIXME: we really can't do this in a 16-bit value...non-Unix platforms
 // !!! FIXME:  and Extended Attributes need more.
 // !!! FIXME: comment me.
@@ -183,6 +195,23 @@ boolean MojoPlatform_flush(void *fd);
 //  success, false on i/o error.
 boolean MojoPlatform_close(void *fd);
 
+// Map (len) bytes of an open file, referenced by its opaque handle from
+//  MojoPlatform_open(), read-only into memory. The mapping stays valid after
+//  (fd) is closed. Returns NULL if the file can't be mapped (empty files,
+//  files too big for the address space, platforms without mmap, etc), in
+//  which case you should just read() it instead. Free the mapping with
+//  MojoPlatform_munmap().
+void *MojoPlatform_mmap(void *fd, uint64 len);
+
+// Free a mapping from MojoPlatform_mmap(). (len) must be the same value
+//  passed to MojoPlatform_mmap().
+void MojoPlatform_munmap(void *ptr, uint64 len);
+
+// Hint that a mapping from MojoPlatform_mmap() will be read front to back,
+//  so the OS can read further ahead. Don't call this for files that get
+//  read by seeking around, like zipfiles. Does nothing where unsupported.
+void MojoPlatform_mmapSequential(void *ptr, uint64 len);
+
 // Enumerate a directory. Returns an opaque pointer that can be used with
 //  repeated calls to MojoPlatform_readdir() to enumerate the names of
 //  directory entries. Returns NULL on error. Non-NULL values should be passed
@@ -274,6 +303,37 @@ boolean MojoPlatform_spawnTerminal(void);
 //  for input, etc. Pumping the GUI event queue happens elsewhere, not here.
 void MojoPlatform_sleep(uint32 ticks);
 
+// Threads. (fn) runs on a new thread, and is passed (data). Returns an opaque
+//  handle on success, NULL on failure. MojoPlatform_waitThread() blocks until
+//  the thread's function returns, and gives you its return value. The handle
+//  is invalid after that call, and every thread must be waited on.
+// Most of MojoSetup (Lua, the GUI, logging, scratchbuf_128k) is NOT thread
+//  safe; threads should be kept to self-contained work like decompression.
+typedef int (*MojoThreadEntry)(void *data);
+void *MojoPlatform_createThread(MojoThreadEntry fn, void *data);
+int MojoPlatform_waitThread(void *thread);
+
+// A number unique to the calling thread for as long as it runs. Never zero.
+uint64 MojoPlatform_threadID(void);
+
+// Mutexes. These are not recursive: don't lock one you already hold.
+//  createMutex returns NULL on failure.
+void *MojoPlatform_createMutex(void);
+void MojoPlatform_lockMutex(void *mutex);
+void MojoPlatform_unlockMutex(void *mutex);
+void MojoPlatform_destroyMutex(void *mutex);
+
+// Counting semaphores. Wait blocks until the count is non-zero, and then
+//  decrements it. Post increments it, waking a waiting thread, if any.
+//  createSemaphore returns NULL on failure.
+void *MojoPlatform_createSemaphore(uint32 initial);
+void MojoPlatform_semaphoreWait(void *sem);
+void MojoPlatform_semaphorePost(void *sem);
+void MojoPlatform_destroySemaphore(void *sem);
+
+// Number of CPU cores available to this process. Always at least 1.
+uint32 MojoPlatform_cpuCount(void);
+
 // Put a line of text to the system log, whatever that might be on a
 //  given platform. (str) is a complete line, but won't end with any newline
 //  characters. You should supply if needed.
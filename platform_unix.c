@@ -31,6 +31,13 @@
 #include <sys/wait.h>
 #include <limits.h>
 #include <errno.h>
+#include <pthread.h>
+
+#if defined(linux) || defined(__linux) || defined(__linux__)
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
 
 #if MOJOSETUP_HAVE_SYS_UCRED_H
 #  ifdef MOJOSETUP_HAVE_MNTENT_H
@@ -59,6 +66,7 @@ void beos_usleep(unsigned long ticks);
 #define usleep beos_usleep
 #else
 #include <dlfcn.h>
+#include <sys/mman.h>
 #define DLOPEN_ARGS (RTLD_NOW | RTLD_GLOBAL)
 #endif
 
@@ -535,6 +543,153 @@ void MojoPlatform_sleep(uint32 ticks)
 } // MojoPlatform_sleep
 
 
+typedef struct
+{
+    pthread_t thread;
+    MojoThreadEntry fn;
+    void *data;
+} UnixThread;
+
+static void *unixThreadEntry(void *_thread)
+{
+    UnixThread *thread = (UnixThread *) _thread;
+    return (void *) ((size_t) thread->fn(thread->data));
+} // unixThreadEntry
+
+
+void *MojoPlatform_createThread(MojoThreadEntry fn, void *data)
+{
+    UnixThread *thread = (UnixThread *) xmalloc(sizeof (UnixThread));
+    thread->fn = fn;
+    thread->data = data;
+    if (pthread_create(&thread->thread, NULL, unixThreadEntry, thread) != 0)
+    {
+        free(thread);
+        return NULL;
+    } // if
+    return thread;
+} // MojoPlatform_createThread
+
+
+int MojoPlatform_waitThread(void *_thread)
+{
+    UnixThread *thread = (UnixThread *) _thread;
+    void *retval = NULL;
+    pthread_join(thread->thread, &retval);
+    free(thread);
+    return (int) ((size_t) retval);
+} // MojoPlatform_waitThread
+
+
+uint64 MojoPlatform_threadID(void)
+{
+    // pthread_t is an integer on some systems and a pointer on others.
+    return (uint64) ((size_t) pthread_self());
+} // MojoPlatform_threadID
+
+
+void *MojoPlatform_createMutex(void)
+{
+    pthread_mutex_t *mutex = (pthread_mutex_t *)
+                                xmalloc(sizeof (pthread_mutex_t));
+    if (pthread_mutex_init(mutex, NULL) != 0)
+    {
+        free(mutex);
+        return NULL;
+    } // if
+    return mutex;
+} // MojoPlatform_createMutex
+
+
+void MojoPlatform_lockMutex(void *mutex)
+{
+    pthread_mutex_lock((pthread_mutex_t *) mutex);
+} // MojoPlatform_lockMutex
+
+
+void MojoPlatform_unlockMutex(void *mutex)
+{
+    pthread_mutex_unlock((pthread_mutex_t *) mutex);
+} // MojoPlatform_unlockMutex
+
+
+void MojoPlatform_destroyMutex(void *mutex)
+{
+    pthread_mutex_destroy((pthread_mutex_t *) mutex);
+    free(mutex);
+} // MojoPlatform_destroyMutex
+
+
+// Mac OS X doesn't implement unnamed POSIX semaphores, so build our own.
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint32 count;
+} UnixSemaphore;
+
+void *MojoPlatform_createSemaphore(uint32 initial)
+{
+    UnixSemaphore *sem = (UnixSemaphore *) xmalloc(sizeof (UnixSemaphore));
+    if (pthread_mutex_init(&sem->mutex, NULL) != 0)
+    {
+        free(sem);
+        return NULL;
+    } // if
+
+    if (pthread_cond_init(&sem->cond, NULL) != 0)
+    {
+        pthread_mutex_destroy(&sem->mutex);
+        free(sem);
+        return NULL;
+    } // if
+
+    sem->count = initial;
+    return sem;
+} // MojoPlatform_createSemaphore
+
+
+void MojoPlatform_semaphoreWait(void *_sem)
+{
+    UnixSemaphore *sem = (UnixSemaphore *) _sem;
+    pthread_mutex_lock(&sem->mutex);
+    while (sem->count == 0)
+        pthread_cond_wait(&sem->cond, &sem->mutex);
+    sem->count--;
+    pthread_mutex_unlock(&sem->mutex);
+} // MojoPlatform_semaphoreWait
+
+
+void MojoPlatform_semaphorePost(void *_sem)
+{
+    UnixSemaphore *sem = (UnixSemaphore *) _sem;
+    pthread_mutex_lock(&sem->mutex);
+    sem->count++;
+    pthread_cond_signal(&sem->cond);
+    pthread_mutex_unlock(&sem->mutex);
+} // MojoPlatform_semaphorePost
+
+
+void MojoPlatform_destroySemaphore(void *_sem)
+{
+    UnixSemaphore *sem = (UnixSemaphore *) _sem;
+    pthread_cond_destroy(&sem->cond);
+    pthread_mutex_destroy(&sem->mutex);
+    free(sem);
+} // MojoPlatform_destroySemaphore
+
+
+uint32 MojoPlatform_cpuCount(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    const long rc = sysconf(_SC_NPROCESSORS_ONLN);
+    if (rc > 0)
+        return (uint32) rc;
+#endif
+    return 1;
+} // MojoPlatform_cpuCount
+
+
 uint32 MojoPlatform_ticks(void)
 {
     uint64 then_ms, now_ms;
@@ -547,6 +702,18 @@ uint32 MojoPlatform_ticks(void)
 } // MojoPlatform_ticks
 
 
+uint64 MojoPlatform_microTicks(void)
+{
+    uint64 then_us, now_us;
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    then_us = (((uint64) startup_time.tv_sec) * 1000000) +
+              ((uint64) startup_time.tv_usec);
+    now_us = (((uint64) now.tv_sec) * 1000000) + ((uint64) now.tv_usec);
+    return now_us - then_us;
+} // MojoPlatform_microTicks
+
+
 void MojoPlatform_die(void)
 {
     _exit(86);
@@ -754,11 +921,49 @@ boolean MojoPlatform_close(void *fd)
     } // if
 
     if (close(handle) == 0)
+    {
         free(fd);
+        retval = true;
+    } // if
     return retval;
 } // MojoPlatform_close
 
 
+void *MojoPlatform_mmap(void *fd, uint64 len)
+{
+#if PLATFORM_BEOS
+    return NULL;  // BeOS 5 doesn't have mmap().
+#else
+    void *retval = NULL;
+    if ((len == 0) || (len != (uint64) ((size_t) len)))
+        return NULL;  // nothing to map, or too big for our address space.
+
+    retval = mmap(NULL, (size_t) len, PROT_READ, MAP_PRIVATE, *((int *) fd), 0);
+    if (retval == MAP_FAILED)
+        return NULL;
+
+    return retval;
+#endif
+} // MojoPlatform_mmap
+
+
+void MojoPlatform_mmapSequential(void *ptr, uint64 len)
+{
+#if !PLATFORM_BEOS && defined(MADV_SEQUENTIAL)
+    madvise(ptr, (size_t) len, MADV_SEQUENTIAL);
+#endif
+} // MojoPlatform_mmapSequential
+
+
+void MojoPlatform_munmap(void *ptr, uint64 len)
+{
+#if !PLATFORM_BEOS
+    if (ptr != NULL)
+        munmap(ptr, (size_t) len);
+#endif
+} // MojoPlatform_munmap
+
+
 void *MojoPlatform_opendir(const char *dirname)
 {
     return opendir(dirname);
@@ -802,6 +1007,40 @@ int64 MojoPlatform_filesize(const char *fname)
 } // MojoPlatform_filesize
 
 
+uint64 MojoPlatform_diskOrder(const char *fname)
+{
+    uint64 retval = 0;
+    struct stat statbuf;
+
+    if (stat(fname, &statbuf) == -1)
+        return 0;
+
+    retval = (uint64) statbuf.st_ino;
+
+#ifdef FS_IOC_FIEMAP
+    // Ask where the first extent lives. Empty files (and some filesystems)
+    //  don't have one, so those just keep the inode number.
+    if (S_ISREG(statbuf.st_mode))
+    {
+        const int fd = open(fname, O_RDONLY);
+        if (fd != -1)
+        {
+            struct { struct fiemap map; struct fiemap_extent extent; } req;
+            memset(&req, '\0', sizeof (req));
+            req.map.fm_length = FIEMAP_MAX_OFFSET;
+            req.map.fm_extent_count = 1;
+            if ( (ioctl(fd, FS_IOC_FIEMAP, &req.map) == 0) &&
+                 (req.map.fm_mapped_extents > 0) )
+                retval = (uint64) req.extent.fe_physical;
+            close(fd);
+        } // if
+    } // if
+#endif
+
+    return retval;
+} // MojoPlatform_diskOrder
+
+
 boolean MojoPlatform_perms(const char *fname, uint16 *p)
 {
     boolean retval = false;
@@ -35,6 +35,8 @@ static uint32 osMinorVer = 0;
 static uint32 osBuildVer = 0;
 
 static uint32 startupTime = 0;
+static uint64 perfStartup = 0;  // zero frequency == no performance counter.
+static uint64 perfFrequency = 0;
 
 // These allocation macros are much more complicated in PhysicsFS.
 #define smallAlloc(x) xmalloc(x)
@@ -901,12 +903,132 @@ void MojoPlatform_sleep(uint32 ticks)
 } // MojoPlatform_sleep
 
 
+typedef struct
+{
+    HANDLE handle;
+    MojoThreadEntry fn;
+    void *data;
+} WinThread;
+
+static DWORD WINAPI winThreadEntry(LPVOID _thread)
+{
+    WinThread *thread = (WinThread *) _thread;
+    return (DWORD) thread->fn(thread->data);
+} // winThreadEntry
+
+
+void *MojoPlatform_createThread(MojoThreadEntry fn, void *data)
+{
+    WinThread *thread = (WinThread *) xmalloc(sizeof (WinThread));
+    thread->fn = fn;
+    thread->data = data;
+    thread->handle = CreateThread(NULL, 0, winThreadEntry, thread, 0, NULL);
+    if (thread->handle == NULL)
+    {
+        free(thread);
+        return NULL;
+    } // if
+    return thread;
+} // MojoPlatform_createThread
+
+
+int MojoPlatform_waitThread(void *_thread)
+{
+    WinThread *thread = (WinThread *) _thread;
+    DWORD retval = 0;
+    WaitForSingleObject(thread->handle, INFINITE);
+    GetExitCodeThread(thread->handle, &retval);
+    CloseHandle(thread->handle);
+    free(thread);
+    return (int) retval;
+} // MojoPlatform_waitThread
+
+
+uint64 MojoPlatform_threadID(void)
+{
+    return (uint64) GetCurrentThreadId();
+} // MojoPlatform_threadID
+
+
+void *MojoPlatform_createMutex(void)
+{
+    CRITICAL_SECTION *mutex = (CRITICAL_SECTION *)
+                                xmalloc(sizeof (CRITICAL_SECTION));
+    InitializeCriticalSection(mutex);
+    return mutex;
+} // MojoPlatform_createMutex
+
+
+void MojoPlatform_lockMutex(void *mutex)
+{
+    EnterCriticalSection((CRITICAL_SECTION *) mutex);
+} // MojoPlatform_lockMutex
+
+
+void MojoPlatform_unlockMutex(void *mutex)
+{
+    LeaveCriticalSection((CRITICAL_SECTION *) mutex);
+} // MojoPlatform_unlockMutex
+
+
+void MojoPlatform_destroyMutex(void *mutex)
+{
+    DeleteCriticalSection((CRITICAL_SECTION *) mutex);
+    free(mutex);
+} // MojoPlatform_destroyMutex
+
+
+void *MojoPlatform_createSemaphore(uint32 initial)
+{
+    return CreateSemaphore(NULL, (LONG) initial, 0x7FFFFFFF, NULL);
+} // MojoPlatform_createSemaphore
+
+
+void MojoPlatform_semaphoreWait(void *sem)
+{
+    WaitForSingleObject((HANDLE) sem, INFINITE);
+} // MojoPlatform_semaphoreWait
+
+
+void MojoPlatform_semaphorePost(void *sem)
+{
+    ReleaseSemaphore((HANDLE) sem, 1, NULL);
+} // MojoPlatform_semaphorePost
+
+
+void MojoPlatform_destroySemaphore(void *sem)
+{
+    CloseHandle((HANDLE) sem);
+} // MojoPlatform_destroySemaphore
+
+
+uint32 MojoPlatform_cpuCount(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors > 0) ? info.dwNumberOfProcessors : 1;
+} // MojoPlatform_cpuCount
+
+
 uint32 MojoPlatform_ticks(void)
 {
     return GetTickCount() - startupTime;
 } // MojoPlatform_ticks
 
 
+uint64 MojoPlatform_microTicks(void)
+{
+    LARGE_INTEGER now;
+    uint64 elapsed;
+    if ((perfFrequency == 0) || (!QueryPerformanceCounter(&now)))
+        return ((uint64) MojoPlatform_ticks()) * 1000;
+    elapsed = ((uint64) now.QuadPart) - perfStartup;
+    // split it up so the multiply doesn't overflow on long runs.
+    return ((elapsed / perfFrequency) * 1000000) +
+           (((elapsed % perfFrequency) * 1000000) / perfFrequency);
+} // MojoPlatform_microTicks
+
+
 void MojoPlatform_die(void)
 {
     STUBBED("Win32 equivalent of _exit()?");
@@ -1206,6 +1328,38 @@ boolean MojoPlatform_close(void *fd)
 } // MojoPlatform_close
 
 
+void *MojoPlatform_mmap(void *fd, uint64 len)
+{
+    HANDLE handle = *((HANDLE *) fd);
+    HANDLE mapping = NULL;
+    void *retval = NULL;
+
+    if ((len == 0) || (len != (uint64) ((SIZE_T) len)))
+        return NULL;  // nothing to map, or too big for our address space.
+
+    mapping = CreateFileMapping(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+        return NULL;
+
+    retval = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, (SIZE_T) len);
+    CloseHandle(mapping);  // the view keeps the mapping alive.
+    return retval;
+} // MojoPlatform_mmap
+
+
+void MojoPlatform_munmap(void *ptr, uint64 len)
+{
+    if (ptr != NULL)
+        UnmapViewOfFile(ptr);
+} // MojoPlatform_munmap
+
+
+void MojoPlatform_mmapSequential(void *ptr, uint64 len)
+{
+    // No equivalent for mapped views; the memory manager reads ahead itself.
+} // MojoPlatform_mmapSequential
+
+
 typedef struct
 {
     HANDLE dir;
@@ -1343,6 +1497,14 @@ int64 MojoPlatform_filesize(const char *fname)
 } // MojoPlatform_filesize
 
 
+uint64 MojoPlatform_diskOrder(const char *fname)
+{
+    // !!! FIXME: GetFileInformationByHandle() has a file index.
+    STUBBED("disk order");
+    return 0;
+} // MojoPlatform_diskOrder
+
+
 boolean MojoPlatform_perms(const char *fname, uint16 *p)
 {
     STUBBED("Windows permissions");
@@ -1555,7 +1717,15 @@ static boolean getOSInfo(void)
 
 static boolean platformInit(void)
 {
+    LARGE_INTEGER perf;
+
     startupTime = GetTickCount();
+    if (QueryPerformanceFrequency(&perf))
+    {
+        perfFrequency = (uint64) perf.QuadPart;
+        QueryPerformanceCounter(&perf);
+        perfStartup = (uint64) perf.QuadPart;
+    } // if
 
     if (!getOSInfo())
         return false;
@@ -21,23 +21,12 @@
 
 local _ = MojoSetup.translate
 
--- Set up the garbage counter. Things that are done in possibly long-running
---  loops that create a lot of junk can optionally set a threshold and call
---  MojoSetup.incrementgarbagecounter() on each iteration. Whenever you hit
---  the threshold, garbage collection runs and resets the counter. This keeps
---  memory usage from spiraling out of control for pathological cases.
--- Note that the counter resets in MojoSetup.collectgarbage() itself, so you
---  don't have to worry about the counter accumulating and firing off extra
---  unnecessary collections if you happen to hit a loop at the wrong time.
-MojoSetup.garbagecounter = 0
-MojoSetup.garbagethreshold = 500
-
-function MojoSetup.incrementgarbagecount()
-    MojoSetup.garbagecounter = MojoSetup.garbagecounter + 1
-    if MojoSetup.garbagecounter >= MojoSetup.garbagethreshold then
-        MojoSetup.collectgarbage()
-    end
-end
+-- Things that are done in possibly long-running loops that create a lot of
+--  junk can call MojoSetup.incrementgarbagecount() on each iteration. That
+--  does a little garbage collection, sized to what was allocated since the
+--  last call, so memory usage doesn't spiral out of control for
+--  pathological cases, without stopping for a full collection every so
+--  often. It lives in lua_glue.c.
 
 -- Returns three elements: protocol, host, path
 function MojoSetup.spliturl(url)
@@ -198,6 +187,12 @@ local function mustBeSplashPosition(fnname, elem, val)
     schema_assert(valid, fnname, elem, _("Splash position is invalid"))
 end
 
+local function mustBeChecksumPolicy(fnname, elem, val)
+    mustBeString(fnname, elem, val)
+    local valid = (val == nil) or MojoSetup.isvalidchecksums(val)
+    schema_assert(valid, fnname, elem, _("Checksum policy is invalid"))
+end
+
 local function mustBePerms(fnname, elem, val)
     mustBeString(fnname, elem, val)
     local valid = MojoSetup.isvalidperms(val)
@@ -316,6 +311,7 @@ function Setup.Package(tab)
         { "updateurl", nil, mustBeUrl },
         { "superuser", false, mustBeBool },
         { "write_manifest", true, mustBeBool },
+        { "checksums", "all", mustBeChecksumPolicy },
         { "support_uninstall", true, mustBeBool },
         { "preuninstall", nil, mustBeFunction },
         { "postuninstall", nil, mustBeFunction },
@@ -422,6 +418,7 @@ function Setup.File(tab)
         { "filter", nil, mustBeFunction },
         { "allowoverwrite", nil, mustBeBool },
         { "permissions", nil, mustBePerms },
+        { "prefetch", nil, mustBeBool },
     })
 end
 
@@ -54,6 +54,7 @@ local function manifest_resync(man, fname, _key)
         local sums = nil
         local lndest = nil
         local ftype = nil
+        local source = man[fname].source
 
         if MojoSetup.platform.issymlink(fullpath) then
             ftype = "symlink"
@@ -71,7 +72,8 @@ local function manifest_resync(man, fname, _key)
             type = ftype,
             mode = perms,
             checksums = sums,
-            linkdest = lndest
+            linkdest = lndest,
+            source = source
         }
 
         MojoSetup.logwarning("Resync'd file '" ..fname.. "' in manifest")
@@ -348,8 +350,7 @@ local function drill_for_archive(archive, path, arclist)
     end
 
     local pathtab = split_path(path)
-    local ent = MojoSetup.archive.enumnext(archive)
-    while ent ~= nil do
+    for ent in MojoSetup.archive.entries(archive) do
         if ent.type == "file" then
             local i = 1
             local enttab = split_path(ent.filename)
@@ -371,7 +372,6 @@ local function drill_for_archive(archive, path, arclist)
                 return drill_for_archive(arc, rebuild_path(pathtab, i), arclist)
             end
         end
-        ent = MojoSetup.archive.enumnext(archive)
     end
 
     MojoSetup.fatal(_("Archive not found"))
@@ -425,9 +425,9 @@ local function install_file(dest, perms, writefn, desc, manifestkey)
 end
 
 
-local function install_file_from_archive(dest, archive, perms, desc, manifestkey)
+local function install_file_from_archive(dest, archive, perms, desc, manifestkey, prefetch)
     local fn = function(callback)
-        return MojoSetup.writefile(archive, dest, perms, nil, callback)
+        return MojoSetup.writefile(archive, dest, perms, nil, callback, prefetch)
     end
     return install_file(dest, perms, fn, desc, manifestkey)
 end
@@ -557,10 +557,10 @@ local function permit_write(dest, entinfo, file)
 end
 
 
-local function install_archive_entity(dest, ent, archive, desc, manifestkey, perms)
+local function install_archive_entity(dest, ent, archive, desc, manifestkey, perms, prefetch)
     install_parent_dirs(dest, manifestkey)
     if ent.type == "file" then
-        install_file_from_archive(dest, archive, perms, desc, manifestkey)
+        install_file_from_archive(dest, archive, perms, desc, manifestkey, prefetch)
     elseif ent.type == "dir" then
         install_directory(dest, perms, manifestkey)
     elseif ent.type == "symlink" then
@@ -572,9 +572,11 @@ local function install_archive_entity(dest, ent, archive, desc, manifestkey, per
 end
 
 
-local function install_archive_entry(archive, ent, file, option)
+-- Where (file) puts archive entry (ent), and with what permissions. The
+--  destination is nil if the file's filter skips this entry.
+local function archive_entry_dest(ent, file)
     local entdest = ent.filename
-    if entdest == nil then return end   -- probably can't happen...
+    if entdest == nil then return nil end   -- probably can't happen...
 
     -- Set destination in native filesystem. May be default or explicit.
     local dest = file.destination
@@ -587,89 +589,101 @@ local function install_archive_entry(archive, ent, file, option)
     local perms = file.permissions   -- may be nil
 
     if file.filter ~= nil then
+        -- (ent) gets refilled for the next entry, but a filter is free to
+        --  hang on to what it's given, so it gets its own table.
+        local filterent = {
+            filename = ent.filename,
+            linkdest = ent.linkdest,
+            filesize = ent.filesize,
+            type = ent.type
+        }
         local filterperms
-        dest, filterperms = file.filter(dest, ent)
+        dest, filterperms = file.filter(dest, filterent)
         if filterperms ~= nil then
             perms = filterperms
         end
     end
 
-    if dest ~= nil then  -- Only install if file wasn't filtered out
-        dest = MojoSetup.destination .. "/" .. dest
-        if permit_write(dest, ent, file) then
-            local desc = option.description
-            install_archive_entity(dest, ent, archive, desc, desc, perms)
-        end
+    if dest == nil then  -- filtered out.
+        return nil
     end
+    return MojoSetup.destination .. "/" .. dest, perms
 end
 
 
-local function install_archive(archive, file, option, dataprefix)
-    if not MojoSetup.archive.enumerate(archive) then
-        MojoSetup.fatal(_("Couldn't enumerate archive"))
-    end
-
-    local isbase = (archive == MojoSetup.archive.base)
-    local single_match = true
+-- A Setup.File, ready to match archive entries against.
+local function new_archive_rule(file, option, index)
+    local rule = { file = file, option = option, index = index }
     local wildcards = file.wildcards
+    if type(wildcards) == "string" then
+        wildcards = { wildcards }
+    end
+    rule.wildcards = wildcards
 
     -- If there's only one explicit file we're looking for, we don't have to
     --  iterate the whole archive...we can stop as soon as we find it.
-    if wildcards == nil then
-        single_match = false
-    else
-        if type(wildcards) == "string" then
-            wildcards = { wildcards }
-        end
-        if #wildcards > 1 then
-            single_match = false
-        else
-            for i,v in ipairs(wildcards) do
-                if string.find(v, "[*?]") ~= nil then
-                    single_match = false
-                    break  -- no reason to keep iterating...
-                end
-            end
-        end
+    rule.single_match = false
+    if (wildcards ~= nil) and (#wildcards == 1) then
+        rule.single_match = (string.find(wildcards[1], "[*?]") == nil)
     end
+    return rule
+end
 
-    local ent = MojoSetup.archive.enumnext(archive)
-    while ent ~= nil do
-        -- If inside GBaseArchive (no URL lead in string), then we
-        --  want to clip to data/ directory...
-        if isbase and (string.len(dataprefix) > 0) then
-            local count
-            ent.filename, count = string.gsub(ent.filename, "^" .. dataprefix, "", 1)
-            if count == 0 then
-                ent.filename = nil
-            end
-        end
-        
-        -- See if we should install this file...
-        if (ent.filename ~= nil) and (ent.filename ~= "") then
-            local should_install = false
-            if wildcards == nil then
-                should_install = true
-            else
-                for i,v in ipairs(wildcards) do
-                    if MojoSetup.wildcardmatch(ent.filename, v) then
-                        should_install = true
-                        break  -- no reason to keep iterating...
-                    end
-                end
-            end
 
-            if should_install then
-                install_archive_entry(archive, ent, file, option)
-                if single_match then
-                    break   -- no sense in iterating further if we're done.
-                end
-            end
-        end
+-- Install everything from (archive) that any of (rules) wants, enumerating
+--  it once, however many rules there are. Each entry goes to every rule
+--  that matches it, in the order the rules are listed.
+-- (written) maps destinations to the index of the rule that installed
+--  them. If one rule already installed a file that an earlier rule wants,
+--  then the earlier rule skips that file. Running each rule on its own,
+--  in order, would have given the later rule's file too.
+-- (srcpath) is where (archive) lives in the installer, for files that came
+--  with it: "" for the base archive itself, or the path of an archive inside
+--  it. It's nil for media and downloads, which we can't find again later.
+local function install_archive_rules(archive, rules, dataprefix, srcpath, written)
+    MojoSetup.tracebegin("archive", rules[1].file.source or "base archive")
+    if not MojoSetup.archive.enumerate(archive) then
+        MojoSetup.fatal(_("Couldn't enumerate archive"))
+    end
 
-        -- and check the next entry in the archive...
-        ent = MojoSetup.archive.enumnext(archive)
+    if written == nil then
+        written = {}
     end
+
+    -- If inside GBaseArchive (no URL lead in string), then we
+    --  want to clip to data/ directory...
+    local prefix = nil
+    if archive == MojoSetup.archive.base then
+        prefix = dataprefix
+    end
+
+    -- The matching happens in C, so we only see the entries we want.
+    local wildcards = {}
+    for i,rule in ipairs(rules) do
+        wildcards[i] = rule.wildcards or { "*" }
+    end
+    local filter = MojoSetup.archive.newfilter(prefix, wildcards)
+
+    -- The rest happens in C, too, except for Setup.File filters and
+    --  deciding whether to replace files that are already there.
+    local hooks = {
+        dest = function(ent, i)
+            return archive_entry_dest(ent, rules[i].file)
+        end,
+        permit = function(ent, i, dest)
+            return permit_write(dest, ent, rules[i].file)
+        end,
+    }
+    MojoSetup.installentries(archive, filter, rules, written, srcpath, hooks)
+
+    MojoSetup.archive.freefilter(filter)
+    MojoSetup.traceend("archive")
+end
+
+
+local function install_archive(archive, file, option, dataprefix, srcpath)
+    local rules = { new_archive_rule(file, option, 1) }
+    install_archive_rules(archive, rules, dataprefix, srcpath, nil)
 end
 
 
@@ -970,8 +984,7 @@ local function install_control_app(desc, key)
 
     local needdirs = { "scripts", "guis", "meta" }
 
-    local ent = MojoSetup.archive.enumnext(base)
-    while ent ~= nil do
+    for ent in MojoSetup.archive.entries(base) do
         -- Make sure this is in a directory we want to write out...
         local should_write = false
 
@@ -992,9 +1005,6 @@ local function install_control_app(desc, key)
                 install_archive_entity(dst, ent, base, desc, key, perms)
             end
         end
-
-        -- and check the next entry in the archive...
-        ent = MojoSetup.archive.enumnext(base)
     end
 
     -- check alternate GUI directory
@@ -1003,9 +1013,8 @@ local function install_control_app(desc, key)
         MojoSetup.loginfo("Checking GUI Path: '" .. guipath .. "'")
         local guiarchive = MojoSetup.archive.fromdir(guipath)
         MojoSetup.archive.enumerate(guiarchive)
-        local ent = MojoSetup.archive.enumnext(guiarchive)
 
-        while ent ~= nil do
+        for ent in MojoSetup.archive.entries(guiarchive) do
             -- Make sure this is in a directory we want to write out...
             local should_write = false
 
@@ -1022,8 +1031,6 @@ local function install_control_app(desc, key)
                     install_archive_entity(dst, ent, guiarchive, desc, key, perms)
                 end
             end
-
-            ent = MojoSetup.archive.enumnext(guiarchive)
         end
         MojoSetup.archive.close(guiarchive)
     end
@@ -1091,6 +1098,15 @@ local function install_manifests(desc, key)
     manifest_add(MojoSetup.manifest, xml_fname, key, "file", perms, nil, nil)
     manifest_add(MojoSetup.manifest, txt_fname, key, "file", perms, nil, nil)
 
+    -- Note where each file came from in the installer, so a later
+    --  "verify --repair" can pull it out again.
+    for fname,source in pairs(MojoSetup.sources) do
+        local entity = MojoSetup.manifest[fname]
+        if (entity ~= nil) and (entity.type == "file") then
+            entity.source = source
+        end
+    end
+
     -- build the "package" table that we serialize, etc.
     local package =
     {
@@ -1281,6 +1297,23 @@ local function get_productkey(thisstage, maxstage, desc, fmt, verify, dest, mani
 end
 
 
+-- (gcstats) is a list of what MojoSetup.gcstats() said after each stage we
+--  ran, with the stage number in "stage".
+local function log_gc_stats(gcstats)
+    local time = 0
+    local peak = 0
+    for i,stats in ipairs(gcstats) do
+        time = time + stats.time
+        if stats.peak > peak then
+            peak = stats.peak
+        end
+        MojoSetup.loginfo(string.format("Stage %d: %.1f ms collecting garbage (%d steps, %d full), Lua heap peaked at %d KB",
+                          stats.stage, stats.time, stats.steps, stats.collections, MojoSetup.truncatenum(stats.peak / 1024)))
+    end
+    MojoSetup.loginfo(string.format("Install: %.1f ms collecting garbage, Lua heap peaked at %d KB", time, MojoSetup.truncatenum(peak / 1024)))
+end
+
+
 local function start_gui(desc, pkg_name, splashfname, splashpos)
     if splashfname ~= nil then
         splashfname = 'meta/' .. splashfname
@@ -1340,6 +1373,17 @@ local function do_install(install)
         MojoSetup.fatal(_("BUG: Setup.DesktopMenuItem requires support_uninstall"))
     end
 
+    -- Digests only go into the manifest, so don't compute any without one.
+    --  The command line can override the package's choice.
+    local checksums = "none"
+    if install.write_manifest then
+        checksums = MojoSetup.cmdlinestr("checksums", "MOJOSETUP_CHECKSUMS",
+                                         install.checksums)
+    end
+    if not MojoSetup.setchecksums(checksums) then
+        badcmdline()
+    end
+
     -- Manifest support requires the Lua parser.
     if (install.write_manifest) and (not MojoSetup.info.luaparser) then
         MojoSetup.fatal(_("BUG: write_manifest requires Lua parser support"))
@@ -1615,10 +1659,18 @@ local function do_install(install)
                 prot,host,path = MojoSetup.spliturl(src)
             end
             if (src == nil) or (prot == "base://") then  -- included content?
-                if MojoSetup.files.included == nil then
-                    MojoSetup.files.included = {}
+                -- Kept in order, since later rules win conflicts.
+                local included = MojoSetup.files.included
+                if included == nil then
+                    included = { index = {} }
+                    MojoSetup.files.included = included
+                end
+                local i = included.index[file]
+                if i == nil then
+                    i = #included + 1
+                    included.index[file] = i
                 end
-                MojoSetup.files.included[file] = option
+                included[i] = { file = file, option = option }
             elseif prot == "media://" then
                 -- !!! FIXME: make sure media id is valid.
                 if MojoSetup.files.media == nil then
@@ -1804,15 +1856,33 @@ local function do_install(install)
         end
 
         if MojoSetup.files.included ~= nil then
-            for file,option in pairs(MojoSetup.files.included) do
+            -- Sort the rules by the archive they read from, so each archive
+            --  is only enumerated (and decompressed) once.
+            local groups = {}
+            local srcpaths = {}
+            for i,v in ipairs(MojoSetup.files.included) do
+                local srcpath = ""
+                if v.file.source ~= nil then
+                    local prot,host,path = MojoSetup.spliturl(v.file.source)
+                    srcpath = install.dataprefix .. path
+                end
+                if groups[srcpath] == nil then
+                    groups[srcpath] = {}
+                    srcpaths[#srcpaths+1] = srcpath
+                end
+                local rules = groups[srcpath]
+                rules[#rules+1] = new_archive_rule(v.file, v.option, i)
+            end
+
+            local written = {}
+            for i,srcpath in ipairs(srcpaths) do
                 local arc = MojoSetup.archive.base
-                if file.source == nil then
-                    install_archive(arc, file, option, install.dataprefix)
+                if srcpath == "" then
+                    install_archive_rules(arc, groups[srcpath], install.dataprefix, "", written)
                 else
-                    local prot,host,path = MojoSetup.spliturl(file.source)
                     local arclist = {}
-                    arc = drill_for_archive(arc, install.dataprefix .. path, arclist)
-                    install_archive(arc, file, option, install.dataprefix)
+                    arc = drill_for_archive(arc, srcpath, arclist)
+                    install_archive_rules(arc, groups[srcpath], install.dataprefix, srcpath, written)
                     close_archive_list(arclist)
                 end
             end
@@ -1862,13 +1932,23 @@ local function do_install(install)
     MojoSetup.stages = stages
 
     MojoSetup.manifest = {}
+    MojoSetup.sources = {}
     MojoSetup.rollbacks = {}
     MojoSetup.downloads = {}
 
+    local gcstats = {}
+    MojoSetup.gcstats(true)   -- start counting from here.
+
     local i = 1
     while MojoSetup.stages[i] ~= nil do
         local stage = MojoSetup.stages[i]
+        MojoSetup.tracebegin("stage", "stage " .. i)
         local rc = stage(i, #MojoSetup.stages)
+        MojoSetup.traceend("stage")
+
+        local stats = MojoSetup.gcstats(true)
+        stats.stage = i
+        gcstats[#gcstats+1] = stats
 
         -- Too many times I forgot to return something.   :)
         if type(rc) ~= "number" then
@@ -1890,6 +1970,8 @@ local function do_install(install)
         end
     end
 
+    log_gc_stats(gcstats)
+
     -- Successful install, so delete conflicts we no longer need to rollback.
     delete_rollbacks()
     delete_files(MojoSetup.downloads)
@@ -1904,6 +1986,7 @@ local function do_install(install)
     -- Done with these things. Make them eligible for garbage collection.
     stages = nil
     MojoSetup.manifest = nil
+    MojoSetup.sources = nil
     MojoSetup.manifestdir = nil
     MojoSetup.metadatadir = nil
     MojoSetup.controldir = nil
@@ -2138,6 +2221,273 @@ end
 
 
 
+-- True if every checksum we have in both tables agrees, false if any of
+--  them don't, and nil if there weren't any in common to compare (the
+--  manifest only recorded algorithms this build can't compute), since that
+--  proves nothing either way.
+local function checksums_match(expected, actual)
+    local compared = false
+    for k,v in pairs(expected) do
+        if actual[k] ~= nil then
+            if actual[k] ~= v then
+                return false
+            end
+            compared = true
+        end
+    end
+    if not compared then
+        return nil
+    end
+    return true
+end
+
+
+-- Check everything in (package.manifest) against what's on disk. Files are
+--  hashed in parallel, with whichever checksums the manifest recorded for
+--  them. Returns an array of { fname=x, problem=y } for anything missing or
+--  changed, or nil if (callback) cancelled.
+local function verify_manifest(package, callback)
+    local bad = {}
+    local items = {}
+
+    for fname,entity in pairs(package.manifest) do
+        local fullpath = MojoSetup.destination .. "/" .. fname
+        local ftype = entity.type
+        local problem = nil
+        if ftype == "symlink" then
+            if not MojoSetup.platform.issymlink(fullpath) then
+                problem = "missing"
+            end
+        elseif (ftype == "dir") or (ftype == "directory") then
+            if not MojoSetup.platform.isdir(fullpath) then
+                problem = "missing"
+            end
+        elseif not MojoSetup.platform.exists(fullpath) then
+            problem = "missing"
+        elseif entity.checksums ~= nil then
+            -- A newer build might have recorded something we've never
+            --  heard of; leave that out, checksums_match() copes.
+            local names = {}
+            for k,v in pairs(entity.checksums) do
+                if MojoSetup.isvalidchecksums(k) then
+                    names[#names+1] = k
+                end
+            end
+            if #names == 0 then
+                if next(entity.checksums) ~= nil then
+                    problem = "unverifiable"
+                end
+            else
+                items[#items+1] = {
+                    fname = fullpath,
+                    checksums = table.concat(names, ","),
+                    relname = fname,
+                    entity = entity
+                }
+            end
+        end
+
+        if problem ~= nil then
+            bad[#bad+1] = { fname = fname, problem = problem }
+        end
+    end
+
+    local done = 0
+    local sumcallback = function(i, ticks, bytes)
+        done = done + 1
+        return callback(items[i].relname, done, #items)
+    end
+
+    local completed, results = MojoSetup.checksumfiles(items, sumcallback)
+    if not completed then
+        return nil
+    end
+
+    for i,item in ipairs(items) do
+        local sums = results[i]
+        local match = nil
+        if sums then
+            match = checksums_match(item.entity.checksums, sums)
+        end
+        if not sums then
+            bad[#bad+1] = { fname = item.relname, problem = "unreadable" }
+        elseif match == nil then
+            bad[#bad+1] = { fname = item.relname, problem = "unverifiable" }
+        elseif not match then
+            bad[#bad+1] = { fname = item.relname, problem = "changed" }
+        end
+    end
+
+    table.sort(bad, function(a, b) return a.fname < b.fname end)
+    return bad
+end
+
+
+-- Put back the files verify_manifest() flagged. Files are pulled out of
+--  (payload), the original installer or its base directory, from wherever
+--  the manifest says they came from. Sets (repaired) on each item we fixed.
+local function repair_files(package, bad, payload, callback)
+    local archive = MojoSetup.archive.fromdir(payload)
+    if archive == nil then
+        archive = MojoSetup.archive.fromfile(payload)
+        if archive == nil then
+            MojoSetup.fatal(_("Couldn't open archive"))
+        end
+    end
+
+    -- Group the files by the archive they came out of, so we only have to
+    --  enumerate each one once.
+    local wanted = {}
+    for i,item in ipairs(bad) do
+        local entity = package.manifest[item.fname]
+        local fullpath = MojoSetup.destination .. "/" .. item.fname
+        if (entity.type == "dir") or (entity.type == "directory") then
+            install_parent_dirs(fullpath, nil)
+            item.repaired = MojoSetup.platform.mkdir(fullpath, nil)
+        elseif entity.type == "symlink" then
+            if entity.linkdest ~= nil then
+                install_parent_dirs(fullpath, nil)
+                item.repaired = MojoSetup.platform.symlink(fullpath, entity.linkdest)
+            end
+        elseif entity.source ~= nil then
+            local byentry = wanted[entity.source.archive]
+            if byentry == nil then
+                byentry = {}
+                wanted[entity.source.archive] = byentry
+            end
+            -- The same entry might have been installed to more than one
+            --  place, so keep every item that wants it.
+            local items = byentry[entity.source.path]
+            if items == nil then
+                items = {}
+                byentry[entity.source.path] = items
+            end
+            items[#items+1] = item
+        end
+    end
+
+    for srcpath,byentry in pairs(wanted) do
+        local arclist = {}
+        local arc = archive
+        if srcpath ~= "" then
+            arc = drill_for_archive(archive, srcpath, arclist)
+        end
+
+        if not MojoSetup.archive.enumerate(arc) then
+            MojoSetup.fatal(_("Couldn't enumerate archive"))
+        end
+
+        for ent in MojoSetup.archive.entries(arc) do
+            local items = byentry[ent.filename]
+            if (items ~= nil) and (ent.type == "file") then
+                -- The entry can only be read once, so the first destination
+                --  comes out of the archive and the rest are copies of it.
+                local src = nil
+                byentry[ent.filename] = nil
+                for i,item in ipairs(items) do
+                    local entity = package.manifest[item.fname]
+                    local dest = MojoSetup.destination .. "/" .. item.fname
+                    local perms = entity.source.perms
+                    local writecallback = function(ticks, justwrote, bw, total)
+                        return callback(item.fname, bw, total)
+                    end
+
+                    local written, sums
+                    install_parent_dirs(dest, nil)
+                    if src == nil then
+                        written, sums = MojoSetup.writefile(arc, dest, perms, nil, writecallback)
+                    else
+                        written, sums = MojoSetup.copyfile(src, dest, perms, nil, writecallback)
+                    end
+
+                    local match = nil
+                    if written and (entity.checksums ~= nil) then
+                        match = checksums_match(entity.checksums, sums)
+                    end
+                    if not written then
+                        MojoSetup.logerror("Failed to rewrite file '" .. dest .. "'")
+                    elseif match == false then
+                        MojoSetup.logerror("File '" .. dest .. "' doesn't match the manifest in this installer")
+                    else
+                        if (match == nil) and (entity.checksums ~= nil) then
+                            MojoSetup.logwarning("Can't verify rewritten file '" .. dest .. "' in this build")
+                        end
+                        MojoSetup.loginfo("Repaired file '" .. dest .. "'")
+                        item.repaired = true
+                        if src == nil then
+                            src = dest
+                        end
+                    end
+                end
+            end
+        end
+
+        close_archive_list(arclist)
+    end
+
+    MojoSetup.archive.close(archive)
+end
+
+
+local function verifier()
+    MojoSetup.loginfo("Verifier starting")
+    local package = load_manifest(MojoSetup.info.argv[3])
+    local payload = MojoSetup.cmdlinestr("repair", nil, nil)
+
+    start_gui(package.description, package.id, package.splash, package.splashpos)
+
+    -- Upvalued in callback so we don't look this up each time...
+    local ptype = _("Verifying")
+    local callback = function(fname, current, total)
+        local item = string.gsub(fname, "^.*/", "", 1)  -- chop off dirs...
+        MojoSetup.gui.progressitem()
+        return MojoSetup.gui.progress(ptype, package.description, calc_percent(current, total), item, true)
+    end
+
+    local bad = verify_manifest(package, callback)
+    if bad == nil then
+        MojoSetup.fatal()  -- user cancelled
+    end
+
+    if (#bad > 0) and (payload ~= nil) then
+        ptype = _("Repairing")
+        repair_files(package, bad, payload, callback)
+    end
+
+    local damaged = {}
+    local unverified = {}
+    for i,item in ipairs(bad) do
+        if item.repaired then
+            -- fixed it, nothing to report.
+        elseif item.problem == "unverifiable" then
+            MojoSetup.logwarning("File '" .. item.fname .. "' can't be verified by this build")
+            unverified[#unverified+1] = item.fname
+        else
+            MojoSetup.logerror("File '" .. item.fname .. "' is " .. item.problem)
+            damaged[#damaged+1] = item.fname
+        end
+    end
+
+    if #damaged > 0 then
+        local errstr = _("These files are missing or damaged:")
+        MojoSetup.fatal(errstr .. "\n\n" .. table.concat(damaged, "\n"))
+    elseif #unverified > 0 then
+        local errstr = _("These files can't be verified:")
+        MojoSetup.fatal(errstr .. "\n\n" .. table.concat(unverified, "\n"))
+    end
+
+    if not MojoSetup.cmdline("noprompt") then
+        if #bad > 0 then
+            MojoSetup.gui.final(_("Repair complete"))
+        else
+            MojoSetup.gui.final(_("Verify complete"))
+        end
+    end
+    stop_gui()
+end
+
+
+
 -- Mainline...
 
 local purpose = nil
@@ -2150,6 +2500,8 @@ if argv2 == "manifest" then
     purpose = manifest_management
 elseif argv2 == "uninstall" then
     purpose = uninstaller
+elseif argv2 == "verify" then
+    purpose = verifier
 else
     purpose = installer
     MojoSetup.runfile("config")  -- This builds the MojoSetup.installs table.
@@ -161,6 +161,13 @@ void *xmalloc(size_t bytes);
 void *xrealloc(void *ptr, size_t bytes);
 char *xstrdup(const char *str);
 
+// xmalloc(), but the buffer starts on an (align)-byte boundary, which must
+//  be a power of two. For structs that want more than malloc() promises,
+//  like anything holding a MojoChecksumContext (XXH3 wants 64 bytes). Free
+//  these with xfreeAligned(), not free().
+void *xmallocAligned(size_t bytes, size_t align);
+void xfreeAligned(void *ptr);
+
 // strncpy() that promises to null-terminate the string, even on overflow.
 char *xstrncpy(char *dst, const char *src, size_t len);
 
@@ -224,6 +231,23 @@ const char *translate(const char *str);
 //   profile("Something I did", start);
 uint32 profile(const char *what, uint32 start_time);
 
+// Tracing, for seeing where an install spends its time. With --trace=FILE
+//  on the command line (or MOJOSETUP_TRACE in the environment), these
+//  record into a per-thread ring buffer, and FILE gets the lot as
+//  chrome://tracing JSON at shutdown. Otherwise they cost one branch.
+// Scopes nest per thread: every MojoTrace_begin() needs an end on the same
+//  thread. Names and categories are copied, and truncated if they're long;
+//  (argnames) must be string literals.
+// These are safe to call from worker jobs.
+extern boolean MojoTrace_enabled;
+void MojoTrace_init(void);
+void MojoTrace_deinit(void);
+void MojoTrace_begin(const char *cat, const char *name);
+void MojoTrace_end(const char *cat);
+void MojoTrace_endWithArgs(const char *cat, uint32 argcount,
+                           const char **argnames, const int64 *args);
+void MojoTrace_counter(const char *name, int64 value);
+
 // This tries to decode a graphic file in memory into an RGBA framebuffer,
 //  first with platform-specific facilities, if any, and then any built-in
 //  decoders, if that fails.
@@ -275,6 +299,21 @@ const char *cmdlinestr(const char *arg, const char *envr, const char *deflt);
 //  is seen. Case matters!
 boolean wildcardMatch(const char *str, const char *pattern);
 
+// A set of wildcardMatch() patterns, each tagged with a number, that finds
+//  every tag with a pattern matching a string in one pass. Patterns are
+//  sorted into a trie by their literal prefix, so only the ones that could
+//  match get the full wildcardMatch() treatment. Tags are small numbers
+//  (they index an array); several patterns can share one.
+// MojoWildcardSet_match() puts the tags that matched (str) into (tags), in
+//  ascending order, with no duplicates, and returns how many there were,
+//  even if that's more than (maxtags). Not thread safe.
+typedef struct MojoWildcardSet MojoWildcardSet;
+MojoWildcardSet *MojoWildcardSet_create(void);
+void MojoWildcardSet_add(MojoWildcardSet *set, const char *pattern, uint32 tag);
+uint32 MojoWildcardSet_match(MojoWildcardSet *set, const char *str,
+                             uint32 *tags, uint32 maxtags);
+void MojoWildcardSet_destroy(MojoWildcardSet *set);
+
 // Logging functions.
 typedef enum
 {
@@ -330,26 +369,122 @@ void MojoSha1_init(MojoSha1 *context);
 void MojoSha1_append(MojoSha1 *context, const uint8 *data, uint32 len);
 void MojoSha1_finish(MojoSha1 *context, uint8 digest[20]);
 
+
+#if SUPPORT_XXH128
+#define XXH_STATIC_LINKING_ONLY 1  // so we can put XXH3_state_t on the stack.
+#define XXH_NAMESPACE MojoSetup_
+#include "xxhash.h"
+typedef XXH3_state_t MojoXxh128;
+#else
+typedef struct MojoXxh128 { int unused; } MojoXxh128;
+#endif
+
+void MojoXxh128_init(MojoXxh128 *context);
+void MojoXxh128_append(MojoXxh128 *context, const uint8 *data, uint32 len);
+void MojoXxh128_finish(MojoXxh128 *context, uint8 digest[16]);
+
+
+#if SUPPORT_BLAKE3
+typedef struct MojoBlake3
+{
+    uint32 cv[8];  // chaining value of the chunk we're working on.
+    uint64 chunk;  // which chunk that is.
+    uint8 block[64];
+    uint32 blocklen;
+    uint32 blocks;  // blocks of this chunk already compressed.
+    uint32 stacklen;
+    uint32 stack[54][8];  // finished subtrees; enough for 2^64 bytes.
+} MojoBlake3;
+#else
+typedef struct MojoBlake3 { int unused; } MojoBlake3;
+#endif
+
+void MojoBlake3_init(MojoBlake3 *context);
+void MojoBlake3_append(MojoBlake3 *context, const uint8 *data, uint32 len);
+void MojoBlake3_finish(MojoBlake3 *context, uint8 digest[32]);
+
+// Which digests to compute. Bits for algorithms that weren't compiled in
+//  are ignored.
+typedef enum
+{
+    MOJOCHECKSUM_NONE = 0,
+    MOJOCHECKSUM_CRC32 = (1 << 0),
+    MOJOCHECKSUM_MD5 = (1 << 1),
+    MOJOCHECKSUM_SHA1 = (1 << 2),
+    MOJOCHECKSUM_XXH128 = (1 << 3),
+    MOJOCHECKSUM_BLAKE3 = (1 << 4),
+    MOJOCHECKSUM_ALL = (MOJOCHECKSUM_CRC32|MOJOCHECKSUM_MD5|MOJOCHECKSUM_SHA1|
+                        MOJOCHECKSUM_XXH128|MOJOCHECKSUM_BLAKE3)
+} MojoChecksumFlags;
+
 typedef struct MojoChecksumContext
 {
+    uint32 flags;
+    uint32 stored;  // digests we were handed instead of computing.
+    uint32 storedcrc32;
     MojoCrc32 crc32;
     MojoMd5 md5;
     MojoSha1 sha1;
+    MojoXxh128 xxh128;
+    MojoBlake3 blake3;
 } MojoChecksumContext;
 
+// Alignment for a MojoChecksumContext, or anything holding one, on the heap:
+//  allocate those with xmallocAligned(). The stack and statics get this
+//  from the compiler.
+#define MOJOCHECKSUM_ALIGN 64
+
 
 typedef struct MojoChecksums
 {
+    uint32 flags;  // which of these were actually computed.
     uint32 crc32;
     uint8 md5[16];
     uint8 sha1[20];
+    uint8 xxh128[16];
+    uint8 blake3[32];
 } MojoChecksums;
 
 
-void MojoChecksum_init(MojoChecksumContext *ctx);
+void MojoChecksum_init(MojoChecksumContext *ctx, uint32 flags);
 void MojoChecksum_append(MojoChecksumContext *c, const uint8 *data, uint32 ln);
 void MojoChecksum_finish(MojoChecksumContext *c, MojoChecksums *sums);
 
+// If (ctx) would compute a CRC-32, don't, and report (crc) instead. This is
+//  for data that carries its own CRC and gets checked against it as it's
+//  read, like a zip entry. Call this before appending anything.
+void MojoChecksum_useCrc32(MojoChecksumContext *ctx, uint32 crc);
+
+// The digests we compute for files we install, for the manifest. Starts out
+//  as MOJOCHECKSUM_ALL; the Lua side sets it per install, from the config
+//  and the command line.
+uint32 MojoChecksum_policy(void);
+void MojoChecksum_setPolicy(uint32 flags);
+
+// Parse a policy string: "all", "none", "fast" (whatever's cheapest), or a
+//  list of algorithm names ("crc32", "md5", "sha1", "xxh128", "blake3")
+//  separated by commas or spaces. Returns false if (str) isn't valid, and
+//  leaves (*flags) alone.
+boolean MojoChecksum_parsePolicy(const char *str, uint32 *flags);
+
+
+// Worker threads, for spreading CPU-heavy work (decompression, hashing)
+//  across cores. There's one pool for the whole process, started the first
+//  time you submit a job, with one thread per CPU core (override with
+//  --threads=N or MOJOSETUP_THREADS; 1 means "don't use threads").
+// Jobs run in any order, on any thread. MojoWorker_wait() blocks until (job)
+//  is finished and frees it, so wait on each job in whatever order you need
+//  the results in. Every job must be waited on. While waiting, the calling
+//  thread runs queued jobs itself, so a job may safely submit and wait on
+//  other jobs. If the pool has no threads, submit runs (fn) immediately.
+// Job functions must not touch Lua, the GUI, logging, or scratchbuf_128k.
+typedef struct MojoJob MojoJob;
+typedef void (*MojoJobFunc)(void *data);
+uint32 MojoWorker_count(void);
+MojoJob *MojoWorker_submit(MojoJobFunc fn, void *data);
+void MojoWorker_wait(MojoJob *job);
+void MojoWorker_shutdown(void);
+
 
 // A pointer to this struct is passed to plugins, so they can access
 //  functionality in the base application. (Add to this as you need to.)